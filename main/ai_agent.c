@@ -1,4 +1,5 @@
 #include <string.h>
+#include <strings.h>
 #include <sys/param.h>
 #include <stdlib.h>
 #include <ctype.h>
@@ -7,117 +8,489 @@
 #include "esp_system.h"
 #include "esp_http_client.h"
 #include "esp_crt_bundle.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "lwip/netdb.h"
 #include "mbedtls/base64.h"
-#include "cJSON.h"
+#include "nvs.h"
+#include "ai_agent.h"
+#include "app_state.h"
+#include "capture_policy.h"
 #include "common.h"
+#include "conv_latency.h"
+#include "json_stream.h"
+#include "json_writer.h"
+#include "load_gov.h"
+#include "metrics.h"
+#include "power_gov.h"
+#include "retry_policy.h"
+#include "rtc_proc.h"
+#include "task_plan.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 
-#define MAX_HTTP_OUTPUT_BUFFER 2048  // Reduced from 4096 to save memory
 #define BASE64_AUTH_LEN        256
-#define AGORA_API_URL          "https://api.agora.io/api/conversational-ai-agent/v2/projects"
+#define AGORA_API_HOST         "api.agora.io"
+#define AGORA_API_URL          "https://" AGORA_API_HOST "/api/conversational-ai-agent/v2/projects"
+#define HTTP_TIMEOUT_MS        10000
+#define AGENT_NAME_LEN         64
+
+/* the agent_id of a joined agent is kept here so that it can still be
+ * stopped after a crash or reboot */
+#define AGENT_NVS_NAMESPACE    "ai_agent"
+#define AGENT_NVS_KEY_ID       "agent_id"
+
+#ifndef CONFIG_AGENT_STANDBY_IDLE_S
+#define CONFIG_AGENT_STANDBY_IDLE_S  600
+#endif
+
+/* a kept-alive connection idle this long is closed before the next request:
+ * the server may have dropped it already, and esp_http_client only finds
+ * out when that request fails, which for a join is after it was sent */
+#ifndef CONFIG_AGENT_HTTP_IDLE_CLOSE_MS
+#define CONFIG_AGENT_HTTP_IDLE_CLOSE_MS  30000
+#endif
+
 
-static char http_response_buffer[MAX_HTTP_OUTPUT_BUFFER] = {0};
-static int http_response_len = 0;
+/* _api_call() result when the endpoint's circuit breaker refuses the call */
+#define API_BREAKER_OPEN       (-2)
+
+/* result of one start attempt */
+#define AGENT_START_OK         0
+#define AGENT_START_FAILED     (-1)
+/* > 0: retry after that many ms */
+
+static char *g_join_body = NULL;  // sized by a measuring render, kept for good
+static int g_join_body_len = 0;
+
+/* CONVO_AGENT_NAME plus the tail of the station MAC, so the agents list
+ * can tell this device's agent apart from others in the project */
+static char g_agent_name[AGENT_NAME_LEN] = {0};
+/* agent_id recorded in NVS, empty when no agent is known to be running */
+static char g_recorded_agent_id[AGENT_ID_LEN] = {0};
+
+/* Fields picked out of an API reply while it streams in.
+ * Replies are never buffered, so their size does not matter. */
+typedef struct {
+    json_stream_t parser;
+    int  body_len;
+    bool parse_error;
+
+    bool has_code;
+    int  code;
+    char agent_id[AGENT_ID_LEN];
+    char reason[48];
+    char message[96];
+    char detail[128];
+
+    int  list_count;                   // entries in data.list
+    char list_agent_id[AGENT_ID_LEN];  // agent_id of the entry named g_agent_name
+
+    bool entry_is_ours;                // data.list entry being parsed
+    char entry_agent_id[AGENT_ID_LEN];
+} agent_reply_t;
+
+static agent_reply_t g_reply;
+
+/* Per-request timings, all relative to the start of the request.
+ * esp_http_client reports TCP connect and TLS handshake as one step. */
+typedef struct {
+    int64_t start_us;
+    int64_t connected_us;    // 0 when the kept-alive connection was reused
+    int64_t header_sent_us;
+    int64_t first_byte_us;
+    int64_t finish_us;
+} http_timing_t;
+
+/* One client for all calls to api.agora.io: the connection is kept alive
+ * between requests and the TLS session ticket is kept for reconnects. */
+static esp_http_client_handle_t g_http_client = NULL;
+static SemaphoreHandle_t g_http_lock = NULL;
+static StaticSemaphore_t g_http_lock_buf;
+static char g_auth_value[BASE64_AUTH_LEN + 10] = {0};
+static http_timing_t g_http_timing = {0};
+static int64_t g_http_idle_since_us = 0;  // end of the last request, 0 when the connection was dropped
+
+static METRIC_HIST(g_http_latency, "http.ms", 100, 200, 400, 800, 1600, 3200, 6400);
+static METRIC_COUNTER(g_http_errors, "http.errors");
+
+static TaskHandle_t g_ctrl_task = NULL;
+static uint32_t g_cmd_generation = 0;
+static uint32_t g_running_generation = 0;  // generation of the command on the worker
+
+/* Transient failures (transport, 429, 5xx) are retried with capped
+ * exponential backoff and full jitter so that a fleet does not retry in
+ * lockstep; each endpoint has its own circuit breaker. */
+static const retry_policy_cfg_t g_api_retry_cfg = {
+    .base_ms           = 500,
+    .cap_ms            = 8000,
+    .max_attempts      = 3,
+    .breaker_threshold = 5,
+    .breaker_open_ms   = 30000,
+    .idempotent        = true,
+};
+
+/* a repeated join can start a second agent, so once the request may have
+ * reached the server it is not repeated here; the next start runs into the
+ * 409 conflict path instead, which finds the agent and stops it */
+static const retry_policy_cfg_t g_join_retry_cfg = {
+    .base_ms           = 500,
+    .cap_ms            = 8000,
+    .max_attempts      = 3,
+    .breaker_threshold = 5,
+    .breaker_open_ms   = 30000,
+    .idempotent        = false,
+};
+
+/* 409 conflicts wait for the stopped agent, the backoff is added on top */
+static const retry_policy_cfg_t g_conflict_retry_cfg = {
+    .base_ms           = 500,
+    .cap_ms            = 4000,
+    .max_attempts      = 3,
+    .breaker_threshold = 0,
+    .breaker_open_ms   = 0,
+};
+
+static retry_endpoint_t g_ep_join;
+static retry_endpoint_t g_ep_agents;
+static retry_endpoint_t g_ep_leave;
+static int32_t g_retry_after_ms = -1;
 
 /* Forward declarations */
 static esp_err_t _http_event_handler(esp_http_client_event_t *evt);
+static bool _agent_wait(uint32_t generation, int delay_ms);
 static int _stop_agent_by_id(const char *agent_id);
-void ai_agent_start(void);
 
-/* Retry task to avoid stack overflow from recursive calls */
-static void _agent_start_retry_task(void *pvParameters)
+/* Generate Base64 encoded credentials for Basic Auth */
+static void _generate_basic_auth(char *output, size_t output_len)
 {
-    int delay_ms = (int)pvParameters;
+    char credentials[128];
+    snprintf(credentials, sizeof(credentials), "%s:%s", AGORA_API_KEY, AGORA_API_SECRET);
 
-    if (delay_ms > 0) {
-        printf("Waiting %d ms before retry...\n", delay_ms);
-        vTaskDelay(pdMS_TO_TICKS(delay_ms));
+    size_t olen = 0;
+    mbedtls_base64_encode((unsigned char *)output, output_len, &olen,
+                          (const unsigned char *)credentials, strlen(credentials));
+}
+
+static int _ms_since_start(int64_t t)
+{
+    return t ? (int)((t - g_http_timing.start_us) / 1000) : -1;
+}
+
+static void _copy_field(char *dst, size_t dst_len, const char *value)
+{
+    snprintf(dst, dst_len, "%s", value);
+}
+
+static void _reply_on_value(void *ctx, const char *path, json_stream_event_t event, const char *value)
+{
+    agent_reply_t *reply = (agent_reply_t *)ctx;
+
+    if (event == JSON_STREAM_OBJECT_END) {
+        if (strcmp(path, "data.list[]") == 0) {
+            // name and agent_id may come in either order, match once the entry is complete
+            if (reply->entry_is_ours && reply->list_agent_id[0] == '\0') {
+                _copy_field(reply->list_agent_id, sizeof(reply->list_agent_id), reply->entry_agent_id);
+            }
+            reply->entry_is_ours     = false;
+            reply->entry_agent_id[0] = '\0';
+            reply->list_count++;
+        }
+        return;
     }
 
-    printf("========================================\n");
-    printf("Retrying agent start...\n");
-    printf("========================================\n");
+    if (event == JSON_STREAM_NUMBER) {
+        if (strcmp(path, "code") == 0) {
+            reply->has_code = true;
+            reply->code     = atoi(value);
+        }
+        return;
+    }
 
-    ai_agent_start();
+    if (event != JSON_STREAM_STRING) {
+        return;
+    }
 
-    // Task done, delete itself
-    vTaskDelete(NULL);
+    if (strcmp(path, "agent_id") == 0) {
+        _copy_field(reply->agent_id, sizeof(reply->agent_id), value);
+    } else if (strcmp(path, "reason") == 0) {
+        _copy_field(reply->reason, sizeof(reply->reason), value);
+    } else if (strcmp(path, "message") == 0) {
+        _copy_field(reply->message, sizeof(reply->message), value);
+    } else if (strcmp(path, "detail") == 0) {
+        _copy_field(reply->detail, sizeof(reply->detail), value);
+    } else if (strcmp(path, "data.list[].agent_id") == 0) {
+        _copy_field(reply->entry_agent_id, sizeof(reply->entry_agent_id), value);
+    } else if (strcmp(path, "data.list[].name") == 0) {
+        reply->entry_is_ours = (strcmp(value, g_agent_name) == 0);
+    }
 }
 
-/* Generate Base64 encoded credentials for Basic Auth */
-static void _generate_basic_auth(char *output, size_t output_len)
+static void _reply_reset(void)
 {
-    char credentials[128];
-    snprintf(credentials, sizeof(credentials), "%s:%s", AGORA_API_KEY, AGORA_API_SECRET);
+    memset(&g_reply, 0, sizeof(g_reply));
+    json_stream_init(&g_reply.parser, _reply_on_value, &g_reply);
+}
 
-    size_t olen = 0;
-    mbedtls_base64_encode((unsigned char *)output, output_len, &olen,
-                          (const unsigned char *)credentials, strlen(credentials));
+/* Record the running agent in NVS, an empty id clears the record */
+static void _agent_record_save(const char *agent_id)
+{
+    if (strcmp(g_recorded_agent_id, agent_id) == 0) {
+        return;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(AGENT_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        printf("✗ Failed to open NVS for agent record: %s\n", esp_err_to_name(err));
+        return;
+    }
+
+    if (agent_id[0] != '\0') {
+        err = nvs_set_str(nvs, AGENT_NVS_KEY_ID, agent_id);
+    } else {
+        err = nvs_erase_key(nvs, AGENT_NVS_KEY_ID);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (err != ESP_OK) {
+        printf("✗ Failed to update agent record: %s\n", esp_err_to_name(err));
+        return;
+    }
+    snprintf(g_recorded_agent_id, sizeof(g_recorded_agent_id), "%s", agent_id);
+}
+
+static void _agent_record_load(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(AGENT_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;  // namespace does not exist until the first join
+    }
+
+    size_t len = sizeof(g_recorded_agent_id);
+    if (nvs_get_str(nvs, AGENT_NVS_KEY_ID, g_recorded_agent_id, &len) != ESP_OK) {
+        g_recorded_agent_id[0] = '\0';
+    }
+    nvs_close(nvs);
+
+    if (g_recorded_agent_id[0] != '\0') {
+        printf("Recorded agent from last run: %s\n", g_recorded_agent_id);
+    }
+}
+
+/* Lazily create the shared client, the auth header is encoded only once */
+static esp_http_client_handle_t _http_client_get(const char *url)
+{
+    if (g_http_client) {
+        esp_http_client_set_url(g_http_client, url);
+        return g_http_client;
+    }
+
+    if (g_auth_value[0] == '\0') {
+        char auth_header[BASE64_AUTH_LEN];
+        _generate_basic_auth(auth_header, sizeof(auth_header));
+        snprintf(g_auth_value, sizeof(g_auth_value), "Basic %s", auth_header);
+    }
+
+    esp_http_client_config_t config = {
+        .url = url,
+        .event_handler = _http_event_handler,
+        .timeout_ms = HTTP_TIMEOUT_MS,
+        .crt_bundle_attach = esp_crt_bundle_attach,  // Use certificate bundle for HTTPS
+        .skip_cert_common_name_check = false,
+        .keep_alive_enable = true,
+        .save_client_session = true,  // resume TLS with the session ticket on reconnect
+    };
+
+    g_http_client = esp_http_client_init(&config);
+    if (g_http_client == NULL) {
+        printf("Failed to init HTTP client\n");
+        return NULL;
+    }
+
+    esp_http_client_set_header(g_http_client, "Content-Type", "application/json");
+    esp_http_client_set_header(g_http_client, "Authorization", g_auth_value);
+
+    return g_http_client;
+}
+
+/* Perform one request on the shared client.
+ * Returns the HTTP status code, or -1 on transport error. */
+static int _http_request(esp_http_client_method_t method, const char *url, const char *body)
+{
+    xSemaphoreTake(g_http_lock, portMAX_DELAY);
+
+    int status_code = -1;
+    esp_http_client_handle_t client = _http_client_get(url);
+    if (client == NULL) {
+        xSemaphoreGive(g_http_lock);
+        return -1;
+    }
+
+    // a reused connection gets no HTTP_EVENT_ON_CONNECTED, reset the reply here
+    _reply_reset();
+    g_retry_after_ms = -1;
+    memset(&g_http_timing, 0, sizeof(g_http_timing));
+    g_http_timing.start_us = esp_timer_get_time();
+
+    int idle_ms = g_http_idle_since_us ? (int)((g_http_timing.start_us - g_http_idle_since_us) / 1000) : 0;
+    if (idle_ms > CONFIG_AGENT_HTTP_IDLE_CLOSE_MS) {
+        // a fresh connection resumes the TLS session, far cheaper than a failed join
+        printf("HTTP connection idle for %d ms, reconnecting\n", idle_ms);
+        esp_http_client_close(client);
+    }
+
+    esp_http_client_set_method(client, method);
+    esp_http_client_set_post_field(client, body, body ? strlen(body) : 0);
+
+    esp_err_t err = esp_http_client_perform(client);
+    g_http_timing.finish_us = esp_timer_get_time();
+
+    metric_observe(&g_http_latency, (uint32_t)_ms_since_start(g_http_timing.finish_us));
+    if (err == ESP_OK) {
+        status_code = esp_http_client_get_status_code(client);
+        if (status_code >= 400) {
+            metric_inc(&g_http_errors);
+        }
+        printf("HTTP Status = %d, content_length = %lld\n",
+               status_code, (long long)esp_http_client_get_content_length(client));
+        g_http_idle_since_us = g_http_timing.finish_us;
+    } else {
+        metric_inc(&g_http_errors);
+        printf("HTTP request failed: %s\n", esp_err_to_name(err));
+        // drop the broken connection, the TLS session is kept for the next attempt
+        esp_http_client_close(client);
+        g_http_idle_since_us = 0;
+    }
+
+    printf("HTTP timing: %s, connect+tls %d ms, header sent %d ms, ttfb %d ms, total %d ms\n",
+           g_http_timing.connected_us ? "new connection" : "reused connection",
+           _ms_since_start(g_http_timing.connected_us),
+           _ms_since_start(g_http_timing.header_sent_us),
+           _ms_since_start(g_http_timing.first_byte_us),
+           _ms_since_start(g_http_timing.finish_us));
+
+    xSemaphoreGive(g_http_lock);
+    return status_code;
+}
+
+static int64_t _now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+static void _log_endpoint(const retry_endpoint_t *ep)
+{
+    printf("API [%s]: breaker %s, attempts %lu, ok %lu, failed %lu, retries %lu, rejected %lu, trips %lu, "
+           "latency last %lu ms / avg %lu ms / max %lu ms\n",
+           ep->name, retry_breaker_state_name(ep->state),
+           (unsigned long)ep->attempts, (unsigned long)ep->successes, (unsigned long)ep->failures,
+           (unsigned long)ep->retries, (unsigned long)ep->rejected, (unsigned long)ep->breaker_trips,
+           (unsigned long)ep->last_latency_ms,
+           (unsigned long)(ep->attempts ? ep->total_latency_ms / ep->attempts : 0),
+           (unsigned long)ep->max_latency_ms);
+}
+
+/* _http_request() under the endpoint's retry policy and circuit breaker.
+ * Returns the final HTTP status, -1 on transport error or API_BREAKER_OPEN. */
+static int _api_call(retry_endpoint_t *ep, esp_http_client_method_t method, const char *url, const char *body)
+{
+    int status_code = -1;
+    uint32_t generation = g_running_generation;
+
+    for (int attempt = 0; attempt < ep->cfg.max_attempts; attempt++) {
+        if (!retry_endpoint_allow(ep, _now_ms())) {
+            printf("API [%s]: circuit breaker open, request refused\n", ep->name);
+            status_code = API_BREAKER_OPEN;
+            break;
+        }
+
+        int64_t start_ms = _now_ms();
+        status_code = _http_request(method, url, body);
+        bool transient = retry_status_is_transient(status_code);
+        retry_endpoint_record(ep, !transient, (uint32_t)(_now_ms() - start_ms), _now_ms());
+
+        bool sent = g_http_timing.header_sent_us != 0;
+        if (!retry_should_retry(&ep->cfg, status_code, sent)) {
+            if (transient) {
+                printf("API [%s]: status %d after the request was sent, not repeating it\n", ep->name, status_code);
+            }
+            break;
+        }
+        if (attempt + 1 >= ep->cfg.max_attempts) {
+            break;
+        }
+
+        int32_t delay_ms = retry_delay_ms(&ep->cfg, attempt, g_retry_after_ms, esp_random());
+        if (delay_ms < 0) {
+            // the control task would be blocked that long, let the caller decide
+            printf("API [%s]: status %d, Retry-After %ld ms is past the %lu ms cap, giving up\n", ep->name,
+                   status_code, (long)g_retry_after_ms, (unsigned long)ep->cfg.cap_ms);
+            break;
+        }
+
+        ep->retries++;
+        printf("API [%s]: status %d, retry %d in %ld ms\n", ep->name, status_code, attempt + 1, (long)delay_ms);
+        if (!_agent_wait(generation, (int)delay_ms)) {
+            printf("API [%s]: superseded, giving up\n", ep->name);
+            break;
+        }
+    }
+
+    _log_endpoint(ep);
+    return status_code;
 }
 
-/* Parse response from /join endpoint to extract agent_id */
+/* Check the /join reply for the agent_id */
 /* Returns: 0 = success, -1 = error, -2 = task conflict */
-static int _parse_join_response(const char *resp_data, int data_len)
+static int _parse_join_response(const agent_reply_t *reply)
 {
-    if (data_len == 0) {
+    if (reply->body_len == 0) {
         printf("Empty response data\n");
         return -1;
     }
 
-    cJSON *root = cJSON_Parse(resp_data);
-    if (root == NULL) {
-        const char *error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr != NULL) {
-            printf("JSON parse error: %s\n", error_ptr);
-        }
+    if (reply->parse_error) {
+        printf("JSON parse error in reply\n");
         return -1;
     }
 
     // Check for agent_id in response
-    cJSON *agent_id = cJSON_GetObjectItemCaseSensitive(root, "agent_id");
-    if (cJSON_IsString(agent_id) && (agent_id->valuestring != NULL)) {
-        printf("✓ Agent ID: %s\n", agent_id->valuestring);
-        snprintf(g_app.agent_id, AGENT_ID_LEN, "%s", agent_id->valuestring);
-        g_app.b_ai_agent_joined = true;
-        printf("✓ Flag updated: b_ai_agent_joined=true, agent_id='%s'\n", g_app.agent_id);
-        cJSON_Delete(root);
+    if (reply->agent_id[0] != '\0') {
+        printf("✓ Agent ID: %s\n", reply->agent_id);
+        snprintf(g_app.agent_id, AGENT_ID_LEN, "%s", reply->agent_id);
+        app_state_set(APP_STATE_AGENT_JOINED);
+        printf("✓ State updated: agent joined, agent_id='%s'\n", g_app.agent_id);
+        _agent_record_save(g_app.agent_id);
         return 0;
     }
 
     // If no agent_id, check for error
-    cJSON *code = cJSON_GetObjectItemCaseSensitive(root, "code");
-    cJSON *message = cJSON_GetObjectItemCaseSensitive(root, "message");
-    cJSON *reason = cJSON_GetObjectItemCaseSensitive(root, "reason");
-    cJSON *detail = cJSON_GetObjectItemCaseSensitive(root, "detail");
-
-    if (cJSON_IsNumber(code)) {
-        printf("Error code: %d\n", code->valueint);
+    if (reply->has_code) {
+        printf("Error code: %d\n", reply->code);
     }
-    if (cJSON_IsString(message) && (message->valuestring != NULL)) {
-        printf("Error message: %s\n", message->valuestring);
+    if (reply->message[0] != '\0') {
+        printf("Error message: %s\n", reply->message);
     }
-    if (cJSON_IsString(reason) && (reason->valuestring != NULL)) {
-        printf("Error reason: %s\n", reason->valuestring);
+    if (reply->reason[0] != '\0') {
+        printf("Error reason: %s\n", reply->reason);
     }
-    if (cJSON_IsString(detail) && (detail->valuestring != NULL)) {
-        printf("Error detail: %s\n", detail->valuestring);
+    if (reply->detail[0] != '\0') {
+        printf("Error detail: %s\n", reply->detail);
     }
 
     // Check for TaskConflict
-    bool is_conflict = false;
-    if (cJSON_IsString(reason) && (reason->valuestring != NULL)) {
-        if (strcmp(reason->valuestring, "TaskConflict") == 0) {
-            is_conflict = true;
-        }
-    }
-    if (!is_conflict && cJSON_IsString(detail) && (detail->valuestring != NULL)) {
-        if (strstr(detail->valuestring, "conflict task") != NULL) {
-            is_conflict = true;
-        }
-    }
+    bool is_conflict = (strcmp(reply->reason, "TaskConflict") == 0) ||
+                       (strstr(reply->detail, "conflict task") != NULL);
 
-    cJSON_Delete(root);
     return is_conflict ? -2 : -1;
 }
 
@@ -131,13 +504,6 @@ static int _get_running_agent_id(char *agent_id_out, size_t agent_id_len)
 
     printf("Querying running agents...\n");
 
-    // Generate authorization header
-    char auth_header[BASE64_AUTH_LEN];
-    _generate_basic_auth(auth_header, sizeof(auth_header));
-
-    char auth_value[BASE64_AUTH_LEN + 10];
-    snprintf(auth_value, sizeof(auth_value), "Basic %s", auth_header);
-
     // Build URL - state=2 means running agents
     char url[256];
     snprintf(url, sizeof(url), "%s/%s/agents?state=2&limit=20",
@@ -145,125 +511,67 @@ static int _get_running_agent_id(char *agent_id_out, size_t agent_id_len)
 
     printf("Request URL: %s\n", url);
 
-    // Initialize HTTP client
-    esp_http_client_config_t config = {
-        .url = url,
-        .event_handler = _http_event_handler,
-        .timeout_ms = 10000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-        .skip_cert_common_name_check = false,
-    };
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-    esp_http_client_set_header(client, "Authorization", auth_value);
-
-    // Perform request
-    esp_err_t err = esp_http_client_perform(client);
-    if (err != ESP_OK) {
-        printf("HTTP GET request failed: %s\n", esp_err_to_name(err));
-        esp_http_client_cleanup(client);
+    int status_code = _api_call(&g_ep_agents, HTTP_METHOD_GET, url, NULL);
+    if (status_code < 0) {
         return -1;
     }
 
-    int status_code = esp_http_client_get_status_code(client);
-    printf("HTTP Status = %d\n", status_code);
-
     if (status_code != 200) {
         printf("Failed to get running agents, status: %d\n", status_code);
-        esp_http_client_cleanup(client);
         return -1;
     }
 
-    // Parse response
-    cJSON *root = cJSON_Parse(http_response_buffer);
-    if (root == NULL) {
+    if (g_reply.parse_error) {
         printf("Failed to parse agents list JSON\n");
-        esp_http_client_cleanup(client);
-        return -1;
-    }
-
-    // Get data object first
-    cJSON *data = cJSON_GetObjectItemCaseSensitive(root, "data");
-    if (!cJSON_IsObject(data)) {
-        printf("No data object in response\n");
-        cJSON_Delete(root);
-        esp_http_client_cleanup(client);
-        return -1;
-    }
-
-    // Get list array from data object
-    cJSON *agents = cJSON_GetObjectItemCaseSensitive(data, "list");
-    if (!cJSON_IsArray(agents)) {
-        printf("No list array in data object\n");
-        cJSON_Delete(root);
-        esp_http_client_cleanup(client);
         return -1;
     }
 
-    int array_size = cJSON_GetArraySize(agents);
-    printf("Found %d running agent(s)\n", array_size);
+    printf("Found %d running agent(s)\n", g_reply.list_count);
 
-    if (array_size == 0) {
+    if (g_reply.list_count == 0) {
         printf("No running agents found\n");
-        cJSON_Delete(root);
-        esp_http_client_cleanup(client);
         return -1;
     }
 
-    // Get first agent's ID
-    cJSON *first_agent = cJSON_GetArrayItem(agents, 0);
-    cJSON *agent_id_json = cJSON_GetObjectItemCaseSensitive(first_agent, "agent_id");
-
-    if (cJSON_IsString(agent_id_json) && (agent_id_json->valuestring != NULL)) {
-        snprintf(agent_id_out, agent_id_len, "%s", agent_id_json->valuestring);
+    // Only ever stop our own agent, the others belong to other devices
+    if (g_reply.list_agent_id[0] != '\0') {
+        snprintf(agent_id_out, agent_id_len, "%s", g_reply.list_agent_id);
         printf("✓ Found running agent ID: %s\n", agent_id_out);
-        cJSON_Delete(root);
-        esp_http_client_cleanup(client);
         return 0;
     }
 
-    printf("Failed to extract agent_id from response\n");
-    cJSON_Delete(root);
-    esp_http_client_cleanup(client);
+    printf("No running agent named '%s'\n", g_agent_name);
     return -1;
 }
 
-/* Parse response from /leave endpoint */
-static int _parse_leave_response(const char *resp_data, int data_len)
+/* Check the /leave reply */
+static int _parse_leave_response(const agent_reply_t *reply)
 {
-    if (data_len == 0) {
+    if (reply->body_len == 0) {
         printf("Empty response data\n");
         return -1;
     }
 
-    cJSON *root = cJSON_Parse(resp_data);
-    if (root == NULL) {
-        const char *error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr != NULL) {
-            printf("JSON parse error: %s\n", error_ptr);
-        }
+    if (reply->parse_error) {
+        printf("JSON parse error in reply\n");
         return -1;
     }
 
     // Check for success
-    cJSON *code = cJSON_GetObjectItemCaseSensitive(root, "code");
-    if (cJSON_IsNumber(code) && code->valueint == 0) {
+    if (reply->has_code && reply->code == 0) {
         printf("✓ Agent left successfully\n");
-        g_app.b_ai_agent_joined = false;
+        app_state_clear(APP_STATE_AGENT_JOINED);
         memset(g_app.agent_id, 0, AGENT_ID_LEN);
-        printf("✓ Flag updated: b_ai_agent_joined=false, agent_id cleared\n");
-        cJSON_Delete(root);
+        printf("✓ State updated: agent left, agent_id cleared\n");
+        _agent_record_save("");
         return 0;
     }
 
     // Check for error
-    cJSON *message = cJSON_GetObjectItemCaseSensitive(root, "message");
-    if (cJSON_IsString(message) && (message->valuestring != NULL)) {
-        printf("Error message: %s\n", message->valuestring);
+    if (reply->message[0] != '\0') {
+        printf("Error message: %s\n", reply->message);
     }
 
-    cJSON_Delete(root);
     return -1;
 }
 
@@ -276,29 +584,37 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
             break;
         case HTTP_EVENT_ON_CONNECTED:
             printf("HTTP_EVENT_ON_CONNECTED\n");
-            http_response_len = 0;
-            memset(http_response_buffer, 0, MAX_HTTP_OUTPUT_BUFFER);
+            g_http_timing.connected_us = esp_timer_get_time();
             break;
         case HTTP_EVENT_HEADER_SENT:
             printf("HTTP_EVENT_HEADER_SENT\n");
+            g_http_timing.header_sent_us = esp_timer_get_time();
             break;
         case HTTP_EVENT_ON_HEADER:
-            printf("HTTP_EVENT_ON_HEADER, key=%s, value=%s\n", evt->header_key, evt->header_value);
+            if (g_http_timing.first_byte_us == 0) {
+                g_http_timing.first_byte_us = esp_timer_get_time();
+            }
+            if (strcasecmp(evt->header_key, "Retry-After") == 0) {
+                g_retry_after_ms = retry_parse_retry_after(evt->header_value);
+            }
             break;
         case HTTP_EVENT_ON_DATA:
+            // chunked bodies arrive here already de-chunked, feed both kinds alike
             printf("HTTP_EVENT_ON_DATA, len=%d\n", evt->data_len);
-            if (!esp_http_client_is_chunked_response(evt->client)) {
-                int copy_len = MIN(evt->data_len, (MAX_HTTP_OUTPUT_BUFFER - http_response_len - 1));
-                if (copy_len > 0) {
-                    memcpy(http_response_buffer + http_response_len, evt->data, copy_len);
-                    http_response_len += copy_len;
-                    http_response_buffer[http_response_len] = '\0';
-                }
+            g_reply.body_len += evt->data_len;
+            if (json_stream_feed(&g_reply.parser, evt->data, evt->data_len) != 0) {
+                g_reply.parse_error = true;
             }
             break;
         case HTTP_EVENT_ON_FINISH:
             printf("HTTP_EVENT_ON_FINISH\n");
-            printf("Response: %s\n", http_response_buffer);
+            if (g_reply.body_len > 0 && json_stream_finish(&g_reply.parser) != 0) {
+                g_reply.parse_error = true;
+            }
+            printf("Response: %d bytes%s, code=%d, agent_id='%s', reason='%s', list=%d\n",
+                   g_reply.body_len, g_reply.parse_error ? " (invalid JSON)" : "",
+                   g_reply.has_code ? g_reply.code : -1, g_reply.agent_id,
+                   g_reply.reason, g_reply.list_count);
             break;
         case HTTP_EVENT_DISCONNECTED:
             printf("HTTP_EVENT_DISCONNECTED\n");
@@ -309,24 +625,21 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-/* Build JSON for /join request */
-static char *_build_join_json(void)
+/* Write the /join request body, the prompts and vendor settings make its
+ * size depend on app_config.h */
+static void _write_join_body(json_writer_t *w)
 {
-    cJSON *root = cJSON_CreateObject();
-    if (root == NULL) {
-        return NULL;
-    }
+    json_writer_begin_object(w, NULL);
 
     // Add name
-    cJSON_AddStringToObject(root, "name", CONVO_AGENT_NAME);
+    json_writer_string(w, "name", g_agent_name);
 
     // Create properties object
-    cJSON *properties = cJSON_CreateObject();
-    cJSON_AddItemToObject(root, "properties", properties);
+    json_writer_begin_object(w, "properties");
 
     // Add channel and token
-    cJSON_AddStringToObject(properties, "channel", CONVO_CHANNEL_NAME);
-    cJSON_AddStringToObject(properties, "token", CONVO_RTC_TOKEN);
+    json_writer_string(w, "channel", CONVO_CHANNEL_NAME);
+    json_writer_string(w, "token", CONVO_RTC_TOKEN);
 
     // Add UIDs (as strings, not numbers)
     char agent_uid_str[16];
@@ -334,229 +647,268 @@ static char *_build_join_json(void)
     snprintf(agent_uid_str, sizeof(agent_uid_str), "%d", CONVO_AGENT_RTC_UID);
     snprintf(remote_uid_str, sizeof(remote_uid_str), "%d", CONVO_REMOTE_RTC_UID);
 
-    cJSON_AddStringToObject(properties, "agent_rtc_uid", agent_uid_str);
-    cJSON *remote_uids = cJSON_CreateArray();
-    cJSON_AddItemToArray(remote_uids, cJSON_CreateString(remote_uid_str));
-    cJSON_AddItemToObject(properties, "remote_rtc_uids", remote_uids);
+    json_writer_string(w, "agent_rtc_uid", agent_uid_str);
+    json_writer_begin_array(w, "remote_rtc_uids");
+    json_writer_string(w, NULL, remote_uid_str);
+    json_writer_end_array(w);
 
     // Add parameters
-    cJSON *parameters = cJSON_CreateObject();
-    cJSON_AddStringToObject(parameters, "output_audio_codec", "PCMU");
-    cJSON_AddItemToObject(properties, "parameters", parameters);
+    json_writer_begin_object(w, "parameters");
+    json_writer_string(w, "output_audio_codec", "PCMU");
+    json_writer_end_object(w);
 
     // Add idle timeout
-    cJSON_AddNumberToObject(properties, "idle_timeout", CONVO_IDLE_TIMEOUT);
+    json_writer_int(w, "idle_timeout", CONVO_IDLE_TIMEOUT);
 
     // Add advanced features
-    cJSON *advanced_features = cJSON_CreateObject();
-    cJSON_AddBoolToObject(advanced_features, "enable_aivad", CONVO_ENABLE_AIVAD);
-    cJSON_AddItemToObject(properties, "advanced_features", advanced_features);
+    json_writer_begin_object(w, "advanced_features");
+    json_writer_bool(w, "enable_aivad", CONVO_ENABLE_AIVAD);
+    json_writer_end_object(w);
 
     // Add LLM configuration
-    cJSON *llm = cJSON_CreateObject();
-    cJSON_AddStringToObject(llm, "url", LLM_URL);
-    cJSON_AddStringToObject(llm, "api_key", LLM_API_KEY);
+    json_writer_begin_object(w, "llm");
+    json_writer_string(w, "url", LLM_URL);
+    json_writer_string(w, "api_key", LLM_API_KEY);
 
     // System messages array
-    cJSON *system_messages = cJSON_CreateArray();
-    cJSON *sys_msg = cJSON_CreateObject();
-    cJSON_AddStringToObject(sys_msg, "role", "system");
-    cJSON_AddStringToObject(sys_msg, "content", LLM_SYSTEM_MESSAGE);
-    cJSON_AddItemToArray(system_messages, sys_msg);
-    cJSON_AddItemToObject(llm, "system_messages", system_messages);
+    json_writer_begin_array(w, "system_messages");
+    json_writer_begin_object(w, NULL);
+    json_writer_string(w, "role", "system");
+    json_writer_string(w, "content", LLM_SYSTEM_MESSAGE);
+    json_writer_end_object(w);
+    json_writer_end_array(w);
 
-    cJSON_AddNumberToObject(llm, "max_history", LLM_MAX_HISTORY);
-    cJSON_AddStringToObject(llm, "greeting_message", LLM_GREETING_MESSAGE);
-    cJSON_AddStringToObject(llm, "failure_message", LLM_FAILURE_MESSAGE);
+    json_writer_int(w, "max_history", LLM_MAX_HISTORY);
+    json_writer_string(w, "greeting_message", LLM_GREETING_MESSAGE);
+    json_writer_string(w, "failure_message", LLM_FAILURE_MESSAGE);
 
     // LLM params
-    cJSON *llm_params = cJSON_CreateObject();
-    cJSON_AddStringToObject(llm_params, "model", LLM_MODEL);
-    cJSON_AddItemToObject(llm, "params", llm_params);
+    json_writer_begin_object(w, "params");
+    json_writer_string(w, "model", LLM_MODEL);
+    json_writer_end_object(w);
 
-    cJSON_AddItemToObject(properties, "llm", llm);
+    json_writer_end_object(w);  // llm
 
     // Add TTS configuration
-    cJSON *tts = cJSON_CreateObject();
+    json_writer_begin_object(w, "tts");
 
 #ifdef USE_TTS_CARTESIA
     // Cartesia TTS configuration
-    cJSON_AddStringToObject(tts, "vendor", TTS_CARTESIA_VENDOR);
+    json_writer_string(w, "vendor", TTS_CARTESIA_VENDOR);
 
-    cJSON *tts_params = cJSON_CreateObject();
-    cJSON_AddStringToObject(tts_params, "api_key", TTS_CARTESIA_API_KEY);
-    cJSON_AddStringToObject(tts_params, "model_id", TTS_CARTESIA_MODEL_ID);
+    json_writer_begin_object(w, "params");
+    json_writer_string(w, "api_key", TTS_CARTESIA_API_KEY);
+    json_writer_string(w, "model_id", TTS_CARTESIA_MODEL_ID);
 
     // Add voice object
-    cJSON *voice = cJSON_CreateObject();
-    cJSON_AddStringToObject(voice, "mode", TTS_CARTESIA_VOICE_MODE);
-    cJSON_AddStringToObject(voice, "id", TTS_CARTESIA_VOICE_ID);
-    cJSON_AddItemToObject(tts_params, "voice", voice);
+    json_writer_begin_object(w, "voice");
+    json_writer_string(w, "mode", TTS_CARTESIA_VOICE_MODE);
+    json_writer_string(w, "id", TTS_CARTESIA_VOICE_ID);
+    json_writer_end_object(w);
 
     // Add output_format object
-    cJSON *output_format = cJSON_CreateObject();
-    cJSON_AddStringToObject(output_format, "container", TTS_CARTESIA_CONTAINER);
-    cJSON_AddNumberToObject(output_format, "sample_rate", TTS_CARTESIA_SAMPLE_RATE);
-    cJSON_AddItemToObject(tts_params, "output_format", output_format);
+    json_writer_begin_object(w, "output_format");
+    json_writer_string(w, "container", TTS_CARTESIA_CONTAINER);
+    json_writer_int(w, "sample_rate", TTS_CARTESIA_SAMPLE_RATE);
+    json_writer_end_object(w);
 
-    cJSON_AddStringToObject(tts_params, "language", TTS_CARTESIA_LANGUAGE);
-    cJSON_AddItemToObject(tts, "params", tts_params);
+    json_writer_string(w, "language", TTS_CARTESIA_LANGUAGE);
+    json_writer_end_object(w);  // params
 #else
     // Microsoft TTS configuration
-    cJSON_AddStringToObject(tts, "vendor", TTS_MICROSOFT_VENDOR);
+    json_writer_string(w, "vendor", TTS_MICROSOFT_VENDOR);
 
-    cJSON *tts_params = cJSON_CreateObject();
-    cJSON_AddStringToObject(tts_params, "key", TTS_MICROSOFT_API_KEY);
-    cJSON_AddStringToObject(tts_params, "region", TTS_MICROSOFT_REGION);
-    cJSON_AddStringToObject(tts_params, "voice_name", TTS_MICROSOFT_VOICE_NAME);
-    cJSON_AddItemToObject(tts, "params", tts_params);
+    json_writer_begin_object(w, "params");
+    json_writer_string(w, "key", TTS_MICROSOFT_API_KEY);
+    json_writer_string(w, "region", TTS_MICROSOFT_REGION);
+    json_writer_string(w, "voice_name", TTS_MICROSOFT_VOICE_NAME);
+    json_writer_end_object(w);  // params
 #endif
 
-    cJSON_AddItemToObject(properties, "tts", tts);
+    json_writer_end_object(w);  // tts
 
     // Add ASR configuration
-    cJSON *asr = cJSON_CreateObject();
-    cJSON_AddStringToObject(asr, "language", ASR_LANGUAGE);
-    cJSON_AddItemToObject(properties, "asr", asr);
-
-    char *json_string = cJSON_Print(root);
-    cJSON_Delete(root);
+    json_writer_begin_object(w, "asr");
+    json_writer_string(w, "language", ASR_LANGUAGE);
+    json_writer_end_object(w);
 
-    return json_string;
+    json_writer_end_object(w);  // properties
+    json_writer_end_object(w);  // root
 }
 
-/* Start conversational AI agent */
-void ai_agent_start(void)
+/* Render the /join request body into g_join_body.
+ * Every input is fixed once the MAC is known, so this runs once at init and
+ * ai_agent_start() (including its 409 retries) sends the buffer as is. */
+static int _render_join_body(void)
 {
-    // Check if agent is already started
-    if (g_app.b_ai_agent_joined) {
-        printf("AI Agent already running\n");
-        return;
+    json_writer_t w;
+    json_writer_init(&w, NULL, 0);
+    _write_join_body(&w);
+    int len = json_writer_finish(&w);
+    if (len < 0) {
+        printf("✗ Join body could not be rendered\n");
+        return -1;
     }
 
-    printf("Starting conversational AI agent...\n");
+    if (g_join_body == NULL) {
+        g_join_body = malloc(len + 1);
+        if (g_join_body == NULL) {
+            printf("✗ No memory for a %d byte join body\n", len);
+            return -1;
+        }
+    }
 
-    // Generate authorization header
-    char auth_header[BASE64_AUTH_LEN];
-    _generate_basic_auth(auth_header, sizeof(auth_header));
+    json_writer_init(&w, g_join_body, len + 1);
+    _write_join_body(&w);
+    g_join_body_len = json_writer_finish(&w);
+    if (g_join_body_len < 0) {
+        return -1;
+    }
 
-    char auth_value[BASE64_AUTH_LEN + 10];
-    snprintf(auth_value, sizeof(auth_value), "Basic %s", auth_header);
+    printf("Join body rendered: %d bytes\n", g_join_body_len);
+    return 0;
+}
 
-    // Build URL
-    char url[256];
-    snprintf(url, sizeof(url), "%s/%s/join", AGORA_API_URL, AGORA_APP_ID);
+static void _agent_ctrl_task(void *arg);
 
-    // Build JSON request
-    char *json_data = _build_join_json();
-    if (json_data == NULL) {
-        printf("Failed to build JSON request\n");
-        return;
+#ifdef CONFIG_AGENT_WARM_STANDBY
+/* (re)join the standby agent whenever the board enters the channel */
+static void _on_app_state(app_state_t changed, app_state_t state, void *ctx)
+{
+    if ((changed & APP_STATE_SESSION_STARTED) && (state & APP_STATE_SESSION_STARTED)) {
+        ai_agent_standby();
     }
+}
+#endif
 
-    printf("Request URL: %s\n", url);
-    printf("Request JSON: %s\n", json_data);
-
-    // Initialize HTTP client with SSL configuration
-    esp_http_client_config_t config = {
-        .url = url,
-        .event_handler = _http_event_handler,
-        .timeout_ms = 10000,
-        .crt_bundle_attach = esp_crt_bundle_attach,  // Use certificate bundle for HTTPS
-        .skip_cert_common_name_check = false,
-    };
+/* Prepare everything the agent requests need and start the control worker */
+void ai_agent_init(void)
+{
+    static StaticTask_t task_buf;
+    static StackType_t task_stack[TASK_AGENT_CTRL_STACK];  // TLS handshakes run on this stack
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_header(client, "Authorization", auth_value);
+    uint8_t mac[6] = {0};
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(g_agent_name, sizeof(g_agent_name), "%s_%02x%02x%02x", CONVO_AGENT_NAME, mac[3], mac[4], mac[5]);
+    printf("Agent name: %s\n", g_agent_name);
 
-    // Send request
-    esp_err_t err = esp_http_client_open(client, strlen(json_data));
-    if (err != ESP_OK) {
-        printf("Failed to open HTTP connection: %s\n", esp_err_to_name(err));
-        free(json_data);
-        esp_http_client_cleanup(client);
-        return;
+    // created before the control worker, the only task that makes requests
+    if (g_http_lock == NULL) {
+        g_http_lock = xSemaphoreCreateMutexStatic(&g_http_lock_buf);
     }
 
-    int wlen = esp_http_client_write(client, json_data, strlen(json_data));
-    if (wlen < 0) {
-        printf("Failed to write HTTP request\n");
-        free(json_data);
-        esp_http_client_cleanup(client);
-        return;
-    }
+    _agent_record_load();
+    _render_join_body();
 
-    free(json_data);
+    retry_endpoint_init(&g_ep_join, "join", &g_join_retry_cfg);
+    retry_endpoint_init(&g_ep_agents, "agents", &g_api_retry_cfg);
+    retry_endpoint_init(&g_ep_leave, "leave", &g_api_retry_cfg);
 
-    // Perform request
-    err = esp_http_client_perform(client);
-    if (err == ESP_OK) {
-        int status_code = esp_http_client_get_status_code(client);
-        printf("HTTP Status = %d, content_length = %lld\n",
-               status_code, esp_http_client_get_content_length(client));
+    metrics_register_hist(&g_http_latency);
+    metrics_register_counter(&g_http_errors);
+
+#ifdef CONFIG_AGENT_WARM_STANDBY
+    app_state_subscribe(_on_app_state, NULL);
+#endif
+
+    if (g_ctrl_task == NULL) {
+        g_ctrl_task = xTaskCreateStaticPinnedToCore(_agent_ctrl_task, "agent_ctrl", TASK_AGENT_CTRL_STACK, NULL,
+                                                    TASK_AGENT_CTRL_PRIO, task_stack, &task_buf,
+                                                    TASK_AGENT_CTRL_CORE);
+    }
+}
+
+/* One start attempt, runs on the control worker */
+static int _agent_do_start(void)
+{
+    // Check if agent is already started
+    if (app_state_has(APP_STATE_AGENT_JOINED)) {
+        printf("AI Agent already running\n");
+        return AGENT_START_OK;
+    }
 
-        // Check for conflict (409)
-        if (status_code == 409) {
-            printf("========================================\n");
-            printf("⚠️  CONFLICT: Agent already exists in channel\n");
-            printf("Attempting to resolve conflict...\n");
-            printf("========================================\n");
+    printf("Starting conversational AI agent...\n");
 
-            esp_http_client_cleanup(client);
+    // Build URL
+    char url[256];
+    snprintf(url, sizeof(url), "%s/%s/join", AGORA_API_URL, AGORA_APP_ID);
 
-            // Step 1: Get running agent ID
-            char running_agent_id[AGENT_ID_LEN] = {0};
-            int query_result = _get_running_agent_id(running_agent_id, sizeof(running_agent_id));
+    if (g_join_body_len <= 0 && _render_join_body() != 0) {
+        printf("Failed to build JSON request\n");
+        return AGENT_START_FAILED;
+    }
 
-            if (query_result == 0) {
-                // Found a running agent - need to stop it
-                printf("Found conflicting agent: %s\n", running_agent_id);
+    // the body carries the LLM and TTS keys, only its size goes to the log
+    printf("Request URL: %s (%d byte body)\n", url, g_join_body_len);
 
-                // Step 2: Stop the running agent
-                if (_stop_agent_by_id(running_agent_id) == 0) {
-                    printf("✓ Conflicting agent stopped\n");
+    int status_code = _api_call(&g_ep_join, HTTP_METHOD_POST, url, g_join_body);
 
-                    // Step 3: Spawn retry task with 2 second delay
-                    xTaskCreate(_agent_start_retry_task, "agent_retry", 8192, (void*)2000, 5, NULL);
-                    return;
-                } else {
-                    printf("✗ Failed to stop conflicting agent\n");
-                    g_app.b_ai_agent_joined = false;
-                    memset(g_app.agent_id, 0, AGENT_ID_LEN);
-                    return;
-                }
-            } else {
-                // No running agents found - the conflict is stale
-                printf("✓ No running agents found (conflict is stale)\n");
+    if (status_code < 0) {
+        printf("✗ Agent was not created\n");
+        // Ensure state is clean
+        app_state_clear(APP_STATE_AGENT_JOINED);
+        memset(g_app.agent_id, 0, AGENT_ID_LEN);
+        return AGENT_START_FAILED;
+    }
 
-                // Spawn retry task with 1 second delay
-                xTaskCreate(_agent_start_retry_task, "agent_retry", 8192, (void*)1000, 5, NULL);
-                return;
+    // Check for conflict (409)
+    if (status_code == 409) {
+        printf("========================================\n");
+        printf("⚠️  CONFLICT: Agent already exists in channel\n");
+        printf("Attempting to resolve conflict...\n");
+        printf("========================================\n");
+
+        // Fast path: the agent recorded in NVS is ours, stop it without a lookup
+        if (g_recorded_agent_id[0] != '\0') {
+            printf("Stopping recorded agent: %s\n", g_recorded_agent_id);
+            if (_stop_agent_by_id(g_recorded_agent_id) == 0) {
+                printf("✓ Conflicting agent stopped\n");
+                return 2000;
             }
+            printf("Recorded agent not stopped, looking it up by name\n");
         }
 
-        // Parse response for success or other errors
-        if (status_code == 200) {
-            _parse_join_response(http_response_buffer, http_response_len);
+        // Step 1: Get running agent ID
+        char running_agent_id[AGENT_ID_LEN] = {0};
+        int query_result = _get_running_agent_id(running_agent_id, sizeof(running_agent_id));
+
+        if (query_result == 0) {
+            // Found a running agent - need to stop it
+            printf("Found conflicting agent: %s\n", running_agent_id);
+
+            // Step 2: Stop the running agent
+            if (_stop_agent_by_id(running_agent_id) == 0) {
+                printf("✓ Conflicting agent stopped\n");
+
+                // Step 3: Retry after 2 seconds
+                return 2000;
+            } else {
+                printf("✗ Failed to stop conflicting agent\n");
+                app_state_clear(APP_STATE_AGENT_JOINED);
+                memset(g_app.agent_id, 0, AGENT_ID_LEN);
+                return AGENT_START_FAILED;
+            }
         } else {
-            // Non-200, non-409 status: start failed
-            printf("✗ Start request failed with status %d\n", status_code);
-            printf("✗ Agent was not created\n");
-            // Ensure state is clean
-            g_app.b_ai_agent_joined = false;
-            memset(g_app.agent_id, 0, AGENT_ID_LEN);
+            // No running agents found - the conflict is stale
+            printf("✓ No running agents found (conflict is stale)\n");
+
+            // Retry after 1 second
+            return 1000;
         }
+    }
+
+    // Parse response for success or other errors
+    if (status_code == 200) {
+        return (_parse_join_response(&g_reply) == 0) ? AGENT_START_OK : AGENT_START_FAILED;
     } else {
-        printf("HTTP request failed: %s\n", esp_err_to_name(err));
+        // Non-200, non-409 status: start failed
+        printf("✗ Start request failed with status %d\n", status_code);
         printf("✗ Agent was not created\n");
         // Ensure state is clean
-        g_app.b_ai_agent_joined = false;
+        app_state_clear(APP_STATE_AGENT_JOINED);
         memset(g_app.agent_id, 0, AGENT_ID_LEN);
+        return AGENT_START_FAILED;
     }
-
-    esp_http_client_cleanup(client);
 }
 
 /* Stop a specific agent by ID */
@@ -569,13 +921,6 @@ static int _stop_agent_by_id(const char *agent_id)
 
     printf("Stopping agent ID: %s\n", agent_id);
 
-    // Generate authorization header
-    char auth_header[BASE64_AUTH_LEN];
-    _generate_basic_auth(auth_header, sizeof(auth_header));
-
-    char auth_value[BASE64_AUTH_LEN + 10];
-    snprintf(auth_value, sizeof(auth_value), "Basic %s", auth_header);
-
     // Build URL with agent_id
     char url[256];
     snprintf(url, sizeof(url), "%s/%s/agents/%s/leave",
@@ -583,31 +928,15 @@ static int _stop_agent_by_id(const char *agent_id)
 
     printf("Request URL: %s\n", url);
 
-    // Initialize HTTP client
-    esp_http_client_config_t config = {
-        .url = url,
-        .event_handler = _http_event_handler,
-        .timeout_ms = 10000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-        .skip_cert_common_name_check = false,
-    };
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Authorization", auth_value);
-
-    // Perform request
-    esp_err_t err = esp_http_client_perform(client);
-    if (err != ESP_OK) {
-        printf("HTTP request failed: %s\n", esp_err_to_name(err));
-        esp_http_client_cleanup(client);
+    int status_code = _api_call(&g_ep_leave, HTTP_METHOD_POST, url, NULL);
+    if (status_code < 0) {
         return -1;
     }
 
-    int status_code = esp_http_client_get_status_code(client);
-    printf("HTTP Status = %d\n", status_code);
-
-    esp_http_client_cleanup(client);
+    // the server has answered for this agent, it will not come back
+    if (strcmp(agent_id, g_recorded_agent_id) == 0) {
+        _agent_record_save("");
+    }
 
     if (status_code == 200) {
         printf("✓ Agent %s stopped successfully\n", agent_id);
@@ -618,30 +947,31 @@ static int _stop_agent_by_id(const char *agent_id)
     }
 }
 
-/* Stop conversational AI agent */
-void ai_agent_stop(void)
+/* Stop the agent, runs on the control worker */
+static void _agent_do_stop(void)
 {
     printf("========================================\n");
     printf("Stopping conversational AI agent...\n");
-    printf("Current state: b_ai_agent_joined=%d, agent_id='%s'\n",
-           g_app.b_ai_agent_joined, g_app.agent_id);
+    printf("Current state: agent joined=%d, agent_id='%s'\n",
+           app_state_has(APP_STATE_AGENT_JOINED), g_app.agent_id);
     printf("========================================\n");
 
+    if (strlen(g_app.agent_id) == 0 && g_recorded_agent_id[0] != '\0') {
+        // left over from before a reboot
+        printf("Stopping recorded agent instead\n");
+        _stop_agent_by_id(g_recorded_agent_id);
+        app_state_clear(APP_STATE_AGENT_JOINED);
+        return;
+    }
+
     if (strlen(g_app.agent_id) == 0) {
         printf("✗ ERROR: No active agent to stop (agent_id is empty)\n");
         printf("This means start request may have failed or not been called\n");
         // Clear flag anyway to ensure clean state
-        g_app.b_ai_agent_joined = false;
+        app_state_clear(APP_STATE_AGENT_JOINED);
         return;
     }
 
-    // Generate authorization header
-    char auth_header[BASE64_AUTH_LEN];
-    _generate_basic_auth(auth_header, sizeof(auth_header));
-
-    char auth_value[BASE64_AUTH_LEN + 10];
-    snprintf(auth_value, sizeof(auth_value), "Basic %s", auth_header);
-
     // Build URL with agent_id
     char url[256];
     snprintf(url, sizeof(url), "%s/%s/agents/%s/leave",
@@ -649,45 +979,399 @@ void ai_agent_stop(void)
 
     printf("Request URL: %s\n", url);
 
-    // Initialize HTTP client with SSL configuration
-    esp_http_client_config_t config = {
-        .url = url,
-        .event_handler = _http_event_handler,
-        .timeout_ms = 10000,
-        .crt_bundle_attach = esp_crt_bundle_attach,  // Use certificate bundle for HTTPS
-        .skip_cert_common_name_check = false,
-    };
+    int status_code = _api_call(&g_ep_leave, HTTP_METHOD_POST, url, NULL);
+    if (status_code == 200) {
+        _parse_leave_response(&g_reply);
+    } else if (status_code > 0) {
+        // Non-200 status: agent may not exist, may have timed out, etc.
+        // Clear state anyway to prevent getting stuck
+        printf("⚠ Stop request failed with status %d, clearing state anyway\n", status_code);
+        app_state_clear(APP_STATE_AGENT_JOINED);
+        memset(g_app.agent_id, 0, AGENT_ID_LEN);
+        _agent_record_save("");
+    } else {
+        // Network error or timeout: clear state to allow retry, the NVS
+        // record stays so the agent can still be stopped on conflict
+        printf("⚠ Clearing state to allow restart\n");
+        app_state_clear(APP_STATE_AGENT_JOINED);
+        memset(g_app.agent_id, 0, AGENT_ID_LEN);
+    }
+}
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Authorization", auth_value);
+/* ---- warm standby ----
+ * The agent is joined ahead of time with audio muted on the board, so a
+ * button press only has to unmute. Playback and uplink stay muted while
+ * the agent is not active, and a standby agent that is not used for
+ * CONFIG_AGENT_STANDBY_IDLE_S is stopped. Without CONFIG_AGENT_WARM_STANDBY
+ * the agent is active exactly while it is joined. */
 
-    // Perform request
-    esp_err_t err = esp_http_client_perform(client);
-    if (err == ESP_OK) {
-        int status_code = esp_http_client_get_status_code(client);
-        printf("HTTP Status = %d, content_length = %lld\n",
-               status_code, esp_http_client_get_content_length(client));
+typedef struct {
+    uint32_t count;
+    uint32_t total_ms;
+    uint32_t max_ms;
+} press_latency_t;
 
-        // Parse response
-        if (status_code == 200) {
-            _parse_leave_response(http_response_buffer, http_response_len);
-        } else {
-            // Non-200 status: agent may not exist, may have timed out, etc.
-            // Clear state anyway to prevent getting stuck
-            printf("⚠ Stop request failed with status %d, clearing state anyway\n", status_code);
-            g_app.b_ai_agent_joined = false;
-            memset(g_app.agent_id, 0, AGENT_ID_LEN);
+static volatile bool g_agent_active = false;
+static bool g_conv_session_open = false;
+
+/* button press to the first agent audio that is played, [0] cold join,
+ * [1] warm standby where the clock runs from the press that unmutes */
+static volatile int64_t g_press_us = 0;
+static bool g_press_warm = false;
+static press_latency_t g_press_latency[2];
+
+#ifdef CONFIG_AGENT_WARM_STANDBY
+static esp_timer_handle_t g_standby_timer = NULL;
+
+static void _standby_timer_cb(void *arg)
+{
+    if (load_gov_level() >= LOAD_LEVEL_HTTP_DEFERRED) {
+        // background work, try again once the load has dropped
+        esp_timer_start_once(g_standby_timer, (uint64_t)CONFIG_LOAD_GOV_PERIOD_MS * 10 * 1000);
+        return;
+    }
+    printf("Agent idle in standby for %d s, stopping it\n", CONFIG_AGENT_STANDBY_IDLE_S);
+    ai_agent_submit(AI_AGENT_CMD_STOP);
+}
+#endif
+
+static void _standby_arm(bool arm)
+{
+#ifdef CONFIG_AGENT_WARM_STANDBY
+    if (g_standby_timer == NULL) {
+        const esp_timer_create_args_t args = {
+            .callback = _standby_timer_cb,
+            .name     = "agent_idle",
+        };
+        if (esp_timer_create(&args, &g_standby_timer) != ESP_OK) {
+            return;
         }
-    } else {
-        // Network error or timeout: clear state to allow retry
-        printf("HTTP request failed: %s\n", esp_err_to_name(err));
-        printf("⚠ Clearing state to allow restart\n");
-        g_app.b_ai_agent_joined = false;
-        memset(g_app.agent_id, 0, AGENT_ID_LEN);
     }
 
-    esp_http_client_cleanup(client);
+    esp_timer_stop(g_standby_timer);
+    if (arm) {
+        esp_timer_start_once(g_standby_timer, (uint64_t)CONFIG_AGENT_STANDBY_IDLE_S * 1000000ULL);
+    }
+#endif
+}
+
+static void _conv_session_end(void)
+{
+    if (g_conv_session_open) {
+        g_conv_session_open = false;
+        conv_latency_session_end();
+    }
+}
+
+/* the worker has joined the agent */
+static void _standby_on_started(void)
+{
+    conv_latency_agent_joined(esp_timer_get_time());
+#ifdef CONFIG_AGENT_WARM_STANDBY
+    rtc_set_audio_muted(!g_agent_active);
+    _standby_arm(!g_agent_active);
+    printf("Agent joined, %s\n", g_agent_active ? "active" : "in standby");
+#else
+    g_agent_active = true;
+#endif
+}
+
+/* the worker has stopped the agent */
+static void _standby_on_stopped(void)
+{
+    g_agent_active = false;
+    g_press_us     = 0;
+    _standby_arm(false);
+    _conv_session_end();
+}
+
+void ai_agent_standby(void)
+{
+#ifdef CONFIG_AGENT_WARM_STANDBY
+    if (app_state_has(APP_STATE_AGENT_JOINED)) {
+        return;
+    }
+    printf("Warm standby: joining the agent muted\n");
+    g_agent_active = false;
+    rtc_set_audio_muted(true);
+    ai_agent_submit(AI_AGENT_CMD_START);
+#else
+    printf("Warm standby is not enabled\n");
+#endif
+}
+
+bool ai_agent_is_active(void)
+{
+#ifdef CONFIG_AGENT_WARM_STANDBY
+    return g_agent_active && app_state_has(APP_STATE_AGENT_JOINED);
+#else
+    return app_state_has(APP_STATE_AGENT_JOINED);
+#endif
+}
+
+void ai_agent_note_agent_audio(void)
+{
+    int64_t press_us = g_press_us;
+    if (press_us == 0) {
+        return;
+    }
+    g_press_us = 0;
+
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - press_us) / 1000);
+    press_latency_t *lat = &g_press_latency[g_press_warm ? 1 : 0];
+    lat->count++;
+    lat->total_ms += ms;
+    if (ms > lat->max_ms) {
+        lat->max_ms = ms;
+    }
+
+    printf("Button to first agent audio: %lu ms (%s), avg %lu ms, max %lu ms over %lu press(es)\n",
+           (unsigned long)ms, g_press_warm ? "warm" : "cold",
+           (unsigned long)(lat->total_ms / lat->count), (unsigned long)lat->max_ms, (unsigned long)lat->count);
+}
+
+/* ---- agent control worker ----
+ * All REST work runs on one task with a fixed stack. Callers only post a
+ * command; a newer command replaces one that has not started yet, and a
+ * running start gives up at its next wait once it has been superseded. */
+
+static portMUX_TYPE g_ctrl_lock = portMUX_INITIALIZER_UNLOCKED;
+static ai_agent_cmd_t g_pending_cmd = AI_AGENT_CMD_NONE;
+static uint32_t g_replaced_cmds = 0;  // 1 << cmd for every pending command a submit replaced
+static ai_agent_event_cb_t g_event_cb = NULL;
+static void *g_event_ctx = NULL;
+
+static const char *_cmd_name(ai_agent_cmd_t cmd)
+{
+    switch (cmd) {
+        case AI_AGENT_CMD_START:   return "start";
+        case AI_AGENT_CMD_STOP:    return "stop";
+        case AI_AGENT_CMD_RESTART: return "restart";
+        default:                   return "none";
+    }
+}
+
+static void _notify(ai_agent_event_t event, ai_agent_cmd_t cmd)
+{
+    if (g_event_cb) {
+        g_event_cb(event, cmd, g_event_ctx);
+    }
+}
+
+static bool _superseded(uint32_t generation)
+{
+    return g_cmd_generation != generation;
+}
+
+/* Sleep, but wake up early when a new command arrives.
+ * Returns false if the running command has been superseded. */
+static bool _agent_wait(uint32_t generation, int delay_ms)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t ticks = pdMS_TO_TICKS(delay_ms);
+
+    while (!_superseded(generation)) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= ticks) {
+            return true;
+        }
+        ulTaskNotifyTake(pdTRUE, ticks - elapsed);
+    }
+    return false;
+}
+
+static void _agent_run_start(ai_agent_cmd_t cmd, uint32_t generation)
+{
+#ifdef CONFIG_AUDIO_CAPTURE_STEREO
+    // the audio task picks the channel up on its next frame; this stack is in internal RAM, NVS may write
+    if (!app_state_has(APP_STATE_AGENT_JOINED)) {
+        printf("Capture channel for this session: %s\n", capture_policy_name(capture_policy_session_begin()));
+    }
+#endif
+
+    for (int attempt = 1; attempt <= g_conflict_retry_cfg.max_attempts; attempt++) {
+        int result = _agent_do_start();
+        if (result == AGENT_START_OK) {
+            _standby_on_started();
+            _notify(AI_AGENT_EVT_STARTED, cmd);
+            return;
+        }
+        if (result == AGENT_START_FAILED || attempt == g_conflict_retry_cfg.max_attempts) {
+            _notify(AI_AGENT_EVT_START_FAILED, cmd);
+            return;
+        }
+
+        // the agent we stopped needs time to leave, jitter on top keeps devices apart
+        int delay_ms = result + (int)retry_backoff_ms(&g_conflict_retry_cfg, attempt - 1, esp_random());
+        printf("Waiting %d ms before retry...\n", delay_ms);
+        if (!_agent_wait(generation, delay_ms)) {
+            printf("Agent start superseded, not retrying\n");
+            _notify(AI_AGENT_EVT_CANCELLED, cmd);
+            return;
+        }
+
+        printf("========================================\n");
+        printf("Retrying agent start (%d/%d)...\n", attempt + 1, g_conflict_retry_cfg.max_attempts);
+        printf("========================================\n");
+    }
+}
+
+static void _agent_ctrl_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (1) {
+            portENTER_CRITICAL(&g_ctrl_lock);
+            ai_agent_cmd_t cmd = g_pending_cmd;
+            uint32_t generation = g_cmd_generation;
+            uint32_t replaced = g_replaced_cmds;
+            g_pending_cmd = AI_AGENT_CMD_NONE;
+            g_replaced_cmds = 0;
+            portEXIT_CRITICAL(&g_ctrl_lock);
+            g_running_generation = generation;
+
+            // reported here rather than by ai_agent_submit, so every event comes from this task
+            for (int c = AI_AGENT_CMD_START; c <= AI_AGENT_CMD_RESTART; c++) {
+                if (replaced & (1u << c)) {
+                    _notify(AI_AGENT_EVT_CANCELLED, (ai_agent_cmd_t)c);
+                }
+            }
+
+            if (cmd == AI_AGENT_CMD_NONE) {
+                break;
+            }
+
+            printf("agent_ctrl: running '%s'\n", _cmd_name(cmd));
+
+            if (cmd == AI_AGENT_CMD_STOP || cmd == AI_AGENT_CMD_RESTART) {
+                _agent_do_stop();
+                _standby_on_stopped();
+                _notify(AI_AGENT_EVT_STOPPED, cmd);
+            }
+
+            if (cmd == AI_AGENT_CMD_START || cmd == AI_AGENT_CMD_RESTART) {
+                if (_superseded(generation)) {
+                    _notify(AI_AGENT_EVT_CANCELLED, cmd);
+                } else {
+                    _agent_run_start(cmd, generation);
+                }
+            }
+        }
+    }
+}
+
+int ai_agent_submit(ai_agent_cmd_t cmd)
+{
+    if (g_ctrl_task == NULL || cmd == AI_AGENT_CMD_NONE) {
+        printf("agent_ctrl: not ready, '%s' ignored\n", _cmd_name(cmd));
+        return -1;
+    }
+
+    portENTER_CRITICAL(&g_ctrl_lock);
+    ai_agent_cmd_t replaced = g_pending_cmd;
+    bool coalesced = (replaced == cmd);
+    if (!coalesced) {
+        g_pending_cmd = cmd;
+        g_cmd_generation++;
+        if (replaced != AI_AGENT_CMD_NONE) {
+            g_replaced_cmds |= 1u << replaced;
+        }
+    }
+    portEXIT_CRITICAL(&g_ctrl_lock);
+
+    if (coalesced) {
+        printf("agent_ctrl: '%s' already pending\n", _cmd_name(cmd));
+        return 0;
+    }
+
+    if (replaced != AI_AGENT_CMD_NONE) {
+        printf("agent_ctrl: '%s' replaces pending '%s'\n", _cmd_name(cmd), _cmd_name(replaced));
+    }
+
+    xTaskNotifyGive(g_ctrl_task);
+    return 0;
+}
+
+void ai_agent_set_event_cb(ai_agent_event_cb_t cb, void *ctx)
+{
+    g_event_ctx = ctx;
+    g_event_cb  = cb;
+}
+
+/* Start conversational AI agent */
+void ai_agent_start(void)
+{
+    g_press_warm = app_state_has(APP_STATE_AGENT_JOINED);
+    g_press_us   = esp_timer_get_time();
+
+    power_gov_wake();
+    conv_latency_session_begin(g_press_us, g_press_warm);
+    g_conv_session_open = true;
+
+#ifdef CONFIG_AGENT_WARM_STANDBY
+    g_agent_active = true;
+    _standby_arm(false);
+    rtc_set_audio_muted(false);
+    if (g_press_warm) {
+        printf("Agent activated from standby\n");
+        return;
+    }
+#endif
+    ai_agent_submit(AI_AGENT_CMD_START);
+}
+
+/* Stop conversational AI agent, in warm standby it only goes back to standby */
+void ai_agent_stop(void)
+{
+    g_press_us = 0;
+
+#ifdef CONFIG_AGENT_WARM_STANDBY
+    if (app_state_has(APP_STATE_AGENT_JOINED)) {
+        g_agent_active = false;
+        rtc_set_audio_muted(true);
+        _standby_arm(true);
+        _conv_session_end();
+        printf("Agent back in standby\n");
+        return;
+    }
+#endif
+    ai_agent_submit(AI_AGENT_CMD_STOP);
+}
+
+/* Stop the agent recorded by the previous run, if any */
+void ai_agent_recover(void)
+{
+    if (g_recorded_agent_id[0] == '\0') {
+        return;
+    }
+
+    // background work, let an overloaded board settle first
+    if (!load_gov_wait_below(LOAD_LEVEL_HTTP_DEFERRED, 30000)) {
+        printf("Load still high, stopping the recorded agent anyway\n");
+    }
+    printf("Agent %s may still be running from the last boot, stopping it\n", g_recorded_agent_id);
+    ai_agent_submit(AI_AGENT_CMD_STOP);
+}
+
+/* Resolve the API host once so the first button press does not pay for DNS */
+void ai_agent_http_warmup(void)
+{
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+
+    int64_t start_us = esp_timer_get_time();
+    int err = getaddrinfo(AGORA_API_HOST, "443", &hints, &res);
+    int elapsed_ms = (int)((esp_timer_get_time() - start_us) / 1000);
+
+    if (err != 0 || res == NULL) {
+        printf("DNS warmup for %s failed: %d (%d ms)\n", AGORA_API_HOST, err, elapsed_ms);
+        return;
+    }
+
+    // lwIP keeps the answer in its DNS table, later connects hit the cache
+    printf("DNS warmup: %s resolved in %d ms\n", AGORA_API_HOST, elapsed_ms);
+    freeaddrinfo(res);
 }
 
 /* Remove old functions that are no longer needed */
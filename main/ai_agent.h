@@ -7,19 +7,63 @@ extern "C" {
 
 
 #include <stdlib.h>
+#include <stdbool.h>
+
+typedef enum {
+  AI_AGENT_CMD_NONE = 0,
+  AI_AGENT_CMD_START,
+  AI_AGENT_CMD_STOP,
+  AI_AGENT_CMD_RESTART,
+} ai_agent_cmd_t;
+
+typedef enum {
+  AI_AGENT_EVT_STARTED = 0,
+  AI_AGENT_EVT_START_FAILED,
+  AI_AGENT_EVT_STOPPED,
+  AI_AGENT_EVT_CANCELLED,  // superseded by a newer command before it finished
+} ai_agent_event_t;
+
+/* completion callback, runs on the agent control task */
+typedef void (*ai_agent_event_cb_t)(ai_agent_event_t event, ai_agent_cmd_t cmd, void *ctx);
+
+/* render the join request and start the agent control task, call once at boot */
+void ai_agent_init(void);
+
+/* queue a command for the control task, never blocks.
+ * A pending command of the same kind is merged, a different one replaced;
+ * the replaced one is reported as AI_AGENT_EVT_CANCELLED by the control task. */
+int ai_agent_submit(ai_agent_cmd_t cmd);
+
+/* register the completion callback */
+void ai_agent_set_event_cb(ai_agent_event_cb_t cb, void *ctx);
 
 /* generate ai agent information */
 void ai_agent_generate(void);
 
-/* start ai agent */
+/* start ai agent, non-blocking */
 void ai_agent_start(void);
 
 /* ping ai agent to keepalive */
 void ai_agent_ping(void);
 
-/* stop ai agent */
+/* stop ai agent, non-blocking */
 void ai_agent_stop(void);
 
+/* resolve the agent API host ahead of the first request, call once the network is up */
+void ai_agent_http_warmup(void);
+
+/* stop the agent left running by the previous boot, call once the network is up */
+void ai_agent_recover(void);
+
+/* warm standby: join the agent muted, call once the board is in the channel */
+void ai_agent_standby(void);
+
+/* true while the agent is talking to the user, false in standby */
+bool ai_agent_is_active(void);
+
+/* agent audio reached playback, called from the RTC audio callback */
+void ai_agent_note_agent_audio(void);
+
 
 #ifdef __cplusplus
 }
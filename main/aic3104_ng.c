@@ -1,5 +1,6 @@
 #include "aic3104_ng.h"
 #include "esp_log.h"
+#include "i2c_mgr.h"
 
 static const char *TAG = "AIC3104_NG";
 
@@ -92,14 +93,14 @@ esp_err_t aic3104_ng_write(aic3104_ng_t *ctx, uint8_t reg, uint8_t val)
     if (!ctx) return ESP_ERR_INVALID_STATE;
 
     uint8_t buf[2] = { reg, val };
-    return i2c_master_write_to_device(ctx->i2c_port, AIC3104_ADDR, buf, sizeof(buf), pdMS_TO_TICKS(50));
+    return i2c_mgr_write(AIC3104_ADDR, I2C_PRIO_CODEC, buf, sizeof(buf), 50);
 }
 
 esp_err_t aic3104_ng_read(aic3104_ng_t *ctx, uint8_t reg, uint8_t *val)
 {
     if (!ctx || !val) return ESP_ERR_INVALID_ARG;
 
-    return i2c_master_write_read_device(ctx->i2c_port, AIC3104_ADDR, &reg, 1, val, 1, pdMS_TO_TICKS(50));
+    return i2c_mgr_write_read(AIC3104_ADDR, I2C_PRIO_CODEC, &reg, 1, val, 1, 50);
 }
 
 esp_err_t aic3104_ng_probe(aic3104_ng_t *ctx, uint8_t *page_val_out)
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "app_state.h"
+#include "task_plan.h"
+
+/* The state lives in an event group, so readers never lock and waiters wake
+ * as soon as a bit is set instead of polling. Writers are serialised by a
+ * mutex so that the change they report matches what they did; every change
+ * is queued and handed to the subscribers on one task. Writers are tasks
+ * (SDK callbacks, the event loop, esp_timer), never ISRs. */
+
+#define APP_STATE_QUEUE_LEN     (16)
+
+typedef struct {
+  app_state_t changed;
+  app_state_t state;
+  int64_t     time_us;
+} app_state_msg_t;
+
+typedef struct {
+  app_state_cb_t cb;
+  void *ctx;
+} app_state_sub_t;
+
+static EventGroupHandle_t g_state_events = NULL;
+static StaticEventGroup_t g_state_events_buf;
+static SemaphoreHandle_t g_state_lock = NULL;
+static StaticSemaphore_t g_state_lock_buf;
+static QueueHandle_t g_state_queue = NULL;
+static StaticQueue_t g_state_queue_buf;
+static uint8_t g_state_queue_storage[APP_STATE_QUEUE_LEN * sizeof(app_state_msg_t)];
+
+static app_state_sub_t g_subs[APP_STATE_MAX_SUBSCRIBERS];
+static int g_sub_count = 0;
+static app_state_stats_t g_stats;
+
+static const char *_bit_name(app_state_t bit)
+{
+  switch (bit) {
+    case APP_STATE_WIFI_CONNECTED:  return "wifi";
+    case APP_STATE_SESSION_STARTED: return "session";
+    case APP_STATE_AGENT_JOINED:    return "agent";
+    default:                        return "?";
+  }
+}
+
+static void _print_change(const app_state_msg_t *msg)
+{
+  for (app_state_t bit = 1; bit && bit <= msg->changed; bit <<= 1) {
+    if (msg->changed & bit) {
+      printf("app_state: %s %s\n", _bit_name(bit), (msg->state & bit) ? "on" : "off");
+    }
+  }
+}
+
+static void _state_task(void *arg)
+{
+  app_state_msg_t msg;
+
+  while (1) {
+    if (xQueueReceive(g_state_queue, &msg, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+
+    _print_change(&msg);
+    for (int i = 0; i < g_sub_count; i++) {
+      g_subs[i].cb(msg.changed, msg.state, g_subs[i].ctx);
+    }
+
+    uint32_t dispatch_us = (uint32_t)(esp_timer_get_time() - msg.time_us);
+    g_stats.last_dispatch_us   = dispatch_us;
+    g_stats.total_dispatch_us += dispatch_us;
+    if (dispatch_us > g_stats.max_dispatch_us) {
+      g_stats.max_dispatch_us = dispatch_us;
+    }
+    if (dispatch_us > 10000) {
+      printf("app_state: slow dispatch, %lu us\n", (unsigned long)dispatch_us);
+    }
+  }
+}
+
+static void _objects_init(void)
+{
+  if (g_state_events == NULL) {
+    g_state_events = xEventGroupCreateStatic(&g_state_events_buf);
+    g_state_lock   = xSemaphoreCreateMutexStatic(&g_state_lock_buf);
+    g_state_queue  = xQueueCreateStatic(APP_STATE_QUEUE_LEN, sizeof(app_state_msg_t), g_state_queue_storage,
+                                        &g_state_queue_buf);
+  }
+}
+
+void app_state_init(void)
+{
+  static StaticTask_t task_buf;
+  static StackType_t task_stack[TASK_APP_STATE_STACK];
+  static bool started = false;
+
+  _objects_init();
+  if (!started) {
+    xTaskCreateStaticPinnedToCore(_state_task, "app_state", TASK_APP_STATE_STACK, NULL, TASK_APP_STATE_PRIO,
+                                  task_stack, &task_buf, TASK_APP_STATE_CORE);
+    started = true;
+  }
+}
+
+static void _update(app_state_t bits, bool set)
+{
+  _objects_init();
+
+  xSemaphoreTake(g_state_lock, portMAX_DELAY);
+  app_state_t old = (app_state_t)xEventGroupGetBits(g_state_events);
+  app_state_t now = set ? (old | bits) : (old & ~bits);
+  if (now == old) {
+    xSemaphoreGive(g_state_lock);
+    return;
+  }
+
+  if (set) {
+    xEventGroupSetBits(g_state_events, bits);
+  } else {
+    xEventGroupClearBits(g_state_events, bits);
+  }
+
+  app_state_msg_t msg = { .changed = old ^ now, .state = now, .time_us = esp_timer_get_time() };
+  g_stats.transitions++;
+  if (xQueueSend(g_state_queue, &msg, 0) != pdTRUE) {
+    g_stats.dropped++;
+  }
+  xSemaphoreGive(g_state_lock);
+}
+
+void app_state_set(app_state_t bits)
+{
+  _update(bits, true);
+}
+
+void app_state_clear(app_state_t bits)
+{
+  _update(bits, false);
+}
+
+app_state_t app_state_get(void)
+{
+  _objects_init();
+  return (app_state_t)xEventGroupGetBits(g_state_events);
+}
+
+bool app_state_has(app_state_t bits)
+{
+  return (app_state_get() & bits) == bits;
+}
+
+bool app_state_wait(app_state_t bits, uint32_t timeout_ms)
+{
+  _objects_init();
+  TickType_t ticks = timeout_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+  EventBits_t got = xEventGroupWaitBits(g_state_events, bits, pdFALSE, pdTRUE, ticks);
+  return (got & bits) == bits;
+}
+
+int app_state_subscribe(app_state_cb_t cb, void *ctx)
+{
+  if (!cb || g_sub_count >= APP_STATE_MAX_SUBSCRIBERS) {
+    return -1;
+  }
+
+  g_subs[g_sub_count].cb  = cb;
+  g_subs[g_sub_count].ctx = ctx;
+  g_sub_count++;
+  return 0;
+}
+
+void app_state_get_stats(app_state_stats_t *stats)
+{
+  if (stats) {
+    *stats = g_stats;
+  }
+}
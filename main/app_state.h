@@ -0,0 +1,58 @@
+#ifndef APP_STATE_H
+#define APP_STATE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/* device state, one event group bit each */
+#define APP_STATE_WIFI_CONNECTED   (1 << 0)   // station has an IP address
+#define APP_STATE_SESSION_STARTED  (1 << 1)   // board is in the RTC channel
+#define APP_STATE_AGENT_JOINED     (1 << 2)   // conversational agent is in the channel
+
+#define APP_STATE_MAX_SUBSCRIBERS  (4)
+
+typedef uint32_t app_state_t;
+
+/* called on the app_state task for every change, in order.
+ * changed holds the bits that flipped, state the bits now set */
+typedef void (*app_state_cb_t)(app_state_t changed, app_state_t state, void *ctx);
+
+typedef struct {
+  uint32_t transitions;
+  uint32_t dropped;            // notifications lost to a full queue
+  uint32_t last_dispatch_us;   // change to the end of subscriber callbacks
+  uint32_t max_dispatch_us;
+  uint64_t total_dispatch_us;
+} app_state_stats_t;
+
+/* start the notification task, call once before anything changes state */
+void app_state_init(void);
+
+void app_state_set(app_state_t bits);
+
+void app_state_clear(app_state_t bits);
+
+app_state_t app_state_get(void);
+
+/* true if all bits are set */
+bool app_state_has(app_state_t bits);
+
+/* block until all bits are set, returns false on timeout */
+bool app_state_wait(app_state_t bits, uint32_t timeout_ms);
+
+int app_state_subscribe(app_state_cb_t cb, void *ctx);
+
+void app_state_get_stats(app_state_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
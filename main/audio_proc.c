@@ -23,7 +23,16 @@
 #include "audio_pipeline.h"
 
 #include "common.h"
+#include "audio_wdog.h"
+#include "app_state.h"
+#include "capture_policy.h"
+#include "media_clock.h"
+#include "metrics.h"
+#include "power_gov.h"
 #include "rtc_proc.h"
+#include "session_arena.h"
+#include "task_plan.h"
+#include "voice_sensor.h"
 
 
 
@@ -32,6 +41,19 @@ static audio_pipeline_handle_t recorder, player;
 static SemaphoreHandle_t g_audio_capture_sem  = NULL;
 static audio_thread_t *g_audio_thread;
 
+static METRIC_COUNTER(g_frames_captured, "audio.frames");
+static METRIC_COUNTER(g_short_reads, "audio.short_reads");
+static METRIC_GAUGE(g_playback_fill, "audio.playback_rb");   // bytes queued for the speaker
+
+#ifdef CONFIG_AUDIO_CAPTURE_STEREO
+/* both XVF3800 channels in 32-bit slots, reduced to mono by capture_policy */
+#define CAPTURE_FRAMES    (CONFIG_PCM_DATA_LEN / sizeof(int16_t))
+#define CAPTURE_READ_LEN  (CAPTURE_FRAMES * 2 * AUDIO_I2S_BITS / 8)
+static METRIC_GAUGE(g_capture_policy, "audio.capture_ch");
+#else
+#define CAPTURE_READ_LEN  CONFIG_PCM_DATA_LEN
+#endif
+
 audio_board_handle_t board_handle;
 
 
@@ -67,19 +89,41 @@ static esp_err_t recorder_pipeline_open(void)
   }
 
   i2s_stream_cfg_t i2s_cfg = I2S_STREAM_CFG_DEFAULT_WITH_PARA(CODEC_ADC_I2S_PORT, CONFIG_PCM_SAMPLE_RATE, AUDIO_I2S_BITS, AUDIO_STREAM_READER);
-  i2s_cfg.task_core     = 0;
-  i2s_cfg.stack_in_ext  = true;
+  i2s_cfg.task_core     = TASK_I2S_READ_CORE;
+  i2s_cfg.task_prio     = TASK_I2S_READ_PRIO;
+  i2s_cfg.task_stack    = TASK_I2S_READ_STACK;
+  i2s_cfg.stack_in_ext  = TASK_I2S_READ_PSRAM;
+#ifdef CONFIG_AUDIO_CAPTURE_STEREO
+  i2s_stream_set_channel_type(&i2s_cfg, I2S_CHANNEL_TYPE_RIGHT_LEFT);
+#else
   i2s_stream_set_channel_type(&i2s_cfg, I2S_CHANNEL_TYPE_ONLY_LEFT);
+#endif
   // i2s_cfg.out_rb_size  = 2 * 1024;
-  i2s_cfg.stack_in_ext  = true;
   i2s_stream_reader = i2s_stream_init(&i2s_cfg);
 
+#ifdef CONFIG_AUDIO_CAPTURE_STEREO
+  // no algorithm runs (algo_mask 0), the channel is picked in audio_send_thread
+  raw_stream_cfg_t raw_cfg = RAW_STREAM_CFG_DEFAULT();
+  raw_cfg.type        = AUDIO_STREAM_READER;
+  raw_cfg.out_rb_size = 4 * CAPTURE_READ_LEN;
+  raw_read = raw_stream_init(&raw_cfg);
+  audio_element_set_output_timeout(raw_read, portMAX_DELAY);
+
+  audio_pipeline_register(recorder, i2s_stream_reader, "i2s");
+  audio_pipeline_register(recorder, raw_read, "raw");
+
+  const char *link_tag[2] = { "i2s", "raw" };
+  audio_pipeline_link(recorder, &link_tag[0], 2);
+#else
   algorithm_stream_cfg_t algo_config = ALGORITHM_STREAM_CFG_DEFAULT();
   algo_config.input_type = ALGORITHM_STREAM_INPUT_TYPE1;
   //algo_config.algo_mask  = ALGORITHM_STREAM_USE_AEC;
   algo_config.algo_mask  = 0;
   algo_config.swap_ch    = true;
-  algo_config.task_stack = 8192;  // Increased from default to prevent stack overflow
+  algo_config.task_stack = TASK_AUDIO_ALGO_STACK;  // larger than the default to prevent stack overflow
+  algo_config.task_prio  = TASK_AUDIO_ALGO_PRIO;
+  algo_config.task_core  = TASK_AUDIO_ALGO_CORE;
+  algo_config.stack_in_ext = TASK_AUDIO_ALGO_PSRAM;
   element_algo = algo_stream_init(&algo_config);
   audio_element_set_music_info(element_algo, CONFIG_PCM_SAMPLE_RATE, 1, 16);
 
@@ -95,6 +139,7 @@ static esp_err_t recorder_pipeline_open(void)
 
   const char *link_tag[3] = { "i2s", "algo", "raw" };
   audio_pipeline_link(recorder, &link_tag[0], 3);
+#endif
 
   printf("audio recorder has been created\n");
   return ESP_OK;
@@ -117,7 +162,10 @@ static esp_err_t player_pipeline_open(void)
   i2s_stream_cfg_t i2s_cfg = I2S_STREAM_CFG_DEFAULT_WITH_PARA(CODEC_ADC_I2S_PORT, CONFIG_PCM_SAMPLE_RATE, AUDIO_I2S_BITS, AUDIO_STREAM_WRITER);
   i2s_cfg.need_expand  = true;
   i2s_stream_set_channel_type(&i2s_cfg, I2S_CHANNEL_TYPE_ONLY_LEFT);
-  i2s_cfg.stack_in_ext = true;
+  i2s_cfg.task_core    = TASK_I2S_WRITE_CORE;
+  i2s_cfg.task_prio    = TASK_I2S_WRITE_PRIO;
+  i2s_cfg.task_stack   = TASK_I2S_WRITE_STACK;
+  i2s_cfg.stack_in_ext = TASK_I2S_WRITE_PSRAM;
   i2s_stream_writer = i2s_stream_init(&i2s_cfg);
 
   audio_pipeline_register(player, raw_write, "raw");
@@ -135,16 +183,112 @@ static void _pipeline_close(audio_pipeline_handle_t handle)
   audio_pipeline_deinit(handle);
 }
 
+/* restart the capture side after persistent deadline misses, the player keeps going */
+static void recorder_pipeline_restart(void)
+{
+  audio_pipeline_stop(recorder);
+  audio_pipeline_wait_for_stop(recorder);
+  audio_pipeline_reset_ringbuffer(recorder);
+  audio_pipeline_reset_elements(recorder);
+  audio_pipeline_run(recorder);
+}
+
+#ifdef CONFIG_VOICE_SENSOR_GATE_UPLINK
+/* frames captured while the voice sensor keeps the uplink closed, the
+ * newest CONFIG_VOICE_SENSOR_PREROLL_FRAMES of them go out first on open */
+typedef struct {
+  uint8_t *pcm;
+  int64_t capture_us[CONFIG_VOICE_SENSOR_PREROLL_FRAMES];
+  int head;
+  int count;
+} uplink_preroll_t;
+
+static METRIC_COUNTER(g_gated_frames, "audio.gated_frames");
+
+static void preroll_push(uplink_preroll_t *pre, const uint8_t *frame, int64_t capture_us)
+{
+  if (!pre->pcm) {
+    return;
+  }
+  memcpy(pre->pcm + pre->head * CONFIG_PCM_DATA_LEN, frame, CONFIG_PCM_DATA_LEN);
+  pre->capture_us[pre->head] = capture_us;
+  pre->head = (pre->head + 1) % CONFIG_VOICE_SENSOR_PREROLL_FRAMES;
+  if (pre->count < CONFIG_VOICE_SENSOR_PREROLL_FRAMES) {
+    pre->count++;
+  }
+}
+
+static void preroll_flush(uplink_preroll_t *pre)
+{
+  int slot = (pre->head - pre->count + CONFIG_VOICE_SENSOR_PREROLL_FRAMES) % CONFIG_VOICE_SENSOR_PREROLL_FRAMES;
+  for (; pre->count > 0; pre->count--) {
+    send_rtc_audio_frame(pre->pcm + slot * CONFIG_PCM_DATA_LEN, CONFIG_PCM_DATA_LEN, pre->capture_us[slot]);
+    slot = (slot + 1) % CONFIG_VOICE_SENSOR_PREROLL_FRAMES;
+  }
+}
+#endif
+
+/* the buffers come from the session arena and are allocated again each
+ * time it is recycled */
+typedef struct {
+  uint8_t *pcm;          // the mono frame that goes to the uplink
+#ifdef CONFIG_AUDIO_CAPTURE_STEREO
+  int32_t *capture;      // reduced straight into pcm, no other copy
+#else
+  uint8_t *capture;
+#endif
+} audio_bufs_t;
+
+static bool _alloc_bufs(audio_bufs_t *bufs)
+{
+  // touched every frame, kept in internal RAM for the session
+  bufs->pcm = session_alloc(SESSION_MEM_INTERNAL, CONFIG_PCM_DATA_LEN);
+  if (!bufs->pcm) {
+    printf("Failed to alloc audio buffer!\n");
+    return false;
+  }
+
+#ifdef CONFIG_AUDIO_CAPTURE_STEREO
+  bufs->capture = session_alloc(SESSION_MEM_INTERNAL, CAPTURE_READ_LEN);
+  if (!bufs->capture) {
+    printf("Failed to alloc capture buffer!\n");
+    return false;
+  }
+#else
+  bufs->capture = bufs->pcm;
+#endif
+  return true;
+}
+
 static void audio_send_thread(void *arg)
 {
   int ret = 0;
+  audio_bufs_t bufs;
 
-  uint8_t *audio_pcm_buf = heap_caps_malloc(CONFIG_PCM_DATA_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-  if (!audio_pcm_buf) {
-    printf("Failed to alloc audio buffer!\n");
+  session_arena_retain();
+  if (!_alloc_bufs(&bufs)) {
     goto THREAD_END;
   }
 
+  metrics_register_counter(&g_frames_captured);
+  metrics_register_counter(&g_short_reads);
+  metrics_register_gauge(&g_playback_fill);
+
+#ifdef CONFIG_AUDIO_CAPTURE_STEREO
+  // picked by the agent control task when an agent session starts
+  capture_policy_t policy = capture_policy_get();
+  metrics_register_gauge(&g_capture_policy);
+  metric_set(&g_capture_policy, policy);
+  printf("capture: stereo, uplink takes the %s channel\n", capture_policy_name(policy));
+#endif
+
+#ifdef CONFIG_VOICE_SENSOR_GATE_UPLINK
+  uplink_preroll_t preroll = {
+    .pcm = session_alloc(SESSION_MEM_PSRAM, CONFIG_VOICE_SENSOR_PREROLL_FRAMES * CONFIG_PCM_DATA_LEN),
+  };
+  metrics_register_counter(&g_gated_frames);
+#endif
+
   recorder_pipeline_open();
   player_pipeline_open();
 
@@ -152,29 +296,95 @@ static void audio_send_thread(void *arg)
 
   audio_pipeline_run(recorder);
   audio_pipeline_run(player);
-  while (g_app.b_call_session_started) {
-    ret = raw_stream_read(raw_read, (char *)audio_pcm_buf, CONFIG_PCM_DATA_LEN);
-    if (ret != CONFIG_PCM_DATA_LEN) {
-      printf("read raw stream error, expect %d, but only %d\n", CONFIG_PCM_DATA_LEN, ret);
+  power_gov_set_media_running(true);
+
+  const audio_wdog_cfg_t wdog_cfg = {
+    .period_us       = CONFIG_AUDIO_FRAME_DURATION_MS * 1000,
+    .slack_us        = CONFIG_AUDIO_FRAME_DURATION_MS * 1000 / 2,
+    .window_us       = AUDIO_WDOG_WINDOW_MS * 1000,
+    .degrade_misses  = CONFIG_AUDIO_WDOG_DEGRADE_MISSES,
+    .restart_windows = CONFIG_AUDIO_WDOG_RESTART_WINDOWS,
+  };
+  audio_wdog_t wdog;
+  bool wdog_started = false;
+  bool agent_joined = false;
+
+  while (app_state_has(APP_STATE_SESSION_STARTED)) {
+    // the agent left, give the arena back so the next agent session starts from a clean one
+    bool joined = app_state_has(APP_STATE_AGENT_JOINED);
+    if (agent_joined && !joined && session_arena_recycle(SESSION_ARENA_RECYCLE_WAIT_MS)) {
+      if (!_alloc_bufs(&bufs)) {
+        break;
+      }
+#ifdef CONFIG_VOICE_SENSOR_GATE_UPLINK
+      preroll.pcm   = session_alloc(SESSION_MEM_PSRAM, CONFIG_VOICE_SENSOR_PREROLL_FRAMES * CONFIG_PCM_DATA_LEN);
+      preroll.count = 0;
+#endif
+      wdog_started = false;   // the wait is not a missed deadline
     }
+    agent_joined = joined;
+
+    ret = raw_stream_read(raw_read, (char *)bufs.capture, CAPTURE_READ_LEN);
+    metric_inc(&g_frames_captured);
+
+    // measured from the first frame, the pipeline start-up is not a miss
+    int64_t read_us = media_clock_now_us();
+    if (!wdog_started) {
+      audio_wdog_reset(&wdog, read_us);
+      wdog_started = true;
+    } else {
+      uint32_t late_us = 0;
+      audio_wdog_action_t action = audio_wdog_tick(&wdog, &wdog_cfg, read_us, &late_us);
+      audio_wdog_handle(action, late_us, TASK_AUDIO_SEND_CORE);
+      if (action == AUDIO_WDOG_RESTART) {
+        recorder_pipeline_restart();
+        wdog_started = false;
+        continue;
+      }
+    }
+
+    if (ret != CAPTURE_READ_LEN) {
+      metric_inc(&g_short_reads);
+      printf("read raw stream error, expect %d, but only %d\n", CAPTURE_READ_LEN, ret);
+    }
+#ifdef CONFIG_AUDIO_CAPTURE_STEREO
+    if (capture_policy_get() != policy) {
+      policy = capture_policy_get();
+      metric_set(&g_capture_policy, policy);
+    }
+    capture_deinterleave_s32(bufs.capture, (int16_t *)bufs.pcm, CAPTURE_FRAMES, policy);
+#endif
+
+    // the read returns once the last sample of the frame is in, the frame started one period earlier
+    int64_t capture_us = media_clock_now_us() - CONFIG_AUDIO_FRAME_DURATION_MS * 1000;
+
+#ifdef CONFIG_VOICE_SENSOR_GATE_UPLINK
+    // nobody is talking, the XVF3800 says so without any DSP here
+    if (!voice_sensor_uplink_open()) {
+      preroll_push(&preroll, bufs.pcm, capture_us);
+      metric_inc(&g_gated_frames);
+      continue;
+    }
+    preroll_flush(&preroll);
+#endif
 
-    send_rtc_audio_frame(audio_pcm_buf, CONFIG_PCM_DATA_LEN);
+    send_rtc_audio_frame(bufs.pcm, CONFIG_PCM_DATA_LEN, capture_us);
   }
 
   //deinit
+  power_gov_set_media_running(false);
   _pipeline_close(player);
   _pipeline_close(recorder);
 
 THREAD_END:
-  if (audio_pcm_buf) {
-    free(audio_pcm_buf);
-  }
+  session_arena_release();
 
   vTaskDelete(NULL);
 }
 
 int playback_stream_write(char *data, int len)
 {
+  metric_set(&g_playback_fill, rb_bytes_filled(audio_element_get_output_ringbuf(raw_write)));
   return raw_stream_write(raw_write, data, len);
 }
 
@@ -186,9 +396,24 @@ void setup_audio(void)
   printf("setup_audio: audio_board initialized\n");
 }
 
+#ifdef CONFIG_AUDIO_CAPTURE_STEREO
+/* ties the channel to the agent, whose server-side transcripts carry its agent_id */
+static void _on_app_state(app_state_t changed, app_state_t state, void *ctx)
+{
+  if ((changed & APP_STATE_AGENT_JOINED) && (state & APP_STATE_AGENT_JOINED)) {
+    printf("capture: agent %s hears the %s channel\n", g_app.agent_id, capture_policy_name(capture_policy_get()));
+  }
+}
+#endif
+
 int audio_start_proc(void)
 {
-  int rval = audio_thread_create(g_audio_thread, "audio_send_task", audio_send_thread, NULL, 4 * 1024, PRIO_TASK_FETCH, true, 0);
+#ifdef CONFIG_AUDIO_CAPTURE_STEREO
+  app_state_subscribe(_on_app_state, NULL);
+#endif
+
+  int rval = audio_thread_create(g_audio_thread, "audio_send_task", audio_send_thread, NULL, TASK_AUDIO_SEND_STACK,
+                                 TASK_AUDIO_SEND_PRIO, TASK_AUDIO_SEND_PSRAM, TASK_AUDIO_SEND_CORE);
   if (rval != ESP_OK) {
     printf("Unable to create audio capture thread!\n");
     return -1;
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "audio_wdog.h"
+#include "load_gov.h"
+#include "metrics.h"
+
+/* The capture loop wakes once per frame. An iteration that comes later
+ * than a period plus slack means the I2S ring buffer filled up while the
+ * loop was blocked or starved, and samples are about to be dropped.
+ * Escalation: every miss is counted, the first in a window is logged with
+ * the busiest other task, repeated misses shed load through the load
+ * governor, and misses that persist anyway restart the capture pipeline. */
+
+#define WDOG_MAX_TASKS  (40)
+
+static METRIC_COUNTER(g_miss_counter, "audio.deadline_miss");
+static METRIC_COUNTER(g_restart_counter, "audio.pipeline_restart");
+static METRIC_HIST(g_late_hist, "audio.late_ms", 5, 10, 20, 40, 80, 160, 320);
+static bool g_metrics_registered = false;
+
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+/* run-time counters of the last load_gov sample, to find who ran instead */
+static TaskHandle_t g_base_handle[WDOG_MAX_TASKS];
+static uint32_t g_base_runtime[WDOG_MAX_TASKS];
+static int g_base_count = 0;
+static uint32_t g_base_total = 0;
+
+/* a miss waiting to be explained by the next sample */
+static bool g_pending = false;
+static uint32_t g_pending_late_us = 0;
+static int g_pending_core = 0;
+static TaskHandle_t g_pending_self = NULL;
+#endif
+
+void audio_wdog_reset(audio_wdog_t *wdog, int64_t now_us)
+{
+  memset(wdog, 0, sizeof(*wdog));
+  wdog->last_us         = now_us;
+  wdog->window_start_us = now_us;
+}
+
+audio_wdog_action_t audio_wdog_tick(audio_wdog_t *wdog, const audio_wdog_cfg_t *cfg, int64_t now_us,
+                                    uint32_t *late_us)
+{
+  audio_wdog_action_t action = AUDIO_WDOG_OK;
+  int64_t gap = now_us - wdog->last_us;
+  wdog->last_us = now_us;
+  *late_us = 0;
+
+  if (now_us - wdog->window_start_us >= cfg->window_us) {
+    wdog->bad_windows     = wdog->window_misses >= cfg->degrade_misses ? wdog->bad_windows + 1 : 0;
+    wdog->window_misses   = 0;
+    wdog->window_start_us = now_us;
+    if (wdog->bad_windows >= cfg->restart_windows) {
+      wdog->bad_windows = 0;
+      action = AUDIO_WDOG_RESTART;
+    }
+  }
+
+  if (gap > (int64_t)(cfg->period_us + cfg->slack_us)) {
+    *late_us = (uint32_t)(gap - cfg->period_us);
+    wdog->total_misses++;
+    wdog->window_misses++;
+    if (*late_us > wdog->max_late_us) {
+      wdog->max_late_us = *late_us;
+    }
+    if (action == AUDIO_WDOG_OK) {
+      action = wdog->window_misses >= cfg->degrade_misses ? AUDIO_WDOG_DEGRADE : AUDIO_WDOG_LOG;
+    }
+  }
+
+  return action;
+}
+
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+static uint32_t _base_runtime(TaskHandle_t handle)
+{
+  for (int i = 0; i < g_base_count; i++) {
+    if (g_base_handle[i] == handle) {
+      return g_base_runtime[i];
+    }
+  }
+  return 0;
+}
+
+void audio_wdog_sample(const TaskStatus_t *tasks, int count, uint32_t total)
+{
+  char name[configMAX_TASK_NAME_LEN] = "?";
+  uint8_t pct = 0;
+
+  portENTER_CRITICAL(&g_lock);
+  bool pending  = g_pending;
+  uint32_t late = g_pending_late_us;
+  int core      = g_pending_core;
+  TaskHandle_t self = g_pending_self;
+  g_pending     = false;
+  portEXIT_CRITICAL(&g_lock);
+
+  if (pending) {
+    // the task other than the audio task and the idle task that ran most on core since the last sample
+    TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+    uint32_t elapsed  = total - g_base_total;
+    uint32_t best     = 0;
+
+    for (int i = 0; i < count; i++) {
+      if (tasks[i].xHandle == self || tasks[i].xHandle == idle) {
+        continue;
+      }
+      if (tasks[i].xCoreID != core && tasks[i].xCoreID != tskNO_AFFINITY) {
+        continue;
+      }
+      uint32_t delta = tasks[i].ulRunTimeCounter - _base_runtime(tasks[i].xHandle);
+      if (delta > best) {
+        best = delta;
+        snprintf(name, sizeof(name), "%s", tasks[i].pcTaskName);
+        pct = elapsed ? (uint8_t)((uint64_t)delta * 100 / elapsed) : 0;
+      }
+    }
+    printf("audio_wdog: frame %lu ms late, busiest on core %d: %s (%u%%)\n", (unsigned long)(late / 1000), core,
+           name, pct);
+  }
+
+  g_base_count = 0;
+  for (int i = 0; i < count && i < WDOG_MAX_TASKS; i++) {
+    g_base_handle[g_base_count]  = tasks[i].xHandle;
+    g_base_runtime[g_base_count] = tasks[i].ulRunTimeCounter;
+    g_base_count++;
+  }
+  g_base_total = total;
+}
+#else
+void audio_wdog_sample(const TaskStatus_t *tasks, int count, uint32_t total)
+{
+}
+#endif
+
+void audio_wdog_handle(audio_wdog_action_t action, uint32_t late_us, int core)
+{
+  if (!g_metrics_registered) {
+    metrics_register_counter(&g_miss_counter);
+    metrics_register_counter(&g_restart_counter);
+    metrics_register_hist(&g_late_hist);
+    g_metrics_registered = true;
+  }
+
+  if (late_us) {
+    metric_inc(&g_miss_counter);
+    metric_observe(&g_late_hist, late_us / 1000);
+  }
+
+  switch (action) {
+    case AUDIO_WDOG_OK:
+      break;
+
+    case AUDIO_WDOG_LOG:
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+      // named by the next load_gov sample, the audio task never walks the task list
+      portENTER_CRITICAL(&g_lock);
+      if (!g_pending) {
+        g_pending         = true;
+        g_pending_late_us = late_us;
+        g_pending_core    = core;
+        g_pending_self    = xTaskGetCurrentTaskHandle();
+      }
+      portEXIT_CRITICAL(&g_lock);
+#else
+      printf("audio_wdog: frame %lu ms late on core %d\n", (unsigned long)(late_us / 1000), core);
+#endif
+      break;
+
+    case AUDIO_WDOG_DEGRADE:
+      load_gov_note_deadline_miss();
+      break;
+
+    case AUDIO_WDOG_RESTART:
+      metric_inc(&g_restart_counter);
+      printf("audio_wdog: misses persist after degrading, restarting the capture pipeline\n");
+      break;
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef AUDIO_WDOG_H
+#define AUDIO_WDOG_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* misses in one window that make the board shed load */
+#ifndef CONFIG_AUDIO_WDOG_DEGRADE_MISSES
+#define CONFIG_AUDIO_WDOG_DEGRADE_MISSES  (3)
+#endif
+
+/* windows in a row at that rate before the capture pipeline is restarted */
+#ifndef CONFIG_AUDIO_WDOG_RESTART_WINDOWS
+#define CONFIG_AUDIO_WDOG_RESTART_WINDOWS (5)
+#endif
+
+#define AUDIO_WDOG_WINDOW_MS              (1000)
+
+typedef enum {
+  AUDIO_WDOG_OK = 0,
+  AUDIO_WDOG_LOG,          // first miss in the window
+  AUDIO_WDOG_DEGRADE,      // repeated misses, shed load
+  AUDIO_WDOG_RESTART,      // still missing after degrading, restart the pipeline
+} audio_wdog_action_t;
+
+typedef struct {
+  uint32_t period_us;      // one frame
+  uint32_t slack_us;       // lateness tolerated before it is a miss
+  uint32_t window_us;
+  uint8_t  degrade_misses;
+  uint8_t  restart_windows;
+} audio_wdog_cfg_t;
+
+typedef struct {
+  int64_t  last_us;        // previous iteration, 0 before the first
+  int64_t  window_start_us;
+  uint32_t window_misses;
+  uint8_t  bad_windows;    // windows in a row that reached degrade_misses
+  uint32_t total_misses;
+  uint32_t max_late_us;
+} audio_wdog_t;
+
+/* start measuring, also after a pipeline restart */
+void audio_wdog_reset(audio_wdog_t *wdog, int64_t now_us);
+
+/* one loop iteration at now_us. A pure function of the clock it is given,
+ * late_us is set to how far past the deadline the iteration came */
+audio_wdog_action_t audio_wdog_tick(audio_wdog_t *wdog, const audio_wdog_cfg_t *cfg, int64_t now_us,
+                                    uint32_t *late_us);
+
+/* count and escalate a miss reported by audio_wdog_tick(), on the audio
+ * task. Logging is left to audio_wdog_sample() */
+void audio_wdog_handle(audio_wdog_action_t action, uint32_t late_us, int core);
+
+/* the run-time stats load_gov has just taken, from its timer. Logs a miss
+ * reported since the previous call with the hottest other task on its core,
+ * then keeps the counters as the baseline for the next one */
+void audio_wdog_sample(const TaskStatus_t *tasks, int count, uint32_t total);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+#include "boot_seq.h"
+#include "task_plan.h"
+
+/* Every step gets a short-lived task that blocks on the event group until
+ * its dependencies are set, so independent chains (Wi-Fi vs codec, I2C and
+ * pipelines) overlap instead of running one after the other. esp_timer
+ * starts counting during startup, its time is used as time since reset. */
+
+typedef struct {
+  const boot_step_t *step;
+  int64_t start_us;   // dependencies met, run() called
+  int64_t end_us;     // run() returned
+  int64_t done_us;    // milestone set
+} boot_record_t;
+
+static EventGroupHandle_t g_boot_events = NULL;
+static StaticEventGroup_t g_boot_events_buf;
+static boot_record_t g_records[BOOT_SEQ_MAX_STEPS];
+static int g_record_count = 0;
+
+static EventGroupHandle_t _events(void)
+{
+  if (g_boot_events == NULL) {
+    g_boot_events = xEventGroupCreateStatic(&g_boot_events_buf);
+  }
+  return g_boot_events;
+}
+
+static int _ms(int64_t us)
+{
+  return us ? (int)(us / 1000) : -1;
+}
+
+static void _step_task(void *arg)
+{
+  boot_record_t *rec = (boot_record_t *)arg;
+  const boot_step_t *step = rec->step;
+
+  if (step->deps) {
+    xEventGroupWaitBits(_events(), step->deps, pdFALSE, pdTRUE, portMAX_DELAY);
+  }
+  rec->start_us = esp_timer_get_time();
+  step->run();
+  rec->end_us = esp_timer_get_time();
+
+  if (!step->async) {
+    boot_seq_signal(step->done);
+  }
+
+  vTaskDelete(NULL);
+}
+
+int boot_seq_start(const boot_step_t *steps, int count)
+{
+  _events();
+
+  for (int i = 0; i < count; i++) {
+    if (g_record_count >= BOOT_SEQ_MAX_STEPS) {
+      printf("boot_seq: too many steps, '%s' not started\n", steps[i].name);
+      return -1;
+    }
+
+    boot_record_t *rec = &g_records[g_record_count++];
+    memset(rec, 0, sizeof(*rec));
+    rec->step = &steps[i];
+
+    uint32_t stack = steps[i].stack_size ? steps[i].stack_size : BOOT_SEQ_STACK_SIZE;
+    if (xTaskCreatePinnedToCore(_step_task, steps[i].name, stack, rec, TASK_BOOT_STEP_PRIO, NULL,
+                                TASK_BOOT_STEP_CORE) != pdPASS) {
+      printf("boot_seq: failed to start step '%s'\n", steps[i].name);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void boot_seq_signal(EventBits_t bits)
+{
+  int64_t now = esp_timer_get_time();
+
+  for (int i = 0; i < g_record_count; i++) {
+    if ((g_records[i].step->done & bits) && g_records[i].done_us == 0) {
+      g_records[i].done_us = now;
+    }
+  }
+
+  xEventGroupSetBits(_events(), bits);
+}
+
+bool boot_seq_wait(EventBits_t bits, uint32_t timeout_ms)
+{
+  TickType_t ticks = timeout_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+  EventBits_t got = xEventGroupWaitBits(_events(), bits, pdFALSE, pdTRUE, ticks);
+  return (got & bits) == bits;
+}
+
+void boot_seq_report(void)
+{
+  printf("========================================\n");
+  printf("Boot report (ms since reset)\n");
+  printf("  %-12s %7s %7s %7s %7s\n", "step", "start", "end", "done", "run");
+  for (int i = 0; i < g_record_count; i++) {
+    const boot_record_t *rec = &g_records[i];
+    int run_ms = rec->end_us ? (int)((rec->end_us - rec->start_us) / 1000) : -1;
+    printf("  %-12s %7d %7d %7d %7d\n", rec->step->name, _ms(rec->start_us), _ms(rec->end_us),
+           _ms(rec->done_us), run_ms);
+  }
+  printf("========================================\n");
+}
@@ -0,0 +1,57 @@
+#ifndef BOOT_SEQ_H
+#define BOOT_SEQ_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+#include "task_plan.h"
+
+#define BOOT_SEQ_MAX_STEPS    (12)
+#define BOOT_SEQ_STACK_SIZE   TASK_BOOT_STEP_STACK
+
+/* boot milestones, one event group bit each */
+#define BOOT_EVT_NVS          (1 << 0)   // NVS ready, agent state loaded
+#define BOOT_EVT_WIFI         (1 << 1)   // station has an IP address
+#define BOOT_EVT_CODEC        (1 << 2)   // audio board, I2C bus and codec up
+#define BOOT_EVT_BUTTON       (1 << 3)   // XVF3800 found, button monitor running
+#define BOOT_EVT_AUDIO        (1 << 4)   // audio task started, waiting for the channel
+#define BOOT_EVT_AGENT_NET    (1 << 5)   // agent API host resolved
+#define BOOT_EVT_RTC          (1 << 6)   // board has joined the RTC channel
+
+/* the board reacts to the SET button once these are set */
+#define BOOT_EVT_READY        (BOOT_EVT_BUTTON | BOOT_EVT_RTC)
+
+typedef struct {
+  const char *name;
+  EventBits_t done;        // milestone this step completes
+  EventBits_t deps;        // milestones that must be reached before it runs
+  void (*run)(void);
+  bool async;              // done is signalled later with boot_seq_signal()
+  uint32_t stack_size;     // 0 for BOOT_SEQ_STACK_SIZE
+} boot_step_t;
+
+/* start every step in its own task, each runs as soon as its dependencies
+ * are met. steps must stay valid until boot_seq_wait() has returned */
+int boot_seq_start(const boot_step_t *steps, int count);
+
+/* mark milestones as reached, safe to call before boot_seq_start() */
+void boot_seq_signal(EventBits_t bits);
+
+/* wait for milestones, returns false on timeout */
+bool boot_seq_wait(EventBits_t bits, uint32_t timeout_ms);
+
+/* print when each step became runnable, ran and completed, in ms since reset */
+void boot_seq_report(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
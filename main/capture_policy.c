@@ -0,0 +1,107 @@
+#include <stdio.h>
+
+#include "nvs.h"
+
+#include "common.h"
+#include "capture_policy.h"
+
+#define CAPTURE_NVS_NAMESPACE  "capture"
+#define CAPTURE_NVS_KEY_NEXT   "ab_next"
+
+static volatile capture_policy_t g_policy = CONFIG_AUDIO_CAPTURE_CHANNEL;
+static volatile int g_override = -1;
+
+const char *capture_policy_name(capture_policy_t policy)
+{
+  switch (policy) {
+    case CAPTURE_CH_LEFT:  return "left";
+    case CAPTURE_CH_RIGHT: return "right";
+    case CAPTURE_CH_MIX:   return "mix";
+    default:               return "?";
+  }
+}
+
+/* XVF3800 samples are 16 bits of audio in the top half of each 32-bit slot.
+ * A plain C loop unrolled by four with a scalar tail, not vectorized: no
+ * S3 SIMD instructions are used, whatever the compiler makes of it */
+void capture_deinterleave_s32(const int32_t *stereo, int16_t *mono, int frames, capture_policy_t policy)
+{
+  int i = 0;
+
+  switch (policy) {
+    case CAPTURE_CH_RIGHT:
+      stereo += 1;
+      // fall through, the right channel is the left one shifted by a sample
+    case CAPTURE_CH_LEFT:
+      for (; i + 4 <= frames; i += 4) {
+        mono[i]     = (int16_t)(stereo[2 * i] >> 16);
+        mono[i + 1] = (int16_t)(stereo[2 * i + 2] >> 16);
+        mono[i + 2] = (int16_t)(stereo[2 * i + 4] >> 16);
+        mono[i + 3] = (int16_t)(stereo[2 * i + 6] >> 16);
+      }
+      for (; i < frames; i++) {
+        mono[i] = (int16_t)(stereo[2 * i] >> 16);
+      }
+      break;
+
+    case CAPTURE_CH_MIX:
+    default:
+      for (; i + 4 <= frames; i += 4) {
+        mono[i]     = (int16_t)(((stereo[2 * i] >> 16) + (stereo[2 * i + 1] >> 16)) >> 1);
+        mono[i + 1] = (int16_t)(((stereo[2 * i + 2] >> 16) + (stereo[2 * i + 3] >> 16)) >> 1);
+        mono[i + 2] = (int16_t)(((stereo[2 * i + 4] >> 16) + (stereo[2 * i + 5] >> 16)) >> 1);
+        mono[i + 3] = (int16_t)(((stereo[2 * i + 6] >> 16) + (stereo[2 * i + 7] >> 16)) >> 1);
+      }
+      for (; i < frames; i++) {
+        mono[i] = (int16_t)(((stereo[2 * i] >> 16) + (stereo[2 * i + 1] >> 16)) >> 1);
+      }
+      break;
+  }
+}
+
+void capture_policy_set(capture_policy_t policy)
+{
+  if (policy < CAPTURE_CH_COUNT) {
+    g_override = policy;
+  }
+}
+
+#ifdef CONFIG_AUDIO_CAPTURE_AB_TEST
+/* the rotation survives reboots, there is usually one session per boot */
+static capture_policy_t _ab_next(void)
+{
+  nvs_handle_t nvs;
+  uint8_t next = CONFIG_AUDIO_CAPTURE_CHANNEL;
+
+  if (nvs_open(CAPTURE_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+    return CONFIG_AUDIO_CAPTURE_CHANNEL;
+  }
+  if (nvs_get_u8(nvs, CAPTURE_NVS_KEY_NEXT, &next) != ESP_OK || next >= CAPTURE_CH_COUNT) {
+    next = CONFIG_AUDIO_CAPTURE_CHANNEL;
+  }
+  if (nvs_set_u8(nvs, CAPTURE_NVS_KEY_NEXT, (next + 1) % CAPTURE_CH_COUNT) == ESP_OK) {
+    nvs_commit(nvs);
+  }
+  nvs_close(nvs);
+  return (capture_policy_t)next;
+}
+#endif
+
+capture_policy_t capture_policy_session_begin(void)
+{
+  if (g_override >= 0) {
+    g_policy = (capture_policy_t)g_override;
+  } else {
+#ifdef CONFIG_AUDIO_CAPTURE_AB_TEST
+    g_policy = _ab_next();
+#else
+    g_policy = CONFIG_AUDIO_CAPTURE_CHANNEL;
+#endif
+  }
+  return g_policy;
+}
+
+capture_policy_t capture_policy_get(void)
+{
+  return g_policy;
+}
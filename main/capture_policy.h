@@ -0,0 +1,50 @@
+#ifndef CAPTURE_POLICY_H
+#define CAPTURE_POLICY_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* With CONFIG_AUDIO_CAPTURE_STEREO both XVF3800 output channels are
+ * captured and one of them, or their mix, goes to the uplink. Which one is
+ * fixed for an agent session. With CONFIG_AUDIO_CAPTURE_AB_TEST the policy rotates
+ * from one session to the next, and is logged with the agent_id so that
+ * server-side ASR results can be compared per channel. */
+
+typedef enum {
+  CAPTURE_CH_LEFT = 0,
+  CAPTURE_CH_RIGHT,
+  CAPTURE_CH_MIX,        // average of both
+  CAPTURE_CH_COUNT
+} capture_policy_t;
+
+/* the policy used when no A/B test runs and none was set */
+#ifndef CONFIG_AUDIO_CAPTURE_CHANNEL
+#define CONFIG_AUDIO_CAPTURE_CHANNEL  CAPTURE_CH_LEFT
+#endif
+
+const char *capture_policy_name(capture_policy_t policy);
+
+/* 32-bit interleaved stereo to 16-bit mono, keeping the top 16 bits.
+ * Scalar, unrolled by four; stereo and mono must not overlap */
+void capture_deinterleave_s32(const int32_t *stereo, int16_t *mono, int frames, capture_policy_t policy);
+
+/* use policy from the next session on, overrides the A/B rotation */
+void capture_policy_set(capture_policy_t policy);
+
+/* pick the policy for an agent session that is starting, called once per
+ * session on the agent control task. May write NVS, so never call it from a
+ * task whose stack is in PSRAM */
+capture_policy_t capture_policy_session_begin(void);
+
+/* the policy of the current session, cheap enough to read every frame */
+capture_policy_t capture_policy_get(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -5,14 +5,19 @@ extern "C" {
 #endif
 
 #include <stdlib.h>
+#include "sdkconfig.h"
 #include "app_config.h"
 
+/* video is opt-in with CONFIG_VIDEO_ENABLE, without it the build is audio-only */
+#if !defined(CONFIG_VIDEO_ENABLE) && !defined(CONFIG_AUDIO_ONLY)
+#define CONFIG_AUDIO_ONLY
+#endif
+
 #define RTC_APP_ID_LEN   32
 #define RTC_TOKEN_LEN    512
 #define AGENT_ID_LEN     64
 
 #define AUDIO_I2S_BITS   32
-#define PRIO_TASK_FETCH (21)
 
 #if defined(CONFIG_USE_G722_CODEC)
 #define AUDIO_CODEC_TYPE AUDIO_CODEC_TYPE_G722
@@ -36,11 +41,7 @@ extern "C" {
 
 
 typedef struct {
-  bool b_wifi_connected;
-  bool b_ai_agent_generated;
-  bool b_call_session_started;
-  bool b_ai_agent_joined;
-
+  /* connection and agent flags live in app_state.h */
   char app_id[RTC_APP_ID_LEN];
   char token[RTC_TOKEN_LEN];
   char agent_id[AGENT_ID_LEN];
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "conv_latency.h"
+
+/* The user hears the agent CONV_LAT_TURN after they stop talking. The end of
+ * speech is found on the uplink with an energy detector against a tracked
+ * noise floor; the reply is the first downlink frame from the agent that is
+ * not silence. Both are stamped on the media clock.
+ *
+ * Each field has a single writer: the VAD state belongs to the audio task,
+ * the reply side to the RTC callback and the session times to the agent
+ * control task. Times are kept in 32 bit ms so that no lock is needed. */
+
+#define FLOOR_EMA_SHIFT  (4)  // 1/16 weight for the newest quiet frame
+
+static const uint32_t g_bin_edges[CONV_HIST_BINS] = {
+  100, 200, 300, 400, 500, 750, 1000, 1500, 2000, 3000, 5000, UINT32_MAX,
+};
+
+static const char *const g_metric_names[CONV_LAT_COUNT] = {
+  "turn", "press->join", "join->greeting",
+};
+
+/* uplink speech detector, audio task only */
+static struct {
+  uint32_t floor;
+  bool     floor_valid;
+  int      speech_ms;
+  int      silence_ms;
+  bool     in_speech;
+  uint32_t speech_end_ms;
+} g_vad;
+
+static struct {
+  volatile uint32_t eos_ms;             // end of the last user turn
+  volatile bool     eos_pending;
+  volatile uint32_t agent_audio_ms;     // last audible agent frame
+  volatile uint32_t agent_burst_ms;     // first frame of the agent audio going on
+  volatile bool     agent_audio_valid;
+
+  volatile uint32_t press_ms;
+  volatile bool     press_pending;
+  volatile uint32_t joined_ms;
+  volatile bool     greeting_pending;
+  volatile bool     session_open;
+
+  volatile uint32_t turns;
+  volatile uint32_t unanswered;
+} g_conv;
+
+static conv_hist_t g_session[CONV_LAT_COUNT];
+static conv_hist_t g_total[CONV_LAT_COUNT];
+
+static uint32_t _ms(int64_t us)
+{
+  return (uint32_t)(us / 1000);
+}
+
+static uint32_t _mean_abs(const int16_t *pcm, int samples)
+{
+  if (samples <= 0) {
+    return 0;
+  }
+
+  uint32_t sum = 0;
+  for (int i = 0; i < samples; i++) {
+    int32_t s = pcm[i];
+    sum += (uint32_t)(s < 0 ? -s : s);
+  }
+  return sum / (uint32_t)samples;
+}
+
+static void _hist_add(conv_hist_t *h, uint32_t ms)
+{
+  int bin = 0;
+  while (bin < CONV_HIST_BINS - 1 && ms > g_bin_edges[bin]) {
+    bin++;
+  }
+  h->bins[bin]++;
+
+  if (h->count == 0 || ms < h->min_ms) {
+    h->min_ms = ms;
+  }
+  if (ms > h->max_ms) {
+    h->max_ms = ms;
+  }
+  h->total_ms += ms;
+  h->count++;
+}
+
+static void _record(conv_lat_metric_t metric, uint32_t ms)
+{
+  _hist_add(&g_session[metric], ms);
+  _hist_add(&g_total[metric], ms);
+}
+
+/* upper bin edge below which pct percent of the samples fall */
+static uint32_t _percentile(const conv_hist_t *h, int pct)
+{
+  uint32_t want = (h->count * (uint32_t)pct + 99) / 100;
+  uint32_t seen = 0;
+
+  for (int i = 0; i < CONV_HIST_BINS; i++) {
+    seen += h->bins[i];
+    if (seen >= want) {
+      return i == CONV_HIST_BINS - 1 ? h->max_ms : g_bin_edges[i];
+    }
+  }
+  return h->max_ms;
+}
+
+static void _dump(const char *scope, conv_lat_metric_t metric, const conv_hist_t *h)
+{
+  if (h->count == 0) {
+    return;
+  }
+
+  printf("conv_latency %s [%s]: n=%lu min=%lu avg=%lu max=%lu p50<=%lu p90<=%lu ms\n", scope,
+         g_metric_names[metric], (unsigned long)h->count, (unsigned long)h->min_ms,
+         (unsigned long)(h->total_ms / h->count), (unsigned long)h->max_ms,
+         (unsigned long)_percentile(h, 50), (unsigned long)_percentile(h, 90));
+
+  char line[160];
+  int len = 0;
+  for (int i = 0; i < CONV_HIST_BINS && len < (int)sizeof(line); i++) {
+    if (g_bin_edges[i] == UINT32_MAX) {
+      len += snprintf(line + len, sizeof(line) - len, " >%lu:%lu", (unsigned long)g_bin_edges[i - 1],
+                      (unsigned long)h->bins[i]);
+    } else {
+      len += snprintf(line + len, sizeof(line) - len, " <=%lu:%lu", (unsigned long)g_bin_edges[i],
+                      (unsigned long)h->bins[i]);
+    }
+  }
+  printf("conv_latency %s [%s]:%s\n", scope, g_metric_names[metric], line);
+}
+
+void conv_latency_session_begin(int64_t now_us, bool joined)
+{
+  memset(g_session, 0, sizeof(g_session));
+  memset(&g_vad, 0, sizeof(g_vad));
+
+  g_conv.eos_pending      = false;
+  g_conv.turns            = 0;
+  g_conv.unanswered       = 0;
+  g_conv.press_ms         = _ms(now_us);
+  g_conv.press_pending    = !joined;
+  g_conv.session_open     = true;
+  if (joined) {
+    /* a warm agent joined in standby, its greeting went to the muted
+     * downlink long ago: measuring it now would hold the standby time */
+    g_conv.greeting_pending = false;
+  }
+}
+
+void conv_latency_agent_joined(int64_t now_us)
+{
+  uint32_t now = _ms(now_us);
+
+  if (g_conv.press_pending) {
+    g_conv.press_pending = false;
+    _record(CONV_LAT_PRESS_JOIN, now - g_conv.press_ms);
+  }
+  g_conv.joined_ms = now;
+  // a standby join outside a conversation has no greeting anyone hears
+  g_conv.greeting_pending = g_conv.session_open;
+}
+
+void conv_latency_capture_frame(const int16_t *pcm, int samples, int64_t capture_us, int frame_ms)
+{
+  uint32_t level = _mean_abs(pcm, samples);
+  uint32_t start = _ms(capture_us);
+
+  if (!g_vad.floor_valid) {
+    g_vad.floor       = level;
+    g_vad.floor_valid = true;
+  }
+
+  bool echo = g_conv.agent_audio_valid && (start - g_conv.agent_audio_ms) < CONV_ECHO_GUARD_MS;
+  bool loud = level > CONV_VAD_MIN_LEVEL && level > g_vad.floor * CONV_VAD_FLOOR_RATIO;
+
+  if (!loud) {
+    // only quiet frames move the floor, speech would drag it up
+    int32_t diff = (int32_t)level - (int32_t)g_vad.floor;
+    g_vad.floor  = (uint32_t)((int32_t)g_vad.floor + (diff >> FLOOR_EMA_SHIFT));
+  }
+
+  if (loud && !echo) {
+    g_vad.speech_ms += frame_ms;
+    g_vad.silence_ms = 0;
+    if (g_vad.speech_ms >= CONV_SPEECH_MIN_MS) {
+      g_vad.in_speech = true;
+    }
+    g_vad.speech_end_ms = start + (uint32_t)frame_ms;
+    return;
+  }
+
+  if (!g_vad.in_speech) {
+    g_vad.speech_ms = 0;
+    return;
+  }
+
+  g_vad.silence_ms += frame_ms;
+  if (g_vad.silence_ms >= CONV_EOS_HANGOVER_MS) {
+    // the turn ended with the last loud frame, not when the hangover ran out
+    g_conv.eos_ms      = g_vad.speech_end_ms;
+    g_conv.eos_pending = true;
+    g_vad.in_speech    = false;
+    g_vad.speech_ms    = 0;
+    g_vad.silence_ms   = 0;
+  }
+}
+
+void conv_latency_agent_audio(const int16_t *pcm, int samples, int64_t now_us)
+{
+  if (_mean_abs(pcm, samples) < CONV_AGENT_MIN_LEVEL) {
+    return;
+  }
+
+  uint32_t now = _ms(now_us);
+  if (!g_conv.agent_audio_valid || now - g_conv.agent_audio_ms > CONV_ECHO_GUARD_MS) {
+    g_conv.agent_burst_ms = now;
+  }
+  g_conv.agent_audio_ms    = now;
+  g_conv.agent_audio_valid = true;
+
+  if (g_conv.greeting_pending) {
+    g_conv.greeting_pending = false;
+    _record(CONV_LAT_JOIN_GREETING, now - g_conv.joined_ms);
+  }
+
+  if (g_conv.eos_pending) {
+    g_conv.eos_pending = false;
+    // a reply quicker than the hangover started before the end of the turn was known
+    uint32_t reply = (int32_t)(g_conv.agent_burst_ms - g_conv.eos_ms) > 0 ? g_conv.agent_burst_ms : now;
+    uint32_t ms = reply - g_conv.eos_ms;
+    if (ms > CONV_REPLY_TIMEOUT_MS) {
+      g_conv.unanswered++;
+      return;
+    }
+    g_conv.turns++;
+    _record(CONV_LAT_TURN, ms);
+  }
+}
+
+void conv_latency_session_end(void)
+{
+  g_conv.session_open     = false;
+  g_conv.greeting_pending = false;
+  g_conv.press_pending    = false;
+  if (g_conv.eos_pending) {
+    g_conv.eos_pending = false;
+    g_conv.unanswered++;
+  }
+
+  printf("conv_latency: session over, %lu turn(s) answered, %lu unanswered\n",
+         (unsigned long)g_conv.turns, (unsigned long)g_conv.unanswered);
+  for (int i = 0; i < CONV_LAT_COUNT; i++) {
+    _dump("session", (conv_lat_metric_t)i, &g_session[i]);
+  }
+  for (int i = 0; i < CONV_LAT_COUNT; i++) {
+    _dump("total", (conv_lat_metric_t)i, &g_total[i]);
+  }
+}
+
+uint32_t conv_latency_bin_edge(int bin)
+{
+  if (bin < 0 || bin >= CONV_HIST_BINS) {
+    return 0;
+  }
+  return g_bin_edges[bin];
+}
+
+void conv_latency_get_hist(conv_lat_metric_t metric, bool session, conv_hist_t *out)
+{
+  if (!out || metric >= CONV_LAT_COUNT) {
+    return;
+  }
+  *out = session ? g_session[metric] : g_total[metric];
+}
@@ -0,0 +1,84 @@
+#ifndef CONV_LATENCY_H
+#define CONV_LATENCY_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* mean |sample| the uplink must exceed, in addition to the noise floor ratio */
+#ifndef CONV_VAD_MIN_LEVEL
+#define CONV_VAD_MIN_LEVEL       (300)
+#endif
+/* speech must be this many times louder than the tracked noise floor */
+#ifndef CONV_VAD_FLOOR_RATIO
+#define CONV_VAD_FLOOR_RATIO     (3)
+#endif
+/* shorter bursts are clicks, not speech */
+#ifndef CONV_SPEECH_MIN_MS
+#define CONV_SPEECH_MIN_MS       (120)
+#endif
+/* silence after speech that makes it an end of turn */
+#ifndef CONV_EOS_HANGOVER_MS
+#define CONV_EOS_HANGOVER_MS     (400)
+#endif
+/* uplink speech this close to agent audio is taken for echo */
+#ifndef CONV_ECHO_GUARD_MS
+#define CONV_ECHO_GUARD_MS       (300)
+#endif
+/* downlink frames quieter than this are not agent speech */
+#ifndef CONV_AGENT_MIN_LEVEL
+#define CONV_AGENT_MIN_LEVEL     (100)
+#endif
+/* an end of turn without agent audio for this long went unanswered */
+#ifndef CONV_REPLY_TIMEOUT_MS
+#define CONV_REPLY_TIMEOUT_MS    (10000)
+#endif
+
+typedef enum {
+  CONV_LAT_TURN = 0,      // end of user speech -> first agent audio
+  CONV_LAT_PRESS_JOIN,    // button press -> agent joined
+  CONV_LAT_JOIN_GREETING, // agent joined -> first agent audio
+  CONV_LAT_COUNT,
+} conv_lat_metric_t;
+
+#define CONV_HIST_BINS  (12)
+
+typedef struct {
+  uint32_t bins[CONV_HIST_BINS];  // upper edges in conv_latency_bin_edge()
+  uint32_t count;
+  uint32_t min_ms;
+  uint32_t max_ms;
+  uint32_t total_ms;
+} conv_hist_t;
+
+/* a conversation starts, at the button press. joined is true when the agent
+ * is already in the channel (warm standby), press-to-join is not measured then */
+void conv_latency_session_begin(int64_t now_us, bool joined);
+
+/* the agent has joined the channel */
+void conv_latency_agent_joined(int64_t now_us);
+
+/* one uplink PCM frame as sent, capture_us is the time of its first sample */
+void conv_latency_capture_frame(const int16_t *pcm, int samples, int64_t capture_us, int frame_ms);
+
+/* one downlink PCM frame from the agent as it goes to playback, never
+ * while the downlink is muted */
+void conv_latency_agent_audio(const int16_t *pcm, int samples, int64_t now_us);
+
+/* the conversation is over, dump the session histograms */
+void conv_latency_session_end(void);
+
+/* upper edge of histogram bin i in ms, UINT32_MAX for the last one */
+uint32_t conv_latency_bin_edge(int bin);
+
+/* copy a histogram, session or since boot */
+void conv_latency_get_hist(conv_lat_metric_t metric, bool session, conv_hist_t *out);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
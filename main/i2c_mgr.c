@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "i2c_mgr.h"
+#include "metrics.h"
+#include "task_plan.h"
+
+#define I2C_RECOVER_CLOCKS      (9)
+#define I2C_HALF_CLOCK_US       (5)      // 100 kHz while bit-banging
+#define I2C_STUCK_SAMPLES       (20)     // 100 us of SDA low on an idle clock
+#define I2C_RECOVER_MIN_GAP_MS  (1000)
+#define I2C_DEV_NAME_LEN        (24)
+
+typedef struct {
+  uint8_t addr;
+  const i2c_op_t *ops;
+  int op_count;
+  uint32_t timeout_ms;
+  int64_t enqueued_us;
+  esp_err_t result;
+  SemaphoreHandle_t done;
+} i2c_req_t;
+
+typedef struct {
+  uint8_t addr;
+  uint32_t max_us;
+  char names[4][I2C_DEV_NAME_LEN];
+  metric_counter_t ok;
+  metric_counter_t errors;
+  metric_counter_t timeouts;
+  metric_hist_t latency;
+} i2c_dev_t;
+
+static i2c_port_t g_port = I2C_NUM_0;
+static int g_sda_gpio = -1;
+static int g_scl_gpio = -1;
+static int64_t g_last_recover_us = 0;
+static QueueHandle_t g_queues[I2C_PRIO_COUNT];
+static SemaphoreHandle_t g_pending = NULL;
+static TaskHandle_t g_task = NULL;
+
+static portMUX_TYPE g_dev_lock = portMUX_INITIALIZER_UNLOCKED;
+static i2c_dev_t g_devs[I2C_MGR_MAX_DEVICES];
+static int g_dev_count = 0;
+
+static METRIC_COUNTER(g_recoveries, "i2c.recoveries");
+static METRIC_COUNTER(g_queue_full, "i2c.queue_full");
+
+int i2c_sched_pick(const int64_t head_us[I2C_PRIO_COUNT], int64_t now_us, int64_t age_limit_us)
+{
+  int pick = -1;
+  int64_t oldest_overdue = 0;
+
+  for (int p = 0; p < I2C_PRIO_COUNT; p++) {
+    if (head_us[p] == 0) {
+      continue;
+    }
+    if (pick < 0) {
+      pick = p;
+    }
+    // a starved class jumps the queue, the longest waiting one first
+    if (now_us - head_us[p] > age_limit_us && (oldest_overdue == 0 || head_us[p] < oldest_overdue)) {
+      oldest_overdue = head_us[p];
+      pick = p;
+    }
+  }
+  return pick;
+}
+
+bool i2c_bus_recover(const i2c_recover_io_t *io)
+{
+  io->set_sda(io->ctx, 1);
+  io->set_scl(io->ctx, 1);
+  io->delay_half_clock(io->ctx);
+
+  // every clock lets the slave shift out one more bit of the byte it was sending
+  for (int i = 0; i < I2C_RECOVER_CLOCKS && !io->get_sda(io->ctx); i++) {
+    io->set_scl(io->ctx, 0);
+    io->delay_half_clock(io->ctx);
+    io->set_scl(io->ctx, 1);
+    io->delay_half_clock(io->ctx);
+  }
+
+  // STOP: SDA rises while SCL is high
+  io->set_scl(io->ctx, 0);
+  io->delay_half_clock(io->ctx);
+  io->set_sda(io->ctx, 0);
+  io->delay_half_clock(io->ctx);
+  io->set_scl(io->ctx, 1);
+  io->delay_half_clock(io->ctx);
+  io->set_sda(io->ctx, 1);
+  io->delay_half_clock(io->ctx);
+
+  return io->get_sda(io->ctx) != 0;
+}
+
+bool i2c_bus_stuck(const i2c_recover_io_t *io, int samples)
+{
+  for (int i = 0; i < samples; i++) {
+    if (io->get_sda(io->ctx) || !io->get_scl(io->ctx)) {
+      return false;
+    }
+    io->delay_half_clock(io->ctx);
+  }
+  return true;
+}
+
+static void _gpio_set_scl(void *ctx, int level)
+{
+  gpio_set_level(g_scl_gpio, level);
+}
+
+static void _gpio_set_sda(void *ctx, int level)
+{
+  gpio_set_level(g_sda_gpio, level);
+}
+
+static int _gpio_get_sda(void *ctx)
+{
+  return gpio_get_level(g_sda_gpio);
+}
+
+static int _gpio_get_scl(void *ctx)
+{
+  return gpio_get_level(g_scl_gpio);
+}
+
+static void _gpio_delay(void *ctx)
+{
+  esp_rom_delay_us(I2C_HALF_CLOCK_US);
+}
+
+static const i2c_recover_io_t g_gpio_io = {
+  .set_scl          = _gpio_set_scl,
+  .set_sda          = _gpio_set_sda,
+  .get_sda          = _gpio_get_sda,
+  .get_scl          = _gpio_get_scl,
+  .delay_half_clock = _gpio_delay,
+};
+
+/* After a failed batch, take the pins away from the peripheral, recover,
+ * and hand them back, but only if a slave really holds SDA. A timeout on
+ * its own is no reason: the legacy driver also times out waiting for its
+ * lock while audio_hal uses the port, and the XVF3800 stretches the clock
+ * while it is busy; clocking the bus then would corrupt that transfer. */
+static void _recover_bus(void)
+{
+  if (g_sda_gpio < 0 || g_scl_gpio < 0 || !i2c_bus_stuck(&g_gpio_io, I2C_STUCK_SAMPLES)) {
+    return;
+  }
+
+  int64_t now_us = esp_timer_get_time();
+  if (g_last_recover_us != 0 && now_us - g_last_recover_us < I2C_RECOVER_MIN_GAP_MS * 1000) {
+    return;
+  }
+  g_last_recover_us = now_us;
+
+  gpio_set_direction(g_sda_gpio, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_set_direction(g_scl_gpio, GPIO_MODE_INPUT_OUTPUT_OD);
+  bool released = i2c_bus_recover(&g_gpio_io);
+
+  i2c_set_pin(g_port, g_sda_gpio, g_scl_gpio, GPIO_PULLUP_ENABLE, GPIO_PULLUP_ENABLE, I2C_MODE_MASTER);
+  i2c_reset_tx_fifo(g_port);
+  i2c_reset_rx_fifo(g_port);
+
+  metric_inc(&g_recoveries);
+  printf("i2c_mgr: bus recovery %s\n", released ? "released SDA" : "failed, SDA still low");
+}
+
+static esp_err_t _run_op(uint8_t addr, const i2c_op_t *op, uint32_t timeout_ms)
+{
+  TickType_t ticks = pdMS_TO_TICKS(timeout_ms);
+
+  switch (op->type) {
+    case I2C_OP_WRITE:
+      return i2c_master_write_to_device(g_port, addr, op->tx, op->tx_len, ticks);
+    case I2C_OP_READ:
+      return i2c_master_read_from_device(g_port, addr, op->rx, op->rx_len, ticks);
+    case I2C_OP_WRITE_READ:
+      return i2c_master_write_read_device(g_port, addr, op->tx, op->tx_len, op->rx, op->rx_len, ticks);
+    case I2C_OP_PROBE: {
+      uint8_t link[I2C_LINK_RECOMMENDED_SIZE(1)];
+      i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
+      i2c_master_start(cmd);
+      i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
+      i2c_master_stop(cmd);
+      esp_err_t ret = i2c_master_cmd_begin(g_port, cmd, ticks);
+      i2c_cmd_link_delete_static(cmd);
+      return ret;
+    }
+    default:
+      return ESP_ERR_INVALID_ARG;
+  }
+}
+
+static i2c_dev_t *_find_dev(uint8_t addr)
+{
+  for (int i = 0; i < g_dev_count; i++) {
+    if (g_devs[i].addr == addr) {
+      return &g_devs[i];
+    }
+  }
+  return NULL;
+}
+
+static void _account(uint8_t addr, esp_err_t ret, int64_t enqueued_us)
+{
+  i2c_dev_t *dev = _find_dev(addr);
+  if (!dev) {
+    return;
+  }
+
+  uint32_t us = (uint32_t)(esp_timer_get_time() - enqueued_us);
+  metric_observe(&dev->latency, us);
+  if (ret == ESP_OK) {
+    metric_inc(&dev->ok);
+  } else if (ret == ESP_ERR_TIMEOUT) {
+    metric_inc(&dev->timeouts);
+  } else {
+    metric_inc(&dev->errors);
+  }
+
+  portENTER_CRITICAL(&g_dev_lock);
+  if (us > dev->max_us) {
+    dev->max_us = us;
+  }
+  portEXIT_CRITICAL(&g_dev_lock);
+}
+
+/* the ops of one batch back to back, stopping at the first failure */
+static esp_err_t _run_batch(i2c_req_t *req)
+{
+  esp_err_t ret = ESP_OK;
+
+  for (int i = 0; i < req->op_count && ret == ESP_OK; i++) {
+    ret = _run_op(req->addr, &req->ops[i], req->timeout_ms);
+  }
+
+  if (ret != ESP_OK) {
+    _recover_bus();
+  }
+
+  _account(req->addr, ret, req->enqueued_us);
+  return ret;
+}
+
+static void _dispatch_task(void *arg)
+{
+  while (1) {
+    xSemaphoreTake(g_pending, portMAX_DELAY);
+
+    int64_t head_us[I2C_PRIO_COUNT];
+    for (int p = 0; p < I2C_PRIO_COUNT; p++) {
+      i2c_req_t *head = NULL;
+      head_us[p] = xQueuePeek(g_queues[p], &head, 0) == pdTRUE ? head->enqueued_us : 0;
+    }
+
+    int p = i2c_sched_pick(head_us, esp_timer_get_time(), (int64_t)CONFIG_I2C_MGR_AGE_LIMIT_MS * 1000);
+    i2c_req_t *req = NULL;
+    if (p < 0 || xQueueReceive(g_queues[p], &req, 0) != pdTRUE) {
+      continue;
+    }
+
+    req->result = _run_batch(req);
+    xSemaphoreGive(req->done);
+  }
+}
+
+esp_err_t i2c_mgr_init(i2c_port_t port, int sda_gpio, int scl_gpio)
+{
+  if (g_task) {
+    return ESP_OK;
+  }
+
+  g_port     = port;
+  g_sda_gpio = sda_gpio;
+  g_scl_gpio = scl_gpio;
+
+  for (int p = 0; p < I2C_PRIO_COUNT; p++) {
+    g_queues[p] = xQueueCreate(I2C_MGR_QUEUE_LEN, sizeof(i2c_req_t *));
+    if (!g_queues[p]) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+  g_pending = xSemaphoreCreateCounting(I2C_PRIO_COUNT * I2C_MGR_QUEUE_LEN, 0);
+  if (!g_pending) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  metrics_register_counter(&g_recoveries);
+  metrics_register_counter(&g_queue_full);
+
+  if (task_plan_create(TASK_I2C_MGR, _dispatch_task, NULL, &g_task) != pdPASS) {
+    printf("i2c_mgr: failed to create the dispatcher\n");
+    return ESP_FAIL;
+  }
+
+  printf("i2c_mgr: port %d SDA %d SCL %d\n", port, sda_gpio, scl_gpio);
+  return ESP_OK;
+}
+
+esp_err_t i2c_mgr_add_device(uint8_t addr, const char *name)
+{
+  portENTER_CRITICAL(&g_dev_lock);
+  if (_find_dev(addr)) {
+    portEXIT_CRITICAL(&g_dev_lock);
+    return ESP_OK;
+  }
+  if (g_dev_count >= I2C_MGR_MAX_DEVICES) {
+    portEXIT_CRITICAL(&g_dev_lock);
+    return ESP_ERR_NO_MEM;
+  }
+  i2c_dev_t *dev = &g_devs[g_dev_count];
+  portEXIT_CRITICAL(&g_dev_lock);
+
+  memset(dev, 0, sizeof(*dev));
+  dev->addr = addr;
+  snprintf(dev->names[0], I2C_DEV_NAME_LEN, "i2c.%s.ok", name);
+  snprintf(dev->names[1], I2C_DEV_NAME_LEN, "i2c.%s.errors", name);
+  snprintf(dev->names[2], I2C_DEV_NAME_LEN, "i2c.%s.timeouts", name);
+  snprintf(dev->names[3], I2C_DEV_NAME_LEN, "i2c.%s.us", name);
+  dev->ok.name       = dev->names[0];
+  dev->errors.name   = dev->names[1];
+  dev->timeouts.name = dev->names[2];
+  dev->latency       = (metric_hist_t){ .name = dev->names[3], .edges = { 200, 500, 1000, 2000, 5000, 10000, 50000 } };
+
+  metrics_register_counter(&dev->ok);
+  metrics_register_counter(&dev->errors);
+  metrics_register_counter(&dev->timeouts);
+  metrics_register_hist(&dev->latency);
+
+  // published last, the dispatcher only looks at devices below the count
+  portENTER_CRITICAL(&g_dev_lock);
+  g_dev_count++;
+  portEXIT_CRITICAL(&g_dev_lock);
+  return ESP_OK;
+}
+
+esp_err_t i2c_mgr_transfer(uint8_t addr, i2c_prio_t prio, const i2c_op_t *ops, int op_count, uint32_t timeout_ms)
+{
+  if (!ops || op_count <= 0 || op_count > I2C_MGR_MAX_OPS || prio >= I2C_PRIO_COUNT) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  StaticSemaphore_t done_buf;
+  i2c_req_t req = {
+    .addr        = addr,
+    .ops         = ops,
+    .op_count    = op_count,
+    .timeout_ms  = timeout_ms,
+    .enqueued_us = esp_timer_get_time(),
+    .result      = ESP_FAIL,
+  };
+
+  // before the dispatcher exists the legacy driver's own lock is all there is
+  if (!g_task) {
+    return _run_batch(&req);
+  }
+
+  req.done = xSemaphoreCreateBinaryStatic(&done_buf);
+  i2c_req_t *ptr = &req;
+  if (xQueueSend(g_queues[prio], &ptr, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+    metric_inc(&g_queue_full);
+    return ESP_ERR_TIMEOUT;
+  }
+  xSemaphoreGive(g_pending);
+
+  // req lives on this stack, so wait for the dispatcher however long it takes;
+  // timeout_ms already bounds every op it runs
+  xSemaphoreTake(req.done, portMAX_DELAY);
+  return req.result;
+}
+
+int i2c_mgr_get_stats(i2c_mgr_dev_stats_t *stats, int max)
+{
+  int n = 0;
+
+  portENTER_CRITICAL(&g_dev_lock);
+  for (; n < g_dev_count && n < max; n++) {
+    stats[n].addr     = g_devs[n].addr;
+    stats[n].ok       = g_devs[n].ok.value;
+    stats[n].errors   = g_devs[n].errors.value;
+    stats[n].timeouts = g_devs[n].timeouts.value;
+    stats[n].max_us   = g_devs[n].max_us;
+  }
+  portEXIT_CRITICAL(&g_dev_lock);
+  return n;
+}
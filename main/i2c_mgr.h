@@ -0,0 +1,127 @@
+#ifndef I2C_MGR_H
+#define I2C_MGR_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "driver/i2c.h"
+
+/* One dispatcher task owns the shared I2C bus for the drivers in this
+ * application. Clients submit a batch of transactions for one device and
+ * block until it has run; the dispatcher always serves the most urgent
+ * class first, so a codec write never waits behind a queue of button polls,
+ * and the transactions of a batch run back to back without other traffic
+ * in between. Traffic from the ADF audio_hal goes through its own i2c_bus
+ * handle and is only serialised by the legacy driver. */
+
+/* a request waiting longer than this is served ahead of more urgent ones */
+#ifndef CONFIG_I2C_MGR_AGE_LIMIT_MS
+#define CONFIG_I2C_MGR_AGE_LIMIT_MS  (200)
+#endif
+
+#define I2C_MGR_MAX_DEVICES   (4)
+#define I2C_MGR_MAX_OPS       (8)     // transactions in one batch
+#define I2C_MGR_QUEUE_LEN     (8)     // pending requests per class
+
+typedef enum {
+  I2C_PRIO_CODEC = 0,      // codec setup and volume
+  I2C_PRIO_CONTROL,        // one-off device commands
+  I2C_PRIO_POLL,           // periodic reads such as the buttons
+  I2C_PRIO_COUNT
+} i2c_prio_t;
+
+typedef enum {
+  I2C_OP_WRITE = 0,
+  I2C_OP_READ,
+  I2C_OP_WRITE_READ,       // write then read after a repeated start
+  I2C_OP_PROBE,            // address only, ESP_OK when the device ACKs
+} i2c_op_type_t;
+
+typedef struct {
+  i2c_op_type_t type;
+  const uint8_t *tx;
+  size_t tx_len;
+  uint8_t *rx;
+  size_t rx_len;
+} i2c_op_t;
+
+#define I2C_OP_WR(buf, len)               { .type = I2C_OP_WRITE, .tx = (buf), .tx_len = (len) }
+#define I2C_OP_RD(buf, len)               { .type = I2C_OP_READ, .rx = (buf), .rx_len = (len) }
+#define I2C_OP_PROBE()                    { .type = I2C_OP_PROBE }
+#define I2C_OP_WR_RD(out, olen, in, ilen) \
+  { .type = I2C_OP_WRITE_READ, .tx = (out), .tx_len = (olen), .rx = (in), .rx_len = (ilen) }
+
+/* which class to serve next given the enqueue time of the head of every
+ * class, 0 for an empty class. A pure function; -1 when all are empty */
+int i2c_sched_pick(const int64_t head_us[I2C_PRIO_COUNT], int64_t now_us, int64_t age_limit_us);
+
+/* the pins of the bus, driven by hand during recovery */
+typedef struct {
+  void (*set_scl)(void *ctx, int level);
+  void (*set_sda)(void *ctx, int level);
+  int (*get_sda)(void *ctx);
+  int (*get_scl)(void *ctx);
+  void (*delay_half_clock)(void *ctx);
+  void *ctx;
+} i2c_recover_io_t;
+
+/* free a bus held by a slave that was cut off mid byte: clock SCL until the
+ * slave lets SDA go, at most nine times, then issue a STOP. Only uses io,
+ * returns whether SDA ended up high */
+bool i2c_bus_recover(const i2c_recover_io_t *io);
+
+/* whether a slave holds the bus: SDA low while SCL stays high at every one
+ * of samples half clocks. A transfer in progress, from this or another
+ * client, toggles SCL and a stretching slave holds it low, neither counts.
+ * Only reads io */
+bool i2c_bus_stuck(const i2c_recover_io_t *io, int samples);
+
+/* take over port, which the board or codec driver has already installed.
+ * The pins are used for recovery only */
+esp_err_t i2c_mgr_init(i2c_port_t port, int sda_gpio, int scl_gpio);
+
+/* per-device statistics are kept for the devices added here, name shows up
+ * in the i2c.<name>.* metrics */
+esp_err_t i2c_mgr_add_device(uint8_t addr, const char *name);
+
+/* run the ops against addr in order as one batch and wait for the result.
+ * timeout_ms bounds every op and the wait for a queue slot. Before
+ * i2c_mgr_init() the batch runs directly in the caller */
+esp_err_t i2c_mgr_transfer(uint8_t addr, i2c_prio_t prio, const i2c_op_t *ops, int op_count, uint32_t timeout_ms);
+
+static inline esp_err_t i2c_mgr_write(uint8_t addr, i2c_prio_t prio, const uint8_t *tx, size_t tx_len,
+                                      uint32_t timeout_ms)
+{
+  const i2c_op_t op = I2C_OP_WR(tx, tx_len);
+  return i2c_mgr_transfer(addr, prio, &op, 1, timeout_ms);
+}
+
+static inline esp_err_t i2c_mgr_write_read(uint8_t addr, i2c_prio_t prio, const uint8_t *tx, size_t tx_len,
+                                           uint8_t *rx, size_t rx_len, uint32_t timeout_ms)
+{
+  const i2c_op_t op = I2C_OP_WR_RD(tx, tx_len, rx, rx_len);
+  return i2c_mgr_transfer(addr, prio, &op, 1, timeout_ms);
+}
+
+typedef struct {
+  uint8_t addr;
+  uint32_t ok;
+  uint32_t errors;
+  uint32_t timeouts;
+  uint32_t max_us;           // slowest batch, queueing included
+} i2c_mgr_dev_stats_t;
+
+/* copy the stats of up to max devices, returns how many were copied */
+int i2c_mgr_get_stats(i2c_mgr_dev_stats_t *stats, int max);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
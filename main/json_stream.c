@@ -0,0 +1,327 @@
+#include <string.h>
+
+#include "json_stream.h"
+
+enum {
+  ST_VALUE = 0,    // expecting a value
+  ST_KEY_OR_END,   // after '{': a key or '}'
+  ST_KEY,          // after ',' in an object: a key
+  ST_COLON,        // after a key
+  ST_STRING,       // inside a key or value string
+  ST_ESCAPE,       // after a backslash
+  ST_UNICODE,      // inside \uXXXX
+  ST_LITERAL,      // inside a number, true, false or null
+  ST_AFTER_VALUE,  // expecting ',' or a closing bracket
+  ST_DONE,         // the root value is complete
+};
+
+static bool _is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool _is_literal_char(char c)
+{
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+static void _token_put(json_stream_t *js, char c)
+{
+  if (js->token_len < JSON_STREAM_MAX_TOKEN - 1) {
+    js->token[js->token_len++] = c;
+  } else {
+    js->truncated = true;
+  }
+}
+
+static void _token_put_utf8(json_stream_t *js, unsigned int cp)
+{
+  if (cp < 0x80) {
+    _token_put(js, (char)cp);
+  } else if (cp < 0x800) {
+    _token_put(js, (char)(0xC0 | (cp >> 6)));
+    _token_put(js, (char)(0x80 | (cp & 0x3F)));
+  } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+    /* surrogate pairs are not reassembled, none of the fields we read need them */
+    _token_put(js, '?');
+  } else {
+    _token_put(js, (char)(0xE0 | (cp >> 12)));
+    _token_put(js, (char)(0x80 | ((cp >> 6) & 0x3F)));
+    _token_put(js, (char)(0x80 | (cp & 0x3F)));
+  }
+}
+
+static void _path_set(json_stream_t *js, int len, const char *suffix, bool dot)
+{
+  int pos = len;
+
+  if (dot && pos > 0 && pos < JSON_STREAM_MAX_PATH - 1) {
+    js->path[pos++] = '.';
+  }
+  for (const char *p = suffix; *p; p++) {
+    if (pos >= JSON_STREAM_MAX_PATH - 1) {
+      js->truncated = true;
+      break;
+    }
+    js->path[pos++] = *p;
+  }
+  js->path[pos] = '\0';
+  js->path_len  = pos;
+}
+
+static void _emit(json_stream_t *js, json_stream_event_t event, const char *value)
+{
+  if (js->cb) {
+    js->cb(js->ctx, js->path, event, value);
+  }
+}
+
+/* a value is complete, find out what may follow it */
+static void _value_done(json_stream_t *js)
+{
+  if (js->depth == 0) {
+    js->state = ST_DONE;
+    return;
+  }
+
+  /* array members share the container path, object members get a new key */
+  _path_set(js, js->base_len[js->depth], "", false);
+  js->state = ST_AFTER_VALUE;
+}
+
+static int _open(json_stream_t *js, char bracket)
+{
+  if (js->depth >= JSON_STREAM_MAX_DEPTH) {
+    return -1;
+  }
+
+  if (bracket == '{') {
+    _emit(js, JSON_STREAM_OBJECT_BEGIN, "");
+  }
+
+  js->depth++;
+  js->container[js->depth] = bracket;
+  if (bracket == '[') {
+    _path_set(js, js->path_len, "[]", false);
+  }
+  js->base_len[js->depth] = js->path_len;
+  js->state = (bracket == '{') ? ST_KEY_OR_END : ST_VALUE;
+  return 0;
+}
+
+static int _close(json_stream_t *js, char bracket)
+{
+  char expected = (bracket == '}') ? '{' : '[';
+
+  if (js->depth == 0 || js->container[js->depth] != expected) {
+    return -1;
+  }
+
+  js->depth--;
+  if (expected == '[') {
+    /* strip the "[]" again */
+    _path_set(js, js->base_len[js->depth + 1] - 2, "", false);
+  } else {
+    /* back to the path of the object itself for the end event */
+    _path_set(js, js->base_len[js->depth + 1], "", false);
+    _emit(js, JSON_STREAM_OBJECT_END, "");
+  }
+
+  _value_done(js);
+  return 0;
+}
+
+static void _literal_done(json_stream_t *js)
+{
+  js->token[js->token_len] = '\0';
+
+  if (strcmp(js->token, "true") == 0) {
+    _emit(js, JSON_STREAM_TRUE, js->token);
+  } else if (strcmp(js->token, "false") == 0) {
+    _emit(js, JSON_STREAM_FALSE, js->token);
+  } else if (strcmp(js->token, "null") == 0) {
+    _emit(js, JSON_STREAM_NULL, js->token);
+  } else if ((js->token[0] >= '0' && js->token[0] <= '9') || js->token[0] == '-') {
+    _emit(js, JSON_STREAM_NUMBER, js->token);
+  } else {
+    js->error = true;
+    return;
+  }
+
+  _value_done(js);
+}
+
+static void _string_done(json_stream_t *js)
+{
+  js->token[js->token_len] = '\0';
+
+  if (js->token_is_key) {
+    _path_set(js, js->base_len[js->depth], js->token, true);
+    js->state = ST_COLON;
+  } else {
+    _emit(js, JSON_STREAM_STRING, js->token);
+    _value_done(js);
+  }
+}
+
+static int _hex_value(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static void _begin_string(json_stream_t *js, bool is_key)
+{
+  js->token_len    = 0;
+  js->token_is_key = is_key;
+  js->state        = ST_STRING;
+}
+
+/* one character outside of strings and literals */
+static void _structural(json_stream_t *js, char c)
+{
+  if (_is_space(c)) {
+    return;
+  }
+
+  switch (js->state) {
+    case ST_VALUE:
+      if (c == '{' || c == '[') {
+        js->error = (_open(js, c) != 0);
+      } else if (c == ']' && js->container[js->depth] == '[' && js->path_len == js->base_len[js->depth]) {
+        /* empty array; a trailing comma slips through, which is fine for a reader */
+        js->error = (_close(js, c) != 0);
+      } else if (c == '"') {
+        _begin_string(js, false);
+      } else if (_is_literal_char(c)) {
+        js->token_len = 0;
+        _token_put(js, c);
+        js->state = ST_LITERAL;
+      } else {
+        js->error = true;
+      }
+      break;
+
+    case ST_KEY_OR_END:
+    case ST_KEY:
+      if (c == '"') {
+        _begin_string(js, true);
+      } else if (c == '}' && js->state == ST_KEY_OR_END) {
+        js->error = (_close(js, c) != 0);
+      } else {
+        js->error = true;
+      }
+      break;
+
+    case ST_COLON:
+      if (c == ':') {
+        js->state = ST_VALUE;
+      } else {
+        js->error = true;
+      }
+      break;
+
+    case ST_AFTER_VALUE:
+      if (c == ',') {
+        js->state = (js->container[js->depth] == '{') ? ST_KEY : ST_VALUE;
+      } else if (c == '}' || c == ']') {
+        js->error = (_close(js, c) != 0);
+      } else {
+        js->error = true;
+      }
+      break;
+
+    case ST_DONE:
+    default:
+      js->error = true;
+      break;
+  }
+}
+
+void json_stream_init(json_stream_t *js, json_stream_cb_t cb, void *ctx)
+{
+  memset(js, 0, sizeof(*js));
+  js->cb    = cb;
+  js->ctx   = ctx;
+  js->state = ST_VALUE;
+}
+
+int json_stream_feed(json_stream_t *js, const char *data, size_t len)
+{
+  for (size_t i = 0; i < len && !js->error; i++) {
+    char c = data[i];
+
+    switch (js->state) {
+      case ST_STRING:
+        if (c == '"') {
+          _string_done(js);
+        } else if (c == '\\') {
+          js->state = ST_ESCAPE;
+        } else {
+          _token_put(js, c);
+        }
+        break;
+
+      case ST_ESCAPE:
+        js->state = ST_STRING;
+        switch (c) {
+          case 'b': _token_put(js, '\b'); break;
+          case 'f': _token_put(js, '\f'); break;
+          case 'n': _token_put(js, '\n'); break;
+          case 'r': _token_put(js, '\r'); break;
+          case 't': _token_put(js, '\t'); break;
+          case 'u':
+            js->unicode        = 0;
+            js->unicode_digits = 0;
+            js->state          = ST_UNICODE;
+            break;
+          default:  _token_put(js, c); break;
+        }
+        break;
+
+      case ST_UNICODE: {
+        int v = _hex_value(c);
+        if (v < 0) {
+          js->error = true;
+          break;
+        }
+        js->unicode = (js->unicode << 4) | (unsigned int)v;
+        if (++js->unicode_digits == 4) {
+          _token_put_utf8(js, js->unicode);
+          js->state = ST_STRING;
+        }
+        break;
+      }
+
+      case ST_LITERAL:
+        if (_is_literal_char(c)) {
+          _token_put(js, c);
+        } else {
+          /* the delimiter belongs to the enclosing structure */
+          _literal_done(js);
+          if (!js->error) {
+            _structural(js, c);
+          }
+        }
+        break;
+
+      default:
+        _structural(js, c);
+        break;
+    }
+  }
+
+  return js->error ? -1 : 0;
+}
+
+int json_stream_finish(json_stream_t *js)
+{
+  /* a bare number at the root has no delimiter after it */
+  if (js->state == ST_LITERAL && js->depth == 0) {
+    _literal_done(js);
+  }
+
+  return (!js->error && js->state == ST_DONE) ? 0 : -1;
+}
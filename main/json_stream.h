@@ -0,0 +1,66 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_STREAM_MAX_DEPTH  (8)
+#define JSON_STREAM_MAX_PATH   (64)
+#define JSON_STREAM_MAX_TOKEN  (128)  // longer values are truncated
+
+typedef enum {
+  JSON_STREAM_STRING = 0,
+  JSON_STREAM_NUMBER,
+  JSON_STREAM_TRUE,
+  JSON_STREAM_FALSE,
+  JSON_STREAM_NULL,
+  JSON_STREAM_OBJECT_BEGIN,
+  JSON_STREAM_OBJECT_END,
+} json_stream_event_t;
+
+/* Called for every scalar value and object boundary.
+ * path is dotted, array elements appear as "[]": "data.list[].agent_id".
+ * value is the decoded token for scalars, "" for object boundaries. */
+typedef void (*json_stream_cb_t)(void *ctx, const char *path, json_stream_event_t event, const char *value);
+
+/* Incremental JSON tokenizer with constant memory: the document can be fed
+ * in pieces of any size, e.g. straight from HTTP_EVENT_ON_DATA. */
+typedef struct {
+  json_stream_cb_t cb;
+  void            *ctx;
+
+  int   state;
+  bool  error;
+  bool  truncated;   // a token or path did not fit, it was cut
+
+  int   depth;
+  char  container[JSON_STREAM_MAX_DEPTH + 1];
+  int   base_len[JSON_STREAM_MAX_DEPTH + 1];
+
+  char  path[JSON_STREAM_MAX_PATH];
+  int   path_len;
+
+  char  token[JSON_STREAM_MAX_TOKEN];
+  int   token_len;
+  bool  token_is_key;
+  unsigned int unicode;
+  int   unicode_digits;
+} json_stream_t;
+
+void json_stream_init(json_stream_t *js, json_stream_cb_t cb, void *ctx);
+
+/* returns 0, or -1 once the input is not valid JSON */
+int json_stream_feed(json_stream_t *js, const char *data, size_t len);
+
+/* returns 0 if exactly one complete document was fed */
+int json_stream_finish(json_stream_t *js);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
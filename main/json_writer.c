@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "json_writer.h"
+
+static void _put(json_writer_t *w, const char *data, size_t len)
+{
+  if (!w->buf && !w->error) {
+    w->len += len;  // measuring
+    return;
+  }
+  /* keep one byte for the terminating NUL */
+  if (w->error || w->len + len >= w->cap) {
+    w->error = true;
+    return;
+  }
+  memcpy(w->buf + w->len, data, len);
+  w->len += len;
+}
+
+static void _putc(json_writer_t *w, char c)
+{
+  _put(w, &c, 1);
+}
+
+static void _put_escaped(json_writer_t *w, const char *str)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  _putc(w, '"');
+  for (const char *p = str; *p; p++) {
+    unsigned char c = (unsigned char)*p;
+    switch (c) {
+      case '"':  _put(w, "\\\"", 2); break;
+      case '\\': _put(w, "\\\\", 2); break;
+      case '\b': _put(w, "\\b", 2);  break;
+      case '\f': _put(w, "\\f", 2);  break;
+      case '\n': _put(w, "\\n", 2);  break;
+      case '\r': _put(w, "\\r", 2);  break;
+      case '\t': _put(w, "\\t", 2);  break;
+      default:
+        if (c < 0x20) {
+          char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f] };
+          _put(w, esc, sizeof(esc));
+        } else {
+          _putc(w, (char)c);
+        }
+        break;
+    }
+  }
+  _putc(w, '"');
+}
+
+/* separator and key in front of every value */
+static void _prefix(json_writer_t *w, const char *key)
+{
+  if (w->need_comma[w->depth]) {
+    _putc(w, ',');
+  }
+  w->need_comma[w->depth] = true;
+
+  if (key) {
+    _put_escaped(w, key);
+    _putc(w, ':');
+  }
+}
+
+static void _open(json_writer_t *w, const char *key, char bracket)
+{
+  _prefix(w, key);
+  _putc(w, bracket);
+  if (w->depth >= JSON_WRITER_MAX_DEPTH) {
+    w->error = true;
+    return;
+  }
+  w->depth++;
+  w->need_comma[w->depth] = false;
+}
+
+static void _close(json_writer_t *w, char bracket)
+{
+  if (w->depth == 0) {
+    w->error = true;
+    return;
+  }
+  w->depth--;
+  _putc(w, bracket);
+}
+
+void json_writer_init(json_writer_t *w, char *buf, size_t cap)
+{
+  memset(w, 0, sizeof(*w));
+  w->buf = buf;
+  w->cap = buf ? cap : 0;
+  if (buf && cap == 0) {
+    w->error = true;
+  }
+}
+
+void json_writer_begin_object(json_writer_t *w, const char *key)
+{
+  _open(w, key, '{');
+}
+
+void json_writer_end_object(json_writer_t *w)
+{
+  _close(w, '}');
+}
+
+void json_writer_begin_array(json_writer_t *w, const char *key)
+{
+  _open(w, key, '[');
+}
+
+void json_writer_end_array(json_writer_t *w)
+{
+  _close(w, ']');
+}
+
+void json_writer_string(json_writer_t *w, const char *key, const char *value)
+{
+  _prefix(w, key);
+  _put_escaped(w, value ? value : "");
+}
+
+void json_writer_int(json_writer_t *w, const char *key, long value)
+{
+  char num[24];
+  int n = snprintf(num, sizeof(num), "%ld", value);
+
+  _prefix(w, key);
+  _put(w, num, (size_t)n);
+}
+
+void json_writer_bool(json_writer_t *w, const char *key, bool value)
+{
+  _prefix(w, key);
+  if (value) {
+    _put(w, "true", 4);
+  } else {
+    _put(w, "false", 5);
+  }
+}
+
+int json_writer_finish(json_writer_t *w)
+{
+  if (w->error || w->depth != 0) {
+    if (w->cap > 0) {
+      w->buf[0] = '\0';
+    }
+    return -1;
+  }
+
+  if (w->buf) {
+    w->buf[w->len] = '\0';
+  }
+  return (int)w->len;
+}
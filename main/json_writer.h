@@ -0,0 +1,46 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_WRITER_MAX_DEPTH  (8)
+
+/* Compact JSON writer into a caller-provided buffer, no heap use.
+ * Errors (overflow, nesting too deep) are sticky and reported by
+ * json_writer_finish(). Pass key = NULL for array items and the root.
+ * With buf = NULL nothing is written and json_writer_finish() returns the
+ * length the output would have, so a buffer can be sized by a first pass. */
+typedef struct {
+  char   *buf;
+  size_t  cap;
+  size_t  len;
+  bool    error;
+  int     depth;
+  bool    need_comma[JSON_WRITER_MAX_DEPTH + 1];
+} json_writer_t;
+
+void json_writer_init(json_writer_t *w, char *buf, size_t cap);
+
+void json_writer_begin_object(json_writer_t *w, const char *key);
+void json_writer_end_object(json_writer_t *w);
+
+void json_writer_begin_array(json_writer_t *w, const char *key);
+void json_writer_end_array(json_writer_t *w);
+
+void json_writer_string(json_writer_t *w, const char *key, const char *value);
+void json_writer_int(json_writer_t *w, const char *key, long value);
+void json_writer_bool(json_writer_t *w, const char *key, bool value);
+
+/* NUL-terminate the output, returns its length or -1 on error */
+int json_writer_finish(json_writer_t *w);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -34,6 +34,7 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_pm.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -42,10 +43,21 @@
 #include "nvs_flash.h"
 
 #include "ai_agent.h"
+#include "app_state.h"
 #include "audio_proc.h"
+#include "boot_seq.h"
 #include "common.h"
+#include "i2c_mgr.h"
+#include "load_gov.h"
+#include "metrics.h"
+#include "power_gov.h"
 #include "rtc_proc.h"
+#include "session_arena.h"
+#include "task_plan.h"
+#include "voice_sensor.h"
+#include "wifi_proc.h"
 #include "aic3104_ng.h"
+#include "board_pins_config.h"
 #include "xvf3800.h"
 // #include "pcal6416a.h"  // Not used - no PCAL6416A on this board
 
@@ -54,60 +66,11 @@
 #endif
 
 app_t g_app = {
-  .b_call_session_started = false,
-  .b_ai_agent_generated   = true,
-  .b_wifi_connected       = false,
-  .b_ai_agent_joined      = false,
   .app_id                 = AGORA_APP_ID,
   .token                  = BOARD_RTC_TOKEN,
   .agent_id               = "",
 };
 
-static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
-{
-  printf("wifi event %ld\n", event_id);
-  if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-    esp_wifi_connect();
-  } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-    esp_wifi_connect();
-  } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
-    //g_app.b_wifi_connected = true;
-    printf("wifi sta mode connect.\n");
-  } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-    ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-    g_app.b_wifi_connected = true;
-    printf("got ip: \n" IPSTR, IP2STR(&event->ip_info.ip));
-  }
-}
-
-/*init wifi as sta */
-static void setup_wifi(void)
-{
-  ESP_ERROR_CHECK(esp_netif_init());
-  ESP_ERROR_CHECK(esp_event_loop_create_default());
-  esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
-  assert(sta_netif);
-
-  wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-  ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-  ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL, NULL));
-  ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, NULL));
-
-  wifi_config_t wifi_config = {
-    .sta = {
-      .ssid            = WIFI_SSID,
-      .password        = WIFI_PASSWORD,
-      .listen_interval = CONFIG_EXAMPLE_WIFI_LISTEN_INTERVAL,
-    },
-  };
-  ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-  ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-  ESP_ERROR_CHECK(esp_wifi_start());
-
-  esp_wifi_set_ps(WIFI_PS_NONE);
-}
-
 // Button callback - DISABLED for ReSpeaker XVF3800 (would cause crash)
 // This callback was designed for ESP32-S3-Korvo-2 V3 board
 /*
@@ -117,8 +80,8 @@ static esp_err_t input_key_service_cb(periph_service_handle_t handle, periph_ser
     case INPUT_KEY_USER_ID_MUTE:
       printf("[ * ] [Stop] Stop Ai Agent\n");
       if (evt->type == INPUT_KEY_SERVICE_ACTION_CLICK_RELEASE) {
-        if (g_app.b_ai_agent_joined) {
-          g_app.b_ai_agent_joined = false;
+        if (app_state_has(APP_STATE_AGENT_JOINED)) {
+          app_state_clear(APP_STATE_AGENT_JOINED);
           // stop ai agent
           ai_agent_stop();
         } else {
@@ -129,10 +92,10 @@ static esp_err_t input_key_service_cb(periph_service_handle_t handle, periph_ser
     case INPUT_KEY_USER_ID_SET:
       printf("[ * ] [Start] Start Ai Agent\n");
       if (evt->type == INPUT_KEY_SERVICE_ACTION_CLICK_RELEASE) {
-        if (!g_app.b_ai_agent_joined) {
+        if (!app_state_has(APP_STATE_AGENT_JOINED)) {
           // start ai agent
           ai_agent_start();
-          g_app.b_ai_agent_joined = true;
+          app_state_set(APP_STATE_AGENT_JOINED);
         } else {
           printf("Ai Agent has already Started.\n");
         }
@@ -184,6 +147,10 @@ static void setup_key_button(void)
     printf("This may be normal - continuing with button monitoring...\n");
   }
 
+#ifdef CONFIG_VOICE_SENSOR
+  voice_sensor_start(&xvf3800);
+#endif
+
   // Start button monitoring task
   ret = xvf3800_start_button_monitor(&xvf3800);
   if (ret != ESP_OK) {
@@ -197,9 +164,8 @@ static void setup_key_button(void)
   }
 }
 
-int app_main(void)
+static void boot_nvs(void)
 {
-  // Initialize NVS
   esp_err_t ret = nvs_flash_init();
   if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
     ESP_ERROR_CHECK(nvs_flash_erase());
@@ -207,45 +173,78 @@ int app_main(void)
   }
   ESP_ERROR_CHECK(ret);
 
-  // init and start wifi
-  setup_wifi();
-
-  // Wait until WiFi is connected
-  while (!g_app.b_wifi_connected) {
-    vTaskDelay(10 / portTICK_PERIOD_MS);
-  }
-
-  // XVF3800 button handler will be initialized after audio_board_init()
-  // (audio_board_init() will configure I2C for AIC3104)
-
-  // Small delay before XVF3800 init
-  vTaskDelay(pdMS_TO_TICKS(500));
+  ai_agent_init();
+}
 
+static void boot_button(void)
+{
   // Suppress I2C_BUS error logs BEFORE starting button handler
-  // The I2C errors are intentional - they occur during button press detection
+  // The I2C errors are intentional - they occur during button press detection,
+  // they are counted per device in the i2c.* metrics instead
   esp_log_level_set("I2C_BUS", ESP_LOG_NONE);
 
+  // audio_board_init() installed the bus, from here on it is shared through i2c_mgr
+  i2c_config_t pins = {0};
+  if (get_i2c_pins(I2C_NUM_0, &pins) != ESP_OK) {
+    pins.sda_io_num = -1;
+    pins.scl_io_num = -1;
+  }
+  i2c_mgr_init(I2C_NUM_0, pins.sda_io_num, pins.scl_io_num);
+  i2c_mgr_add_device(AIC3104_ADDR, "codec");
+  i2c_mgr_add_device(XVF3800_I2C_ADDR, "xvf");
+
   // Initialize XVF3800 button handler for ReSpeaker
   setup_key_button();
+}
 
-  //setup and start audio
-  setup_audio();
-
+static void boot_audio(void)
+{
   audio_sema_init();
   audio_start_proc();
+}
 
+static void boot_agent_net(void)
+{
+  ai_agent_http_warmup();
+  ai_agent_recover();
+  metrics_http_start();
+}
+
+static void boot_rtc(void)
+{
   printf("~~~~~start agora rtc demo~~~~\r\n");
+  agora_rtc_proc_create(NULL, AI_AGENT_USER_ID);
+}
 
-  while (!g_app.b_ai_agent_generated) {
-    vTaskDelay(10 / portTICK_PERIOD_MS);
-  }
+/* Wi-Fi and the audio side do not depend on each other and come up in
+ * parallel; the XVF3800 shares the I2C bus that audio_board_init() sets up
+ * and keeps its resource ID in NVS. */
+static const boot_step_t s_boot_steps[] = {
+  { "nvs",       BOOT_EVT_NVS,       0,                                 boot_nvs,       false, 0 },
+  { "wifi",      BOOT_EVT_WIFI,      BOOT_EVT_NVS,                      wifi_proc_start, true, 0 },
+  { "codec",     BOOT_EVT_CODEC,     0,                                 setup_audio,    false, 0 },
+  { "button",    BOOT_EVT_BUTTON,    BOOT_EVT_CODEC | BOOT_EVT_NVS,     boot_button,    false, 0 },
+  { "audio",     BOOT_EVT_AUDIO,     BOOT_EVT_CODEC,                    boot_audio,     false, 0 },
+  { "agent_net", BOOT_EVT_AGENT_NET, BOOT_EVT_WIFI,                     boot_agent_net, false, 0 },
+  { "rtc",       BOOT_EVT_RTC,       BOOT_EVT_WIFI | BOOT_EVT_AUDIO,    boot_rtc,       true,  8192 },
+};
 
-  agora_rtc_proc_create(NULL, AI_AGENT_USER_ID);
+int app_main(void)
+{
+  app_state_init();
+  session_arena_init();
+  power_gov_init();
+  load_gov_init();
+  boot_seq_start(s_boot_steps, sizeof(s_boot_steps) / sizeof(s_boot_steps[0]));
+
+  boot_seq_wait(BOOT_EVT_READY, UINT32_MAX);
+  int64_t ready_us = esp_timer_get_time();
 
-  while(!g_app.b_call_session_started) {
-    usleep(200 * 1000);
-  }
   printf("~~~~~agora_rtc_join_channel success~~~~\r\n");
+  boot_seq_report();
+  task_plan_log();
+  task_plan_start_jitter_probe();
+  printf("Reset to ready for button: %d ms\n", (int)(ready_us / 1000));
   printf("========================================\n");
   printf("✓ Board RTC has joined channel successfully!\n");
   printf("  You can now press SET button to:\n");
@@ -254,27 +253,31 @@ int app_main(void)
   printf("========================================\n");
 
 #ifndef CONFIG_AUDIO_ONLY
-  //  start_video_proc();
+  start_video_proc();
 #endif
 
   // Auto-start AI agent is DISABLED - use button to start manually
   // printf("~~~~~Auto-starting Ai Agent~~~~\r\n");
   // ai_agent_start();
-  // g_app.b_ai_agent_joined = true;
+  // app_state_set(APP_STATE_AGENT_JOINED);
   // printf("~~~~~Ai Agent started successfully~~~~\r\n");
 
 
+  int report_count = 0;
   while (1) {
     // audio_sys_get_real_time_stats();
-    printf("MEM Total:%ld Bytes, Inter:%d Bytes, Dram:%d Bytes\n", esp_get_free_heap_size(),
-              heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
-              heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    metrics_sample_system();
+    metrics_dump();
 
-    if (g_app.b_ai_agent_joined) {
+    if (app_state_has(APP_STATE_AGENT_JOINED)) {
       // Note: Agora API automatically manages agent lifecycle
       // No need to send keepalive pings
     }
 
+    if (++report_count % 6 == 0) {
+      power_gov_report();
+    }
+
     sleep(10);
   }
 
@@ -0,0 +1,194 @@
+#include <stdio.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "audio_wdog.h"
+#include "common.h"
+#include "load_gov.h"
+#include "metrics.h"
+
+/* Audio is the one thing that must not suffer, so when the CPU runs out the
+ * other features give way in a fixed order, one level per sample, and come
+ * back one level at a time only after the load has stayed low for a while.
+ * Load is the non-idle share of the busiest core from the FreeRTOS run-time
+ * stats; audio deadline misses count as overload whatever the CPU says. */
+
+#define LOAD_GOV_MAX_TASKS  (40)
+
+/* an audio-only build has no video to shed, the H.264 path already runs at QVGA */
+#if defined(CONFIG_AUDIO_ONLY)
+#define LOAD_GOV_SKIP_LEVELS  ((1u << LOAD_LEVEL_VIDEO_LOW_RES) | (1u << LOAD_LEVEL_VIDEO_PAUSED))
+#elif defined(CONFIG_VIDEO_USE_H264)
+#define LOAD_GOV_SKIP_LEVELS  (1u << LOAD_LEVEL_VIDEO_LOW_RES)
+#else
+#define LOAD_GOV_SKIP_LEVELS  (0)
+#endif
+
+static const load_policy_cfg_t g_policy_cfg = {
+  .cpu_high_pct    = CONFIG_LOAD_GOV_CPU_HIGH,
+  .cpu_low_pct     = CONFIG_LOAD_GOV_CPU_LOW,
+  .degrade_samples = 2,
+  .restore_samples = 10,
+  .miss_burst      = 3,
+  .skip_levels     = LOAD_GOV_SKIP_LEVELS,
+};
+
+static load_policy_t g_policy;
+static volatile load_level_t g_level = LOAD_LEVEL_FULL;
+static volatile uint32_t g_misses = 0;
+static esp_timer_handle_t g_sample_timer = NULL;
+
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+static TaskStatus_t g_tasks[LOAD_GOV_MAX_TASKS];
+static uint32_t g_prev_idle[portNUM_PROCESSORS];
+static uint32_t g_prev_total = 0;
+#endif
+
+static METRIC_GAUGE(g_level_gauge, "load.level");
+static METRIC_GAUGE(g_cpu_gauge, "load.cpu_max");
+
+/* the next level from level in direction dir that is not skipped, level
+ * itself at either end of the ladder */
+static load_level_t _next_level(const load_policy_cfg_t *cfg, load_level_t level, int dir)
+{
+  for (int next = (int)level + dir; next >= LOAD_LEVEL_FULL && next < LOAD_LEVEL_COUNT; next += dir) {
+    if (!(cfg->skip_levels & (1u << next))) {
+      return (load_level_t)next;
+    }
+  }
+  return level;
+}
+
+load_level_t load_policy_step(const load_policy_cfg_t *cfg, load_policy_t *policy, const load_sample_t *in)
+{
+  bool overloaded = in->deadline_misses > 0 || in->cpu_pct > cfg->cpu_high_pct;
+  bool calm       = in->deadline_misses == 0 && in->cpu_pct < cfg->cpu_low_pct;
+
+  policy->over = overloaded ? policy->over + 1 : 0;
+  policy->calm = calm ? policy->calm + 1 : 0;
+
+  if (overloaded && (policy->over >= cfg->degrade_samples || in->deadline_misses >= cfg->miss_burst)) {
+    policy->level = _next_level(cfg, policy->level, 1);
+    policy->over = 0;
+  } else if (calm && policy->calm >= cfg->restore_samples) {
+    policy->level = _next_level(cfg, policy->level, -1);
+    policy->calm = 0;
+  }
+
+  return policy->level;
+}
+
+const char *load_level_name(load_level_t level)
+{
+  switch (level) {
+    case LOAD_LEVEL_FULL:          return "full";
+    case LOAD_LEVEL_VIDEO_LOW_RES: return "video low res";
+    case LOAD_LEVEL_VIDEO_PAUSED:  return "video paused";
+    case LOAD_LEVEL_DSP_OFF:       return "dsp off";
+    case LOAD_LEVEL_HTTP_DEFERRED: return "http deferred";
+    default:                       return "?";
+  }
+}
+
+/* non-idle share of the busiest core since the last call, 0 on the first */
+static uint8_t _busiest_core_pct(void)
+{
+  uint8_t busiest = 0;
+
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+  uint32_t total = 0;
+  UBaseType_t n = uxTaskGetSystemState(g_tasks, LOAD_GOV_MAX_TASKS, &total);
+  if (n == 0) {
+    return 0;  // more tasks than slots
+  }
+  // the same snapshot names whoever starved the audio task
+  audio_wdog_sample(g_tasks, n, total);
+
+  uint32_t elapsed = total - g_prev_total;
+  for (int core = 0; core < portNUM_PROCESSORS; core++) {
+    TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+    for (UBaseType_t i = 0; i < n; i++) {
+      if (g_tasks[i].xHandle != idle) {
+        continue;
+      }
+      uint32_t idle_delta = g_tasks[i].ulRunTimeCounter - g_prev_idle[core];
+      g_prev_idle[core] = g_tasks[i].ulRunTimeCounter;
+      if (g_prev_total != 0 && elapsed > 0 && idle_delta <= elapsed) {
+        uint8_t pct = (uint8_t)(100 - (uint64_t)idle_delta * 100 / elapsed);
+        if (pct > busiest) {
+          busiest = pct;
+        }
+      }
+      break;
+    }
+  }
+  g_prev_total = total;
+#endif
+
+  return busiest;
+}
+
+static void _sample_timer_cb(void *arg)
+{
+  load_sample_t sample = {
+    .cpu_pct         = _busiest_core_pct(),
+    .deadline_misses = __atomic_exchange_n(&g_misses, 0, __ATOMIC_RELAXED),
+  };
+
+  load_level_t old = g_policy.level;
+  load_level_t now = load_policy_step(&g_policy_cfg, &g_policy, &sample);
+
+  metric_set(&g_cpu_gauge, sample.cpu_pct);
+  metric_set(&g_level_gauge, now);
+  if (now != old) {
+    g_level = now;
+    printf("load: %s -> %s (cpu %u%%, %lu deadline misses)\n", load_level_name(old), load_level_name(now),
+           sample.cpu_pct, (unsigned long)sample.deadline_misses);
+  }
+}
+
+void load_gov_init(void)
+{
+  if (g_sample_timer) {
+    return;
+  }
+
+  metrics_register_gauge(&g_level_gauge);
+  metrics_register_gauge(&g_cpu_gauge);
+
+  const esp_timer_create_args_t args = {
+    .callback = _sample_timer_cb,
+    .name     = "load_gov",
+  };
+  if (esp_timer_create(&args, &g_sample_timer) != ESP_OK) {
+    printf("load: failed to create the sample timer\n");
+    return;
+  }
+  esp_timer_start_periodic(g_sample_timer, (uint64_t)CONFIG_LOAD_GOV_PERIOD_MS * 1000);
+}
+
+void load_gov_note_deadline_miss(void)
+{
+  __atomic_fetch_add(&g_misses, 1, __ATOMIC_RELAXED);
+}
+
+load_level_t load_gov_level(void)
+{
+  return g_level;
+}
+
+bool load_gov_wait_below(load_level_t level, uint32_t timeout_ms)
+{
+  int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+  // the level moves once per sample period, polling at that rate is enough
+  while (g_level >= level) {
+    if (esp_timer_get_time() >= deadline_us) {
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_LOAD_GOV_PERIOD_MS));
+  }
+  return true;
+}
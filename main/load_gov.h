@@ -0,0 +1,77 @@
+#ifndef LOAD_GOV_H
+#define LOAD_GOV_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* sample period of the CPU budget monitor */
+#ifndef CONFIG_LOAD_GOV_PERIOD_MS
+#define CONFIG_LOAD_GOV_PERIOD_MS   (1000)
+#endif
+
+/* step down when the busiest core is above this, step back up below the
+ * low mark; in between the level is held */
+#ifndef CONFIG_LOAD_GOV_CPU_HIGH
+#define CONFIG_LOAD_GOV_CPU_HIGH    (85)
+#endif
+#ifndef CONFIG_LOAD_GOV_CPU_LOW
+#define CONFIG_LOAD_GOV_CPU_LOW     (60)
+#endif
+
+/* the degradation ladder, every level includes the ones before it. Levels
+ * with nothing to shed in this build are stepped over */
+typedef enum {
+  LOAD_LEVEL_FULL = 0,
+  LOAD_LEVEL_VIDEO_LOW_RES,    // JPEG at QVGA
+  LOAD_LEVEL_VIDEO_PAUSED,     // no capture or encode
+  LOAD_LEVEL_DSP_OFF,          // optional uplink analysis skipped
+  LOAD_LEVEL_HTTP_DEFERRED,    // background HTTP work waits
+  LOAD_LEVEL_COUNT
+} load_level_t;
+
+typedef struct {
+  uint8_t cpu_high_pct;
+  uint8_t cpu_low_pct;
+  uint8_t degrade_samples;   // overloaded samples in a row before stepping down
+  uint8_t restore_samples;   // calm samples in a row before stepping back up
+  uint8_t miss_burst;        // this many deadline misses in one sample step down at once
+  uint32_t skip_levels;      // bit per load_level_t that does nothing here
+} load_policy_cfg_t;
+
+typedef struct {
+  uint8_t  cpu_pct;          // busiest core over the sample period
+  uint32_t deadline_misses;  // audio deadline misses in the sample period
+} load_sample_t;
+
+typedef struct {
+  load_level_t level;
+  uint8_t over;              // overloaded samples in a row
+  uint8_t calm;              // calm samples in a row
+} load_policy_t;
+
+/* the ladder, a pure function of the samples fed to it. Moves at most one
+ * level per call, skipped levels not counted, and returns the new level */
+load_level_t load_policy_step(const load_policy_cfg_t *cfg, load_policy_t *policy, const load_sample_t *in);
+
+const char *load_level_name(load_level_t level);
+
+/* start sampling the run-time stats */
+void load_gov_init(void);
+
+/* the audio path keeps missing frame deadlines, safe from any task */
+void load_gov_note_deadline_miss(void);
+
+load_level_t load_gov_level(void);
+
+/* block until the level is below level, returns false on timeout */
+bool load_gov_wait_below(load_level_t level, uint32_t timeout_ms);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
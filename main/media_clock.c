@@ -0,0 +1,170 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include "esp_timer.h"
+
+#include "media_clock.h"
+
+/* Neither audio_frame_info_t nor video_frame_info_t carry a timestamp, the SDK
+ * stamps frames when they are handed over. Lip sync at the far end therefore
+ * depends on both paths having the same capture-to-send latency, so the bound
+ * is enforced at the send point: video that would be too late is dropped,
+ * before the encoder when the encode time makes that predictable, and video
+ * that is early is held back. Frames that aged in a backlog are dropped too.
+ *
+ * The audio task and the video task share the fields below. All of them are
+ * 32 bit so that they can be updated without a lock; the int64_t ones are
+ * only touched by the video task. */
+
+#define AUDIO_LATENCY_EMA_SHIFT  (3)  // 1/8 weight for the newest sample
+#define VIDEO_AGE_EMA_SHIFT      (3)
+#define ENCODE_EMA_SHIFT         (2)
+
+static struct {
+  volatile int32_t  audio_latency_us;
+  volatile bool     audio_valid;
+  volatile int32_t  video_latency_us;
+  volatile int32_t  video_age_us;
+  volatile bool     video_valid;
+  volatile int32_t  encode_us;
+  volatile bool     encode_valid;
+  volatile int32_t  skew_us;
+  volatile int32_t  max_abs_skew_us;
+  volatile uint32_t audio_frames;
+  volatile uint32_t video_frames;
+  volatile uint32_t video_skewed;
+  volatile uint32_t video_held;
+  volatile uint32_t video_dropped;
+  int64_t           check_us;      // when the frame now in the encoder was checked
+  int64_t           last_sent_us;  // 0 until a frame is sent
+} g_sync;
+
+int64_t media_clock_now_us(void)
+{
+  return esp_timer_get_time();
+}
+
+void media_sync_reset(void)
+{
+  memset((void *)&g_sync, 0, sizeof(g_sync));
+}
+
+void media_sync_audio_sent(int64_t capture_us, int64_t send_us)
+{
+  int32_t latency = (int32_t)(send_us - capture_us);
+
+  if (!g_sync.audio_valid) {
+    g_sync.audio_latency_us = latency;
+    g_sync.audio_valid      = true;
+  } else {
+    g_sync.audio_latency_us += (latency - g_sync.audio_latency_us) >> AUDIO_LATENCY_EMA_SHIFT;
+  }
+  g_sync.audio_frames++;
+}
+
+/* no video for too long, a frame goes out whatever its skew */
+static bool _starving(int64_t now_us)
+{
+  return g_sync.last_sent_us == 0 || now_us - g_sync.last_sent_us >= MEDIA_SYNC_MIN_VIDEO_GAP_MS * 1000LL;
+}
+
+media_sync_action_t media_sync_video_check(int64_t capture_us, int64_t now_us)
+{
+  int32_t age = (int32_t)(now_us - capture_us);
+  g_sync.check_us = now_us;
+
+  if (!g_sync.video_valid) {
+    g_sync.video_age_us = age;
+    g_sync.video_valid  = true;
+    return MEDIA_SYNC_SEND;
+  }
+
+  /* dropped frames count too, so a lasting rise in latency becomes the new
+   * normal within a few frames instead of dropping everything after it */
+  bool stale = age - g_sync.video_age_us > MEDIA_SYNC_MAX_BACKLOG_MS * 1000;
+  g_sync.video_age_us += (age - g_sync.video_age_us) >> VIDEO_AGE_EMA_SHIFT;
+  if (stale) {
+    return MEDIA_SYNC_DROP;
+  }
+
+  // it would reach the send point too far behind audio, do not spend an encode on it
+  if (g_sync.audio_valid && g_sync.encode_valid && !_starving(now_us)) {
+    int32_t skew = age + g_sync.encode_us - g_sync.audio_latency_us;
+    if (skew > MEDIA_SYNC_MAX_SKEW_MS * 1000) {
+      return MEDIA_SYNC_DROP;
+    }
+  }
+  return MEDIA_SYNC_SEND;
+}
+
+media_sync_action_t media_sync_video_send_check(int64_t capture_us, int64_t now_us, int32_t *hold_us)
+{
+  int32_t encode = (int32_t)(now_us - g_sync.check_us);
+  *hold_us = 0;
+
+  if (!g_sync.encode_valid) {
+    g_sync.encode_us    = encode;
+    g_sync.encode_valid = true;
+  } else {
+    g_sync.encode_us += (encode - g_sync.encode_us) >> ENCODE_EMA_SHIFT;
+  }
+
+  if (!g_sync.audio_valid) {
+    return MEDIA_SYNC_SEND;
+  }
+
+  int32_t skew = (int32_t)(now_us - capture_us) - g_sync.audio_latency_us;
+  if (skew > MEDIA_SYNC_MAX_SKEW_MS * 1000) {
+    return _starving(now_us) ? MEDIA_SYNC_SEND : MEDIA_SYNC_DROP;
+  }
+  if (skew < -MEDIA_SYNC_MAX_SKEW_MS * 1000) {
+    *hold_us = -skew;
+    g_sync.video_held++;
+    return MEDIA_SYNC_HOLD;
+  }
+  return MEDIA_SYNC_SEND;
+}
+
+void media_sync_video_sent(int64_t capture_us, int64_t send_us)
+{
+  int32_t latency = (int32_t)(send_us - capture_us);
+
+  g_sync.video_latency_us = latency;
+  g_sync.last_sent_us     = send_us;
+  if (g_sync.audio_valid) {
+    int32_t skew     = latency - g_sync.audio_latency_us;
+    int32_t abs_skew = skew < 0 ? -skew : skew;
+    g_sync.skew_us   = skew;
+    if (abs_skew > g_sync.max_abs_skew_us) {
+      g_sync.max_abs_skew_us = abs_skew;
+    }
+    if (abs_skew > MEDIA_SYNC_MAX_SKEW_MS * 1000) {
+      g_sync.video_skewed++;
+    }
+  }
+  g_sync.video_frames++;
+}
+
+void media_sync_video_dropped(void)
+{
+  g_sync.video_dropped++;
+}
+
+void media_sync_get_stats(media_sync_stats_t *stats)
+{
+  if (!stats) {
+    return;
+  }
+
+  stats->audio_latency_us = g_sync.audio_latency_us;
+  stats->video_latency_us = g_sync.video_latency_us;
+  stats->video_age_us     = g_sync.video_age_us;
+  stats->encode_us        = g_sync.encode_us;
+  stats->skew_us          = g_sync.skew_us;
+  stats->max_abs_skew_us  = g_sync.max_abs_skew_us;
+  stats->audio_frames     = g_sync.audio_frames;
+  stats->video_frames     = g_sync.video_frames;
+  stats->video_skewed     = g_sync.video_skewed;
+  stats->video_held       = g_sync.video_held;
+  stats->video_dropped    = g_sync.video_dropped;
+}
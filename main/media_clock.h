@@ -0,0 +1,79 @@
+#ifndef MEDIA_CLOCK_H
+#define MEDIA_CLOCK_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+
+/* the bound on video - audio capture-to-send latency at the send point:
+ * video that would go out later than this behind audio is dropped, video
+ * further ahead is held until it is level with audio */
+#ifndef MEDIA_SYNC_MAX_SKEW_MS
+#define MEDIA_SYNC_MAX_SKEW_MS   (80)
+#endif
+/* a frame older than the usual video latency by this much sat in a backlog,
+ * a newer one is already waiting behind it */
+#ifndef MEDIA_SYNC_MAX_BACKLOG_MS
+#define MEDIA_SYNC_MAX_BACKLOG_MS   (150)
+#endif
+/* a pipeline whose encode alone breaks the skew bound would never send
+ * video; one late frame goes out after this long without any */
+#ifndef MEDIA_SYNC_MIN_VIDEO_GAP_MS
+#define MEDIA_SYNC_MIN_VIDEO_GAP_MS (1000)
+#endif
+
+typedef enum {
+  MEDIA_SYNC_SEND = 0,   // go on with the frame
+  MEDIA_SYNC_HOLD,       // ahead of audio, wait hold_us before sending it
+  MEDIA_SYNC_DROP,       // stale or too far behind audio
+} media_sync_action_t;
+
+typedef struct {
+  int32_t  audio_latency_us;  // smoothed capture-to-send latency of audio
+  int32_t  video_latency_us;  // capture-to-send latency of the last video frame
+  int32_t  video_age_us;      // smoothed age of video frames when they are checked
+  int32_t  encode_us;         // smoothed time from the check to the send point
+  int32_t  skew_us;           // video - audio latency at the last video send
+  int32_t  max_abs_skew_us;   // largest |skew| since reset
+  uint32_t audio_frames;
+  uint32_t video_frames;
+  uint32_t video_skewed;      // sent with |skew| above MEDIA_SYNC_MAX_SKEW_MS
+  uint32_t video_held;
+  uint32_t video_dropped;
+} media_sync_stats_t;
+
+/* monotonic media clock shared by the capture paths, microseconds since boot */
+int64_t media_clock_now_us(void);
+
+/* forget all latency history, called when a new call session starts */
+void media_sync_reset(void);
+
+/* record an audio frame handed to the SDK */
+void media_sync_audio_sent(int64_t capture_us, int64_t send_us);
+
+/* decide whether a video frame captured at capture_us is worth encoding:
+ * SEND or DROP. Call it before the encoder, a drop there leaves no gap in
+ * the reference chain; frames the encode time would push past the skew
+ * bound are dropped here already */
+media_sync_action_t media_sync_video_check(int64_t capture_us, int64_t now_us);
+
+/* the encoded frame at the send point: SEND, HOLD for *hold_us, or DROP
+ * when it is later than the bound after all. A drop here leaves a gap in
+ * an H.264 reference chain, the caller restarts it with a key frame */
+media_sync_action_t media_sync_video_send_check(int64_t capture_us, int64_t now_us, int32_t *hold_us);
+
+/* record a video frame handed to the SDK */
+void media_sync_video_sent(int64_t capture_us, int64_t send_us);
+
+/* record a video frame dropped by either check */
+void media_sync_video_dropped(void);
+
+void media_sync_get_stats(media_sync_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "common.h"
+#ifdef CONFIG_METRICS_HTTP_SERVER
+#include "esp_http_server.h"
+#endif
+
+#include "load_gov.h"
+#include "metrics.h"
+#include "task_plan.h"
+
+#ifndef CONFIG_METRICS_HTTP_PORT
+#define CONFIG_METRICS_HTTP_PORT  (8080)
+#endif
+
+#define METRICS_SNAPSHOT_LEN      (2048)
+#define CPU_TRACK_TASKS           (40)
+
+typedef struct {
+  TaskHandle_t handle;
+  uint32_t     runtime;
+} cpu_prev_t;
+
+typedef struct {
+  char    name[configMAX_TASK_NAME_LEN];
+  uint8_t pct;       // share of all cores over the last sample period
+  int8_t  core;      // -1 when not pinned
+} cpu_top_t;
+
+static portMUX_TYPE g_metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static metric_counter_t *g_counters[METRICS_MAX];
+static metric_gauge_t *g_gauges[METRICS_MAX];
+static metric_hist_t *g_hists[METRICS_MAX];
+static int g_counter_count = 0;
+static int g_gauge_count = 0;
+static int g_hist_count = 0;
+
+static METRIC_GAUGE(g_heap_int_free, "heap.int_free");
+static METRIC_GAUGE(g_heap_int_largest, "heap.int_largest");
+static METRIC_GAUGE(g_heap_int_min, "heap.int_min");
+static METRIC_GAUGE(g_heap_psram_free, "heap.psram_free");
+static METRIC_GAUGE(g_heap_psram_largest, "heap.psram_largest");
+static bool g_system_registered = false;
+
+/* CPU sampling state, owned by the task calling metrics_sample_system() */
+static cpu_prev_t g_cpu_prev[CPU_TRACK_TASKS];
+static int g_cpu_prev_count = 0;
+static uint32_t g_cpu_prev_total = 0;
+/* published result, copied under g_metrics_lock */
+static cpu_top_t g_cpu_top[METRICS_TOP_TASKS];
+static int g_cpu_top_count = 0;
+
+void metric_observe(metric_hist_t *h, uint32_t value)
+{
+  int bin = 0;
+  while (bin < METRICS_HIST_BINS - 1 && value > h->edges[bin]) {
+    bin++;
+  }
+  __atomic_fetch_add(&h->bins[bin], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+}
+
+static void _register(void **table, int *count, void *metric)
+{
+  portENTER_CRITICAL(&g_metrics_lock);
+  for (int i = 0; i < *count; i++) {
+    if (table[i] == metric) {
+      portEXIT_CRITICAL(&g_metrics_lock);
+      return;
+    }
+  }
+  if (*count < METRICS_MAX) {
+    table[(*count)++] = metric;
+  }
+  portEXIT_CRITICAL(&g_metrics_lock);
+}
+
+void metrics_register_counter(metric_counter_t *c)
+{
+  _register((void **)g_counters, &g_counter_count, c);
+}
+
+void metrics_register_gauge(metric_gauge_t *g)
+{
+  _register((void **)g_gauges, &g_gauge_count, g);
+}
+
+void metrics_register_hist(metric_hist_t *h)
+{
+  _register((void **)g_hists, &g_hist_count, h);
+}
+
+static uint32_t _prev_runtime(TaskHandle_t handle)
+{
+  for (int i = 0; i < g_cpu_prev_count; i++) {
+    if (g_cpu_prev[i].handle == handle) {
+      return g_cpu_prev[i].runtime;
+    }
+  }
+  return 0;
+}
+
+static void _sample_cpu(void)
+{
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+  UBaseType_t n = uxTaskGetNumberOfTasks() + 4;
+  TaskStatus_t *tasks = malloc(n * sizeof(TaskStatus_t));
+  if (!tasks) {
+    return;
+  }
+
+  uint32_t total = 0;
+  n = uxTaskGetSystemState(tasks, n, &total);
+  uint32_t elapsed = (total - g_cpu_prev_total) * portNUM_PROCESSORS;
+
+  cpu_top_t top[METRICS_TOP_TASKS];
+  int top_count = 0;
+
+  for (UBaseType_t i = 0; i < n && g_cpu_prev_total != 0 && elapsed; i++) {
+    uint32_t delta = tasks[i].ulRunTimeCounter - _prev_runtime(tasks[i].xHandle);
+    uint8_t pct = (uint8_t)((uint64_t)delta * 100 / elapsed);
+
+    // keep the busiest tasks, sorted by share
+    int pos = top_count;
+    while (pos > 0 && top[pos - 1].pct < pct) {
+      pos--;
+    }
+    if (pos >= METRICS_TOP_TASKS) {
+      continue;
+    }
+    int last = top_count < METRICS_TOP_TASKS ? top_count : METRICS_TOP_TASKS - 1;
+    memmove(&top[pos + 1], &top[pos], (last - pos) * sizeof(top[0]));
+    snprintf(top[pos].name, sizeof(top[pos].name), "%s", tasks[i].pcTaskName);
+    top[pos].pct  = pct;
+    top[pos].core = tasks[i].xCoreID == tskNO_AFFINITY ? -1 : (int8_t)tasks[i].xCoreID;
+    if (top_count < METRICS_TOP_TASKS) {
+      top_count++;
+    }
+  }
+
+  g_cpu_prev_count = 0;
+  for (UBaseType_t i = 0; i < n && g_cpu_prev_count < CPU_TRACK_TASKS; i++) {
+    g_cpu_prev[g_cpu_prev_count].handle  = tasks[i].xHandle;
+    g_cpu_prev[g_cpu_prev_count].runtime = tasks[i].ulRunTimeCounter;
+    g_cpu_prev_count++;
+  }
+  g_cpu_prev_total = total;
+  free(tasks);
+
+  portENTER_CRITICAL(&g_metrics_lock);
+  memcpy(g_cpu_top, top, top_count * sizeof(top[0]));
+  g_cpu_top_count = top_count;
+  portEXIT_CRITICAL(&g_metrics_lock);
+#endif
+}
+
+void metrics_sample_system(void)
+{
+  if (!g_system_registered) {
+    metrics_register_gauge(&g_heap_int_free);
+    metrics_register_gauge(&g_heap_int_largest);
+    metrics_register_gauge(&g_heap_int_min);
+    metrics_register_gauge(&g_heap_psram_free);
+    metrics_register_gauge(&g_heap_psram_largest);
+    g_system_registered = true;
+  }
+
+  metric_set(&g_heap_int_free, (int32_t)heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+  metric_set(&g_heap_int_largest, (int32_t)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+  metric_set(&g_heap_int_min, (int32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+  metric_set(&g_heap_psram_free, (int32_t)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+  metric_set(&g_heap_psram_largest, (int32_t)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+
+  _sample_cpu();
+}
+
+/* snprintf that never runs past the end of buf */
+#define APPEND(...)                                                   \
+  do {                                                                \
+    if (pos < (int)len) {                                             \
+      pos += snprintf(buf + pos, len - pos, __VA_ARGS__);             \
+    }                                                                 \
+  } while (0)
+
+int metrics_snapshot(char *buf, size_t len)
+{
+  int pos = 0;
+
+  if (!buf || len == 0) {
+    return 0;
+  }
+  buf[0] = '\0';
+
+  APPEND("c");
+  for (int i = 0; i < g_counter_count; i++) {
+    APPEND(" %s=%lu", g_counters[i]->name, (unsigned long)g_counters[i]->value);
+  }
+  APPEND("\ng");
+  for (int i = 0; i < g_gauge_count; i++) {
+    APPEND(" %s=%ld", g_gauges[i]->name, (long)g_gauges[i]->value);
+  }
+  APPEND("\n");
+
+  for (int i = 0; i < g_hist_count; i++) {
+    const metric_hist_t *h = g_hists[i];
+    uint32_t count = h->count;
+    APPEND("h %s n=%lu avg=%lu", h->name, (unsigned long)count, (unsigned long)(count ? h->sum / count : 0));
+    for (int b = 0; b < METRICS_HIST_BINS; b++) {
+      if (b < METRICS_HIST_BINS - 1) {
+        APPEND(" %lu:%lu", (unsigned long)h->edges[b], (unsigned long)h->bins[b]);
+      } else {
+        APPEND(" +:%lu", (unsigned long)h->bins[b]);
+      }
+    }
+    APPEND("\n");
+  }
+
+  cpu_top_t top[METRICS_TOP_TASKS];
+  portENTER_CRITICAL(&g_metrics_lock);
+  int top_count = g_cpu_top_count;
+  memcpy(top, g_cpu_top, top_count * sizeof(top[0]));
+  portEXIT_CRITICAL(&g_metrics_lock);
+
+  APPEND("cpu");
+  for (int i = 0; i < top_count; i++) {
+    if (top[i].core >= 0) {
+      APPEND(" %s@%d=%u%%", top[i].name, top[i].core, top[i].pct);
+    } else {
+      APPEND(" %s=%u%%", top[i].name, top[i].pct);
+    }
+  }
+  APPEND("\n");
+
+  return pos;
+}
+
+void metrics_dump(void)
+{
+  char *buf = malloc(METRICS_SNAPSHOT_LEN);
+  if (!buf) {
+    return;
+  }
+
+  metrics_snapshot(buf, METRICS_SNAPSHOT_LEN);
+
+  // prefix every line so the snapshot is easy to grep out of the log
+  char *line = buf;
+  while (*line) {
+    char *end = strchr(line, '\n');
+    if (end) {
+      *end = '\0';
+    }
+    printf("M %s\n", line);
+    if (!end) {
+      break;
+    }
+    line = end + 1;
+  }
+  free(buf);
+}
+
+#ifdef CONFIG_METRICS_HTTP_SERVER
+static esp_err_t _metrics_get_handler(httpd_req_t *req)
+{
+  if (load_gov_level() >= LOAD_LEVEL_HTTP_DEFERRED) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  char *buf = malloc(METRICS_SNAPSHOT_LEN);
+  if (!buf) {
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+
+  int len = metrics_snapshot(buf, METRICS_SNAPSHOT_LEN);
+  if (len >= METRICS_SNAPSHOT_LEN) {
+    len = METRICS_SNAPSHOT_LEN - 1;
+  }
+  httpd_resp_set_type(req, "text/plain");
+  esp_err_t err = httpd_resp_send(req, buf, len);
+  free(buf);
+  return err;
+}
+#endif
+
+void metrics_http_start(void)
+{
+#ifdef CONFIG_METRICS_HTTP_SERVER
+  static httpd_handle_t server = NULL;
+  if (server) {
+    return;
+  }
+
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  config.server_port = CONFIG_METRICS_HTTP_PORT;
+  config.ctrl_port   = CONFIG_METRICS_HTTP_PORT + 1;
+  config.task_priority = TASK_METRICS_HTTP_PRIO;
+  config.stack_size    = TASK_METRICS_HTTP_STACK;
+  config.core_id       = TASK_METRICS_HTTP_CORE;
+
+  if (httpd_start(&server, &config) != ESP_OK) {
+    printf("metrics: failed to start HTTP server\n");
+    server = NULL;
+    return;
+  }
+
+  static const httpd_uri_t uri = {
+    .uri     = "/metrics",
+    .method  = HTTP_GET,
+    .handler = _metrics_get_handler,
+  };
+  httpd_register_uri_handler(server, &uri);
+  printf("metrics: serving /metrics on port %d\n", CONFIG_METRICS_HTTP_PORT);
+#endif
+}
@@ -0,0 +1,85 @@
+#ifndef METRICS_H
+#define METRICS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Counters, gauges and histograms are plain structs owned by the subsystem
+ * that updates them and registered once by address. Updates are single
+ * relaxed atomic operations, so they are safe from any task and cheap
+ * enough for per-frame paths; only the snapshot walks the registry. */
+
+#define METRICS_MAX            (48)
+#define METRICS_HIST_BINS      (8)
+#define METRICS_TOP_TASKS      (8)     // tasks listed in the CPU section
+
+typedef struct {
+  const char *name;
+  volatile uint32_t value;
+} metric_counter_t;
+
+typedef struct {
+  const char *name;
+  volatile int32_t value;
+} metric_gauge_t;
+
+typedef struct {
+  const char *name;
+  uint32_t edges[METRICS_HIST_BINS - 1];   // upper bin edges, the last bin is open
+  volatile uint32_t bins[METRICS_HIST_BINS];
+  volatile uint32_t count;
+  volatile uint32_t sum;
+} metric_hist_t;
+
+#define METRIC_COUNTER(var, metric_name)  metric_counter_t var = { .name = metric_name }
+#define METRIC_GAUGE(var, metric_name)    metric_gauge_t var = { .name = metric_name }
+#define METRIC_HIST(var, metric_name, ...) \
+  metric_hist_t var = { .name = metric_name, .edges = { __VA_ARGS__ } }
+
+static inline void metric_add(metric_counter_t *c, uint32_t n)
+{
+  __atomic_fetch_add(&c->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void metric_inc(metric_counter_t *c)
+{
+  __atomic_fetch_add(&c->value, 1, __ATOMIC_RELAXED);
+}
+
+static inline void metric_set(metric_gauge_t *g, int32_t value)
+{
+  __atomic_store_n(&g->value, value, __ATOMIC_RELAXED);
+}
+
+void metric_observe(metric_hist_t *h, uint32_t value);
+
+void metrics_register_counter(metric_counter_t *c);
+
+void metrics_register_gauge(metric_gauge_t *g);
+
+void metrics_register_hist(metric_hist_t *h);
+
+/* update the heap and CPU gauges, call periodically from one task */
+void metrics_sample_system(void);
+
+/* render all metrics as compact text, one group per line. Returns the
+ * length written, len or more when the text had to be cut */
+int metrics_snapshot(char *buf, size_t len);
+
+/* print the snapshot on the serial console */
+void metrics_dump(void);
+
+/* serve the snapshot at http://<ip>:CONFIG_METRICS_HTTP_PORT/metrics,
+ * only with CONFIG_METRICS_HTTP_SERVER */
+void metrics_http_start(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "common.h"
+#include "app_state.h"
+#include "power_gov.h"
+
+/* Without an agent nobody listens to the board, so it idles: Wi-Fi uses
+ * modem sleep and DFS lets the CPU drop towards CONFIG_EXAMPLE_MIN_CPU_FREQ_MHZ.
+ * A button press, or an agent in the channel, makes it active: Wi-Fi power
+ * save is off so downlink audio is not delayed to the next beacon.
+ *
+ * The capture and playback pipelines run for the whole RTC session, agent
+ * or not. The PM locks that keep the CPU at full speed for them are only
+ * held while the board is active; when idle nothing is sent to a listener
+ * and the audio path may run slower. The I2S driver holds its own APB lock
+ * while its channels are enabled, which keeps the DMA clock steady and the
+ * chip out of light sleep, so the CPU only scales down to 80 MHz inside a
+ * session. Light sleep is opt-in with CONFIG_POWER_LIGHT_SLEEP, for boards
+ * whose peripherals survive it. */
+
+#ifndef CONFIG_POWER_LIGHT_SLEEP
+#define CONFIG_POWER_LIGHT_SLEEP  (0)
+#endif
+
+static SemaphoreHandle_t g_power_lock = NULL;
+static StaticSemaphore_t g_power_lock_buf;
+static esp_timer_handle_t g_hold_timer = NULL;
+#ifdef CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t g_cpu_lock = NULL;
+static esp_pm_lock_handle_t g_sleep_lock = NULL;
+#endif
+static bool g_locks_held = false;
+
+static power_inputs_t g_inputs;
+static power_gov_stats_t g_stats;
+static int64_t g_mode_since_ms = 0;
+static volatile int64_t g_wake_us = 0;  // pending wake-to-audio measurement
+
+static int64_t _now_ms(void)
+{
+  return esp_timer_get_time() / 1000;
+}
+
+power_mode_t power_policy_mode(const power_inputs_t *in, int64_t now_ms)
+{
+  if (in->agent_joined || now_ms < in->hold_until_ms) {
+    return POWER_MODE_ACTIVE;
+  }
+  return POWER_MODE_IDLE;
+}
+
+static void _set_locks(bool hold)
+{
+  if (hold == g_locks_held) {
+    return;
+  }
+#ifdef CONFIG_PM_ENABLE
+  if (hold) {
+    esp_pm_lock_acquire(g_cpu_lock);
+    esp_pm_lock_acquire(g_sleep_lock);
+  } else {
+    esp_pm_lock_release(g_cpu_lock);
+    esp_pm_lock_release(g_sleep_lock);
+  }
+#endif
+  g_locks_held = hold;
+}
+
+static void _apply_wifi_ps(power_mode_t mode)
+{
+  if (!app_state_has(APP_STATE_WIFI_CONNECTED)) {
+    return;  // applied again once Wi-Fi is up
+  }
+  esp_wifi_set_ps(mode == POWER_MODE_ACTIVE ? WIFI_PS_NONE : WIFI_PS_MIN_MODEM);
+}
+
+/* re-run the policy, callers hold g_power_lock */
+static void _evaluate(bool force_wifi)
+{
+  int64_t now = _now_ms();
+  power_mode_t mode = power_policy_mode(&g_inputs, now);
+
+  if (mode != g_stats.mode) {
+    uint64_t spent = (uint64_t)(now - g_mode_since_ms);
+    if (g_stats.mode == POWER_MODE_ACTIVE) {
+      g_stats.active_ms += spent;
+    } else {
+      g_stats.idle_ms += spent;
+    }
+    g_mode_since_ms = now;
+    g_stats.mode = mode;
+    g_stats.transitions++;
+    printf("power: %s\n", mode == POWER_MODE_ACTIVE ? "active" : "idle");
+    force_wifi = true;
+  }
+
+  _set_locks(g_inputs.media_running && mode == POWER_MODE_ACTIVE);
+  if (force_wifi) {
+    _apply_wifi_ps(mode);
+  }
+
+  // come back when the hold window closes
+  if (mode == POWER_MODE_ACTIVE && !g_inputs.agent_joined && g_hold_timer) {
+    esp_timer_stop(g_hold_timer);
+    esp_timer_start_once(g_hold_timer, (uint64_t)(g_inputs.hold_until_ms - now + 1) * 1000);
+  }
+}
+
+static void _hold_timer_cb(void *arg)
+{
+  xSemaphoreTake(g_power_lock, portMAX_DELAY);
+  _evaluate(false);
+  xSemaphoreGive(g_power_lock);
+}
+
+static void _on_app_state(app_state_t changed, app_state_t state, void *ctx)
+{
+  xSemaphoreTake(g_power_lock, portMAX_DELAY);
+  if (changed & APP_STATE_AGENT_JOINED) {
+    g_inputs.agent_joined = (state & APP_STATE_AGENT_JOINED) != 0;
+    if (!g_inputs.agent_joined) {
+      g_inputs.hold_until_ms = _now_ms() + CONFIG_POWER_IDLE_DELAY_MS;
+    }
+  }
+  _evaluate((changed & APP_STATE_WIFI_CONNECTED) && (state & APP_STATE_WIFI_CONNECTED));
+  xSemaphoreGive(g_power_lock);
+}
+
+void power_gov_init(void)
+{
+#ifdef CONFIG_PM_ENABLE
+  esp_pm_config_t pm_config = {
+    .max_freq_mhz       = CONFIG_EXAMPLE_MAX_CPU_FREQ_MHZ,
+    .min_freq_mhz       = CONFIG_EXAMPLE_MIN_CPU_FREQ_MHZ,
+    .light_sleep_enable = CONFIG_POWER_LIGHT_SLEEP,
+  };
+  esp_err_t err = esp_pm_configure(&pm_config);
+  if (err != ESP_OK) {
+    printf("power: esp_pm_configure failed: %s\n", esp_err_to_name(err));
+  }
+  esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "media_cpu", &g_cpu_lock);
+  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "media_sleep", &g_sleep_lock);
+  printf("power: DFS %d-%d MHz, light sleep %s\n", CONFIG_EXAMPLE_MIN_CPU_FREQ_MHZ,
+         CONFIG_EXAMPLE_MAX_CPU_FREQ_MHZ, CONFIG_POWER_LIGHT_SLEEP ? "on" : "off");
+#else
+  printf("power: CONFIG_PM_ENABLE is off, only Wi-Fi power save is managed\n");
+#endif
+
+  g_power_lock = xSemaphoreCreateMutexStatic(&g_power_lock_buf);
+
+  const esp_timer_create_args_t args = {
+    .callback = _hold_timer_cb,
+    .name     = "power_hold",
+  };
+  esp_timer_create(&args, &g_hold_timer);
+
+  g_stats.mode    = POWER_MODE_IDLE;
+  g_mode_since_ms = _now_ms();
+
+  app_state_subscribe(_on_app_state, NULL);
+}
+
+void power_gov_wake(void)
+{
+  if (!g_power_lock) {
+    return;
+  }
+
+  xSemaphoreTake(g_power_lock, portMAX_DELAY);
+  if (g_stats.mode == POWER_MODE_IDLE) {
+    g_wake_us = esp_timer_get_time();
+  }
+  g_inputs.hold_until_ms = _now_ms() + CONFIG_POWER_IDLE_DELAY_MS;
+  _evaluate(false);
+  xSemaphoreGive(g_power_lock);
+}
+
+void power_gov_set_media_running(bool running)
+{
+  if (!g_power_lock) {
+    return;
+  }
+
+  xSemaphoreTake(g_power_lock, portMAX_DELAY);
+  g_inputs.media_running = running;
+  _evaluate(false);
+  xSemaphoreGive(g_power_lock);
+}
+
+void power_gov_note_audio(void)
+{
+  int64_t wake_us = g_wake_us;
+  if (wake_us == 0) {
+    return;
+  }
+  g_wake_us = 0;
+
+  uint32_t ms = (uint32_t)((esp_timer_get_time() - wake_us) / 1000);
+  g_stats.last_wake_to_audio_ms = ms;
+  if (ms > g_stats.max_wake_to_audio_ms) {
+    g_stats.max_wake_to_audio_ms = ms;
+  }
+  printf("power: wake from idle to agent audio %lu ms\n", (unsigned long)ms);
+}
+
+void power_gov_get_stats(power_gov_stats_t *stats)
+{
+  if (!stats || !g_power_lock) {
+    return;
+  }
+
+  xSemaphoreTake(g_power_lock, portMAX_DELAY);
+  *stats = g_stats;
+  uint64_t spent = (uint64_t)(_now_ms() - g_mode_since_ms);
+  if (g_stats.mode == POWER_MODE_ACTIVE) {
+    stats->active_ms += spent;
+  } else {
+    stats->idle_ms += spent;
+  }
+  xSemaphoreGive(g_power_lock);
+}
+
+void power_gov_report(void)
+{
+  power_gov_stats_t stats;
+  power_gov_get_stats(&stats);
+
+  uint64_t total = stats.idle_ms + stats.active_ms;
+  printf("power: %s, idle %llu s (%d%%), active %llu s, %lu transitions, wake to audio last %lu / max %lu ms\n",
+         stats.mode == POWER_MODE_ACTIVE ? "active" : "idle", (unsigned long long)(stats.idle_ms / 1000),
+         total ? (int)(stats.idle_ms * 100 / total) : 0, (unsigned long long)(stats.active_ms / 1000),
+         (unsigned long)stats.transitions, (unsigned long)stats.last_wake_to_audio_ms,
+         (unsigned long)stats.max_wake_to_audio_ms);
+#if defined(CONFIG_PM_ENABLE) && defined(CONFIG_PM_PROFILING)
+  esp_pm_dump_locks(stdout);
+#endif
+}
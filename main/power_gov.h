@@ -0,0 +1,64 @@
+#ifndef POWER_GOV_H
+#define POWER_GOV_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* stay active this long after a wake-up or after the agent has left,
+ * so a restart or the next turn does not pay for a mode switch */
+#ifndef CONFIG_POWER_IDLE_DELAY_MS
+#define CONFIG_POWER_IDLE_DELAY_MS  (5000)
+#endif
+
+/* the mode picks the Wi-Fi power save; the PM locks that keep the CPU at
+ * full speed and out of light sleep are held while it is active and the
+ * pipelines run */
+typedef enum {
+  POWER_MODE_IDLE = 0,   // modem sleep
+  POWER_MODE_ACTIVE,     // Wi-Fi power save off
+} power_mode_t;
+
+typedef struct {
+  bool    media_running;   // capture/playback pipelines are running
+  bool    agent_joined;
+  int64_t hold_until_ms;   // stay active until then
+} power_inputs_t;
+
+typedef struct {
+  power_mode_t mode;
+  uint32_t transitions;
+  uint64_t idle_ms;             // time spent in each mode
+  uint64_t active_ms;
+  uint32_t last_wake_to_audio_ms;
+  uint32_t max_wake_to_audio_ms;
+} power_gov_stats_t;
+
+/* the policy, a pure function of its inputs and the time */
+power_mode_t power_policy_mode(const power_inputs_t *in, int64_t now_ms);
+
+/* configure DFS/light sleep and start in idle mode */
+void power_gov_init(void);
+
+/* a user action is coming, go active now */
+void power_gov_wake(void);
+
+/* the audio pipelines started or stopped */
+void power_gov_set_media_running(bool running);
+
+/* agent audio reached playback, ends a wake-to-audio measurement */
+void power_gov_note_audio(void);
+
+void power_gov_get_stats(power_gov_stats_t *stats);
+
+/* print the idle/active split and the PM locks */
+void power_gov_report(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
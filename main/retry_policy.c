@@ -0,0 +1,150 @@
+#include <string.h>
+
+#include "retry_policy.h"
+
+#define RETRY_AFTER_MAX_S  (3600)
+
+void retry_endpoint_init(retry_endpoint_t *ep, const char *name, const retry_policy_cfg_t *cfg)
+{
+  memset(ep, 0, sizeof(*ep));
+  ep->name  = name;
+  ep->cfg   = *cfg;
+  ep->state = RETRY_BREAKER_CLOSED;
+}
+
+bool retry_endpoint_allow(retry_endpoint_t *ep, int64_t now_ms)
+{
+  switch (ep->state) {
+    case RETRY_BREAKER_CLOSED:
+      return true;
+
+    case RETRY_BREAKER_OPEN:
+      if (now_ms - ep->opened_at_ms < (int64_t)ep->cfg.breaker_open_ms) {
+        ep->rejected++;
+        return false;
+      }
+      ep->state = RETRY_BREAKER_HALF_OPEN;
+      ep->trial_in_flight = false;
+      /* fall through */
+
+    case RETRY_BREAKER_HALF_OPEN:
+    default:
+      if (ep->trial_in_flight) {
+        ep->rejected++;
+        return false;
+      }
+      ep->trial_in_flight = true;
+      return true;
+  }
+}
+
+void retry_endpoint_record(retry_endpoint_t *ep, bool success, uint32_t latency_ms, int64_t now_ms)
+{
+  ep->attempts++;
+  ep->last_latency_ms   = latency_ms;
+  ep->total_latency_ms += latency_ms;
+  if (latency_ms > ep->max_latency_ms) {
+    ep->max_latency_ms = latency_ms;
+  }
+
+  if (success) {
+    ep->successes++;
+    ep->consecutive_failures = 0;
+    ep->state = RETRY_BREAKER_CLOSED;
+    ep->trial_in_flight = false;
+    return;
+  }
+
+  ep->failures++;
+  ep->consecutive_failures++;
+
+  /* a failed trial re-opens at once, otherwise open after the threshold */
+  if (ep->state == RETRY_BREAKER_HALF_OPEN ||
+      (ep->state == RETRY_BREAKER_CLOSED && ep->consecutive_failures >= ep->cfg.breaker_threshold)) {
+    ep->state        = RETRY_BREAKER_OPEN;
+    ep->opened_at_ms = now_ms;
+    ep->breaker_trips++;
+  }
+  ep->trial_in_flight = false;
+}
+
+uint32_t retry_backoff_ms(const retry_policy_cfg_t *cfg, int retry, uint32_t random)
+{
+  uint32_t window = cfg->base_ms;
+
+  for (int i = 0; i < retry && window < cfg->cap_ms; i++) {
+    window *= 2;
+  }
+  if (window > cfg->cap_ms) {
+    window = cfg->cap_ms;
+  }
+
+  return window ? random % (window + 1) : 0;
+}
+
+bool retry_status_is_transient(int status)
+{
+  return status < 0 || status == 429 || (status >= 500 && status <= 599);
+}
+
+bool retry_should_retry(const retry_policy_cfg_t *cfg, int status, bool sent)
+{
+  if (!retry_status_is_transient(status)) {
+    return false;
+  }
+  if (cfg->idempotent) {
+    return true;
+  }
+  return (status < 0 && !sent) || status == 429;
+}
+
+int32_t retry_parse_retry_after(const char *value)
+{
+  if (!value) {
+    return -1;
+  }
+
+  while (*value == ' ') {
+    value++;
+  }
+
+  int32_t seconds = 0;
+  const char *p = value;
+  for (; *p >= '0' && *p <= '9'; p++) {
+    if (seconds < RETRY_AFTER_MAX_S) {
+      seconds = seconds * 10 + (*p - '0');
+    }
+  }
+
+  if (p == value || (*p != '\0' && *p != ' ')) {
+    return -1;
+  }
+  if (seconds > RETRY_AFTER_MAX_S) {
+    seconds = RETRY_AFTER_MAX_S;
+  }
+
+  return seconds * 1000;
+}
+
+int32_t retry_delay_ms(const retry_policy_cfg_t *cfg, int retry, int32_t retry_after_ms, uint32_t random)
+{
+  if (retry_after_ms >= 0 && (uint32_t)retry_after_ms > cfg->cap_ms) {
+    return -1;
+  }
+
+  uint32_t delay = retry_backoff_ms(cfg, retry, random);
+  if (retry_after_ms >= 0 && (uint32_t)retry_after_ms > delay) {
+    delay = (uint32_t)retry_after_ms;
+  }
+  return (int32_t)delay;
+}
+
+const char *retry_breaker_state_name(retry_breaker_state_t state)
+{
+  switch (state) {
+    case RETRY_BREAKER_CLOSED:    return "closed";
+    case RETRY_BREAKER_OPEN:      return "open";
+    case RETRY_BREAKER_HALF_OPEN: return "half-open";
+    default:                      return "?";
+  }
+}
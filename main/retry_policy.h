@@ -0,0 +1,82 @@
+#ifndef RETRY_POLICY_H
+#define RETRY_POLICY_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  uint32_t base_ms;            // backoff window of the first retry
+  uint32_t cap_ms;             // largest backoff window
+  int      max_attempts;       // attempts per call, including the first
+  int      breaker_threshold;  // consecutive failures that open the breaker
+  uint32_t breaker_open_ms;    // time the breaker stays open before a trial call
+  bool     idempotent;         // repeating a request the server may have acted on is harmless
+} retry_policy_cfg_t;
+
+typedef enum {
+  RETRY_BREAKER_CLOSED = 0,
+  RETRY_BREAKER_OPEN,
+  RETRY_BREAKER_HALF_OPEN,
+} retry_breaker_state_t;
+
+/* Per-endpoint breaker state and metrics. Times are in ms on any monotonic
+ * clock, the caller passes them in so the logic has no platform dependency. */
+typedef struct {
+  const char           *name;
+  retry_policy_cfg_t    cfg;
+
+  retry_breaker_state_t state;
+  int                   consecutive_failures;
+  int64_t               opened_at_ms;
+  bool                  trial_in_flight;
+
+  uint32_t attempts;
+  uint32_t successes;
+  uint32_t failures;
+  uint32_t retries;
+  uint32_t rejected;       // calls refused while the breaker was open
+  uint32_t breaker_trips;
+  uint32_t last_latency_ms;
+  uint32_t max_latency_ms;
+  uint64_t total_latency_ms;
+} retry_endpoint_t;
+
+void retry_endpoint_init(retry_endpoint_t *ep, const char *name, const retry_policy_cfg_t *cfg);
+
+/* false while the breaker is open; in half-open state one trial call passes */
+bool retry_endpoint_allow(retry_endpoint_t *ep, int64_t now_ms);
+
+/* record the outcome of one attempt */
+void retry_endpoint_record(retry_endpoint_t *ep, bool success, uint32_t latency_ms, int64_t now_ms);
+
+/* full jitter: uniform in [0, min(cap, base * 2^retry)], retry counts from 0 */
+uint32_t retry_backoff_ms(const retry_policy_cfg_t *cfg, int retry, uint32_t random);
+
+/* transport errors (status < 0), 429 and 5xx are worth retrying */
+bool retry_status_is_transient(int status);
+
+/* whether an attempt that ended with status is repeated. sent tells whether
+ * the request got past the connect phase; a call that is not idempotent is
+ * only repeated when the server cannot have acted on it: nothing was sent,
+ * or it answered 429 */
+bool retry_should_retry(const retry_policy_cfg_t *cfg, int status, bool sent);
+
+/* Retry-After as delta-seconds, returns ms or -1 (HTTP-dates are not used by the API) */
+int32_t retry_parse_retry_after(const char *value);
+
+/* the wait before retry number retry: the backoff, or the server's
+ * Retry-After (retry_after_ms, -1 if none) when that is longer. -1 when
+ * Retry-After is past cap_ms, the call gives up instead of waiting that long */
+int32_t retry_delay_ms(const retry_policy_cfg_t *cfg, int retry, int32_t retry_after_ms, uint32_t random);
+
+const char *retry_breaker_state_name(retry_breaker_state_t state);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
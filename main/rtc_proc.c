@@ -2,35 +2,60 @@
 #include "board.h"
 
 #include "common.h"
+#include "app_state.h"
 #include "agora_rtc_api.h"
+#include "ai_agent.h"
 #include "audio_proc.h"
+#include "boot_seq.h"
+#include "conv_latency.h"
+#include "load_gov.h"
+#include "media_clock.h"
+#include "metrics.h"
+#include "power_gov.h"
 #include "rtc_proc.h"
 
 #define DEFAULT_SDK_LOG_PATH      "io.agora.rtc_sdk"
 #define DEFAULT_AREA_CODE         AREA_CODE_GLOB
 
+#ifdef CONFIG_VIDEO_USE_H264
+#define VIDEO_DATA_TYPE           VIDEO_DATA_TYPE_H264
+#else
+#define VIDEO_DATA_TYPE           VIDEO_DATA_TYPE_GENERIC_JPEG
+#endif
+
 static connection_id_t g_conn_id;
+static rtc_key_frame_req_cb_t g_key_frame_req_cb = NULL;
+static volatile bool g_audio_muted = false;
+
+static METRIC_COUNTER(g_audio_sent, "rtc.audio_sent");
+static METRIC_COUNTER(g_audio_send_err, "rtc.audio_send_err");
+static METRIC_COUNTER(g_video_send_err, "rtc.video_send_err");
+static METRIC_COUNTER(g_agent_audio_rx, "rtc.agent_audio_rx");
 
 static void __on_join_channel_success(connection_id_t conn_id, uint32_t uid, int elapsed)
 {
   connection_info_t conn_info = { 0 };
 
+  media_sync_reset();
+
+  // the capture loop runs while this is set, set it before releasing the loop
+  app_state_set(APP_STATE_SESSION_STARTED);
   audio_sema_pend();
 
-  g_app.b_call_session_started = true;
   agora_rtc_get_connection_info(conn_id, &conn_info);
   printf("[conn-%lu] Join the channel %s successfully, uid %lu elapsed %d ms\n", conn_id, conn_info.channel_name, uid, elapsed);
+  boot_seq_signal(BOOT_EVT_RTC);
 }
 
 static void __on_connection_lost(connection_id_t conn_id)
 {
-  g_app.b_call_session_started = false;
+  app_state_clear(APP_STATE_SESSION_STARTED);
   printf("[conn-%lu] Lost connection from the channel\n", conn_id);
 }
 
 static void __on_rejoin_channel_success(connection_id_t conn_id, uint32_t uid, int elapsed_ms)
 {
-  g_app.b_call_session_started = true;
+  app_state_set(APP_STATE_SESSION_STARTED);
   printf("[conn-%lu] Rejoin the channel successfully, uid %lu elapsed %d ms\n", conn_id, uid, elapsed_ms);
 }
 
@@ -47,7 +72,7 @@ static void __on_user_offline(connection_id_t conn_id, uint32_t uid, int reason)
   if (uid == CONVO_AGENT_RTC_UID) {
     printf("⚠️  AI Agent (uid=%lu) has left RTC channel\n", uid);
     printf("   Clearing agent state flags\n");
-    g_app.b_ai_agent_joined = false;
+    app_state_clear(APP_STATE_AGENT_JOINED);
     memset(g_app.agent_id, 0, AGENT_ID_LEN);
   }
 }
@@ -92,6 +117,18 @@ static void __on_audio_data(connection_id_t conn_id, const uint32_t uid, uint16_
     printf("[conn-%lu] on_audio_data, uid %lu sent_ts %u data_type %d, len %zu\n", conn_id, uid, sent_ts,
            info_ptr->data_type, len);
   }
+  if (uid == CONVO_AGENT_RTC_UID) {
+    metric_inc(&g_agent_audio_rx);
+  }
+  // a standby agent's greeting is not heard, none of the latencies end on it
+  if (g_audio_muted) {
+    return;
+  }
+  if (uid == CONVO_AGENT_RTC_UID) {
+    conv_latency_agent_audio((const int16_t *)data, len / sizeof(int16_t), media_clock_now_us());
+    ai_agent_note_agent_audio();
+    power_gov_note_audio();
+  }
   playback_stream_write((char *)data, len);
 }
 #endif //#ifdef CONFIG_ENABLE_AUDIO_MIXING
@@ -112,6 +149,9 @@ static void __on_target_bitrate_changed(connection_id_t conn_id, uint32_t target
 static void __on_key_frame_gen_req(connection_id_t conn_id, uint32_t uid, video_stream_type_e stream_type)
 {
   printf("[conn-%lu] Frame loss detected. Please notify the encoder to generate key frame immediately\n", conn_id);
+  if (g_key_frame_req_cb) {
+    g_key_frame_req_cb();
+  }
 }
 
 static void __on_user_mute_video(connection_id_t conn_id, uint32_t uid, bool muted)
@@ -155,6 +195,11 @@ int agora_rtc_proc_create(char *license, uint32_t uid)
 {
   int rval = -1;
 
+  metrics_register_counter(&g_audio_sent);
+  metrics_register_counter(&g_audio_send_err);
+  metrics_register_counter(&g_video_send_err);
+  metrics_register_counter(&g_agent_audio_rx);
+
   // 1. API: init agora rtc sdk
   agora_rtc_event_handler_t event_handler = { 0 };
   app_init_event_handler(&event_handler);
@@ -219,37 +264,68 @@ void agora_rtc_proc_destroy(void)
   agora_rtc_fini();
 }
 
-int send_rtc_audio_frame(uint8_t *data, uint32_t len)
+int send_rtc_audio_frame(uint8_t *data, uint32_t len, int64_t capture_us)
 {
   // API: send audio data
+  if (g_audio_muted) {
+    return 0;
+  }
+
+  // what the agent hears, so the end of the user's turn is detected here;
+  // optional analysis that is shed under load
+  if (load_gov_level() < LOAD_LEVEL_DSP_OFF) {
+    conv_latency_capture_frame((const int16_t *)data, len / sizeof(int16_t), capture_us,
+                               CONFIG_AUDIO_FRAME_DURATION_MS);
+  }
+
   audio_frame_info_t info = { 0 };
   info.data_type = AUDIO_DATA_TYPE_PCM;
 
   int rval = agora_rtc_send_audio_data(g_conn_id, data, len, &info);
   if (rval < 0) {
+    metric_inc(&g_audio_send_err);
     printf("Failed to send audio data, reason: %s\n", agora_rtc_err_2_str(rval));
     return -1;
   }
+  metric_inc(&g_audio_sent);
+
+  media_sync_audio_sent(capture_us, media_clock_now_us());
 
   return 0;
 }
 
-int send_rtc_video_frame(uint8_t *data, uint32_t len)
+void rtc_set_audio_muted(bool muted)
+{
+  if (g_audio_muted != muted) {
+    printf("RTC audio %s\n", muted ? "muted" : "unmuted");
+  }
+  g_audio_muted = muted;
+}
+
+void rtc_set_key_frame_req_cb(rtc_key_frame_req_cb_t cb)
+{
+  g_key_frame_req_cb = cb;
+}
+
+int send_rtc_video_frame(uint8_t *data, uint32_t len, bool is_key_frame, int64_t capture_us)
 {
   // API: send video data
   video_frame_info_t info = {
-    .data_type    = VIDEO_DATA_TYPE_GENERIC_JPEG,
+    .data_type    = VIDEO_DATA_TYPE,
     .stream_type  = VIDEO_STREAM_HIGH,
-    .frame_type   = VIDEO_FRAME_KEY,
+    .frame_type   = is_key_frame ? VIDEO_FRAME_KEY : VIDEO_FRAME_DELTA,
     .rotation     = VIDEO_ORIENTATION_0,
     .frame_rate   = 0
   };
 
   int rval = agora_rtc_send_video_data(g_conn_id, data, len, &info);
   if (rval < 0) {
+    metric_inc(&g_video_send_err);
     printf("Failed to send video data, reason: %s\n", agora_rtc_err_2_str(rval));
     return -1;
   }
 
+  media_sync_video_sent(capture_us, media_clock_now_us());
+
   return 0;
 }
@@ -6,6 +6,8 @@ extern "C" {
 
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 
 #define BANDWIDTH_ESTIMATE_MIN_BITRATE     (500000)
@@ -17,9 +19,18 @@ int agora_rtc_proc_create(char *license, uint32_t uid);
 
 void agora_rtc_proc_destroy(void);
 
-int send_rtc_video_frame(uint8_t *data, uint32_t len);
+/* key frame request from the far end, called from the SDK thread */
+typedef void (*rtc_key_frame_req_cb_t)(void);
 
-int send_rtc_audio_frame(uint8_t *data, uint32_t len);
+void rtc_set_key_frame_req_cb(rtc_key_frame_req_cb_t cb);
+
+/* capture_us is the media clock time of the first sample/pixel in the frame */
+int send_rtc_video_frame(uint8_t *data, uint32_t len, bool is_key_frame, int64_t capture_us);
+
+int send_rtc_audio_frame(uint8_t *data, uint32_t len, int64_t capture_us);
+
+/* drop uplink audio and remote playback locally, the connection stays up */
+void rtc_set_audio_muted(bool muted);
 
 #ifdef __cplusplus
 }
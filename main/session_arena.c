@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "common.h"
+#include "metrics.h"
+#include "session_arena.h"
+
+#define ARENA_ALIGN          (16)
+#define RECYCLE_POLL_MS      (10)
+
+typedef struct {
+  uint8_t *base;
+  size_t size;
+  size_t used;
+  size_t high_water;
+  uint32_t fallbacks;
+  uint32_t caps;
+} arena_t;
+
+static portMUX_TYPE g_arena_lock = portMUX_INITIALIZER_UNLOCKED;
+static arena_t g_arenas[SESSION_MEM_COUNT] = {
+  [SESSION_MEM_INTERNAL] = { .caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT },
+  [SESSION_MEM_PSRAM]    = { .caps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT },
+};
+static void *g_fallbacks[SESSION_ARENA_MAX_FALLBACKS];
+static int g_fallback_count = 0;
+static int g_users = 0;
+static int g_recycling = 0;     // users waiting in session_arena_recycle()
+static uint32_t g_resets = 0;
+static size_t g_largest_block = 0;
+static size_t g_min_largest_block = SIZE_MAX;
+
+static METRIC_GAUGE(g_int_high_water, "arena.int_hw");
+static METRIC_GAUGE(g_psram_high_water, "arena.psram_hw");
+static METRIC_COUNTER(g_fallback_counter, "arena.fallbacks");
+
+void session_arena_init(void)
+{
+  static const size_t sizes[SESSION_MEM_COUNT] = {
+    [SESSION_MEM_INTERNAL] = CONFIG_SESSION_ARENA_INTERNAL_KB * 1024,
+    [SESSION_MEM_PSRAM]    = CONFIG_SESSION_ARENA_PSRAM_KB * 1024,
+  };
+
+  for (int i = 0; i < SESSION_MEM_COUNT; i++) {
+    arena_t *arena = &g_arenas[i];
+    if (arena->base) {
+      continue;
+    }
+    arena->base = heap_caps_aligned_alloc(ARENA_ALIGN, sizes[i], arena->caps);
+    arena->size = arena->base ? sizes[i] : 0;
+    if (!arena->base) {
+      printf("session_arena: failed to reserve %u bytes, using the heap\n", (unsigned)sizes[i]);
+    }
+  }
+
+  metrics_register_gauge(&g_int_high_water);
+  metrics_register_gauge(&g_psram_high_water);
+  metrics_register_counter(&g_fallback_counter);
+}
+
+void session_arena_retain(void)
+{
+  portENTER_CRITICAL(&g_arena_lock);
+  g_users++;
+  portEXIT_CRITICAL(&g_arena_lock);
+}
+
+/* called with g_arena_lock held, every user is done with its buffers */
+static void _reset_locked(void **fallbacks, int *fallback_count, size_t *used)
+{
+  for (int i = 0; i < SESSION_MEM_COUNT; i++) {
+    used[i] = g_arenas[i].used;
+    g_arenas[i].used = 0;
+  }
+  *fallback_count = g_fallback_count;
+  memcpy(fallbacks, g_fallbacks, g_fallback_count * sizeof(fallbacks[0]));
+  g_fallback_count = 0;
+  g_recycling      = 0;
+  g_resets++;
+}
+
+static void _after_reset(void **fallbacks, int fallback_count, const size_t *used)
+{
+  for (int i = 0; i < fallback_count; i++) {
+    heap_caps_free(fallbacks[i]);
+  }
+
+  // whether start/stop cycles fragment the internal heap shows up here
+  g_largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (g_largest_block < g_min_largest_block) {
+    g_min_largest_block = g_largest_block;
+  }
+
+  printf("session_arena: reset #%lu, internal %u/%u, psram %u/%u, %d fallbacks, largest internal block %u (min %u)\n",
+         (unsigned long)g_resets, (unsigned)used[SESSION_MEM_INTERNAL], (unsigned)g_arenas[SESSION_MEM_INTERNAL].size,
+         (unsigned)used[SESSION_MEM_PSRAM], (unsigned)g_arenas[SESSION_MEM_PSRAM].size, fallback_count,
+         (unsigned)g_largest_block, (unsigned)g_min_largest_block);
+}
+
+void session_arena_release(void)
+{
+  void *fallbacks[SESSION_ARENA_MAX_FALLBACKS];
+  int fallback_count = 0;
+  size_t used[SESSION_MEM_COUNT];
+
+  portENTER_CRITICAL(&g_arena_lock);
+  if (g_users == 0) {
+    portEXIT_CRITICAL(&g_arena_lock);
+    return;
+  }
+  // the others may all be waiting to recycle, then this was the one they waited for
+  g_users--;
+  if (g_users > 0 && g_recycling < g_users) {
+    portEXIT_CRITICAL(&g_arena_lock);
+    return;
+  }
+  _reset_locked(fallbacks, &fallback_count, used);
+  portEXIT_CRITICAL(&g_arena_lock);
+
+  _after_reset(fallbacks, fallback_count, used);
+}
+
+bool session_arena_recycle(uint32_t timeout_ms)
+{
+  void *fallbacks[SESSION_ARENA_MAX_FALLBACKS];
+  int fallback_count = 0;
+  size_t used[SESSION_MEM_COUNT];
+
+  portENTER_CRITICAL(&g_arena_lock);
+  uint32_t resets = g_resets;
+  bool last = ++g_recycling >= g_users;
+  if (last) {
+    _reset_locked(fallbacks, &fallback_count, used);
+  }
+  portEXIT_CRITICAL(&g_arena_lock);
+
+  if (last) {
+    _after_reset(fallbacks, fallback_count, used);
+    return true;
+  }
+
+  // another user still works on its buffers, wait for it to recycle too
+  for (uint32_t waited_ms = 0; waited_ms < timeout_ms; waited_ms += RECYCLE_POLL_MS) {
+    vTaskDelay(pdMS_TO_TICKS(RECYCLE_POLL_MS));
+    if (g_resets != resets) {
+      return true;
+    }
+  }
+
+  portENTER_CRITICAL(&g_arena_lock);
+  bool done = g_resets != resets;
+  if (!done) {
+    g_recycling--;
+  }
+  portEXIT_CRITICAL(&g_arena_lock);
+  return done;
+}
+
+void *session_alloc(session_mem_t mem, size_t size)
+{
+  if (mem >= SESSION_MEM_COUNT || size == 0) {
+    return NULL;
+  }
+
+  arena_t *arena = &g_arenas[mem];
+  size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  void *ptr = NULL;
+
+  portENTER_CRITICAL(&g_arena_lock);
+  if (arena->base && arena->size - arena->used >= need) {
+    ptr = arena->base + arena->used;
+    arena->used += need;
+    if (arena->used > arena->high_water) {
+      arena->high_water = arena->used;
+    }
+  }
+  portEXIT_CRITICAL(&g_arena_lock);
+
+  if (ptr) {
+    metric_set(mem == SESSION_MEM_INTERNAL ? &g_int_high_water : &g_psram_high_water, (int32_t)arena->high_water);
+    return ptr;
+  }
+
+  // the arena is too small for this session, the heap takes over
+  ptr = heap_caps_aligned_alloc(ARENA_ALIGN, size, arena->caps);
+  if (!ptr) {
+    return NULL;
+  }
+
+  portENTER_CRITICAL(&g_arena_lock);
+  bool tracked = g_fallback_count < SESSION_ARENA_MAX_FALLBACKS;
+  if (tracked) {
+    g_fallbacks[g_fallback_count++] = ptr;
+    arena->fallbacks++;
+  }
+  portEXIT_CRITICAL(&g_arena_lock);
+
+  if (!tracked) {
+    heap_caps_free(ptr);
+    return NULL;
+  }
+
+  metric_inc(&g_fallback_counter);
+  printf("session_arena: %u bytes from the heap, %s arena full\n", (unsigned)size,
+         mem == SESSION_MEM_INTERNAL ? "internal" : "psram");
+  return ptr;
+}
+
+void session_arena_get_stats(session_arena_stats_t *stats)
+{
+  if (!stats) {
+    return;
+  }
+
+  portENTER_CRITICAL(&g_arena_lock);
+  for (int i = 0; i < SESSION_MEM_COUNT; i++) {
+    stats->arena[i].size       = g_arenas[i].size;
+    stats->arena[i].used       = g_arenas[i].used;
+    stats->arena[i].high_water = g_arenas[i].high_water;
+    stats->arena[i].fallbacks  = g_arenas[i].fallbacks;
+  }
+  stats->resets                     = g_resets;
+  stats->largest_internal_block     = g_largest_block;
+  stats->min_largest_internal_block = g_min_largest_block == SIZE_MAX ? 0 : g_min_largest_block;
+  portEXIT_CRITICAL(&g_arena_lock);
+}
@@ -0,0 +1,81 @@
+#ifndef SESSION_ARENA_H
+#define SESSION_ARENA_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Buffers that live exactly as long as a session come from two bump arenas
+ * reserved at boot, before the heap has a chance to fragment. They are never
+ * freed one by one; the arenas are reset in O(1) once the last user has
+ * released the RTC session, or once every user has recycled at the end of
+ * an agent session, so start/stop cycles leave no holes. */
+
+#ifndef CONFIG_SESSION_ARENA_INTERNAL_KB
+#define CONFIG_SESSION_ARENA_INTERNAL_KB  (4)
+#endif
+#ifndef CONFIG_SESSION_ARENA_PSRAM_KB
+#ifdef CONFIG_VIDEO_USE_H264
+#define CONFIG_SESSION_ARENA_PSRAM_KB     (192)   // I420 frame and bitstream buffer
+#else
+#define CONFIG_SESSION_ARENA_PSRAM_KB     (64)
+#endif
+#endif
+
+/* how long a media thread waits for the others to recycle, at least one
+ * video frame period */
+#define SESSION_ARENA_RECYCLE_WAIT_MS     (1000)
+
+/* allocations that do not fit fall back to the heap and are freed at reset */
+#define SESSION_ARENA_MAX_FALLBACKS       (8)
+
+typedef enum {
+  SESSION_MEM_INTERNAL = 0,   // DMA capable internal RAM, for small hot buffers
+  SESSION_MEM_PSRAM,          // bulk data
+  SESSION_MEM_COUNT
+} session_mem_t;
+
+typedef struct {
+  size_t size;
+  size_t used;
+  size_t high_water;          // most used in any session
+  uint32_t fallbacks;         // allocations served by the heap instead
+} session_arena_usage_t;
+
+typedef struct {
+  session_arena_usage_t arena[SESSION_MEM_COUNT];
+  uint32_t resets;
+  size_t largest_internal_block;       // after the last reset
+  size_t min_largest_internal_block;   // worst seen after any reset
+} session_arena_stats_t;
+
+/* reserve both arenas, call once early in app_main */
+void session_arena_init(void);
+
+/* a session user starts, its allocations stay valid until it releases */
+void session_arena_retain(void);
+
+/* the last release resets both arenas */
+void session_arena_release(void);
+
+/* the agent session ended and the caller no longer needs its buffers. Once
+ * every user has called it both arenas are reset and it returns true; the
+ * caller must then allocate its buffers again. Returns false if the other
+ * users did not follow within timeout_ms, the old buffers stay valid */
+bool session_arena_recycle(uint32_t timeout_ms);
+
+/* 16 byte aligned, NULL only if the heap fallback fails too. Never free
+ * the result */
+void *session_alloc(session_mem_t mem, size_t size);
+
+void session_arena_get_stats(session_arena_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,114 @@
+#include <stdio.h>
+
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "metrics.h"
+#include "task_plan.h"
+
+#ifndef CONFIG_TASK_PLAN_JITTER_PERIOD_MS
+#define CONFIG_TASK_PLAN_JITTER_PERIOD_MS  (10)
+#endif
+
+#define JITTER_WINDOW  (1000)   // wakeups per sched.wake_max_us window
+
+#define TASK_PLAN_ENTRY(id, task_name, task_core, task_prio, task_stack, task_mem) \
+  [TASK_##id] = { .name = task_name, .core = task_core, .prio = task_prio, .stack = task_stack, .mem = task_mem },
+
+static const task_plan_t g_task_plan[TASK_PLAN_COUNT] = {
+  TASK_PLAN_TABLE(TASK_PLAN_ENTRY)
+};
+
+const task_plan_t *task_plan_get(task_id_t id)
+{
+  if (id >= TASK_PLAN_COUNT) {
+    return NULL;
+  }
+  return &g_task_plan[id];
+}
+
+BaseType_t task_plan_create(task_id_t id, TaskFunction_t fn, void *arg, TaskHandle_t *handle)
+{
+  const task_plan_t *plan = task_plan_get(id);
+  if (!plan) {
+    return pdFAIL;
+  }
+
+  if (plan->mem == TASK_STACK_PSRAM) {
+    return xTaskCreatePinnedToCoreWithCaps(fn, plan->name, plan->stack, arg, plan->prio, handle, plan->core,
+                                           MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  }
+  return xTaskCreatePinnedToCore(fn, plan->name, plan->stack, arg, plan->prio, handle, plan->core);
+}
+
+void task_plan_log(void)
+{
+#ifdef CONFIG_TASK_PLAN_AUDIO_CORE1
+  printf("task_plan: audio on core 1, control on core 0\n");
+#else
+  printf("task_plan: audio on core 0 with Wi-Fi, control floating\n");
+#endif
+}
+
+#ifdef CONFIG_TASK_PLAN_JITTER_PROBE
+static METRIC_HIST(g_wake_hist, "sched.wake_us", 20, 50, 100, 200, 500, 1000, 5000);
+static METRIC_GAUGE(g_wake_max, "sched.wake_max_us");   // worst wakeup in the last window
+static TaskHandle_t g_probe_task = NULL;
+static volatile int64_t g_probe_stamp_us = 0;
+
+static void _probe_timer_cb(void *arg)
+{
+  g_probe_stamp_us = esp_timer_get_time();
+  xTaskNotifyGive(g_probe_task);
+}
+
+static void _probe_task(void *arg)
+{
+  uint32_t window_max = 0;
+  uint32_t samples = 0;
+
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    uint32_t late_us = (uint32_t)(esp_timer_get_time() - g_probe_stamp_us);
+
+    metric_observe(&g_wake_hist, late_us);
+    if (late_us > window_max) {
+      window_max = late_us;
+    }
+    if (++samples >= JITTER_WINDOW) {
+      metric_set(&g_wake_max, (int32_t)window_max);
+      window_max = 0;
+      samples = 0;
+    }
+  }
+}
+#endif
+
+void task_plan_start_jitter_probe(void)
+{
+#ifdef CONFIG_TASK_PLAN_JITTER_PROBE
+  if (g_probe_task) {
+    return;
+  }
+
+  metrics_register_hist(&g_wake_hist);
+  metrics_register_gauge(&g_wake_max);
+
+  if (task_plan_create(TASK_JITTER_PROBE, _probe_task, NULL, &g_probe_task) != pdPASS) {
+    printf("task_plan: failed to start the jitter probe\n");
+    return;
+  }
+
+  const esp_timer_create_args_t args = {
+    .callback = _probe_timer_cb,
+    .name     = "sched_probe",
+  };
+  esp_timer_handle_t timer = NULL;
+  esp_timer_create(&args, &timer);
+  esp_timer_start_periodic(timer, CONFIG_TASK_PLAN_JITTER_PERIOD_MS * 1000);
+  printf("task_plan: jitter probe on core %d, prio %d, every %d ms\n", TASK_JITTER_PROBE_CORE,
+         TASK_JITTER_PROBE_PRIO, CONFIG_TASK_PLAN_JITTER_PERIOD_MS);
+#endif
+}
@@ -0,0 +1,97 @@
+#ifndef TASK_PLAN_H
+#define TASK_PLAN_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Where every task of the application runs. Wi-Fi and the esp_timer task
+ * live on core 0; the default profile keeps the audio path there as well,
+ * CONFIG_TASK_PLAN_AUDIO_CORE1 moves it to core 1 and pins the control
+ * tasks to core 0 so nothing but audio competes for core 1.
+ * Threads created inside the RTC SDK are not covered and float. */
+
+#define TASK_CORE_ANY          tskNO_AFFINITY
+
+#ifdef CONFIG_TASK_PLAN_AUDIO_CORE1
+#define TASK_CORE_AUDIO        1
+#define TASK_CORE_VIDEO        0
+#define TASK_CORE_CTRL         0
+#else
+#define TASK_CORE_AUDIO        0
+#define TASK_CORE_VIDEO        0
+#define TASK_CORE_CTRL         TASK_CORE_ANY
+#endif
+
+typedef enum {
+  TASK_STACK_INTERNAL = 0,
+  TASK_STACK_PSRAM,
+} task_stack_mem_t;
+
+/* stack 0: the stack is owned by the library that creates the task
+ *  id            name               core             prio  stack  stack memory */
+#define TASK_PLAN_TABLE(X)                                                                  \
+  X(I2S_READ,     "i2s_read",        TASK_CORE_AUDIO, 23,   3072,  TASK_STACK_PSRAM)        \
+  X(I2S_WRITE,    "i2s_write",       TASK_CORE_AUDIO, 23,   3072,  TASK_STACK_PSRAM)        \
+  X(AUDIO_ALGO,   "algo",            TASK_CORE_AUDIO, 5,    8192,  TASK_STACK_PSRAM)        \
+  X(AUDIO_SEND,   "audio_send_task", TASK_CORE_AUDIO, 21,   4096,  TASK_STACK_PSRAM)        \
+  X(VIDEO_SEND,   "video_send_task", TASK_CORE_VIDEO, 21,   5120,  TASK_STACK_INTERNAL)     \
+  X(JPEG_HFM,     "jpeg_hfm",        TASK_CORE_VIDEO, 20,   0,     TASK_STACK_INTERNAL)     \
+  X(APP_STATE,    "app_state",       TASK_CORE_CTRL,  10,   3072,  TASK_STACK_INTERNAL)     \
+  X(AGENT_CTRL,   "agent_ctrl",      TASK_CORE_CTRL,  5,    8192,  TASK_STACK_INTERNAL)     \
+  X(XVF_BUTTON,   "xvf3800_button",  TASK_CORE_CTRL,  5,    4096,  TASK_STACK_INTERNAL)     \
+  X(I2C_MGR,      "i2c_mgr",         TASK_CORE_CTRL,  11,   3072,  TASK_STACK_INTERNAL)     \
+  X(VOICE_SENSOR, "voice_sensor",    TASK_CORE_CTRL,  6,    3072,  TASK_STACK_INTERNAL)     \
+  X(BOOT_STEP,    "boot_step",       TASK_CORE_ANY,   5,    4096,  TASK_STACK_INTERNAL)     \
+  X(METRICS_HTTP, "metrics_http",    TASK_CORE_CTRL,  5,    4096,  TASK_STACK_INTERNAL)     \
+  X(JITTER_PROBE, "sched_probe",     TASK_CORE_AUDIO, 21,   2048,  TASK_STACK_INTERNAL)
+
+/* TASK_<id> indexes the table */
+#define TASK_PLAN_ID(id, ...)  TASK_##id,
+typedef enum {
+  TASK_PLAN_TABLE(TASK_PLAN_ID)
+  TASK_PLAN_COUNT
+} task_id_t;
+
+/* TASK_<id>_CORE, _PRIO, _STACK and _PSRAM are compile-time constants,
+ * for static stacks and the ADF element configs */
+#define TASK_PLAN_CONST(id, name, core, prio, stack, mem) \
+  TASK_##id##_CORE = (core), TASK_##id##_PRIO = (prio), TASK_##id##_STACK = (stack), \
+  TASK_##id##_PSRAM = ((mem) == TASK_STACK_PSRAM),
+enum {
+  TASK_PLAN_TABLE(TASK_PLAN_CONST)
+};
+
+typedef struct {
+  const char *name;
+  BaseType_t core;
+  UBaseType_t prio;
+  uint32_t stack;
+  task_stack_mem_t mem;
+} task_plan_t;
+
+const task_plan_t *task_plan_get(task_id_t id);
+
+/* create a dynamically allocated task as planned, the stack comes from
+ * PSRAM when the plan says so */
+BaseType_t task_plan_create(task_id_t id, TaskFunction_t fn, void *arg, TaskHandle_t *handle);
+
+/* print the active profile */
+void task_plan_log(void);
+
+/* with CONFIG_TASK_PLAN_JITTER_PROBE, measure how late a task at the audio
+ * priority on the audio core wakes up after being notified; the result is
+ * in the sched.* metrics */
+void task_plan_start_jitter_probe(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
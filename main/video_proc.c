@@ -10,21 +10,55 @@
 #include "esp_jpeg_common.h"
 #include "esp_camera.h"
 #include "esp_jpeg_enc.h"
+#include "esp_timer.h"
+#ifdef CONFIG_VIDEO_USE_H264
+#include "esp_h264_enc_single_sw.h"
+#include "yuv_convert.h"
+#endif
 
 #include "common.h"
+#include "app_state.h"
+#include "load_gov.h"
+#include "media_clock.h"
 #include "rtc_proc.h"
+#include "session_arena.h"
+#include "task_plan.h"
 
 
 #ifndef CONFIG_AUDIO_ONLY
 
 
+#ifdef CONFIG_VIDEO_USE_H264
+/* software H.264 on the S3 keeps up at QVGA, not at VGA */
+#define CONFIG_FRAME_WIDTH 320
+#define CONFIG_FRAME_HIGH  240
+#define CONFIG_FRAME_SIZE  (FRAMESIZE_QVGA)
+#else
 #define CONFIG_FRAME_WIDTH 640//480
 #define CONFIG_FRAME_HIGH  480//320
 #define CONFIG_FRAME_SIZE  (FRAMESIZE_VGA)//(FRAMESIZE_HVGA)
+#endif
+
+#ifndef CONFIG_VIDEO_FPS
+#define CONFIG_VIDEO_FPS          5
+#endif
+#ifndef CONFIG_VIDEO_H264_GOP
+#define CONFIG_VIDEO_H264_GOP     (CONFIG_VIDEO_FPS * 4)   // one IDR every 4 s
+#endif
+#ifndef CONFIG_VIDEO_H264_BITRATE
+#define CONFIG_VIDEO_H264_BITRATE (200 * 1000)
+#endif
+
+#define VIDEO_STATS_INTERVAL      50  // frames between encoder stats prints
 
 #define CAMERA_WIDTH (CONFIG_FRAME_WIDTH)
 #define CAMERA_HIGH (CONFIG_FRAME_HIGH)
 
+/* JPEG resolution when the load governor asks for less work */
+#define LOW_RES_WIDTH      320
+#define LOW_RES_HIGH       240
+#define LOW_RES_FRAME_SIZE (FRAMESIZE_QVGA)
+
 #define CAM_PIN_PWDN -1 // power down is not used
 #define CAM_PIN_RESET -1 // software reset will be performed
 #define CAM_PIN_XCLK GPIO_NUM_40
@@ -79,14 +113,16 @@ static camera_config_t camera_config = {
 };
 
 
-static jpeg_enc_handle_t init_jpeg_encoder(int quality, int hfm_core, int hfm_priority, jpeg_subsampling_t subsampling)
+#ifndef CONFIG_VIDEO_USE_H264
+static jpeg_enc_handle_t init_jpeg_encoder(int width, int height, int quality, int hfm_core, int hfm_priority,
+                                           jpeg_subsampling_t subsampling)
 {
   jpeg_enc_handle_t jpeg_enc = NULL;
 
   jpeg_enc_config_t jpeg_enc_info = DEFAULT_JPEG_ENC_CONFIG();
 
-  jpeg_enc_info.width       = CAMERA_WIDTH;
-  jpeg_enc_info.height      = CAMERA_HIGH;
+  jpeg_enc_info.width       = width;
+  jpeg_enc_info.height      = height;
   // jpeg_enc_info.src_type    = JPEG_RAW_TYPE_YCbY2YCrY2;  //conv_mode = YUV422_TO_YUV420 
   jpeg_enc_info.src_type    = JPEG_PIXEL_FORMAT_YCbYCr;
   jpeg_enc_info.subsampling = subsampling;
@@ -104,55 +140,289 @@ static jpeg_enc_handle_t init_jpeg_encoder(int quality, int hfm_core, int hfm_pr
   return jpeg_enc;
 }
 
+/* switch the sensor and the encoder between full and low resolution,
+ * returns the encoder to use from now on, NULL if it could not be reopened */
+static jpeg_enc_handle_t video_set_low_res(jpeg_enc_handle_t jpeg_enc, bool low_res)
+{
+  sensor_t *sensor = esp_camera_sensor_get();
+  if (!sensor || sensor->set_framesize(sensor, low_res ? LOW_RES_FRAME_SIZE : CONFIG_FRAME_SIZE) != 0) {
+    printf("video: failed to change the frame size\n");
+    return jpeg_enc;
+  }
+
+  jpeg_enc_close(jpeg_enc);
+  printf("video: %s resolution\n", low_res ? "low" : "full");
+  return init_jpeg_encoder(low_res ? LOW_RES_WIDTH : CAMERA_WIDTH, low_res ? LOW_RES_HIGH : CAMERA_HIGH, 40,
+                           TASK_JPEG_HFM_CORE, TASK_JPEG_HFM_PRIO, JPEG_SUBSAMPLE_420);
+}
+#endif
+
+static volatile bool g_key_frame_req = false;
+
+typedef struct {
+  int      frames;
+  int      key_frames;
+  uint32_t bytes;
+  int64_t  encode_us;
+} video_stats_t;
+
+static void video_stats_update(video_stats_t *stats, uint32_t len, bool is_key_frame, int64_t encode_us)
+{
+  stats->frames++;
+  stats->key_frames += is_key_frame ? 1 : 0;
+  stats->bytes      += len;
+  stats->encode_us  += encode_us;
+
+  if (stats->frames == VIDEO_STATS_INTERVAL) {
+    media_sync_stats_t sync;
+    media_sync_get_stats(&sync);
+
+    printf("video %s: %d frames (%d key), avg %lu B/frame, avg encode %lld us, ~%lu kbps\n",
+#ifdef CONFIG_VIDEO_USE_H264
+           "h264",
+#else
+           "jpeg",
+#endif
+           stats->frames, stats->key_frames, (unsigned long)(stats->bytes / stats->frames),
+           (long long)(stats->encode_us / stats->frames),
+           (unsigned long)(stats->bytes * 8 / stats->frames * CONFIG_VIDEO_FPS / 1000));
+    printf("a/v sync: audio latency %ld us, video latency %ld us, skew %ld us (max %ld), %lu skewed, %lu held, %lu dropped\n",
+           (long)sync.audio_latency_us, (long)sync.video_latency_us, (long)sync.skew_us,
+           (long)sync.max_abs_skew_us, (unsigned long)sync.video_skewed, (unsigned long)sync.video_held,
+           (unsigned long)sync.video_dropped);
+    memset(stats, 0, sizeof(*stats));
+  }
+}
+
+static void video_on_key_frame_req(void)
+{
+  g_key_frame_req = true;
+}
+
+#ifdef CONFIG_VIDEO_USE_H264
+static esp_h264_enc_handle_t init_h264_encoder(void)
+{
+  esp_h264_enc_handle_t h264_enc = NULL;
+
+  esp_h264_enc_cfg_sw_t cfg = {
+    .gop      = CONFIG_VIDEO_H264_GOP,
+    .fps      = CONFIG_VIDEO_FPS,
+    .res      = { .width = CAMERA_WIDTH, .height = CAMERA_HIGH },
+    .rc       = { .bitrate = CONFIG_VIDEO_H264_BITRATE, .qp_min = 26, .qp_max = 40 },
+    .pic_type = ESP_H264_RAW_FMT_I420,
+  };
+
+  if (esp_h264_enc_sw_new(&cfg, &h264_enc) != ESP_H264_ERR_OK) {
+    printf("h264 enc new failed\n");
+    return NULL;
+  }
+
+  if (esp_h264_enc_open(h264_enc) != ESP_H264_ERR_OK) {
+    printf("h264 enc open failed\n");
+    esp_h264_enc_del(h264_enc);
+    return NULL;
+  }
+
+  return h264_enc;
+}
+#endif
+
 static void video_send_thread(void *arg)
 {
   int image_len = 0;
   const int image_buf_len = 30 * 1024;
+  video_stats_t stats = { 0 };
+  esp_err_t err = ESP_OK;
 
   jpeg_enc_handle_t jpeg_enc_hdl = NULL;
-
-  uint8_t *image_buf = heap_caps_malloc(image_buf_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#ifdef CONFIG_VIDEO_USE_H264
+  esp_h264_enc_handle_t h264_enc_hdl = NULL;
+  const int yuv_buf_len = YUV_I420_SIZE(CAMERA_WIDTH, CAMERA_HIGH);
+  uint8_t *yuv_buf = NULL;
+#endif
+
+  session_arena_retain();
+  uint8_t *image_buf = session_alloc(SESSION_MEM_PSRAM, image_buf_len);
   if (!image_buf) {
     printf( "Failed to alloc video buffer!\n");
     goto THREAD_END;
   }
 
   // initialize the camera
-  esp_err_t err = esp_camera_init(&camera_config);
+  err = esp_camera_init(&camera_config);
   if (err != ESP_OK) {
     printf( "Camera Init Failed\n");
     goto THREAD_END;
   }
 
-  jpeg_enc_hdl = init_jpeg_encoder(40, 0, 20, JPEG_SUBSAMPLE_420);
+#ifdef CONFIG_VIDEO_USE_H264
+  yuv_buf = session_alloc(SESSION_MEM_PSRAM, yuv_buf_len);  // 16 byte aligned
+  if (!yuv_buf) {
+    printf( "Failed to alloc yuv buffer!\n");
+    goto THREAD_END;
+  }
+
+  h264_enc_hdl = init_h264_encoder();
+  if (!h264_enc_hdl) {
+    printf( "Failed to initialize h264 enc!\n");
+    goto THREAD_END;
+  }
+#else
+  jpeg_enc_hdl = init_jpeg_encoder(CAMERA_WIDTH, CAMERA_HIGH, 40, TASK_JPEG_HFM_CORE, TASK_JPEG_HFM_PRIO,
+                                   JPEG_SUBSAMPLE_420);
   if (!jpeg_enc_hdl) {
     printf( "Failed to initialize jpeg enc!\n");
     goto THREAD_END;
   }
+#endif
+
+  rtc_set_key_frame_req_cb(video_on_key_frame_req);
+
+  int frame_width = CAMERA_WIDTH;
+#ifndef CONFIG_VIDEO_USE_H264
+  bool low_res = false;
+#endif
+  bool agent_joined = false;
+
+  while (app_state_has(APP_STATE_SESSION_STARTED)) {
+    // the agent left, recycle the arena together with the audio thread
+    bool joined = app_state_has(APP_STATE_AGENT_JOINED);
+    if (agent_joined && !joined && session_arena_recycle(SESSION_ARENA_RECYCLE_WAIT_MS)) {
+      image_buf = session_alloc(SESSION_MEM_PSRAM, image_buf_len);
+#ifdef CONFIG_VIDEO_USE_H264
+      yuv_buf = session_alloc(SESSION_MEM_PSRAM, yuv_buf_len);
+      if (!yuv_buf) {
+        printf("Failed to alloc yuv buffer!\n");
+        break;
+      }
+#endif
+      if (!image_buf) {
+        printf("Failed to alloc video buffer!\n");
+        break;
+      }
+    }
+    agent_joined = joined;
+
+    load_level_t load = load_gov_level();
+    if (load >= LOAD_LEVEL_VIDEO_PAUSED) {
+      // no capture or encode until the load drops, resume with a key frame
+      g_key_frame_req = true;
+      usleep(1000 * 1000 / CONFIG_VIDEO_FPS);
+      continue;
+    }
+
+#ifndef CONFIG_VIDEO_USE_H264
+    /* the H.264 path already runs at QVGA */
+    if ((load >= LOAD_LEVEL_VIDEO_LOW_RES) != low_res) {
+      low_res      = !low_res;
+      jpeg_enc_hdl = video_set_low_res(jpeg_enc_hdl, low_res);
+      frame_width  = low_res ? LOW_RES_WIDTH : CAMERA_WIDTH;
+      if (!jpeg_enc_hdl) {
+        printf("Failed to reopen jpeg enc!\n");
+        break;
+      }
+    }
+#endif
 
-  while (g_app.b_call_session_started) {
     camera_fb_t *pic = esp_camera_fb_get();
+    if (!pic) {
+      // the driver timed out waiting for a frame, give the camera a frame period
+      printf("Camera capture failed\n");
+      usleep(1000 * 1000 / CONFIG_VIDEO_FPS);
+      continue;
+    }
+    if (pic->width != frame_width) {
+      // still in flight from before a resolution change
+      esp_camera_fb_return(pic);
+      continue;
+    }
+    // the camera driver stamps frames with esp_timer, the same base as the media clock
+    int64_t capture_us = (int64_t)pic->timestamp.tv_sec * 1000000 + pic->timestamp.tv_usec;
+    if (media_sync_video_check(capture_us, media_clock_now_us()) == MEDIA_SYNC_DROP) {
+      // stale, or the encode would leave it too far behind audio. The encoder
+      // never saw this one, so the reference chain is intact
+      esp_camera_fb_return(pic);
+      media_sync_video_dropped();
+      continue;
+    }
+    bool is_key_frame = true;
+    int64_t encode_start = esp_timer_get_time();
+
+#ifdef CONFIG_VIDEO_USE_H264
+    if (g_key_frame_req) {
+      /* the encoder has no "force IDR" control, reopening restarts the GOP with an IDR */
+      g_key_frame_req = false;
+      esp_h264_enc_close(h264_enc_hdl);
+      esp_h264_enc_open(h264_enc_hdl);
+    }
+
+    /* the software encoder only accepts planar I420, the camera delivers packed YUYV */
+    yuyv_to_i420(pic->buf, yuv_buf, CAMERA_WIDTH, CAMERA_HIGH);
+    esp_camera_fb_return(pic);
 
+    esp_h264_enc_in_frame_t in_frame = {
+      .raw_data = { .buffer = yuv_buf, .len = yuv_buf_len },
+      .pts      = (uint32_t)(encode_start / 1000),
+    };
+    esp_h264_enc_out_frame_t out_frame = {
+      .raw_data = { .buffer = image_buf, .len = image_buf_len },
+    };
+    if (esp_h264_enc_process(h264_enc_hdl, &in_frame, &out_frame) != ESP_H264_ERR_OK) {
+      printf("h264 encode failed\n");
+      g_key_frame_req = true;
+      usleep(1000 * 1000 / CONFIG_VIDEO_FPS);
+      continue;
+    }
+    image_len    = out_frame.length;
+    is_key_frame = (out_frame.frame_type == ESP_H264_FRAME_TYPE_IDR || out_frame.frame_type == ESP_H264_FRAME_TYPE_I);
+#else
+    /* every JPEG is self-contained, there is nothing to do for a key frame request */
+    g_key_frame_req = false;
     jpeg_enc_process(jpeg_enc_hdl, pic->buf, pic->len, image_buf, image_buf_len, &image_len);
+    esp_camera_fb_return(pic);
+#endif
+
+    video_stats_update(&stats, image_len, is_key_frame, esp_timer_get_time() - encode_start);
 
     // printf("esp_camera_fb_get buf %p, len %d, image %p, image_len %d\n", pic->buf, pic->len, image_buf, image_len);
 
-    send_rtc_video_frame(image_buf, image_len);
+    /* the SDK takes no capture time, keep |video - audio| latency within the
+     * bound here where the frame is handed over */
+    int32_t hold_us = 0;
+    media_sync_action_t action = media_sync_video_send_check(capture_us, media_clock_now_us(), &hold_us);
+    if (action == MEDIA_SYNC_DROP) {
+      media_sync_video_dropped();
+#ifdef CONFIG_VIDEO_USE_H264
+      // the next P frame would reference this one
+      g_key_frame_req = true;
+#endif
+      continue;
+    }
+    if (action == MEDIA_SYNC_HOLD) {
+      usleep(hold_us);
+    }
+
+    send_rtc_video_frame(image_buf, image_len, is_key_frame, capture_us);
 
-    esp_camera_fb_return(pic);
-  
     // sleep and wait until time is up for next send
-    usleep(200 * 1000);
+    usleep(1000 * 1000 / CONFIG_VIDEO_FPS);
   }
 
 THREAD_END:
+  rtc_set_key_frame_req_cb(NULL);
+
   if (jpeg_enc_hdl) {
     jpeg_enc_close(jpeg_enc_hdl);
   }
 
-  if (image_buf) {
-    free(image_buf);
+#ifdef CONFIG_VIDEO_USE_H264
+  if (h264_enc_hdl) {
+    esp_h264_enc_close(h264_enc_hdl);
+    esp_h264_enc_del(h264_enc_hdl);
   }
+#endif
+
+  session_arena_release();
 
   // deinitialize the camera
   err = esp_camera_deinit();
@@ -165,9 +435,9 @@ THREAD_END:
 
 int start_video_proc(void)
 {
-  int rval = xTaskCreatePinnedToCore(video_send_thread, "video_send_task", 5 * 1024, NULL, PRIO_TASK_FETCH, NULL, 0);
+  int rval = task_plan_create(TASK_VIDEO_SEND, video_send_thread, NULL, NULL);
   if (rval != pdTRUE) {
-    printf("Unable to create audio capture thread!\r\n");
+    printf("Unable to create video send thread!\r\n");
     return -1;
   }
 
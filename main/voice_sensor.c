@@ -0,0 +1,165 @@
+#include <stdio.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "common.h"
+#include "app_state.h"
+#include "metrics.h"
+#include "task_plan.h"
+#include "voice_sensor.h"
+#include "xvf3800_param.h"
+
+/* The XVF3800 already runs VAD, beamforming and DoA on the microphone
+ * array, so instead of analysing PCM here a low-rate task reads the results
+ * over the control protocol: DOA_VALUE carries the direction and the speech
+ * flag, AEC_SPENERGY_VALUES the speech energy per beam, both in one I2C
+ * batch. Reads only run while an agent is joined: before that nobody
+ * listens to the uplink and the bus is left to the buttons. */
+
+#define SENSOR_IDLE_WAIT_MS  (1000)
+
+static xvf3800_handle_t *g_xvf = NULL;
+static TaskHandle_t g_task = NULL;
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static voice_sensor_state_t g_state = { .doa_deg = -1 };
+static voice_sensor_cb_t g_cb = NULL;
+static void *g_cb_ctx = NULL;
+
+static METRIC_COUNTER(g_onsets, "voice.onsets");
+static METRIC_COUNTER(g_read_errors, "voice.read_errors");
+static METRIC_GAUGE(g_doa_gauge, "voice.doa_deg");
+
+bool voice_gate_step(voice_gate_t *gate, const voice_gate_cfg_t *cfg, bool speech, int64_t now_us)
+{
+  if (speech) {
+    gate->open           = true;
+    gate->last_speech_us = now_us;
+  } else if (gate->open && now_us - gate->last_speech_us >= cfg->hangover_us) {
+    gate->open = false;
+  }
+  return gate->open;
+}
+
+static bool _fresh(const voice_sensor_state_t *state, int64_t now_us)
+{
+  return state->valid &&
+         now_us - state->updated_us < (int64_t)CONFIG_VOICE_SENSOR_PERIOD_MS * 1000 * VOICE_SENSOR_STALE_PERIODS;
+}
+
+static void _sensor_task(void *arg)
+{
+  const voice_gate_cfg_t cfg = { .hangover_us = CONFIG_VOICE_SENSOR_HANGOVER_MS * 1000 };
+  voice_gate_t gate = { 0 };
+  TickType_t last_wake = xTaskGetTickCount();
+
+  while (1) {
+    if (!app_state_has(APP_STATE_AGENT_JOINED)) {
+      app_state_wait(APP_STATE_AGENT_JOINED, SENSOR_IDLE_WAIT_MS);
+      last_wake = xTaskGetTickCount();
+      continue;
+    }
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_VOICE_SENSOR_PERIOD_MS));
+
+    xvf3800_param_io_t io[] = {
+      { .id = XVF3800_PARAM_DOA_VALUE },
+      { .id = XVF3800_PARAM_AEC_SPENERGY_VALUES },
+    };
+    xvf3800_param_read(g_xvf, io, 2);
+    if (io[0].err != ESP_OK) {
+      metric_inc(&g_read_errors);
+      continue;  // readings go stale and the uplink fails open
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    bool speech    = io[0].v[1].i != 0;
+    bool was_open  = gate.open;
+    bool open      = voice_gate_step(&gate, &cfg, speech, now_us);
+
+    float energy = 0;
+    if (io[1].err == ESP_OK) {
+      for (int i = 0; i < XVF3800_PARAM_MAX_VALUES; i++) {
+        if (io[1].v[i].f > energy) {
+          energy = io[1].v[i].f;
+        }
+      }
+    }
+
+    portENTER_CRITICAL(&g_lock);
+    g_state.valid       = true;
+    g_state.speech      = speech;
+    g_state.uplink_open = open;
+    g_state.energy      = energy;
+    g_state.updated_us  = now_us;
+    if (speech) {
+      g_state.doa_deg = (int16_t)(io[0].v[0].i % 360);   // the direction is only meaningful while someone talks
+    }
+    int16_t doa = g_state.doa_deg;
+    portEXIT_CRITICAL(&g_lock);
+
+    if (open != was_open) {
+      if (open) {
+        metric_inc(&g_onsets);
+        metric_set(&g_doa_gauge, doa);
+      }
+      if (g_cb) {
+        g_cb(open, doa, g_cb_ctx);
+      }
+    }
+  }
+}
+
+void voice_sensor_start(xvf3800_handle_t *xvf)
+{
+  if (g_task || !xvf) {
+    return;
+  }
+  g_xvf = xvf;
+
+  metrics_register_counter(&g_onsets);
+  metrics_register_counter(&g_read_errors);
+  metrics_register_gauge(&g_doa_gauge);
+
+  if (task_plan_create(TASK_VOICE_SENSOR, _sensor_task, NULL, &g_task) != pdPASS) {
+    printf("voice_sensor: failed to create the task\n");
+    return;
+  }
+  printf("voice_sensor: every %d ms, hangover %d ms\n", CONFIG_VOICE_SENSOR_PERIOD_MS,
+         CONFIG_VOICE_SENSOR_HANGOVER_MS);
+}
+
+void voice_sensor_get(voice_sensor_state_t *state)
+{
+  portENTER_CRITICAL(&g_lock);
+  *state = g_state;
+  portEXIT_CRITICAL(&g_lock);
+  state->valid = _fresh(state, esp_timer_get_time());
+}
+
+bool voice_sensor_speech(void)
+{
+  voice_sensor_state_t state;
+  voice_sensor_get(&state);
+  return state.valid && state.speech;
+}
+
+bool voice_sensor_uplink_open(void)
+{
+  voice_sensor_state_t state;
+  voice_sensor_get(&state);
+  return !state.valid || state.uplink_open;
+}
+
+int16_t voice_sensor_direction(void)
+{
+  voice_sensor_state_t state;
+  voice_sensor_get(&state);
+  return state.doa_deg;
+}
+
+void voice_sensor_set_cb(voice_sensor_cb_t cb, void *ctx)
+{
+  g_cb_ctx = ctx;
+  g_cb     = cb;
+}
@@ -0,0 +1,79 @@
+#ifndef VOICE_SENSOR_H
+#define VOICE_SENSOR_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "xvf3800.h"
+
+/* read the XVF3800 speech flag, speech energy and direction this often */
+#ifndef CONFIG_VOICE_SENSOR_PERIOD_MS
+#define CONFIG_VOICE_SENSOR_PERIOD_MS    (50)
+#endif
+
+/* the uplink stays open this long after the last speech reading */
+#ifndef CONFIG_VOICE_SENSOR_HANGOVER_MS
+#define CONFIG_VOICE_SENSOR_HANGOVER_MS  (800)
+#endif
+
+/* frames kept while the uplink is closed and sent first when it opens,
+ * covering the sensor period so the onset of speech is not clipped */
+#ifndef CONFIG_VOICE_SENSOR_PREROLL_FRAMES
+#define CONFIG_VOICE_SENSOR_PREROLL_FRAMES  (8)
+#endif
+
+/* readings older than this many periods count as no sensor */
+#define VOICE_SENSOR_STALE_PERIODS       (4)
+
+typedef struct {
+  uint32_t hangover_us;
+} voice_gate_cfg_t;
+
+typedef struct {
+  bool open;
+  int64_t last_speech_us;
+} voice_gate_t;
+
+/* the uplink gate, a pure function of the readings fed to it. Opens on
+ * speech, closes hangover_us after the last speech; returns whether open */
+bool voice_gate_step(voice_gate_t *gate, const voice_gate_cfg_t *cfg, bool speech, int64_t now_us);
+
+typedef struct {
+  bool valid;              // a fresh reading is available
+  bool speech;             // XVF3800 VAD
+  bool uplink_open;        // speech or within the hangover
+  int16_t doa_deg;         // direction of the talker, 0-359, -1 unknown
+  float energy;            // speech energy of the loudest beam
+  int64_t updated_us;
+} voice_sensor_state_t;
+
+/* speech started (true) or the hangover ran out (false), on the sensor task */
+typedef void (*voice_sensor_cb_t)(bool speech, int16_t doa_deg, void *ctx);
+
+/* start reading the sensor from xvf, which must stay valid */
+void voice_sensor_start(xvf3800_handle_t *xvf);
+
+void voice_sensor_get(voice_sensor_state_t *state);
+
+/* the XVF3800 hears speech now; false without a sensor. Cheap enough to
+ * call from the audio path, for barge-in */
+bool voice_sensor_speech(void);
+
+/* whether the uplink should carry audio; true without a sensor or when the
+ * readings are stale, so a failing sensor never mutes the user */
+bool voice_sensor_uplink_open(void);
+
+/* direction of the last talker in degrees, -1 when unknown */
+int16_t voice_sensor_direction(void);
+
+void voice_sensor_set_cb(voice_sensor_cb_t cb, void *ctx);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,349 @@
+#include <assert.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+
+#include "app_state.h"
+#include "boot_seq.h"
+#include "common.h"
+#include "retry_policy.h"
+#include "wifi_proc.h"
+
+/* The AP that last gave us an IP is cached in NVS. A (re)connect first goes
+ * straight to that BSSID on its channel, which skips the all-channel scan;
+ * after WIFI_TARGETED_MAX_TRIES failures it falls back to a full scan.
+ * Retries are spaced by jittered exponential backoff instead of calling
+ * esp_wifi_connect() again from the disconnect event. The backoff timer only
+ * posts an event, so every connect runs on the default event loop task like
+ * the handlers that share its state.
+ *
+ * With CONFIG_WIFI_STATIC_IP_FAST_PATH the cached lease is also applied as
+ * a static address so DHCP is skipped. Only use it on networks that reserve
+ * the address for this device; DHCP is restored once a targeted connect
+ * fails. */
+
+#define WIFI_NVS_NAMESPACE       "wifi_cache"
+#define WIFI_NVS_KEY_AP          "ap"
+#define WIFI_CACHE_VERSION       (1)
+
+#ifndef WIFI_TARGETED_MAX_TRIES
+#define WIFI_TARGETED_MAX_TRIES  (2)
+#endif
+
+/* the backoff is over, connect again */
+ESP_EVENT_DEFINE_BASE(WIFI_PROC_EVENT);
+enum {
+  WIFI_PROC_EVENT_RETRY = 0,
+};
+
+/* the esp_timer task could not post the retry, try again this much later */
+#define WIFI_RETRY_POST_AGAIN_MS (100)
+
+typedef struct {
+  uint8_t  version;
+  uint8_t  channel;
+  uint8_t  bssid[6];
+  char     ssid[33];
+  uint32_t ip;
+  uint32_t netmask;
+  uint32_t gw;
+  uint32_t dns;
+} wifi_cache_t;
+
+typedef enum {
+  WIFI_STRATEGY_TARGETED = 0,
+  WIFI_STRATEGY_FULL_SCAN,
+} wifi_strategy_t;
+
+static const retry_policy_cfg_t g_wifi_retry_cfg = {
+  .base_ms           = 250,
+  .cap_ms            = 10000,
+  .max_attempts      = 0,
+  .breaker_threshold = 0,
+  .breaker_open_ms   = 0,
+};
+
+static esp_netif_t *g_sta_netif = NULL;
+static esp_timer_handle_t g_retry_timer = NULL;
+static wifi_cache_t g_cache;
+static bool g_cache_valid = false;
+#ifdef CONFIG_WIFI_STATIC_IP_FAST_PATH
+static bool g_static_ip = false;
+#endif
+
+static wifi_strategy_t g_strategy = WIFI_STRATEGY_FULL_SCAN;
+static int g_targeted_failures = 0;
+static int g_retries = 0;              // consecutive failed attempts
+static int64_t g_cycle_start_us = 0;   // 0 while connected
+static wifi_proc_stats_t g_stats;
+
+static const char *_strategy_name(wifi_strategy_t strategy)
+{
+  return strategy == WIFI_STRATEGY_TARGETED ? "targeted" : "full scan";
+}
+
+static void _cache_load(void)
+{
+  nvs_handle_t nvs;
+  if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+    return;
+  }
+
+  size_t len = sizeof(g_cache);
+  esp_err_t err = nvs_get_blob(nvs, WIFI_NVS_KEY_AP, &g_cache, &len);
+  nvs_close(nvs);
+
+  // a cache for another network is useless
+  g_cache_valid = (err == ESP_OK && len == sizeof(g_cache) && g_cache.version == WIFI_CACHE_VERSION &&
+                   strcmp(g_cache.ssid, WIFI_SSID) == 0 && g_cache.channel != 0);
+  if (g_cache_valid) {
+    printf("wifi: cached AP " MACSTR " on channel %d\n", MAC2STR(g_cache.bssid), g_cache.channel);
+  }
+}
+
+static void _cache_save(const wifi_cache_t *cache)
+{
+  if (g_cache_valid && memcmp(cache, &g_cache, sizeof(g_cache)) == 0) {
+    return;  // unchanged, spare the flash
+  }
+
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+  if (err == ESP_OK) {
+    err = nvs_set_blob(nvs, WIFI_NVS_KEY_AP, cache, sizeof(*cache));
+    if (err == ESP_OK) {
+      err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+  }
+
+  if (err != ESP_OK) {
+    printf("wifi: failed to cache AP: %s\n", esp_err_to_name(err));
+    return;
+  }
+  g_cache       = *cache;
+  g_cache_valid = true;
+}
+
+#ifdef CONFIG_WIFI_STATIC_IP_FAST_PATH
+static void _set_static_ip(bool enable)
+{
+  if (enable == g_static_ip) {
+    return;
+  }
+
+  if (enable) {
+    esp_netif_ip_info_t info = {
+      .ip      = { .addr = g_cache.ip },
+      .netmask = { .addr = g_cache.netmask },
+      .gw      = { .addr = g_cache.gw },
+    };
+    esp_netif_dns_info_t dns = { .ip.u_addr.ip4.addr = g_cache.dns, .ip.type = ESP_IPADDR_TYPE_V4 };
+
+    esp_netif_dhcpc_stop(g_sta_netif);
+    if (esp_netif_set_ip_info(g_sta_netif, &info) != ESP_OK) {
+      esp_netif_dhcpc_start(g_sta_netif);
+      return;
+    }
+    esp_netif_set_dns_info(g_sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+    printf("wifi: using cached lease " IPSTR "\n", IP2STR(&info.ip));
+  } else {
+    esp_netif_dhcpc_start(g_sta_netif);
+    printf("wifi: back to DHCP\n");
+  }
+  g_static_ip = enable;
+}
+#endif
+
+/* pick how the next attempt connects */
+static wifi_strategy_t _strategy_next(void)
+{
+  if (g_cache_valid && g_targeted_failures < WIFI_TARGETED_MAX_TRIES) {
+    return WIFI_STRATEGY_TARGETED;
+  }
+  return WIFI_STRATEGY_FULL_SCAN;
+}
+
+static void _connect(void)
+{
+  wifi_config_t cfg = { 0 };
+  esp_wifi_get_config(WIFI_IF_STA, &cfg);
+
+  g_strategy = _strategy_next();
+  if (g_strategy == WIFI_STRATEGY_TARGETED) {
+    cfg.sta.bssid_set   = true;
+    memcpy(cfg.sta.bssid, g_cache.bssid, sizeof(cfg.sta.bssid));
+    cfg.sta.channel     = g_cache.channel;
+    cfg.sta.scan_method = WIFI_FAST_SCAN;
+  } else {
+    cfg.sta.bssid_set   = false;
+    cfg.sta.channel     = 0;
+    cfg.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    cfg.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+  }
+  esp_wifi_set_config(WIFI_IF_STA, &cfg);
+
+#ifdef CONFIG_WIFI_STATIC_IP_FAST_PATH
+  _set_static_ip(g_strategy == WIFI_STRATEGY_TARGETED && g_cache.ip != 0);
+#endif
+
+  if (g_cycle_start_us == 0) {
+    g_cycle_start_us = esp_timer_get_time();
+  }
+  g_stats.attempts++;
+  printf("wifi: connecting (%s, attempt %d)\n", _strategy_name(g_strategy), g_retries + 1);
+  esp_wifi_connect();
+}
+
+static void _retry_timer_cb(void *arg)
+{
+  // never block the esp_timer task on a full event queue
+  if (esp_event_post(WIFI_PROC_EVENT, WIFI_PROC_EVENT_RETRY, NULL, 0, 0) != ESP_OK) {
+    esp_timer_start_once(g_retry_timer, WIFI_RETRY_POST_AGAIN_MS * 1000);
+  }
+}
+
+static void _on_disconnected(const wifi_event_sta_disconnected_t *event)
+{
+  app_state_clear(APP_STATE_WIFI_CONNECTED);
+
+  if (g_cycle_start_us == 0) {
+    // we were connected, the link dropped: reconnect right away on the same AP
+    g_retries           = 0;
+    g_targeted_failures = 0;
+    printf("wifi: link lost, reason %d\n", event->reason);
+    _connect();
+    return;
+  }
+
+  if (g_strategy == WIFI_STRATEGY_TARGETED) {
+    g_targeted_failures++;
+  }
+
+  uint32_t delay_ms = retry_backoff_ms(&g_wifi_retry_cfg, g_retries, esp_random());
+  g_retries++;
+  printf("wifi: %s connect failed, reason %d, retry in %lu ms\n", _strategy_name(g_strategy), event->reason,
+         (unsigned long)delay_ms);
+
+  esp_timer_stop(g_retry_timer);
+  esp_timer_start_once(g_retry_timer, (uint64_t)delay_ms * 1000);
+}
+
+static void _on_got_ip(const ip_event_got_ip_t *event)
+{
+  uint32_t to_ip_ms = (uint32_t)((esp_timer_get_time() - g_cycle_start_us) / 1000);
+
+  g_stats.connects++;
+  if (g_strategy == WIFI_STRATEGY_TARGETED) {
+    g_stats.targeted_ok++;
+  } else {
+    g_stats.full_scan_ok++;
+  }
+  g_stats.last_to_ip_ms = to_ip_ms;
+  if (g_stats.connects == 1 || to_ip_ms < g_stats.min_to_ip_ms) {
+    g_stats.min_to_ip_ms = to_ip_ms;
+  }
+  if (to_ip_ms > g_stats.max_to_ip_ms) {
+    g_stats.max_to_ip_ms = to_ip_ms;
+  }
+
+  printf("wifi: got ip " IPSTR " in %lu ms (%s, %d retries), min %lu / max %lu ms over %lu connect(s)\n",
+         IP2STR(&event->ip_info.ip), (unsigned long)to_ip_ms, _strategy_name(g_strategy), g_retries,
+         (unsigned long)g_stats.min_to_ip_ms, (unsigned long)g_stats.max_to_ip_ms,
+         (unsigned long)g_stats.connects);
+
+  g_cycle_start_us    = 0;
+  g_retries           = 0;
+  g_targeted_failures = 0;
+
+  wifi_cache_t cache = { .version = WIFI_CACHE_VERSION };
+  wifi_ap_record_t ap;
+  if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    cache.channel = ap.primary;
+  }
+  snprintf(cache.ssid, sizeof(cache.ssid), "%s", WIFI_SSID);
+  cache.ip      = event->ip_info.ip.addr;
+  cache.netmask = event->ip_info.netmask.addr;
+  cache.gw      = event->ip_info.gw.addr;
+
+  esp_netif_dns_info_t dns;
+  if (esp_netif_get_dns_info(g_sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+    cache.dns = dns.ip.u_addr.ip4.addr;
+  }
+  if (cache.channel != 0) {
+    _cache_save(&cache);
+  }
+
+  app_state_set(APP_STATE_WIFI_CONNECTED);
+  boot_seq_signal(BOOT_EVT_WIFI);
+}
+
+static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+  if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+    _connect();
+  } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+    _on_disconnected((const wifi_event_sta_disconnected_t *)event_data);
+  } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+    printf("wifi sta mode connect.\n");
+  } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+    _on_got_ip((const ip_event_got_ip_t *)event_data);
+  } else if (event_base == WIFI_PROC_EVENT && event_id == WIFI_PROC_EVENT_RETRY) {
+    // a retry posted before the link came up is stale
+    if (g_cycle_start_us != 0) {
+      _connect();
+    }
+  }
+}
+
+/*init wifi as sta */
+void wifi_proc_start(void)
+{
+  ESP_ERROR_CHECK(esp_netif_init());
+  ESP_ERROR_CHECK(esp_event_loop_create_default());
+  g_sta_netif = esp_netif_create_default_wifi_sta();
+  assert(g_sta_netif);
+
+  _cache_load();
+
+  const esp_timer_create_args_t timer_args = {
+    .callback = _retry_timer_cb,
+    .name     = "wifi_retry",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &g_retry_timer));
+
+  wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+  ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+  ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL, NULL));
+  ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, NULL));
+  ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_PROC_EVENT, WIFI_PROC_EVENT_RETRY, &event_handler, NULL,
+                                                      NULL));
+
+  wifi_config_t wifi_config = {
+    .sta = {
+      .ssid            = WIFI_SSID,
+      .password        = WIFI_PASSWORD,
+      .listen_interval = CONFIG_EXAMPLE_WIFI_LISTEN_INTERVAL,
+    },
+  };
+  ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+  ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+  ESP_ERROR_CHECK(esp_wifi_start());
+
+  // power_gov picks the power save mode once an IP is obtained
+  esp_wifi_set_ps(WIFI_PS_NONE);
+}
+
+void wifi_proc_get_stats(wifi_proc_stats_t *stats)
+{
+  if (stats) {
+    *stats = g_stats;
+  }
+}
@@ -0,0 +1,31 @@
+#ifndef WIFI_PROC_H
+#define WIFI_PROC_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+  uint32_t connects;          // times an IP was obtained
+  uint32_t attempts;          // esp_wifi_connect() calls
+  uint32_t targeted_ok;       // connects on the cached BSSID/channel
+  uint32_t full_scan_ok;      // connects after a full scan
+  uint32_t last_to_ip_ms;     // start of the (re)connect to IP
+  uint32_t min_to_ip_ms;
+  uint32_t max_to_ip_ms;
+} wifi_proc_stats_t;
+
+/* init Wi-Fi as station and start connecting, returns once the driver is
+ * started. BOOT_EVT_WIFI is signalled when an IP is obtained */
+void wifi_proc_start(void);
+
+void wifi_proc_get_stats(wifi_proc_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
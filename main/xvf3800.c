@@ -1,15 +1,168 @@
 #include "xvf3800.h"
+#include "xvf3800_param.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#ifdef CONFIG_XVF3800_BUTTON_INT_GPIO
+#include "driver/gpio.h"
+#endif
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "ai_agent.h"
 #include "common.h"
+#include "app_state.h"
+#include "i2c_mgr.h"
+#include "metrics.h"
+#include "task_plan.h"
+#include "nvs.h"
 #include "string.h"
 
 static const char *TAG = "XVF3800";
 static xvf3800_handle_t *g_handle = NULL;
 static TaskHandle_t g_monitor_task = NULL;
 
+#define XVF3800_NVS_NAMESPACE  "xvf3800"
+#define XVF3800_NVS_KEY        "resid"
+#define XVF3800_CACHE_VERSION  (1)
+
+typedef struct {
+    uint8_t version;
+    uint8_t resource_id_gpio;
+    uint8_t fw_version[3];     // firmware the ID was found on
+    uint16_t scan_ms;          // what the scan cost, reported when it is skipped
+} xvf3800_cache_t;
+
+static METRIC_COUNTER(g_i2c_errors, "xvf.i2c_errors");
+static METRIC_HIST(g_press_latency, "button.press_ms", 20, 40, 80, 120, 160, 240, 400);
+static METRIC_COUNTER(g_inferred_presses, "button.inferred");
+static METRIC_GAUGE(g_bus_permille, "button.i2c_busy_permille");
+
+#ifndef CONFIG_XVF3800_BUTTON_FAST_POLL_MS
+#define CONFIG_XVF3800_BUTTON_FAST_POLL_MS  20
+#endif
+#ifndef CONFIG_XVF3800_BUTTON_IDLE_POLL_MS
+#define CONFIG_XVF3800_BUTTON_IDLE_POLL_MS  100
+#endif
+
+#ifdef CONFIG_XVF3800_BUTTON_INT_GPIO
+/* the interrupt wakes the task, polling only catches a missed edge */
+#define BUTTON_IDLE_POLL_MS       1000
+#else
+#define BUTTON_IDLE_POLL_MS       CONFIG_XVF3800_BUTTON_IDLE_POLL_MS
+#endif
+#define BUTTON_DEBOUNCE_MS        30
+/* the ReSpeaker XVF3800 stalls on I2C while a button is held, see _button_action() */
+#if !defined(CONFIG_XVF3800_BUTTON_NO_INFER) && !defined(CONFIG_XVF3800_BUTTON_INFER_FROM_I2C)
+#define CONFIG_XVF3800_BUTTON_INFER_FROM_I2C
+#endif
+#ifndef CONFIG_XVF3800_BUTTON_INFER_MAX_MS
+#define CONFIG_XVF3800_BUTTON_INFER_MAX_MS  1500   // a longer outage is a bus fault, not a press
+#endif
+#define BUTTON_FAST_HOLD_MS       2000   // fast polling this long after any activity
+#define BUTTON_STATS_INTERVAL_MS  60000
+
+typedef enum {
+    BUTTON_STATE_RELEASED = 0,
+    BUTTON_STATE_PRESS_PENDING,
+    BUTTON_STATE_PRESSED,
+    BUTTON_STATE_RELEASE_PENDING,
+} button_state_t;
+
+typedef enum {
+    BUTTON_EVENT_NONE = 0,
+    BUTTON_EVENT_PRESS,
+    BUTTON_EVENT_RELEASE,
+} button_event_t;
+
+typedef struct {
+    uint8_t gpi;
+    bool is_set;               // SET toggles the agent, MUTE stops it
+    button_state_t state;
+    int64_t since_us;          // first sample at the pending level
+    int64_t edge_us;           // last sample before the press was seen
+} button_t;
+
+/*
+ * The GPIO resource ID found by the scan is kept in NVS together with the
+ * firmware version it was found on. At boot one GPI_VALUE_ALL read with the
+ * cached ID validates it; the 0x00-0x20 scan only runs when that read fails,
+ * the firmware version changed or there is no cache yet.
+ */
+static void xvf3800_cache_load(xvf3800_cache_t *cache)
+{
+    nvs_handle_t nvs;
+    memset(cache, 0, sizeof(*cache));
+    if (nvs_open(XVF3800_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+
+    size_t len = sizeof(*cache);
+    esp_err_t err = nvs_get_blob(nvs, XVF3800_NVS_KEY, cache, &len);
+    nvs_close(nvs);
+
+    if (err != ESP_OK || len != sizeof(*cache) || cache->version != XVF3800_CACHE_VERSION) {
+        memset(cache, 0, sizeof(*cache));
+    }
+}
+
+static void xvf3800_cache_save(const xvf3800_cache_t *cache)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(XVF3800_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, XVF3800_NVS_KEY, cache, sizeof(*cache));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to cache resource ID: %s", esp_err_to_name(err));
+    }
+}
+
+/* one GPI_VALUE_ALL read, true when the resource ID answers it */
+static bool xvf3800_try_resource_id(xvf3800_handle_t *handle, uint8_t resid, uint32_t timeout_ms)
+{
+    uint8_t write_buf[3];
+    write_buf[0] = resid;
+    write_buf[1] = XVF3800_CMD_GPI_VALUE_ALL | 0x80;  // Read command
+    write_buf[2] = 5;  // Expected reply: 1 status + 4 data bytes
+
+    uint8_t read_buf[5] = {0};
+    esp_err_t ret = i2c_mgr_write_read(handle->i2c_addr, I2C_PRIO_CONTROL, write_buf, 3,
+                                       read_buf, 5, timeout_ms);
+    if (ret != ESP_OK || read_buf[0] != XVF3800_STATUS_SUCCESS) {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Resource ID 0x%02X answers, GPIO bitmap: 0x%02X%02X%02X%02X",
+             resid, read_buf[4], read_buf[3], read_buf[2], read_buf[1]);
+    return true;
+}
+
+static bool xvf3800_scan_resource_id(xvf3800_handle_t *handle)
+{
+    ESP_LOGI(TAG, "Scanning for valid GPIO Resource ID...");
+
+    for (uint8_t test_resid = 0x00; test_resid <= 0x20; test_resid++) {
+        if (!xvf3800_try_resource_id(handle, test_resid, 50)) {
+            continue;
+        }
+
+        handle->resource_id_gpio = test_resid;
+        if (test_resid != XVF3800_RESOURCE_ID_GPIO) {
+            ESP_LOGW(TAG, "Auto-updated Resource ID from 0x%02X to 0x%02X",
+                     XVF3800_RESOURCE_ID_GPIO, test_resid);
+        }
+        return true;
+    }
+
+    ESP_LOGE(TAG, "✗ No valid GPIO Resource ID found in range 0x00-0x20");
+    ESP_LOGE(TAG, "  XVF3800 may need firmware initialization first");
+    return false;
+}
+
 esp_err_t xvf3800_init(xvf3800_handle_t *handle, i2c_port_t i2c_port)
 {
     if (!handle) return ESP_ERR_INVALID_ARG;
@@ -17,133 +170,109 @@ esp_err_t xvf3800_init(xvf3800_handle_t *handle, i2c_port_t i2c_port)
     handle->i2c_port = i2c_port;
     handle->i2c_addr = XVF3800_I2C_ADDR;
     handle->resource_id_gpio = XVF3800_RESOURCE_ID_GPIO;  // Default value
+    memset(handle->fw_version, 0, sizeof(handle->fw_version));
+
+    metrics_register_counter(&g_i2c_errors);
 
     ESP_LOGI(TAG, "Initializing XVF3800 at I2C address 0x%02X", handle->i2c_addr);
     ESP_LOGI(TAG, "Using XMOS control protocol (resource-based commands)");
 
     // Try to detect XVF3800 - simple probe
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (handle->i2c_addr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_stop(cmd);
+    const i2c_op_t probe = I2C_OP_PROBE();
+    esp_err_t ret = i2c_mgr_transfer(handle->i2c_addr, I2C_PRIO_CONTROL, &probe, 1, 100);
 
-    esp_err_t ret = i2c_master_cmd_begin(handle->i2c_port, cmd, pdMS_TO_TICKS(100));
-    i2c_cmd_link_delete(cmd);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "✗ XVF3800 probe failed: %s", esp_err_to_name(ret));
+        ESP_LOGW(TAG, "This may be normal - device may need specific initialization");
+        return ESP_OK;  // Return OK even if probe fails
+    }
 
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "✓ XVF3800 detected at address 0x%02X", handle->i2c_addr);
-
-        // Scan for valid Resource IDs
-        ESP_LOGI(TAG, "Scanning for valid GPIO Resource ID...");
-        bool found_valid_resource = false;
-
-        for (uint8_t test_resid = 0x00; test_resid <= 0x20; test_resid++) {
-            // Try to read GPI_VALUE_ALL with this resource ID
-            uint8_t write_buf[3];
-            write_buf[0] = test_resid;
-            write_buf[1] = XVF3800_CMD_GPI_VALUE_ALL | 0x80;  // Read command
-            write_buf[2] = 5;  // Expected reply: 1 status + 4 data bytes
-
-            uint8_t read_buf[5] = {0};
-
-            esp_err_t scan_ret = i2c_master_write_read_device(
-                handle->i2c_port,
-                handle->i2c_addr,
-                write_buf,
-                3,
-                read_buf,
-                5,
-                pdMS_TO_TICKS(50)
-            );
-
-            if (scan_ret == ESP_OK && read_buf[0] == XVF3800_STATUS_SUCCESS) {
-                ESP_LOGW(TAG, "✓✓✓ FOUND valid Resource ID: 0x%02X (status=0x%02X)",
-                         test_resid, read_buf[0]);
-                ESP_LOGW(TAG, "    GPIO bitmap: 0x%02X%02X%02X%02X",
-                         read_buf[4], read_buf[3], read_buf[2], read_buf[1]);
-                found_valid_resource = true;
-
-                // Save the correct resource ID to handle
-                handle->resource_id_gpio = test_resid;
-
-                if (test_resid != XVF3800_RESOURCE_ID_GPIO) {
-                    ESP_LOGW(TAG, "    ⚠️  Auto-updated Resource ID from 0x%02X to 0x%02X",
-                             XVF3800_RESOURCE_ID_GPIO, test_resid);
-                    ESP_LOGW(TAG, "    For permanent fix, update xvf3800.h:");
-                    ESP_LOGW(TAG, "    #define XVF3800_RESOURCE_ID_GPIO 0x%02X", test_resid);
-                } else {
-                    ESP_LOGI(TAG, "    ✓ Resource ID 0x%02X matches header definition", test_resid);
-                }
+    ESP_LOGI(TAG, "✓ XVF3800 detected at address 0x%02X", handle->i2c_addr);
 
-                // Found it, can break early
-                break;
-            }
-        }
+    int64_t start_us = esp_timer_get_time();
 
-        if (!found_valid_resource) {
-            ESP_LOGE(TAG, "✗ No valid GPIO Resource ID found in range 0x00-0x20");
-            ESP_LOGE(TAG, "  XVF3800 may need firmware initialization first");
+    // an unreadable version stays 0.0.0, and only matches a cache made the same way
+    int32_t version[3];
+    xvf3800_param_cache_clear();
+    if (xvf3800_param_get_int(handle, XVF3800_PARAM_VERSION, version, 3) == ESP_OK) {
+        for (int i = 0; i < 3; i++) {
+            handle->fw_version[i] = (uint8_t)version[i];
         }
+        ESP_LOGI(TAG, "Firmware %u.%u.%u", handle->fw_version[0], handle->fw_version[1], handle->fw_version[2]);
+    }
 
-    } else {
-        ESP_LOGW(TAG, "✗ XVF3800 probe failed: %s", esp_err_to_name(ret));
-        ESP_LOGW(TAG, "This may be normal - device may need specific initialization");
+    xvf3800_cache_t cache;
+    xvf3800_cache_load(&cache);
+
+    bool cached = cache.version == XVF3800_CACHE_VERSION &&
+                  memcmp(cache.fw_version, handle->fw_version, sizeof(cache.fw_version)) == 0 &&
+                  xvf3800_try_resource_id(handle, cache.resource_id_gpio, 100);
+    if (cached) {
+        handle->resource_id_gpio = cache.resource_id_gpio;
+        ESP_LOGI(TAG, "Resource ID 0x%02X from NVS in %lld ms, scan skipped (took %u ms)",
+                 handle->resource_id_gpio, (long long)((esp_timer_get_time() - start_us) / 1000), cache.scan_ms);
+        return ESP_OK;
+    }
+
+    if (cache.version == XVF3800_CACHE_VERSION) {
+        ESP_LOGW(TAG, "Cached Resource ID 0x%02X (firmware %u.%u.%u) no longer valid, rescanning",
+                 cache.resource_id_gpio, cache.fw_version[0], cache.fw_version[1], cache.fw_version[2]);
     }
 
-    return ESP_OK;  // Return OK even if probe fails
+    if (xvf3800_scan_resource_id(handle)) {
+        cache.version = XVF3800_CACHE_VERSION;
+        cache.resource_id_gpio = handle->resource_id_gpio;
+        memcpy(cache.fw_version, handle->fw_version, sizeof(cache.fw_version));
+        cache.scan_ms = (uint16_t)((esp_timer_get_time() - start_us) / 1000);
+        xvf3800_cache_save(&cache);
+        ESP_LOGI(TAG, "Resource ID 0x%02X found by scan in %u ms, cached", handle->resource_id_gpio,
+                 cache.scan_ms);
+    }
+
+    return ESP_OK;
 }
 
 /**
  * Write a control command to XVF3800
- * Format: Resource_ID + Command_ID + Length + Payload (optional)
- * Then read status byte
+ * Format: Resource_ID + Command_ID + Payload length + Payload (optional),
+ * the same framing as xvf3800_param_write()
+ * Then read status byte, both in one I2C batch
  */
 static esp_err_t xvf3800_write_cmd(xvf3800_handle_t *handle, uint8_t resource_id,
-                                    uint8_t cmd_id, uint8_t *payload, uint8_t payload_len)
+                                    uint8_t cmd_id, uint8_t *payload, uint8_t payload_len,
+                                    i2c_prio_t prio)
 {
     if (!handle) return ESP_ERR_INVALID_ARG;
 
-    // Total transfer size = Resource ID (1) + Command ID (1) + Length (1) + Payload
-    uint8_t total_size = 3 + payload_len;
     uint8_t write_buf[64];  // Max command size from docs
+    if (payload_len > sizeof(write_buf) - 3) return ESP_ERR_INVALID_SIZE;
 
+    // the length byte counts the payload only, unlike a read where it counts the status byte too
     write_buf[0] = resource_id;
     write_buf[1] = cmd_id;
-    write_buf[2] = total_size;
+    write_buf[2] = payload_len;
 
     if (payload && payload_len > 0) {
         memcpy(&write_buf[3], payload, payload_len);
     }
 
-    // Write command
-    esp_err_t ret = i2c_master_write_to_device(
-        handle->i2c_port,
-        handle->i2c_addr,
-        write_buf,
-        3 + payload_len,
-        pdMS_TO_TICKS(100)
-    );
+    // Write command, then read status byte
+    uint8_t status = 0xFF;
+    const i2c_op_t ops[] = {
+        I2C_OP_WR(write_buf, 3 + payload_len),
+        I2C_OP_RD(&status, 1),
+    };
+    esp_err_t ret = i2c_mgr_transfer(handle->i2c_addr, prio, ops, 2, 100);
 
     if (ret != ESP_OK) {
+        metric_inc(&g_i2c_errors);
         ESP_LOGD(TAG, "Write cmd failed: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    // Read status byte
-    uint8_t status = 0xFF;
-    ret = i2c_master_read_from_device(
-        handle->i2c_port,
-        handle->i2c_addr,
-        &status,
-        1,
-        pdMS_TO_TICKS(100)
-    );
-
-    if (ret == ESP_OK) {
-        if (status != XVF3800_STATUS_SUCCESS) {
-            ESP_LOGD(TAG, "Command returned status: 0x%02X", status);
-            return ESP_FAIL;
-        }
+    if (status != XVF3800_STATUS_SUCCESS) {
+        ESP_LOGD(TAG, "Command returned status: 0x%02X", status);
+        return ESP_FAIL;
     }
 
     return ret;
@@ -155,7 +284,8 @@ static esp_err_t xvf3800_write_cmd(xvf3800_handle_t *handle, uint8_t resource_id
  * Then repeated START and read Status + Payload
  */
 static esp_err_t xvf3800_read_cmd(xvf3800_handle_t *handle, uint8_t resource_id,
-                                   uint8_t cmd_id, uint8_t *response, uint8_t response_len)
+                                   uint8_t cmd_id, uint8_t *response, uint8_t response_len,
+                                   i2c_prio_t prio)
 {
     if (!handle || !response) return ESP_ERR_INVALID_ARG;
 
@@ -168,15 +298,7 @@ static esp_err_t xvf3800_read_cmd(xvf3800_handle_t *handle, uint8_t resource_id,
     // Use write-read combined transaction
     uint8_t read_buf[65];  // Status + max payload
 
-    esp_err_t ret = i2c_master_write_read_device(
-        handle->i2c_port,
-        handle->i2c_addr,
-        write_buf,
-        3,
-        read_buf,
-        response_len + 1,
-        pdMS_TO_TICKS(100)
-    );
+    esp_err_t ret = i2c_mgr_write_read(handle->i2c_addr, prio, write_buf, 3, read_buf, response_len + 1, 100);
 
     if (ret == ESP_OK) {
         uint8_t status = read_buf[0];
@@ -188,6 +310,7 @@ static esp_err_t xvf3800_read_cmd(xvf3800_handle_t *handle, uint8_t resource_id,
             return ESP_FAIL;
         }
     } else {
+        metric_inc(&g_i2c_errors);
         ESP_LOGD(TAG, "I2C error: %s - ResID:0x%02X Cmd:0x%02X",
                  esp_err_to_name(ret), resource_id, cmd_id);
     }
@@ -206,7 +329,7 @@ esp_err_t xvf3800_read_gpi_all(xvf3800_handle_t *handle, uint32_t *bitmap)
 
     uint8_t response[4] = {0};  // uint32 = 4 bytes
     esp_err_t ret = xvf3800_read_cmd(handle, handle->resource_id_gpio,
-                                      XVF3800_CMD_GPI_VALUE_ALL, response, sizeof(response));
+                                      XVF3800_CMD_GPI_VALUE_ALL, response, sizeof(response), I2C_PRIO_POLL);
 
     if (ret == ESP_OK) {
         // Combine bytes into uint32 (little-endian)
@@ -251,7 +374,7 @@ esp_err_t xvf3800_read_gpi(xvf3800_handle_t *handle, uint8_t pin_index, uint8_t
 
     // Step 1: Set GPI_INDEX to select pin
     ret = xvf3800_write_cmd(handle, handle->resource_id_gpio,
-                            XVF3800_CMD_GPI_INDEX, &pin_index, 1);
+                            XVF3800_CMD_GPI_INDEX, &pin_index, 1, I2C_PRIO_POLL);
 
     if (ret != ESP_OK) {
         ESP_LOGD(TAG, "Failed to set GPI_INDEX to %d: %s", pin_index, esp_err_to_name(ret));
@@ -264,7 +387,7 @@ esp_err_t xvf3800_read_gpi(xvf3800_handle_t *handle, uint8_t pin_index, uint8_t
     // Step 2: Read GPI_VALUE
     uint8_t value = 0;
     ret = xvf3800_read_cmd(handle, handle->resource_id_gpio,
-                           XVF3800_CMD_GPI_VALUE, &value, 1);
+                           XVF3800_CMD_GPI_VALUE, &value, 1, I2C_PRIO_POLL);
 
     if (ret == ESP_OK) {
         *state = value;
@@ -291,211 +414,225 @@ esp_err_t xvf3800_read_mute_button(xvf3800_handle_t *handle, bool *is_pressed)
     return ret;
 }
 
-static void button_monitor_task(void *arg)
+/*
+ * Button handling
+ *
+ * The buttons are read over I2C with GPI_VALUE_ALL. Where the board routes
+ * an XVF3800 output to an ESP32 pin (CONFIG_XVF3800_BUTTON_INT_GPIO) an edge
+ * on it wakes the task; otherwise the task polls, slowly while nothing
+ * happens and at the fast rate for a while after any activity. Each button
+ * has its own debouncing state machine, so the event says which button
+ * changed.
+ *
+ * On this board a pressed button can make the XVF3800 stop answering on
+ * I2C, so by default a failure that lasts between the debounce time and
+ * CONFIG_XVF3800_BUTTON_INFER_MAX_MS and ends with both buttons released
+ * is taken as a press of SET, the toggle, and reported as inferred. A
+ * longer outage is a bus fault and toggles nothing. Boards whose buttons
+ * leave the bus alone define CONFIG_XVF3800_BUTTON_NO_INFER.
+ */
+static void _button_action(bool is_set, bool inferred, int64_t edge_us)
 {
-    xvf3800_handle_t *handle = (xvf3800_handle_t *)arg;
-    bool prev_mute_pressed = false;
-    bool prev_set_pressed = false;
-    int poll_count = 0;
-    int consecutive_errors = 0;
-    const int MAX_CONSECUTIVE_ERRORS = 10;
-    const int MAX_RETRIES = 3;
-    uint32_t last_valid_bitmap = 0;
-    bool was_in_failure = false;
-
-    ESP_LOGI(TAG, "========================================");
-    ESP_LOGI(TAG, "Button monitor task started");
-    ESP_LOGI(TAG, "Button mapping:");
-    ESP_LOGI(TAG, "  - SET button   (GPI[1]) → TOGGLE AI Agent (Start/Stop)");
-    ESP_LOGI(TAG, "  - MUTE button  (GPI[0]) → STOP AI Agent");
-    ESP_LOGI(TAG, "I2C: 0x%02X, Resource: 0x%02X", handle->i2c_addr, handle->resource_id_gpio);
-    ESP_LOGI(TAG, "========================================");
+    if (is_set) {
+        if (!ai_agent_is_active()) {
+            if (!app_state_has(APP_STATE_SESSION_STARTED)) {
+                ESP_LOGW(TAG, "✗ Cannot start AI Agent: Board RTC has not joined channel yet");
+                return;
+            }
+            ESP_LOGI(TAG, "→ Starting AI Agent...");
+            ai_agent_start();
+        } else {
+            ESP_LOGI(TAG, "→ Stopping AI Agent...");
+            ai_agent_stop();
+        }
+    } else {
+        ESP_LOGI(TAG, "→ Stopping AI Agent...");
+        ai_agent_stop();
+    }
 
-    while (1) {
-        // Read all GPIO states with retry logic
-        uint32_t gpio_bitmap = 0;
-        esp_err_t ret = ESP_FAIL;
+    // from the last sample that still saw the button released, an upper bound
+    uint32_t latency_ms = (uint32_t)((esp_timer_get_time() - edge_us) / 1000);
+    metric_observe(&g_press_latency, latency_ms);
+    ESP_LOGW(TAG, "%s button pressed%s, press to action <= %lu ms", is_set ? "SET" : "MUTE",
+             inferred ? " (inferred from I2C failure)" : "", (unsigned long)latency_ms);
+}
 
-        // Try multiple times with small delays
-        for (int retry = 0; retry < MAX_RETRIES; retry++) {
-            ret = xvf3800_read_gpi_all(handle, &gpio_bitmap);
-            if (ret == ESP_OK) {
-                break;  // Success, exit retry loop
+static button_event_t _button_sample(button_t *button, bool pressed, int64_t now_us, int64_t prev_us)
+{
+    switch (button->state) {
+        case BUTTON_STATE_RELEASED:
+            if (pressed) {
+                button->state    = BUTTON_STATE_PRESS_PENDING;
+                button->since_us = now_us;
+                button->edge_us  = prev_us;
             }
-            // Small delay before retry
-            vTaskDelay(pdMS_TO_TICKS(5));
-        }
+            break;
+
+        case BUTTON_STATE_PRESS_PENDING:
+            if (!pressed) {
+                button->state = BUTTON_STATE_RELEASED;  // a glitch
+            } else if (now_us - button->since_us >= BUTTON_DEBOUNCE_MS * 1000) {
+                button->state = BUTTON_STATE_PRESSED;
+                return BUTTON_EVENT_PRESS;
+            }
+            break;
 
-        poll_count++;
-
-        // Check if we're recovering from failure state
-        if (ret == ESP_OK && was_in_failure) {
-            ESP_LOGW(TAG, "========================================");
-            ESP_LOGW(TAG, "🔄 RECOVERED from I2C failure at poll #%d", poll_count);
-            ESP_LOGW(TAG, "   Previous bitmap: 0x%08lX", (unsigned long)last_valid_bitmap);
-            ESP_LOGW(TAG, "   Current bitmap:  0x%08lX", (unsigned long)gpio_bitmap);
-
-            // When button is pressed, I2C fails. When button is released, I2C recovers.
-            // So bitmap after recovery should match the released state (same as before).
-            // The very fact that I2C failed tells us a button was pressed.
-            // We can use a simple heuristic: assume buttons were pressed during failure.
-
-            ESP_LOGW(TAG, "   💡 Button press detected via I2C failure recovery");
-            ESP_LOGW(TAG, "   Triggering button press events...");
-
-            // Extract button states from current (recovered) bitmap
-            bool mute_pressed_now = !(gpio_bitmap & (1 << XVF3800_GPI_MUTE_BUTTON));
-            bool set_pressed_now = !(gpio_bitmap & (1 << XVF3800_GPI_ACTION_BUTTON));
-
-            // If button is still pressed after recovery, process the press event
-            // Otherwise, assume it was a quick press-release during the failure period
-            if (!mute_pressed_now && !set_pressed_now) {
-                // Both buttons released - this is the expected case
-                // We can't tell which button was pressed, so trigger based on AI agent state
-                ESP_LOGW(TAG, "   Buttons now released - checking which action to take");
-
-                // Heuristic: Toggle AI agent state
-                // If running, assume MUTE was pressed. If stopped, assume SET was pressed.
-                if (g_app.b_ai_agent_joined) {
-                    ESP_LOGW(TAG, "   → Assuming MUTE button was pressed (AI Agent is running)");
-                    ESP_LOGI(TAG, "→ Stopping AI Agent...");
-                    ai_agent_stop();
-                    prev_mute_pressed = false;
-                } else {
-                    ESP_LOGW(TAG, "   → Assuming SET button was pressed (AI Agent is stopped)");
-                    // Check if board RTC has joined channel first
-                    if (!g_app.b_call_session_started) {
-                        ESP_LOGW(TAG, "✗ Cannot start AI Agent: Board RTC has not joined channel yet");
-                    } else {
-                        ESP_LOGI(TAG, "→ Starting AI Agent...");
-                        ai_agent_start();
-                    }
-                    prev_set_pressed = false;
-                }
+        case BUTTON_STATE_PRESSED:
+            if (!pressed) {
+                button->state    = BUTTON_STATE_RELEASE_PENDING;
+                button->since_us = now_us;
+            }
+            break;
+
+        case BUTTON_STATE_RELEASE_PENDING:
+            if (pressed) {
+                button->state = BUTTON_STATE_PRESSED;
+            } else if (now_us - button->since_us >= BUTTON_DEBOUNCE_MS * 1000) {
+                button->state = BUTTON_STATE_RELEASED;
+                return BUTTON_EVENT_RELEASE;
             }
+            break;
+    }
 
-            ESP_LOGW(TAG, "========================================");
-            was_in_failure = false;
-        }
+    return BUTTON_EVENT_NONE;
+}
 
-        // DEBUG: Log failures and periodic status
-        if (ret != ESP_OK) {
-            if (!was_in_failure) {
-                ESP_LOGW(TAG, "⚠️  I2C FAILURE started at poll #%d (button pressed?)", poll_count);
-                // Log the first failure with details to help diagnose
-                ESP_LOGW(TAG, "    This helps us understand WHY I2C fails:");
-                ESP_LOGW(TAG, "    - TIMEOUT = XVF3800 not responding");
-                ESP_LOGW(TAG, "    - NACK = XVF3800 rejected the command");
-                ESP_LOGW(TAG, "    - Check DEBUG logs above for error type");
-            }
-            was_in_failure = true;
+static bool _button_settled(const button_t *button)
+{
+    return button->state == BUTTON_STATE_RELEASED || button->state == BUTTON_STATE_PRESSED;
+}
 
-            if (poll_count % 10 == 0) {
-                ESP_LOGI(TAG, "[Poll #%d] ret=%s (retried %d times)",
-                         poll_count, esp_err_to_name(ret), MAX_RETRIES);
+#ifdef CONFIG_XVF3800_BUTTON_INT_GPIO
+static void IRAM_ATTR _button_isr(void *arg)
+{
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(g_monitor_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void _button_int_init(void)
+{
+    const gpio_config_t io = {
+        .pin_bit_mask = 1ULL << CONFIG_XVF3800_BUTTON_INT_GPIO,
+        .mode         = GPIO_MODE_INPUT,
+        .pull_up_en   = GPIO_PULLUP_ENABLE,
+        .intr_type    = GPIO_INTR_ANYEDGE,
+    };
+    gpio_config(&io);
+
+    // the service may already be installed by the board code
+    esp_err_t ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "gpio_install_isr_service failed: %s", esp_err_to_name(ret));
+        return;
+    }
+    gpio_isr_handler_add(CONFIG_XVF3800_BUTTON_INT_GPIO, _button_isr, NULL);
+    ESP_LOGI(TAG, "Button interrupt on GPIO %d", CONFIG_XVF3800_BUTTON_INT_GPIO);
+}
+#endif
+
+static void button_monitor_task(void *arg)
+{
+    xvf3800_handle_t *handle = (xvf3800_handle_t *)arg;
+    button_t buttons[2] = {
+        { .gpi = XVF3800_GPI_ACTION_BUTTON, .is_set = true },
+        { .gpi = XVF3800_GPI_MUTE_BUTTON,   .is_set = false },
+    };
+    int64_t prev_us = esp_timer_get_time();
+    int64_t active_until_us = 0;        // fast polling until then
+    int64_t failure_since_us = 0;       // first failed read, 0 while reads succeed
+#ifdef CONFIG_XVF3800_BUTTON_INFER_FROM_I2C
+    int64_t failure_edge_us = 0;
+#endif
+    uint32_t poll_ms = CONFIG_XVF3800_BUTTON_FAST_POLL_MS;
+    int64_t stats_since_us = prev_us;
+    uint32_t polls = 0;
+    int64_t bus_us = 0;
+
+    metrics_register_hist(&g_press_latency);
+    metrics_register_counter(&g_inferred_presses);
+    metrics_register_gauge(&g_bus_permille);
+
+#ifdef CONFIG_XVF3800_BUTTON_INT_GPIO
+    g_monitor_task = xTaskGetCurrentTaskHandle();  // the ISR may fire before the creator stores it
+    _button_int_init();
+#endif
+
+    ESP_LOGI(TAG, "Button monitor started: SET (GPI[1]) toggles the agent, MUTE (GPI[0]) stops it");
+    ESP_LOGI(TAG, "I2C: 0x%02X, Resource: 0x%02X, poll %d-%d ms", handle->i2c_addr, handle->resource_id_gpio,
+             CONFIG_XVF3800_BUTTON_FAST_POLL_MS, BUTTON_IDLE_POLL_MS);
+
+    while (1) {
+        uint32_t gpio_bitmap = 0;
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t ret = xvf3800_read_gpi_all(handle, &gpio_bitmap);
+        int64_t now_us = esp_timer_get_time();
+        bus_us += now_us - start_us;
+        polls++;
+
+        if (ret != ESP_OK) {
+            if (failure_since_us == 0) {
+                failure_since_us = now_us;
+#ifdef CONFIG_XVF3800_BUTTON_INFER_FROM_I2C
+                failure_edge_us  = prev_us;
+#endif
+                ESP_LOGD(TAG, "I2C failure started: %s", esp_err_to_name(ret));
             }
+            active_until_us = now_us + BUTTON_FAST_HOLD_MS * 1000;
         } else {
-            // Success - save valid bitmap
-            last_valid_bitmap = gpio_bitmap;
-
-            if (poll_count % 10 == 0) {
-                ESP_LOGI(TAG, "[Poll #%d] ret=%s, bitmap=0x%08lX",
-                         poll_count, esp_err_to_name(ret), (unsigned long)gpio_bitmap);
+            // Active LOW - bit=0 means pressed, bit=1 means released
+            bool any_pending = false;
+            for (int i = 0; i < 2; i++) {
+                bool pressed = !(gpio_bitmap & (1 << buttons[i].gpi));
+                if (_button_sample(&buttons[i], pressed, now_us, prev_us) == BUTTON_EVENT_PRESS) {
+                    _button_action(buttons[i].is_set, false, buttons[i].edge_us);
+                }
+                any_pending |= !_button_settled(&buttons[i]);
             }
-        }
 
-        // Print periodic status
-        if (poll_count % 50 == 0) {
-            if (ret == ESP_OK) {
-                bool mute_state = (gpio_bitmap & (1 << XVF3800_GPI_MUTE_BUTTON)) ? true : false;
-                bool set_state = (gpio_bitmap & (1 << XVF3800_GPI_ACTION_BUTTON)) ? true : false;
-
-                ESP_LOGI(TAG, "✓ Monitoring (poll #%d): MUTE=%s, SET=%s",
-                         poll_count,
-                         mute_state ? "released" : "PRESSED",
-                         set_state ? "released" : "PRESSED");
-                consecutive_errors = 0;
-            } else {
-                consecutive_errors++;
-                ESP_LOGW(TAG, "✗ Button read error #%d: %s",
-                         consecutive_errors, esp_err_to_name(ret));
-
-                if (consecutive_errors >= MAX_CONSECUTIVE_ERRORS) {
-                    ESP_LOGE(TAG, "========================================");
-                    ESP_LOGE(TAG, "XVF3800 NOT RESPONDING after %d errors", consecutive_errors);
-                    ESP_LOGE(TAG, "Possible issues:");
-                    ESP_LOGE(TAG, "  1. Resource ID 0x%02X may be incorrect", handle->resource_id_gpio);
-                    ESP_LOGE(TAG, "  2. Command IDs may need adjustment");
-                    ESP_LOGE(TAG, "  3. XVF3800 firmware not initialized");
-                    ESP_LOGE(TAG, "  4. I2C communication problem");
-                    ESP_LOGE(TAG, "Try different Resource IDs: 0x00-0x10");
-                    ESP_LOGE(TAG, "========================================");
-
-                    // Reset error counter and wait before retry
-                    consecutive_errors = 0;
-                    vTaskDelay(pdMS_TO_TICKS(5000));
+#ifdef CONFIG_XVF3800_BUTTON_INFER_FROM_I2C
+            if (failure_since_us != 0) {
+                int64_t failed_us = now_us - failure_since_us;
+                bool released = buttons[0].state == BUTTON_STATE_RELEASED &&
+                                buttons[1].state == BUTTON_STATE_RELEASED;
+                if (released && failed_us >= BUTTON_DEBOUNCE_MS * 1000 &&
+                    failed_us <= CONFIG_XVF3800_BUTTON_INFER_MAX_MS * 1000) {
+                    metric_inc(&g_inferred_presses);
+                    _button_action(true, true, failure_edge_us);
                 }
             }
-        }
-
-        if (ret == ESP_OK) {
-            // Extract button states from bitmap
-            // Note: Active LOW - bit=0 means pressed, bit=1 means released
-            bool mute_pressed = !(gpio_bitmap & (1 << XVF3800_GPI_MUTE_BUTTON));
-            bool set_pressed = !(gpio_bitmap & (1 << XVF3800_GPI_ACTION_BUTTON));
-
-            // Detect MUTE button press (to STOP AI agent)
-            // Check for button press-release cycle (not just press state)
-            // This handles the case where button was pressed during I2C failure
-            if (mute_pressed && !prev_mute_pressed) {
-                ESP_LOGW(TAG, "========================================");
-                ESP_LOGW(TAG, "MUTE BUTTON PRESSED!");
-                ESP_LOGW(TAG, "========================================");
-                ESP_LOGI(TAG, "→ Stopping AI Agent...");
-                ai_agent_stop();
+#endif
+            if (failure_since_us != 0) {
+                ESP_LOGD(TAG, "I2C failure ended after %lld ms", (long long)((now_us - failure_since_us) / 1000));
+                failure_since_us = 0;
             }
 
-            // Detect SET button press (to TOGGLE AI agent - start/stop)
-            if (set_pressed && !prev_set_pressed) {
-                ESP_LOGW(TAG, "========================================");
-                ESP_LOGW(TAG, "SET BUTTON PRESSED!");
-                ESP_LOGW(TAG, "RTC channel status: b_call_session_started=%d", g_app.b_call_session_started);
-                ESP_LOGW(TAG, "Current agent state: b_ai_agent_joined=%d, agent_id='%s'",
-                         g_app.b_ai_agent_joined, g_app.agent_id);
-                ESP_LOGW(TAG, "========================================");
-
-                if (!g_app.b_ai_agent_joined) {
-                    // Check if board RTC has joined channel first
-                    if (!g_app.b_call_session_started) {
-                        ESP_LOGW(TAG, "✗ Cannot start AI Agent: Board RTC has not joined channel yet");
-                        ESP_LOGW(TAG, "  Please wait for board to connect to RTC channel first");
-                    } else {
-                        ESP_LOGI(TAG, "→ Starting AI Agent...");
-                        ai_agent_start();
-                    }
-                } else {
-                    ESP_LOGI(TAG, "→ Stopping AI Agent...");
-                    ai_agent_stop();
-                }
+            if (any_pending) {
+                active_until_us = now_us + BUTTON_FAST_HOLD_MS * 1000;
             }
+        }
+        prev_us = now_us;
 
-            // Log button release events (optional, for debugging)
-            if (!mute_pressed && prev_mute_pressed) {
-                ESP_LOGD(TAG, "MUTE button released");
-            }
-            if (!set_pressed && prev_set_pressed) {
-                ESP_LOGD(TAG, "SET button released");
-            }
+        // fast while something happens, then back off towards the idle rate
+        if (now_us < active_until_us) {
+            poll_ms = CONFIG_XVF3800_BUTTON_FAST_POLL_MS;
+        } else if (poll_ms < BUTTON_IDLE_POLL_MS) {
+            poll_ms = poll_ms * 2 < BUTTON_IDLE_POLL_MS ? poll_ms * 2 : BUTTON_IDLE_POLL_MS;
+        }
 
-            prev_mute_pressed = mute_pressed;
-            prev_set_pressed = set_pressed;
-        } else {
-            // During I2C failure, we can't read buttons
-            // But we'll detect state change when we recover (see "RECOVERED" block above)
+        if (now_us - stats_since_us >= BUTTON_STATS_INTERVAL_MS * 1000) {
+            int64_t window_us = now_us - stats_since_us;
+            int32_t permille = (int32_t)(bus_us * 1000 / window_us);
+            metric_set(&g_bus_permille, permille);
+            ESP_LOGI(TAG, "Button polling: %lu reads in %d s, I2C busy %ld.%ld%%", (unsigned long)polls,
+                     (int)(window_us / 1000000), (long)(permille / 10), (long)(permille % 10));
+            stats_since_us = now_us;
+            polls = 0;
+            bus_us = 0;
         }
 
-        // Poll every 20ms for faster button response
-        vTaskDelay(pdMS_TO_TICKS(20));
+        // an edge interrupt ends the wait early
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(poll_ms));
     }
 }
 
@@ -505,14 +642,8 @@ esp_err_t xvf3800_start_button_monitor(xvf3800_handle_t *handle)
 
     g_handle = handle;
 
-    BaseType_t ret = xTaskCreate(
-        button_monitor_task,
-        "xvf3800_button",
-        8192,  // Increased from 4096 - HTTP requests need more stack
-        handle,
-        5,
-        &g_monitor_task
-    );
+    // HTTP requests run on the agent control task, a small stack is enough
+    BaseType_t ret = task_plan_create(TASK_XVF_BUTTON, button_monitor_task, handle, &g_monitor_task);
 
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create button monitor task");
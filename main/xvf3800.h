@@ -13,6 +13,7 @@
 // Note: Actual values need to be confirmed from device_control_shared.h
 #define XVF3800_RESOURCE_ID_GPIO    0x00  // Confirmed from working ReSpeaker code
 #define XVF3800_RESOURCE_ID_DFU     0xF0  // Confirmed from documentation
+// DSP parameters (AEC, beamformer, AGC, noise suppression, DoA) are in xvf3800_param.h
 
 // XVF3800 Command IDs for GPIO (estimated values, may need adjustment)
 // Based on io_config_cmds.yaml structure mentioned in programming guide
@@ -29,6 +30,7 @@
 // Control command return status (from control_ret_t enum)
 #define XVF3800_STATUS_SUCCESS      0x00
 #define XVF3800_STATUS_ERROR        0x01
+#define XVF3800_STATUS_RETRY        0x40  // servicer busy, send the command again
 
 // Button state
 typedef enum {
@@ -40,11 +42,16 @@ typedef struct {
     i2c_port_t i2c_port;
     uint8_t i2c_addr;
     uint8_t resource_id_gpio;  // Dynamically discovered GPIO resource ID
+    uint8_t fw_version[3];     // major, minor, patch; 0.0.0 when unreadable
 } xvf3800_handle_t;
 
 /**
  * @brief Initialize XVF3800 device
  *
+ * The GPIO resource ID is validated from the NVS cache with a single read
+ * and only rescanned when that fails or the firmware version changed, so
+ * NVS must be initialised first.
+ *
  * @param handle Handle to store device context
  * @param i2c_port I2C port number
  * @return ESP_OK on success
@@ -82,8 +89,9 @@ esp_err_t xvf3800_read_mute_button(xvf3800_handle_t *handle, bool *is_pressed);
 /**
  * @brief Start button monitoring task
  *
- * This creates a FreeRTOS task that polls the mute button and triggers
- * callbacks when button state changes.
+ * This creates a FreeRTOS task that reads the SET and MUTE buttons, woken
+ * by an edge on CONFIG_XVF3800_BUTTON_INT_GPIO when the board has one and
+ * polling at an adaptive rate otherwise, and acts on debounced presses.
  *
  * @param handle Device handle
  * @return ESP_OK on success
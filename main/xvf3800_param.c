@@ -0,0 +1,386 @@
+#include "xvf3800_param.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "i2c_mgr.h"
+#include "string.h"
+
+static const char *TAG = "XVF3800_PARAM";
+
+#define PARAM_MAX_BYTES     (XVF3800_PARAM_MAX_VALUES * 4)
+#define PARAM_RETRIES       3       // attempts while the servicer answers RETRY
+#define PARAM_RETRY_DELAY_MS 2
+#define PARAM_TIMEOUT_MS    100
+#define RAD_TO_DEG          57.29577951f
+
+#define XVF3800_PARAM_ROW(id, p_resid, p_cmd, p_count, p_type, p_access) \
+    [XVF3800_PARAM_##id] = { .name = #id, .resid = p_resid, .cmd = p_cmd, .count = p_count, \
+                             .type = p_type, .access = p_access },
+
+static const xvf3800_param_desc_t g_params[XVF3800_PARAM_COUNT] = {
+    XVF3800_PARAM_TABLE(XVF3800_PARAM_ROW)
+};
+
+typedef struct {
+    bool valid;
+    xvf3800_value_t v[XVF3800_PARAM_MAX_VALUES];
+} param_cache_t;
+
+static portMUX_TYPE g_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+static param_cache_t g_cache[XVF3800_PARAM_COUNT];
+
+const xvf3800_param_desc_t *xvf3800_param_desc(xvf3800_param_t id)
+{
+    if (id >= XVF3800_PARAM_COUNT) return NULL;
+    return &g_params[id];
+}
+
+static size_t _type_size(xvf3800_type_t type)
+{
+    switch (type) {
+        case XVF3800_TYPE_U8:  return 1;
+        case XVF3800_TYPE_U16: return 2;
+        default:               return 4;
+    }
+}
+
+size_t xvf3800_param_size(const xvf3800_param_desc_t *desc)
+{
+    return _type_size(desc->type) * desc->count;
+}
+
+size_t xvf3800_param_encode(const xvf3800_param_desc_t *desc, const xvf3800_value_t *values,
+                            uint8_t *buf, size_t buf_len)
+{
+    size_t size = _type_size(desc->type);
+    if (desc->count > XVF3800_PARAM_MAX_VALUES || buf_len < size * desc->count) return 0;
+
+    for (int n = 0; n < desc->count; n++) {
+        uint32_t raw;
+        float f;
+
+        switch (desc->type) {
+            case XVF3800_TYPE_FLOAT:
+                f = values[n].f;
+                memcpy(&raw, &f, 4);
+                break;
+            case XVF3800_TYPE_RADIANS:
+                f = values[n].f / RAD_TO_DEG;
+                memcpy(&raw, &f, 4);
+                break;
+            default:
+                raw = (uint32_t)values[n].i;
+                break;
+        }
+
+        for (size_t b = 0; b < size; b++) {
+            buf[n * size + b] = (uint8_t)(raw >> (8 * b));
+        }
+    }
+    return size * desc->count;
+}
+
+size_t xvf3800_param_decode(const xvf3800_param_desc_t *desc, const uint8_t *buf, size_t len,
+                            xvf3800_value_t *values)
+{
+    size_t size = _type_size(desc->type);
+    if (desc->count > XVF3800_PARAM_MAX_VALUES || len < size * desc->count) return 0;
+
+    for (int n = 0; n < desc->count; n++) {
+        uint32_t raw = 0;
+        for (size_t b = 0; b < size; b++) {
+            raw |= (uint32_t)buf[n * size + b] << (8 * b);
+        }
+
+        switch (desc->type) {
+            case XVF3800_TYPE_FLOAT:
+                memcpy(&values[n].f, &raw, 4);
+                break;
+            case XVF3800_TYPE_RADIANS:
+                memcpy(&values[n].f, &raw, 4);
+                values[n].f *= RAD_TO_DEG;
+                break;
+            default:
+                // U8 and U16 were zero-extended above; I32 and U32 keep their bits
+                values[n].i = (int32_t)raw;
+                break;
+        }
+    }
+    return size * desc->count;
+}
+
+static bool _cache_get(xvf3800_param_io_t *io)
+{
+    bool hit;
+    portENTER_CRITICAL(&g_cache_lock);
+    hit = g_cache[io->id].valid;
+    if (hit) {
+        memcpy(io->v, g_cache[io->id].v, sizeof(io->v));
+    }
+    portEXIT_CRITICAL(&g_cache_lock);
+    return hit;
+}
+
+static void _cache_put(const xvf3800_param_io_t *io)
+{
+    portENTER_CRITICAL(&g_cache_lock);
+    memcpy(g_cache[io->id].v, io->v, sizeof(io->v));
+    g_cache[io->id].valid = true;
+    portEXIT_CRITICAL(&g_cache_lock);
+}
+
+void xvf3800_param_cache_clear(void)
+{
+    portENTER_CRITICAL(&g_cache_lock);
+    for (int i = 0; i < XVF3800_PARAM_COUNT; i++) {
+        g_cache[i].valid = false;
+    }
+    portEXIT_CRITICAL(&g_cache_lock);
+}
+
+/*
+ * Reads go out as write (resid, cmd | 0x80, 1 + size) with a repeated start
+ * into read (status, payload); up to I2C_MGR_MAX_OPS of them per I2C batch.
+ * Items the servicer answers with RETRY are sent again in the next round.
+ */
+static esp_err_t _read_chunk(xvf3800_handle_t *handle, xvf3800_param_io_t **items, int count)
+{
+    uint8_t tx[I2C_MGR_MAX_OPS][3];
+    uint8_t rx[I2C_MGR_MAX_OPS][1 + PARAM_MAX_BYTES];
+    i2c_op_t ops[I2C_MGR_MAX_OPS];
+    esp_err_t ret = ESP_OK;
+
+    for (int attempt = 0; attempt < PARAM_RETRIES && count > 0; attempt++) {
+        if (attempt > 0) vTaskDelay(pdMS_TO_TICKS(PARAM_RETRY_DELAY_MS));
+
+        for (int n = 0; n < count; n++) {
+            const xvf3800_param_desc_t *desc = &g_params[items[n]->id];
+            size_t size = xvf3800_param_size(desc);
+            tx[n][0] = desc->resid;
+            tx[n][1] = desc->cmd | 0x80;
+            tx[n][2] = 1 + size;
+            rx[n][0] = 0xFF;
+            ops[n] = (i2c_op_t)I2C_OP_WR_RD(tx[n], 3, rx[n], 1 + size);
+        }
+
+        ret = i2c_mgr_transfer(handle->i2c_addr, I2C_PRIO_CONTROL, ops, count, PARAM_TIMEOUT_MS);
+
+        int retry = 0;
+        for (int n = 0; n < count; n++) {
+            xvf3800_param_io_t *io = items[n];
+            const xvf3800_param_desc_t *desc = &g_params[io->id];
+
+            if (ret != ESP_OK) {
+                io->err = ret;
+            } else if (rx[n][0] == XVF3800_STATUS_RETRY) {
+                items[retry++] = io;
+                io->err = ESP_ERR_TIMEOUT;
+            } else if (rx[n][0] != XVF3800_STATUS_SUCCESS) {
+                ESP_LOGD(TAG, "%s: status 0x%02X", desc->name, rx[n][0]);
+                io->err = ESP_FAIL;
+            } else {
+                xvf3800_param_decode(desc, &rx[n][1], xvf3800_param_size(desc), io->v);
+                io->err = ESP_OK;
+                if (desc->access == XVF3800_ACCESS_CONST) {
+                    _cache_put(io);
+                }
+            }
+        }
+        count = ret == ESP_OK ? retry : 0;
+    }
+
+    return ret;
+}
+
+/*
+ * Writes go out as write (resid, cmd, size, payload) followed by a read of
+ * the status byte, two I2C ops per parameter.
+ */
+static esp_err_t _write_chunk(xvf3800_handle_t *handle, xvf3800_param_io_t **items, int count)
+{
+    uint8_t tx[I2C_MGR_MAX_OPS / 2][3 + PARAM_MAX_BYTES];
+    uint8_t status[I2C_MGR_MAX_OPS / 2];
+    i2c_op_t ops[I2C_MGR_MAX_OPS];
+    esp_err_t ret = ESP_OK;
+
+    for (int attempt = 0; attempt < PARAM_RETRIES && count > 0; attempt++) {
+        if (attempt > 0) vTaskDelay(pdMS_TO_TICKS(PARAM_RETRY_DELAY_MS));
+
+        for (int n = 0; n < count; n++) {
+            const xvf3800_param_desc_t *desc = &g_params[items[n]->id];
+            size_t size = xvf3800_param_encode(desc, items[n]->v, &tx[n][3], PARAM_MAX_BYTES);
+            tx[n][0] = desc->resid;
+            tx[n][1] = desc->cmd;
+            tx[n][2] = size;
+            status[n] = 0xFF;
+            ops[2 * n] = (i2c_op_t)I2C_OP_WR(tx[n], 3 + size);
+            ops[2 * n + 1] = (i2c_op_t)I2C_OP_RD(&status[n], 1);
+        }
+
+        ret = i2c_mgr_transfer(handle->i2c_addr, I2C_PRIO_CONTROL, ops, 2 * count, PARAM_TIMEOUT_MS);
+
+        int retry = 0;
+        for (int n = 0; n < count; n++) {
+            xvf3800_param_io_t *io = items[n];
+            if (ret != ESP_OK) {
+                io->err = ret;
+            } else if (status[n] == XVF3800_STATUS_RETRY) {
+                items[retry++] = io;
+                io->err = ESP_ERR_TIMEOUT;
+            } else if (status[n] != XVF3800_STATUS_SUCCESS) {
+                ESP_LOGD(TAG, "%s: status 0x%02X", g_params[io->id].name, status[n]);
+                io->err = ESP_FAIL;
+            } else {
+                io->err = ESP_OK;
+            }
+        }
+        count = ret == ESP_OK ? retry : 0;
+    }
+
+    return ret;
+}
+
+static esp_err_t _first_error(const xvf3800_param_io_t *io, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (io[i].err != ESP_OK) return io[i].err;
+    }
+    return ESP_OK;
+}
+
+esp_err_t xvf3800_param_read(xvf3800_handle_t *handle, xvf3800_param_io_t *io, int count)
+{
+    if (!handle || !io) return ESP_ERR_INVALID_ARG;
+
+    xvf3800_param_io_t *chunk[I2C_MGR_MAX_OPS];
+    int pending = 0;
+
+    for (int i = 0; i < count; i++) {
+        const xvf3800_param_desc_t *desc = xvf3800_param_desc(io[i].id);
+        if (!desc || desc->access == XVF3800_ACCESS_WO) {
+            io[i].err = ESP_ERR_INVALID_ARG;
+            continue;
+        }
+        if (desc->access == XVF3800_ACCESS_CONST && _cache_get(&io[i])) {
+            io[i].err = ESP_OK;
+            continue;
+        }
+
+        chunk[pending++] = &io[i];
+        if (pending == I2C_MGR_MAX_OPS) {
+            _read_chunk(handle, chunk, pending);
+            pending = 0;
+        }
+    }
+    if (pending > 0) {
+        _read_chunk(handle, chunk, pending);
+    }
+
+    return _first_error(io, count);
+}
+
+esp_err_t xvf3800_param_write(xvf3800_handle_t *handle, xvf3800_param_io_t *io, int count)
+{
+    if (!handle || !io) return ESP_ERR_INVALID_ARG;
+
+    xvf3800_param_io_t *chunk[I2C_MGR_MAX_OPS / 2];
+    int pending = 0;
+
+    for (int i = 0; i < count; i++) {
+        const xvf3800_param_desc_t *desc = xvf3800_param_desc(io[i].id);
+        if (!desc || (desc->access != XVF3800_ACCESS_RW && desc->access != XVF3800_ACCESS_WO)) {
+            io[i].err = ESP_ERR_INVALID_ARG;
+            continue;
+        }
+
+        chunk[pending++] = &io[i];
+        if (pending == I2C_MGR_MAX_OPS / 2) {
+            _write_chunk(handle, chunk, pending);
+            pending = 0;
+        }
+    }
+    if (pending > 0) {
+        _write_chunk(handle, chunk, pending);
+    }
+
+    return _first_error(io, count);
+}
+
+static esp_err_t _get(xvf3800_handle_t *handle, xvf3800_param_t id, xvf3800_param_io_t *io, int count)
+{
+    const xvf3800_param_desc_t *desc = xvf3800_param_desc(id);
+    if (!desc || count > desc->count) return ESP_ERR_INVALID_ARG;
+
+    io->id = id;
+    return xvf3800_param_read(handle, io, 1);
+}
+
+static esp_err_t _set(xvf3800_handle_t *handle, xvf3800_param_t id, xvf3800_param_io_t *io, int count)
+{
+    // a partial write would send zeros for the rest
+    const xvf3800_param_desc_t *desc = xvf3800_param_desc(id);
+    if (!desc || count != desc->count) return ESP_ERR_INVALID_ARG;
+
+    io->id = id;
+    return xvf3800_param_write(handle, io, 1);
+}
+
+static bool _is_float(xvf3800_param_t id)
+{
+    xvf3800_type_t type = g_params[id].type;
+    return type == XVF3800_TYPE_FLOAT || type == XVF3800_TYPE_RADIANS;
+}
+
+esp_err_t xvf3800_param_get_int(xvf3800_handle_t *handle, xvf3800_param_t id, int32_t *out, int count)
+{
+    xvf3800_param_io_t io = {0};
+    esp_err_t ret = _get(handle, id, &io, count);
+    if (ret != ESP_OK) return ret;
+
+    for (int n = 0; n < count; n++) {
+        out[n] = _is_float(id) ? (int32_t)io.v[n].f : io.v[n].i;
+    }
+    return ESP_OK;
+}
+
+esp_err_t xvf3800_param_get_float(xvf3800_handle_t *handle, xvf3800_param_t id, float *out, int count)
+{
+    xvf3800_param_io_t io = {0};
+    esp_err_t ret = _get(handle, id, &io, count);
+    if (ret != ESP_OK) return ret;
+
+    for (int n = 0; n < count; n++) {
+        out[n] = _is_float(id) ? io.v[n].f : (float)io.v[n].i;
+    }
+    return ESP_OK;
+}
+
+esp_err_t xvf3800_param_set_int(xvf3800_handle_t *handle, xvf3800_param_t id, const int32_t *in, int count)
+{
+    if (id >= XVF3800_PARAM_COUNT || count > XVF3800_PARAM_MAX_VALUES) return ESP_ERR_INVALID_ARG;
+
+    xvf3800_param_io_t io = {0};
+    for (int n = 0; n < count; n++) {
+        if (_is_float(id)) {
+            io.v[n].f = (float)in[n];
+        } else {
+            io.v[n].i = in[n];
+        }
+    }
+    return _set(handle, id, &io, count);
+}
+
+esp_err_t xvf3800_param_set_float(xvf3800_handle_t *handle, xvf3800_param_t id, const float *in, int count)
+{
+    if (id >= XVF3800_PARAM_COUNT || count > XVF3800_PARAM_MAX_VALUES) return ESP_ERR_INVALID_ARG;
+
+    xvf3800_param_io_t io = {0};
+    for (int n = 0; n < count; n++) {
+        if (_is_float(id)) {
+            io.v[n].f = in[n];
+        } else {
+            io.v[n].i = (int32_t)in[n];
+        }
+    }
+    return _set(handle, id, &io, count);
+}
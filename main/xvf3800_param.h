@@ -0,0 +1,161 @@
+#ifndef XVF3800_PARAM_H
+#define XVF3800_PARAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "xvf3800.h"
+
+/*
+ * Typed access to the XVF3800 DSP parameters over the control protocol.
+ *
+ * Every parameter is one row of XVF3800_PARAM_TABLE: resource ID, command
+ * ID, number of values, wire type and access. Values travel little-endian;
+ * RADIANS values are floats on the wire and degrees in this API. CONST
+ * parameters are read from the device once and served from a cache after
+ * that.
+ *
+ * Resource and command IDs follow the xvf_host parameter list of the 2.x
+ * firmware; check them against the flashed firmware before relying on a new
+ * row.
+ */
+
+typedef enum {
+    XVF3800_TYPE_U8 = 0,
+    XVF3800_TYPE_U16,
+    XVF3800_TYPE_I32,
+    XVF3800_TYPE_U32,
+    XVF3800_TYPE_FLOAT,
+    XVF3800_TYPE_RADIANS,      // float radians on the wire, degrees here
+} xvf3800_type_t;
+
+typedef enum {
+    XVF3800_ACCESS_RO = 0,     // changes at runtime, always read from the device
+    XVF3800_ACCESS_CONST,      // read-only and fixed while the firmware runs, cached
+    XVF3800_ACCESS_RW,
+    XVF3800_ACCESS_WO,
+} xvf3800_access_t;
+
+/*  id                         resid cmd count type                  access */
+#define XVF3800_PARAM_TABLE(X)                                                       \
+    /* application */                                                                \
+    X(VERSION,                   48,   0,  3,  XVF3800_TYPE_U8,      XVF3800_ACCESS_CONST) \
+    /* echo canceller and beamformer */                                              \
+    X(AEC_AECPATHCHANGE,         33,   0,  1,  XVF3800_TYPE_I32,     XVF3800_ACCESS_RO)    \
+    X(AEC_HPFONOFF,              33,   1,  1,  XVF3800_TYPE_I32,     XVF3800_ACCESS_RW)    \
+    X(AEC_AECSILENCELEVEL,       33,   2,  2,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(AEC_AECCONVERGED,          33,   3,  1,  XVF3800_TYPE_I32,     XVF3800_ACCESS_RO)    \
+    X(AEC_AECEMPHASISONOFF,      33,   4,  1,  XVF3800_TYPE_I32,     XVF3800_ACCESS_RW)    \
+    X(AEC_FAR_EXTGAIN,           33,   5,  1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(AEC_RT60,                  33,   9,  1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RO)    \
+    X(AEC_ASROUTONOFF,           33,   35, 1,  XVF3800_TYPE_I32,     XVF3800_ACCESS_RW)    \
+    X(AEC_ASROUTGAIN,            33,   36, 1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(AEC_FIXEDBEAMSONOFF,       33,   37, 1,  XVF3800_TYPE_I32,     XVF3800_ACCESS_RW)    \
+    X(AEC_FIXEDBEAMSTHETA,       33,   39, 2,  XVF3800_TYPE_RADIANS, XVF3800_ACCESS_RW)    \
+    X(AEC_AZIMUTH_VALUES,        33,   75, 4,  XVF3800_TYPE_RADIANS, XVF3800_ACCESS_RO)    \
+    X(AEC_SPENERGY_VALUES,       33,   80, 4,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RO)    \
+    /* post-processing: AGC and noise suppression */                                 \
+    X(PP_AGCONOFF,               17,   10, 1,  XVF3800_TYPE_I32,     XVF3800_ACCESS_RW)    \
+    X(PP_AGCMAXGAIN,             17,   11, 1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(PP_AGCDESIREDLEVEL,        17,   12, 1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(PP_AGCGAIN,                17,   13, 1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(PP_AGCTIME,                17,   14, 1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(PP_MIN_NS,                 17,   21, 1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(PP_MIN_NN,                 17,   22, 1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(PP_ECHOONOFF,              17,   23, 1,  XVF3800_TYPE_I32,     XVF3800_ACCESS_RW)    \
+    /* audio manager */                                                              \
+    X(AUDIO_MGR_MIC_GAIN,        35,   0,  1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(AUDIO_MGR_REF_GAIN,        35,   1,  1,  XVF3800_TYPE_FLOAT,   XVF3800_ACCESS_RW)    \
+    X(AUDIO_MGR_SELECTED_AZIMUTHS, 35, 11, 2,  XVF3800_TYPE_RADIANS, XVF3800_ACCESS_RO)    \
+    /* direction of arrival: degrees and a speech flag */                            \
+    X(DOA_VALUE,                 20,   18, 2,  XVF3800_TYPE_U16,     XVF3800_ACCESS_RO)
+
+#define XVF3800_PARAM_ID(id, ...) XVF3800_PARAM_##id,
+typedef enum {
+    XVF3800_PARAM_TABLE(XVF3800_PARAM_ID)
+    XVF3800_PARAM_COUNT
+} xvf3800_param_t;
+
+#define XVF3800_PARAM_MAX_VALUES    4
+
+typedef struct {
+    const char *name;
+    uint8_t resid;
+    uint8_t cmd;
+    uint8_t count;
+    xvf3800_type_t type;
+    xvf3800_access_t access;
+} xvf3800_param_desc_t;
+
+/* integer types fill i, FLOAT and RADIANS fill f */
+typedef union {
+    int32_t i;
+    float f;
+} xvf3800_value_t;
+
+/* one parameter of a batch */
+typedef struct {
+    xvf3800_param_t id;
+    xvf3800_value_t v[XVF3800_PARAM_MAX_VALUES];
+    esp_err_t err;             // per parameter result
+} xvf3800_param_io_t;
+
+/**
+ * @brief Row of the parameter table, NULL for an unknown id
+ */
+const xvf3800_param_desc_t *xvf3800_param_desc(xvf3800_param_t id);
+
+/**
+ * @brief Wire size of a parameter in bytes
+ */
+size_t xvf3800_param_size(const xvf3800_param_desc_t *desc);
+
+/**
+ * @brief Encode values for the wire, little-endian, degrees to radians
+ *
+ * Pure function of its arguments.
+ *
+ * @return bytes written, 0 if buf is too small
+ */
+size_t xvf3800_param_encode(const xvf3800_param_desc_t *desc, const xvf3800_value_t *values,
+                            uint8_t *buf, size_t buf_len);
+
+/**
+ * @brief Decode values from the wire, radians to degrees
+ *
+ * Pure function of its arguments.
+ *
+ * @return bytes consumed, 0 if len is too short
+ */
+size_t xvf3800_param_decode(const xvf3800_param_desc_t *desc, const uint8_t *buf, size_t len,
+                            xvf3800_value_t *values);
+
+/**
+ * @brief Read several parameters in as few I2C batches as possible
+ *
+ * CONST parameters already cached are not read again.
+ *
+ * @return ESP_OK if every parameter was read, otherwise the first error;
+ *         io[n].err tells which ones failed
+ */
+esp_err_t xvf3800_param_read(xvf3800_handle_t *handle, xvf3800_param_io_t *io, int count);
+
+/**
+ * @brief Write several parameters in as few I2C batches as possible
+ */
+esp_err_t xvf3800_param_write(xvf3800_handle_t *handle, xvf3800_param_io_t *io, int count);
+
+/**
+ * @brief Forget the cached CONST values, e.g. after a device reset
+ */
+void xvf3800_param_cache_clear(void);
+
+/* single value helpers, for parameters with count values */
+esp_err_t xvf3800_param_get_int(xvf3800_handle_t *handle, xvf3800_param_t id, int32_t *out, int count);
+esp_err_t xvf3800_param_get_float(xvf3800_handle_t *handle, xvf3800_param_t id, float *out, int count);
+esp_err_t xvf3800_param_set_int(xvf3800_handle_t *handle, xvf3800_param_t id, const int32_t *in, int count);
+esp_err_t xvf3800_param_set_float(xvf3800_handle_t *handle, xvf3800_param_t id, const float *in, int count);
+
+#endif // XVF3800_PARAM_H
@@ -0,0 +1,22 @@
+#include "yuv_convert.h"
+
+void yuyv_to_i420(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+  uint8_t *dst_y = dst;
+  uint8_t *dst_u = dst + width * height;
+  uint8_t *dst_v = dst_u + width * height / 4;
+
+  for (int row = 0; row < height; row++) {
+    const uint8_t *line = src + row * width * 2;
+    for (int col = 0; col < width; col += 2) {
+      *dst_y++ = line[0];
+      *dst_y++ = line[2];
+      /* 4:2:0 keeps the chroma of even rows only */
+      if ((row & 1) == 0) {
+        *dst_u++ = line[1];
+        *dst_v++ = line[3];
+      }
+      line += 4;
+    }
+  }
+}
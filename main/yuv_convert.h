@@ -0,0 +1,21 @@
+#ifndef YUV_CONVERT_H
+#define YUV_CONVERT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+
+/* the I420 size of a width x height frame, luma plane then quarter size U and V */
+#define YUV_I420_SIZE(width, height)  ((width) * (height) * 3 / 2)
+
+/* packed YUYV from the camera to planar I420 for the H.264 encoder. width
+ * and height must be even, dst holds YUV_I420_SIZE(width, height) bytes */
+void yuyv_to_i420(const uint8_t *src, uint8_t *dst, int width, int height);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
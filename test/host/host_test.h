@@ -0,0 +1,49 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+/* Minimal checks for the host tests: a failed check is printed and counted,
+ * the test goes on, and main returns the count through TEST_EXIT(). */
+
+#include <stdio.h>
+#include <string.h>
+
+static int g_test_failures = 0;
+
+#define TEST_CHECK(cond)                                                  \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);    \
+      g_test_failures++;                                                  \
+    }                                                                     \
+  } while (0)
+
+#define TEST_CHECK_INT(actual, expected)                                  \
+  do {                                                                    \
+    long long a_ = (long long)(actual), e_ = (long long)(expected);       \
+    if (a_ != e_) {                                                       \
+      printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__,    \
+             #actual, a_, e_);                                            \
+      g_test_failures++;                                                  \
+    }                                                                     \
+  } while (0)
+
+#define TEST_CHECK_STR(actual, expected)                                  \
+  do {                                                                    \
+    const char *a_ = (actual), *e_ = (expected);                          \
+    if (!a_ || strcmp(a_, e_) != 0) {                                     \
+      printf("%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, \
+             #actual, a_ ? a_ : "(null)", e_);                            \
+      g_test_failures++;                                                  \
+    }                                                                     \
+  } while (0)
+
+#define TEST_RUN(fn)                                                      \
+  do {                                                                    \
+    int before_ = g_test_failures;                                        \
+    fn();                                                                 \
+    printf("%s %s\n", g_test_failures == before_ ? "PASS" : "FAIL", #fn);  \
+  } while (0)
+
+#define TEST_EXIT()  return g_test_failures ? 1 : 0
+
+#endif
@@ -0,0 +1,265 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "rest_standin.h"
+
+#define REQ_MAX  (8192)
+
+static SSL_CTX *g_ctx = NULL;
+static int g_listen_fd = -1;
+static int g_idle_close_ms = 0;
+static standin_route_t g_route = NULL;
+static void *g_route_ctx = NULL;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static standin_stats_t g_stats;
+
+/* a P-256 key and a certificate for it, valid for an hour */
+static SSL_CTX *_server_ctx(void)
+{
+  EVP_PKEY *key = EVP_EC_gen("P-256");
+  X509 *cert = X509_new();
+  if (key == NULL || cert == NULL) {
+    return NULL;
+  }
+
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, key);
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"standin", -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  X509_sign(cert, key, EVP_sha256());
+
+  SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+  if (ctx && (SSL_CTX_use_certificate(ctx, cert) != 1 || SSL_CTX_use_PrivateKey(ctx, key) != 1)) {
+    SSL_CTX_free(ctx);
+    ctx = NULL;
+  }
+  X509_free(cert);
+  EVP_PKEY_free(key);
+  return ctx;
+}
+
+static const char *_reason(int status)
+{
+  switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 409: return "Conflict";
+    case 429: return "Too Many Requests";
+    case 503: return "Service Unavailable";
+    default:  return "Status";
+  }
+}
+
+static bool _write_all(SSL *ssl, const char *data, int len)
+{
+  while (len > 0) {
+    int n = SSL_write(ssl, data, len);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+static void _note_auth(const char *auth)
+{
+  pthread_mutex_lock(&g_lock);
+  g_stats.requests++;
+  if (g_stats.auth[0] == '\0') {
+    snprintf(g_stats.auth, sizeof(g_stats.auth), "%s", auth);
+  } else if (strcmp(g_stats.auth, auth) != 0) {
+    g_stats.auth_changes++;
+  }
+  pthread_mutex_unlock(&g_lock);
+}
+
+/* one request off the connection and its answer, false once the connection is done */
+static bool _serve_one(SSL *ssl, char *buf, int *have)
+{
+  char *end;
+  while ((end = memmem(buf, *have, "\r\n\r\n", 4)) == NULL) {
+    if (*have >= REQ_MAX - 1) {
+      return false;
+    }
+    int n = SSL_read(ssl, buf + *have, REQ_MAX - 1 - *have);
+    if (n <= 0) {
+      // the receive timeout runs out on a connection left idle
+      if (*have == 0 && SSL_get_error(ssl, n) == SSL_ERROR_WANT_READ) {
+        pthread_mutex_lock(&g_lock);
+        g_stats.idle_closed++;
+        pthread_mutex_unlock(&g_lock);
+      }
+      return false;
+    }
+    *have += n;
+  }
+  int head_len = (int)(end - buf) + 4;
+  end[2] = '\0';
+
+  char method[16] = {0}, path[512] = {0}, auth[256] = {0};
+  int body_len = 0;
+  if (sscanf(buf, "%15s %511s", method, path) != 2) {
+    return false;
+  }
+  for (char *line = strstr(buf, "\r\n") + 2, *eol; (eol = strstr(line, "\r\n")) != NULL; line = eol + 2) {
+    *eol = '\0';
+    char *colon = strchr(line, ':');
+    if (colon == NULL) {
+      continue;
+    }
+    *colon = '\0';
+    char *value = colon + 1 + strspn(colon + 1, " \t");
+    if (strcasecmp(line, "Content-Length") == 0) {
+      body_len = atoi(value);
+    } else if (strcasecmp(line, "Authorization") == 0) {
+      snprintf(auth, sizeof(auth), "%s", value);
+    }
+  }
+  if (body_len < 0 || head_len + body_len >= REQ_MAX) {
+    return false;
+  }
+  while (*have < head_len + body_len) {
+    int n = SSL_read(ssl, buf + *have, REQ_MAX - 1 - *have);
+    if (n <= 0) {
+      return false;
+    }
+    *have += n;
+  }
+
+  char body[REQ_MAX];
+  memcpy(body, buf + head_len, body_len);
+  body[body_len] = '\0';
+  _note_auth(auth);
+
+  standin_reply_t reply = { .status = 404 };
+  g_route(method, path, body, &reply, g_route_ctx);
+  if (reply.drop) {
+    return false;
+  }
+
+  char out[STANDIN_BODY_MAX + 256];
+  int len = snprintf(out, sizeof(out),
+                     "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+                     "Connection: keep-alive\r\n\r\n%s",
+                     reply.status, _reason(reply.status), (int)strlen(reply.body), reply.body);
+  if (!_write_all(ssl, out, len)) {
+    return false;
+  }
+
+  // whatever came after this request stays for the next one
+  *have -= head_len + body_len;
+  memmove(buf, buf + head_len + body_len, *have);
+  return true;
+}
+
+static void *_conn_thread(void *arg)
+{
+  int fd = (int)(intptr_t)arg;
+  char buf[REQ_MAX];
+  int have = 0;
+  int one = 1;
+
+  // the reply would otherwise wait behind the session tickets for an ACK
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (g_idle_close_ms > 0) {
+    struct timeval tv = { .tv_sec = g_idle_close_ms / 1000, .tv_usec = (g_idle_close_ms % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  }
+
+  SSL *ssl = SSL_new(g_ctx);
+  SSL_set_fd(ssl, fd);
+  if (SSL_accept(ssl) == 1) {
+    pthread_mutex_lock(&g_lock);
+    g_stats.connections++;
+    if (SSL_session_reused(ssl)) {
+      g_stats.resumed++;
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    while (_serve_one(ssl, buf, &have)) {
+    }
+    SSL_shutdown(ssl);
+  }
+  SSL_free(ssl);
+  close(fd);
+  return NULL;
+}
+
+static void *_accept_thread(void *arg)
+{
+  while (1) {
+    int fd = accept(g_listen_fd, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, _conn_thread, (void *)(intptr_t)fd) != 0) {
+      close(fd);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+  return NULL;
+}
+
+int standin_start(standin_route_t route, void *ctx, int idle_close_ms)
+{
+  struct sockaddr_in addr = {
+    .sin_family      = AF_INET,
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  socklen_t addr_len = sizeof(addr);
+
+  // a client that has gone away is a failed write, not a signal
+  signal(SIGPIPE, SIG_IGN);
+  g_route         = route;
+  g_route_ctx     = ctx;
+  g_idle_close_ms = idle_close_ms;
+  g_ctx           = _server_ctx();
+  if (g_ctx == NULL) {
+    return 0;
+  }
+  SSL_CTX_set_session_id_context(g_ctx, (const unsigned char *)"standin", 7);
+
+  g_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (g_listen_fd < 0 || bind(g_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(g_listen_fd, 8) != 0 || getsockname(g_listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+    return 0;
+  }
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, _accept_thread, NULL) != 0) {
+    return 0;
+  }
+  pthread_detach(thread);
+  return ntohs(addr.sin_port);
+}
+
+void standin_get_stats(standin_stats_t *stats)
+{
+  pthread_mutex_lock(&g_lock);
+  *stats = g_stats;
+  pthread_mutex_unlock(&g_lock);
+}
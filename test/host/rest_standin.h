@@ -0,0 +1,36 @@
+#ifndef REST_STANDIN_H
+#define REST_STANDIN_H
+
+/* A local HTTPS server standing in for a REST API: TLS on OpenSSL with a
+ * throwaway self-signed certificate, HTTP/1.1 with keep-alive, a thread
+ * per connection. Each request is answered by the route callback; it
+ * runs on the connection's thread, one request at a time. */
+
+#include <stdbool.h>
+
+#define STANDIN_BODY_MAX  (2048)
+
+typedef struct {
+  int status;
+  char body[STANDIN_BODY_MAX];
+  bool drop;      // close the connection instead of answering
+} standin_reply_t;
+
+typedef void (*standin_route_t)(const char *method, const char *path, const char *body, standin_reply_t *reply,
+                                void *ctx);
+
+typedef struct {
+  int connections;    // TCP connections accepted
+  int resumed;        // of them, TLS sessions resumed from a ticket
+  int idle_closed;    // kept-alive connections the server closed for idling
+  int requests;
+  int auth_changes;   // requests whose Authorization differed from the first one
+  char auth[256];     // the first Authorization header seen
+} standin_stats_t;
+
+/* start serving on an ephemeral port and return it, 0 on failure. A
+ * kept-alive connection idle for idle_close_ms is closed, 0 keeps it */
+int standin_start(standin_route_t route, void *ctx, int idle_close_ms);
+void standin_get_stats(standin_stats_t *stats);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef HOST_APP_CONFIG_H
+#define HOST_APP_CONFIG_H
+
+/* the host tests build with the documented defaults */
+#include "app_config.h.example"
+
+#endif
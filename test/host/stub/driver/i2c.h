@@ -0,0 +1,57 @@
+#ifndef HOST_DRIVER_I2C_H
+#define HOST_DRIVER_I2C_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+/* the legacy master API; transfers go to the device attached with
+ * host_i2c_attach() */
+
+typedef int i2c_port_t;
+typedef struct host_i2c_cmd *i2c_cmd_handle_t;
+
+#define I2C_NUM_0         (0)
+#define I2C_NUM_1         (1)
+#define I2C_MASTER_WRITE  (0)
+#define I2C_MASTER_READ   (1)
+
+typedef enum { I2C_MODE_SLAVE, I2C_MODE_MASTER } i2c_mode_t;
+typedef enum { I2C_MASTER_ACK, I2C_MASTER_NACK, I2C_MASTER_LAST_NACK } i2c_ack_type_t;
+
+typedef struct {
+  i2c_mode_t mode;
+  int sda_io_num;
+  int scl_io_num;
+  bool sda_pullup_en;
+  bool scl_pullup_en;
+  struct {
+    uint32_t clk_speed;
+  } master;
+  uint32_t clk_flags;
+} i2c_config_t;
+
+#define I2C_LINK_RECOMMENDED_SIZE(n)  (64 * (n))
+
+i2c_cmd_handle_t i2c_cmd_link_create(void);
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buf, uint32_t size);
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd);
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en);
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks);
+
+esp_err_t i2c_master_write_to_device(i2c_port_t port, uint8_t addr, const uint8_t *wr, size_t wr_len, TickType_t ticks);
+esp_err_t i2c_master_read_from_device(i2c_port_t port, uint8_t addr, uint8_t *rd, size_t rd_len, TickType_t ticks);
+esp_err_t i2c_master_write_read_device(i2c_port_t port, uint8_t addr, const uint8_t *wr, size_t wr_len, uint8_t *rd,
+                                       size_t rd_len, TickType_t ticks);
+
+esp_err_t i2c_set_pin(i2c_port_t port, int sda, int scl, bool sda_pullup, bool scl_pullup, i2c_mode_t mode);
+esp_err_t i2c_reset_tx_fifo(i2c_port_t port);
+esp_err_t i2c_reset_rx_fifo(i2c_port_t port);
+
+#endif
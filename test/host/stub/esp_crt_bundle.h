@@ -0,0 +1,9 @@
+#ifndef HOST_ESP_CRT_BUNDLE_H
+#define HOST_ESP_CRT_BUNDLE_H
+
+#include "esp_err.h"
+
+/* accepted and ignored: the host client does not check certificates */
+esp_err_t esp_crt_bundle_attach(void *conf);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HOST_ESP_EVENT_H
+#define HOST_ESP_EVENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+/* the default event loop, one thread dispatching posted events in order */
+
+typedef const char *esp_event_base_t;
+typedef void *esp_event_handler_instance_t;
+typedef void (*esp_event_handler_t)(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+
+#define ESP_EVENT_ANY_ID              (-1)
+#define ESP_EVENT_DECLARE_BASE(id)    extern esp_event_base_t const id
+#define ESP_EVENT_DEFINE_BASE(id)     esp_event_base_t const id = #id
+
+esp_err_t esp_event_loop_create_default(void);
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t handler, void *arg,
+                                              esp_event_handler_instance_t *instance);
+/* ESP_ERR_TIMEOUT if the queue stays full for ticks_to_wait */
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdio.h>
+
+#include "esp_err.h"
+
+typedef enum { ESP_LOG_NONE, ESP_LOG_ERROR, ESP_LOG_WARN, ESP_LOG_INFO, ESP_LOG_DEBUG, ESP_LOG_VERBOSE } esp_log_level_t;
+
+#define ESP_LOGE(tag, fmt, ...)  printf("E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)  printf("W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)  printf("I %s: " fmt "\n", tag, ##__VA_ARGS__)
+/* not printed, but the format is still checked against the arguments */
+#define ESP_LOGD(tag, fmt, ...)  do { if (0) printf("D %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, fmt, ...)  do { if (0) printf("V %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+
+#define esp_log_level_set(tag, level)  ((void)(tag), (void)(level))
+
+#endif
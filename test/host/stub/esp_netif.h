@@ -0,0 +1,66 @@
+#ifndef HOST_ESP_NETIF_H
+#define HOST_ESP_NETIF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef struct host_netif esp_netif_t;
+
+typedef struct {
+  uint32_t addr;
+} esp_ip4_addr_t;
+
+#define ESP_IPADDR_TYPE_V4  (0)
+
+typedef struct {
+  union {
+    esp_ip4_addr_t ip4;
+  } u_addr;
+  uint8_t type;
+} esp_ip_addr_t;
+
+typedef struct {
+  esp_ip4_addr_t ip;
+  esp_ip4_addr_t netmask;
+  esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+  esp_ip_addr_t ip;
+} esp_netif_dns_info_t;
+
+typedef enum {
+  ESP_NETIF_DNS_MAIN = 0,
+  ESP_NETIF_DNS_BACKUP,
+} esp_netif_dns_type_t;
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+typedef enum {
+  IP_EVENT_STA_GOT_IP = 0,
+  IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+typedef struct {
+  int if_index;
+  esp_netif_ip_info_t ip_info;
+  bool ip_changed;
+} ip_event_got_ip_t;
+
+#define IPSTR  "%d.%d.%d.%d"
+#define IP2STR(ipaddr)                                                                        \
+  (int)((ipaddr)->addr & 0xff), (int)(((ipaddr)->addr >> 8) & 0xff),                          \
+  (int)(((ipaddr)->addr >> 16) & 0xff), (int)(((ipaddr)->addr >> 24) & 0xff)
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *netif);
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *netif);
+esp_err_t esp_netif_set_ip_info(esp_netif_t *netif, const esp_netif_ip_info_t *info);
+esp_err_t esp_netif_set_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns);
+esp_err_t esp_netif_get_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+/* The subset of the FreeRTOS API the application uses, on pthreads. One
+ * tick is one millisecond; critical sections share one recursive mutex. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+typedef uint8_t StackType_t;
+
+typedef struct host_task *TaskHandle_t;
+typedef struct host_queue *QueueHandle_t;
+typedef struct host_queue *SemaphoreHandle_t;
+typedef struct host_events *EventGroupHandle_t;
+
+/* the static variants allocate anyway, the buffers only need to exist */
+typedef struct { void *unused[4]; } StaticTask_t;
+typedef struct { void *unused[4]; } StaticQueue_t;
+typedef struct { void *unused[4]; } StaticSemaphore_t;
+typedef struct { void *unused[4]; } StaticEventGroup_t;
+
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED  { 0 }
+
+void host_critical_enter(void);
+void host_critical_exit(void);
+#define portENTER_CRITICAL(mux)       ((void)(mux), host_critical_enter())
+#define portEXIT_CRITICAL(mux)        ((void)(mux), host_critical_exit())
+#define portENTER_CRITICAL_ISR(mux)   portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux)    portEXIT_CRITICAL(mux)
+
+#define pdTRUE                        (1)
+#define pdFALSE                       (0)
+#define pdPASS                        (1)
+#define pdFAIL                        (0)
+#define errQUEUE_FULL                 (0)
+
+#define portMAX_DELAY                 ((TickType_t)0xffffffffu)
+#define configTICK_RATE_HZ            (1000)
+#define portTICK_PERIOD_MS            (1)
+#define pdMS_TO_TICKS(ms)             ((TickType_t)(ms))
+#define pdTICKS_TO_MS(ticks)          ((uint32_t)(ticks))
+
+#define portNUM_PROCESSORS            (2)
+#define tskNO_AFFINITY                (0x7fffffff)
+#define tskIDLE_PRIORITY              (0)
+#define configMAX_PRIORITIES          (25)
+#define configMAX_TASK_NAME_LEN       (16)
+#define configUSE_TRACE_FACILITY      (1)
+#define configGENERATE_RUN_TIME_STATS (1)
+
+#define portYIELD_FROM_ISR(woken)     ((void)(woken))
+
+#endif
@@ -0,0 +1,270 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_err.h"
+#include "esp_mac.h"
+#include "esp_pm.h"
+#include "esp_random.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "host_stub.h"
+
+/* ---- time ---- */
+
+static int64_t g_sim_us = -1;
+
+static int64_t _mono_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t esp_timer_get_time(void)
+{
+  int64_t sim = __atomic_load_n(&g_sim_us, __ATOMIC_SEQ_CST);
+  return sim >= 0 ? sim : _mono_us();
+}
+
+void host_time_set(int64_t us)
+{
+  __atomic_store_n(&g_sim_us, us, __ATOMIC_SEQ_CST);
+}
+
+void host_time_advance(int64_t us)
+{
+  __atomic_add_fetch(&g_sim_us, us, __ATOMIC_SEQ_CST);
+}
+
+void host_time_real(void)
+{
+  host_time_set(-1);
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+  usleep(us);
+}
+
+uint32_t esp_random(void)
+{
+  return (uint32_t)random();
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+  static const uint8_t base[6] = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 };
+  memcpy(mac, base, sizeof(base));
+  mac[5] += (uint8_t)type;
+  return ESP_OK;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+  switch (code) {
+    case ESP_OK:                   return "ESP_OK";
+    case ESP_FAIL:                 return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:           return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:      return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:    return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:     return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT:          return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_NVS_NOT_FOUND:    return "ESP_ERR_NVS_NOT_FOUND";
+    default:                       return "ERROR";
+  }
+}
+
+/* ---- esp_timer, on real time ---- */
+
+struct esp_timer {
+  esp_timer_cb_t cb;
+  void *arg;
+  int64_t due_us;      // 0 when stopped
+  int64_t period_us;   // 0 for one shot
+  struct esp_timer *next;
+};
+
+static pthread_mutex_t g_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_timer_cond;
+static pthread_once_t g_timer_once = PTHREAD_ONCE_INIT;
+static struct esp_timer *g_timers = NULL;
+
+static void *_timer_thread(void *arg)
+{
+  pthread_mutex_lock(&g_timer_lock);
+  while (1) {
+    int64_t now = _mono_us();
+    int64_t next_due = 0;
+    struct esp_timer *due = NULL;
+
+    for (struct esp_timer *t = g_timers; t; t = t->next) {
+      if (t->due_us == 0) {
+        continue;
+      }
+      if (t->due_us <= now && (!due || t->due_us < due->due_us)) {
+        due = t;
+      }
+      if (!next_due || t->due_us < next_due) {
+        next_due = t->due_us;
+      }
+    }
+
+    if (due) {
+      due->due_us = due->period_us ? due->due_us + due->period_us : 0;
+      esp_timer_cb_t cb = due->cb;
+      void *cb_arg = due->arg;
+      pthread_mutex_unlock(&g_timer_lock);
+      cb(cb_arg);
+      pthread_mutex_lock(&g_timer_lock);
+      continue;
+    }
+
+    if (!next_due) {
+      pthread_cond_wait(&g_timer_cond, &g_timer_lock);
+    } else {
+      struct timespec ts = { .tv_sec = next_due / 1000000, .tv_nsec = (next_due % 1000000) * 1000 };
+      pthread_cond_timedwait(&g_timer_cond, &g_timer_lock, &ts);
+    }
+  }
+  return NULL;
+}
+
+static void _timer_init(void)
+{
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&g_timer_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, _timer_thread, NULL);
+  pthread_detach(thread);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+  if (!args || !args->callback || !handle) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  pthread_once(&g_timer_once, _timer_init);
+
+  struct esp_timer *timer = calloc(1, sizeof(*timer));
+  timer->cb  = args->callback;
+  timer->arg = args->arg;
+
+  pthread_mutex_lock(&g_timer_lock);
+  timer->next = g_timers;
+  g_timers    = timer;
+  pthread_mutex_unlock(&g_timer_lock);
+
+  *handle = timer;
+  return ESP_OK;
+}
+
+static esp_err_t _timer_start(esp_timer_handle_t timer, uint64_t us, bool periodic)
+{
+  pthread_mutex_lock(&g_timer_lock);
+  if (timer->due_us) {
+    pthread_mutex_unlock(&g_timer_lock);
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->due_us    = _mono_us() + (int64_t)(us ? us : 1);
+  timer->period_us = periodic ? (int64_t)us : 0;
+  pthread_cond_broadcast(&g_timer_cond);
+  pthread_mutex_unlock(&g_timer_lock);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+  return _timer_start(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+  return _timer_start(timer, period_us, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+  pthread_mutex_lock(&g_timer_lock);
+  esp_err_t err = timer->due_us ? ESP_OK : ESP_ERR_INVALID_STATE;
+  timer->due_us = 0;
+  pthread_mutex_unlock(&g_timer_lock);
+  return err;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+  pthread_mutex_lock(&g_timer_lock);
+  for (struct esp_timer **t = &g_timers; *t; t = &(*t)->next) {
+    if (*t == timer) {
+      *t = timer->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&g_timer_lock);
+  free(timer);
+  return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+  pthread_mutex_lock(&g_timer_lock);
+  bool active = timer->due_us != 0;
+  pthread_mutex_unlock(&g_timer_lock);
+  return active;
+}
+
+/* ---- power management ---- */
+
+struct esp_pm_lock {
+  int count;
+};
+
+static int g_pm_held = 0;
+
+esp_err_t esp_pm_configure(const void *config)
+{
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char *name, esp_pm_lock_handle_t *handle)
+{
+  *handle = calloc(1, sizeof(**handle));
+  return *handle ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+  __atomic_add_fetch(&handle->count, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&g_pm_held, 1, __ATOMIC_SEQ_CST);
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+  if (__atomic_load_n(&handle->count, __ATOMIC_SEQ_CST) == 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  __atomic_sub_fetch(&handle->count, 1, __ATOMIC_SEQ_CST);
+  __atomic_sub_fetch(&g_pm_held, 1, __ATOMIC_SEQ_CST);
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_dump_locks(FILE *stream)
+{
+  fprintf(stream, "pm locks held: %d\n", host_pm_locks_held());
+  return ESP_OK;
+}
+
+int host_pm_locks_held(void)
+{
+  return __atomic_load_n(&g_pm_held, __ATOMIC_SEQ_CST);
+}
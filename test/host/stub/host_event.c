@@ -0,0 +1,160 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "host_stub.h"
+
+/* ---- the default event loop ---- */
+
+#define EVENT_QUEUE_LEN    (32)
+#define EVENT_DATA_MAX     (64)
+#define EVENT_HANDLERS_MAX (16)
+
+typedef struct {
+  esp_event_base_t base;
+  int32_t id;
+  size_t size;
+  uint8_t data[EVENT_DATA_MAX];
+} event_t;
+
+typedef struct {
+  esp_event_base_t base;
+  int32_t id;
+  esp_event_handler_t handler;
+  void *arg;
+} handler_t;
+
+static pthread_mutex_t g_loop_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_loop_cond = PTHREAD_COND_INITIALIZER;
+static event_t g_queue[EVENT_QUEUE_LEN];
+static int g_head = 0;
+static int g_count = 0;
+static bool g_dispatching = false;
+static handler_t g_handlers[EVENT_HANDLERS_MAX];
+static int g_handler_count = 0;
+static bool g_loop_created = false;
+static pthread_t g_loop_thread;
+
+static void *_loop_thread(void *arg)
+{
+  pthread_mutex_lock(&g_loop_lock);
+  while (1) {
+    while (g_count == 0) {
+      g_dispatching = false;
+      pthread_cond_broadcast(&g_loop_cond);
+      pthread_cond_wait(&g_loop_cond, &g_loop_lock);
+    }
+    event_t event = g_queue[g_head];
+    g_head = (g_head + 1) % EVENT_QUEUE_LEN;
+    g_count--;
+    g_dispatching = true;
+    pthread_cond_broadcast(&g_loop_cond);
+
+    handler_t handlers[EVENT_HANDLERS_MAX];
+    int handler_count = g_handler_count;
+    memcpy(handlers, g_handlers, sizeof(handlers));
+    pthread_mutex_unlock(&g_loop_lock);
+
+    for (int i = 0; i < handler_count; i++) {
+      if (handlers[i].base == event.base && (handlers[i].id == ESP_EVENT_ANY_ID || handlers[i].id == event.id)) {
+        handlers[i].handler(handlers[i].arg, event.base, event.id, event.size ? event.data : NULL);
+      }
+    }
+    pthread_mutex_lock(&g_loop_lock);
+  }
+  return NULL;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+  pthread_mutex_lock(&g_loop_lock);
+  if (g_loop_created) {
+    pthread_mutex_unlock(&g_loop_lock);
+    return ESP_ERR_INVALID_STATE;
+  }
+  g_loop_created = true;
+  pthread_create(&g_loop_thread, NULL, _loop_thread, NULL);
+  pthread_detach(g_loop_thread);
+  pthread_mutex_unlock(&g_loop_lock);
+  return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t handler, void *arg,
+                                              esp_event_handler_instance_t *instance)
+{
+  pthread_mutex_lock(&g_loop_lock);
+  if (g_handler_count == EVENT_HANDLERS_MAX) {
+    pthread_mutex_unlock(&g_loop_lock);
+    return ESP_ERR_NO_MEM;
+  }
+  g_handlers[g_handler_count++] = (handler_t){ event_base, event_id, handler, arg };
+  pthread_mutex_unlock(&g_loop_lock);
+
+  if (instance) {
+    *instance = &g_handlers[g_handler_count - 1];
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait)
+{
+  if (event_data_size > EVENT_DATA_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec  += ticks_to_wait / 1000;
+  deadline.tv_nsec += (long)(ticks_to_wait % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&g_loop_lock);
+  while (g_loop_created && g_count == EVENT_QUEUE_LEN) {
+    bool timed_out = ticks_to_wait == 0;
+    if (ticks_to_wait == portMAX_DELAY) {
+      pthread_cond_wait(&g_loop_cond, &g_loop_lock);
+    } else if (!timed_out) {
+      timed_out = pthread_cond_timedwait(&g_loop_cond, &g_loop_lock, &deadline) != 0;
+    }
+    if (timed_out) {
+      pthread_mutex_unlock(&g_loop_lock);
+      return ESP_ERR_TIMEOUT;
+    }
+  }
+  if (!g_loop_created) {
+    pthread_mutex_unlock(&g_loop_lock);
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  event_t *event = &g_queue[(g_head + g_count) % EVENT_QUEUE_LEN];
+  event->base = event_base;
+  event->id   = event_id;
+  event->size = event_data_size;
+  if (event_data_size) {
+    memcpy(event->data, event_data, event_data_size);
+  }
+  g_count++;
+  g_dispatching = true;
+  pthread_cond_broadcast(&g_loop_cond);
+  pthread_mutex_unlock(&g_loop_lock);
+  return ESP_OK;
+}
+
+bool host_event_loop_current(void)
+{
+  return g_loop_created && pthread_equal(pthread_self(), g_loop_thread);
+}
+
+void host_event_loop_idle(void)
+{
+  pthread_mutex_lock(&g_loop_lock);
+  while (g_count > 0 || g_dispatching) {
+    pthread_cond_wait(&g_loop_cond, &g_loop_lock);
+  }
+  pthread_mutex_unlock(&g_loop_lock);
+}
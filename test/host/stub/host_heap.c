@@ -0,0 +1,203 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "host_stub.h"
+
+/* Each heap is one buffer cut into blocks kept in address order. Allocation
+ * is first fit, free merges with free neighbours, so holes left by
+ * interleaved lifetimes show up in heap_caps_get_largest_free_block(). */
+
+#define HEAP_MAX_BLOCKS       (4096)
+#define HEAP_MIN_ALIGN        (8)
+#define HEAP_INTERNAL_DEFAULT (320 * 1024)
+#define HEAP_PSRAM_DEFAULT    (2 * 1024 * 1024)
+
+typedef struct {
+  size_t off;
+  size_t size;
+  bool used;
+} heap_block_t;
+
+typedef struct {
+  uint8_t *base;
+  size_t size;
+  size_t free;
+  size_t min_free;
+  heap_block_t blocks[HEAP_MAX_BLOCKS];
+  int count;
+} heap_t;
+
+enum { HEAP_INTERNAL = 0, HEAP_PSRAM, HEAP_COUNT };
+
+static pthread_mutex_t g_heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static heap_t g_heaps[HEAP_COUNT];
+
+static void _heap_reset(heap_t *heap, size_t size)
+{
+  free(heap->base);
+  heap->base      = aligned_alloc(64, (size + 63) & ~(size_t)63);
+  heap->size      = size;
+  heap->free      = size;
+  heap->min_free  = size;
+  heap->blocks[0] = (heap_block_t){ .off = 0, .size = size, .used = false };
+  heap->count     = 1;
+}
+
+static heap_t *_heap(uint32_t caps)
+{
+  heap_t *heap = &g_heaps[(caps & MALLOC_CAP_SPIRAM) ? HEAP_PSRAM : HEAP_INTERNAL];
+  if (!heap->base) {
+    _heap_reset(heap, heap == &g_heaps[HEAP_PSRAM] ? HEAP_PSRAM_DEFAULT : HEAP_INTERNAL_DEFAULT);
+  }
+  return heap;
+}
+
+static void _insert(heap_t *heap, int at, heap_block_t block)
+{
+  memmove(&heap->blocks[at + 1], &heap->blocks[at], (heap->count - at) * sizeof(heap->blocks[0]));
+  heap->blocks[at] = block;
+  heap->count++;
+}
+
+static void _remove(heap_t *heap, int at)
+{
+  memmove(&heap->blocks[at], &heap->blocks[at + 1], (heap->count - at - 1) * sizeof(heap->blocks[0]));
+  heap->count--;
+}
+
+static void *_alloc(heap_t *heap, size_t alignment, size_t size)
+{
+  if (size == 0) {
+    return NULL;
+  }
+  if (alignment < HEAP_MIN_ALIGN) {
+    alignment = HEAP_MIN_ALIGN;
+  }
+  size = (size + HEAP_MIN_ALIGN - 1) & ~(size_t)(HEAP_MIN_ALIGN - 1);
+
+  for (int i = 0; i < heap->count; i++) {
+    heap_block_t *block = &heap->blocks[i];
+    if (block->used) {
+      continue;
+    }
+    size_t start = (block->off + alignment - 1) & ~(alignment - 1);
+    size_t pad   = start - block->off;
+    if (pad + size > block->size || heap->count + 2 > HEAP_MAX_BLOCKS) {
+      continue;
+    }
+
+    size_t tail = block->size - pad - size;
+    if (pad) {
+      _insert(heap, i, (heap_block_t){ .off = block->off, .size = pad, .used = false });
+      i++;
+    }
+    heap->blocks[i] = (heap_block_t){ .off = start, .size = size, .used = true };
+    if (tail) {
+      _insert(heap, i + 1, (heap_block_t){ .off = start + size, .size = tail, .used = false });
+    }
+
+    heap->free -= size;
+    if (heap->free < heap->min_free) {
+      heap->min_free = heap->free;
+    }
+    return heap->base + start;
+  }
+  return NULL;
+}
+
+void *heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps)
+{
+  pthread_mutex_lock(&g_heap_lock);
+  void *ptr = _alloc(_heap(caps), alignment, size);
+  pthread_mutex_unlock(&g_heap_lock);
+  return ptr;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+  return heap_caps_aligned_alloc(HEAP_MIN_ALIGN, size, caps);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+  void *ptr = heap_caps_malloc(n * size, caps);
+  if (ptr) {
+    memset(ptr, 0, n * size);
+  }
+  return ptr;
+}
+
+void heap_caps_free(void *ptr)
+{
+  if (!ptr) {
+    return;
+  }
+
+  pthread_mutex_lock(&g_heap_lock);
+  for (int h = 0; h < HEAP_COUNT; h++) {
+    heap_t *heap = &g_heaps[h];
+    if (!heap->base || (uint8_t *)ptr < heap->base || (uint8_t *)ptr >= heap->base + heap->size) {
+      continue;
+    }
+    size_t off = (size_t)((uint8_t *)ptr - heap->base);
+    for (int i = 0; i < heap->count; i++) {
+      if (heap->blocks[i].off != off || !heap->blocks[i].used) {
+        continue;
+      }
+      heap->blocks[i].used = false;
+      heap->free += heap->blocks[i].size;
+      if (i + 1 < heap->count && !heap->blocks[i + 1].used) {
+        heap->blocks[i].size += heap->blocks[i + 1].size;
+        _remove(heap, i + 1);
+      }
+      if (i > 0 && !heap->blocks[i - 1].used) {
+        heap->blocks[i - 1].size += heap->blocks[i].size;
+        _remove(heap, i);
+      }
+      break;
+    }
+  }
+  pthread_mutex_unlock(&g_heap_lock);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+  pthread_mutex_lock(&g_heap_lock);
+  size_t free_size = _heap(caps)->free;
+  pthread_mutex_unlock(&g_heap_lock);
+  return free_size;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+  pthread_mutex_lock(&g_heap_lock);
+  size_t min_free = _heap(caps)->min_free;
+  pthread_mutex_unlock(&g_heap_lock);
+  return min_free;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+  size_t largest = 0;
+
+  pthread_mutex_lock(&g_heap_lock);
+  heap_t *heap = _heap(caps);
+  for (int i = 0; i < heap->count; i++) {
+    if (!heap->blocks[i].used && heap->blocks[i].size > largest) {
+      largest = heap->blocks[i].size;
+    }
+  }
+  pthread_mutex_unlock(&g_heap_lock);
+  return largest;
+}
+
+void host_heap_init(size_t internal_size, size_t psram_size)
+{
+  pthread_mutex_lock(&g_heap_lock);
+  _heap_reset(&g_heaps[HEAP_INTERNAL], internal_size);
+  _heap_reset(&g_heaps[HEAP_PSRAM], psram_size);
+  pthread_mutex_unlock(&g_heap_lock);
+}
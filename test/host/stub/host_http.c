@@ -0,0 +1,458 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+
+#include "esp_crt_bundle.h"
+#include "esp_http_client.h"
+#include "host_stub.h"
+#include "mbedtls/base64.h"
+
+/* ---- esp_http_client, on OpenSSL ----
+ * Every connection goes to 127.0.0.1 on the port the test set, the URL's
+ * host is still sent as SNI and Host. The server certificate is not
+ * checked. As in ESP-IDF a kept-alive connection is reused as it is: one
+ * the server has closed fails the next request with
+ * ESP_ERR_HTTP_CONNECTION_CLOSED. Bodies come in Content-Length framing
+ * only, handed out in small ON_DATA pieces. */
+
+#define HTTP_MAX_HEADERS  (8)
+#define HTTP_HEAD_MAX     (4096)
+#define HTTP_DATA_PIECE   (64)
+
+typedef struct {
+  char *key;
+  char *value;
+} http_header_t;
+
+struct esp_http_client {
+  esp_http_client_config_t cfg;
+  char host[128];
+  char path[512];
+  esp_http_client_method_t method;
+  const char *post;
+  int post_len;
+  http_header_t headers[HTTP_MAX_HEADERS];
+
+  SSL_CTX *ctx;
+  SSL *ssl;              // NULL while not connected
+  int fd;
+  SSL_SESSION *session;  // kept with save_client_session
+
+  int status;
+  int64_t content_length;
+};
+
+static int g_port = 0;
+static int g_clients = 0;
+
+void host_http_set_port(int port)
+{
+  __atomic_store_n(&g_port, port, __ATOMIC_SEQ_CST);
+}
+
+int host_http_clients(void)
+{
+  return __atomic_load_n(&g_clients, __ATOMIC_SEQ_CST);
+}
+
+esp_err_t esp_crt_bundle_attach(void *conf)
+{
+  return ESP_OK;
+}
+
+static void _event(esp_http_client_handle_t client, esp_http_client_event_id_t id, void *data, int len, char *key,
+                   char *value)
+{
+  if (client->cfg.event_handler == NULL) {
+    return;
+  }
+  esp_http_client_event_t evt = {
+    .event_id     = id,
+    .client       = client,
+    .data         = data,
+    .data_len     = len,
+    .user_data    = client->cfg.user_data,
+    .header_key   = key,
+    .header_value = value,
+  };
+  client->cfg.event_handler(&evt);
+}
+
+static const char *_method_name(esp_http_client_method_t method)
+{
+  switch (method) {
+    case HTTP_METHOD_POST:   return "POST";
+    case HTTP_METHOD_PUT:    return "PUT";
+    case HTTP_METHOD_PATCH:  return "PATCH";
+    case HTTP_METHOD_DELETE: return "DELETE";
+    case HTTP_METHOD_HEAD:   return "HEAD";
+    default:                 return "GET";
+  }
+}
+
+/* scheme://host[:port]/path, the port is ignored */
+static esp_err_t _parse_url(esp_http_client_handle_t client, const char *url)
+{
+  const char *p = url ? strstr(url, "://") : NULL;
+  if (p == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  p += 3;
+
+  size_t host_len = strcspn(p, ":/");
+  if (host_len == 0 || host_len >= sizeof(client->host)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memcpy(client->host, p, host_len);
+  client->host[host_len] = '\0';
+
+  const char *path = strchr(p, '/');
+  snprintf(client->path, sizeof(client->path), "%s", path ? path : "/");
+  return ESP_OK;
+}
+
+static void _save_session(esp_http_client_handle_t client)
+{
+  if (!client->cfg.save_client_session || client->ssl == NULL) {
+    return;
+  }
+  SSL_SESSION *session = SSL_get1_session(client->ssl);
+  if (session == NULL || !SSL_SESSION_is_resumable(session)) {
+    SSL_SESSION_free(session);
+    return;
+  }
+  SSL_SESSION_free(client->session);
+  client->session = session;
+}
+
+/* drop the connection without telling the event handler */
+static void _drop(esp_http_client_handle_t client)
+{
+  if (client->ssl) {
+    _save_session(client);
+    // close_notify as esp-tls sends it, OpenSSL voids the session of a connection freed without one
+    SSL_shutdown(client->ssl);
+    SSL_free(client->ssl);
+    client->ssl = NULL;
+  }
+  if (client->fd >= 0) {
+    close(client->fd);
+    client->fd = -1;
+  }
+}
+
+static esp_err_t _connect(esp_http_client_handle_t client)
+{
+  int port = __atomic_load_n(&g_port, __ATOMIC_SEQ_CST);
+  struct sockaddr_in addr = {
+    .sin_family      = AF_INET,
+    .sin_port        = htons((uint16_t)port),
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  struct timeval tv = {
+    .tv_sec  = client->cfg.timeout_ms / 1000,
+    .tv_usec = (client->cfg.timeout_ms % 1000) * 1000,
+  };
+
+  client->fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (client->fd < 0) {
+    return ESP_ERR_HTTP_CONNECT;
+  }
+  setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  // headers and body go out as separate writes, as they do from esp_http_client
+  int one = 1;
+  setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (port == 0 || connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    _drop(client);
+    _event(client, HTTP_EVENT_ERROR, NULL, 0, NULL, NULL);
+    return ESP_ERR_HTTP_CONNECT;
+  }
+
+  client->ssl = SSL_new(client->ctx);
+  SSL_set_fd(client->ssl, client->fd);
+  SSL_set_tlsext_host_name(client->ssl, client->host);
+  if (client->session) {
+    SSL_set_session(client->ssl, client->session);
+  }
+  if (SSL_connect(client->ssl) != 1) {
+    _drop(client);
+    _event(client, HTTP_EVENT_ERROR, NULL, 0, NULL, NULL);
+    return ESP_ERR_HTTP_CONNECT;
+  }
+
+  _event(client, HTTP_EVENT_ON_CONNECTED, NULL, 0, NULL, NULL);
+  return ESP_OK;
+}
+
+static bool _write_all(esp_http_client_handle_t client, const char *data, int len)
+{
+  while (len > 0) {
+    int n = SSL_write(client->ssl, data, len);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+/* ends the request with err, the connection with it */
+static esp_err_t _fail(esp_http_client_handle_t client, esp_err_t err)
+{
+  esp_http_client_close(client);
+  return err;
+}
+
+/* the status line and the headers, what follows them is left in buf */
+static esp_err_t _read_head(esp_http_client_handle_t client, char *buf, int *have, int *head_len, bool *keep_alive)
+{
+  char *end;
+  while ((end = memmem(buf, *have, "\r\n\r\n", 4)) == NULL) {
+    if (*have >= HTTP_HEAD_MAX - 1) {
+      return ESP_ERR_HTTP_FETCH_HEADER;
+    }
+    int n = SSL_read(client->ssl, buf + *have, HTTP_HEAD_MAX - 1 - *have);
+    if (n <= 0) {
+      // nothing at all: the server had closed the kept-alive connection
+      return *have == 0 ? ESP_ERR_HTTP_CONNECTION_CLOSED : ESP_ERR_HTTP_FETCH_HEADER;
+    }
+    *have += n;
+  }
+  *head_len = (int)(end - buf) + 4;
+  end[2] = '\0';
+
+  char *line = buf;
+  char *eol = strstr(line, "\r\n");
+  *eol = '\0';
+  if (sscanf(line, "HTTP/1.%*d %d", &client->status) != 1) {
+    return ESP_ERR_HTTP_FETCH_HEADER;
+  }
+
+  client->content_length = -1;
+  for (line = eol + 2; (eol = strstr(line, "\r\n")) != NULL; line = eol + 2) {
+    *eol = '\0';
+    char *colon = strchr(line, ':');
+    if (colon == NULL) {
+      continue;
+    }
+    *colon = '\0';
+    char *value = colon + 1;
+    value += strspn(value, " \t");
+
+    if (strcasecmp(line, "Content-Length") == 0) {
+      client->content_length = strtoll(value, NULL, 10);
+    } else if (strcasecmp(line, "Connection") == 0 && strcasecmp(value, "close") == 0) {
+      *keep_alive = false;
+    }
+    _event(client, HTTP_EVENT_ON_HEADER, NULL, 0, line, value);
+  }
+  return ESP_OK;
+}
+
+static void _data(esp_http_client_handle_t client, char *data, int len)
+{
+  for (int off = 0; off < len; off += HTTP_DATA_PIECE) {
+    int n = len - off < HTTP_DATA_PIECE ? len - off : HTTP_DATA_PIECE;
+    _event(client, HTTP_EVENT_ON_DATA, data + off, n, NULL, NULL);
+  }
+}
+
+static esp_err_t _read_response(esp_http_client_handle_t client)
+{
+  char buf[HTTP_HEAD_MAX];
+  int have = 0, head_len = 0;
+  bool keep_alive = client->cfg.keep_alive_enable;
+
+  esp_err_t err = _read_head(client, buf, &have, &head_len, &keep_alive);
+  if (err != ESP_OK) {
+    return _fail(client, err);
+  }
+
+  int64_t left = client->content_length > 0 ? client->content_length : 0;
+  int n = have - head_len;
+  if (n > left) {
+    n = (int)left;
+  }
+  _data(client, buf + head_len, n);
+  left -= n;
+
+  while (left > 0) {
+    n = SSL_read(client->ssl, buf, left < (int64_t)sizeof(buf) ? (int)left : (int)sizeof(buf));
+    if (n <= 0) {
+      return _fail(client, ESP_FAIL);
+    }
+    _data(client, buf, n);
+    left -= n;
+  }
+
+  _event(client, HTTP_EVENT_ON_FINISH, NULL, 0, NULL, NULL);
+  // the session tickets of a fresh connection have come in with the reply
+  _save_session(client);
+  if (!keep_alive) {
+    esp_http_client_close(client);
+  }
+  return ESP_OK;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+  struct esp_http_client *client = calloc(1, sizeof(*client));
+  if (client == NULL) {
+    return NULL;
+  }
+  client->cfg     = *config;
+  client->cfg.url = NULL;
+  client->fd      = -1;
+  if (client->cfg.timeout_ms <= 0) {
+    client->cfg.timeout_ms = 5000;
+  }
+  if (_parse_url(client, config->url) != ESP_OK) {
+    free(client);
+    return NULL;
+  }
+
+  client->ctx = SSL_CTX_new(TLS_client_method());
+  SSL_CTX_set_verify(client->ctx, SSL_VERIFY_NONE, NULL);
+  if (config->crt_bundle_attach) {
+    config->crt_bundle_attach(client->ctx);
+  }
+  // a write to a connection the server has reset is an error, not a signal
+  signal(SIGPIPE, SIG_IGN);
+
+  __atomic_add_fetch(&g_clients, 1, __ATOMIC_SEQ_CST);
+  return client;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url)
+{
+  return _parse_url(client, url);
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+  http_header_t *free_slot = NULL;
+  for (int i = 0; i < HTTP_MAX_HEADERS; i++) {
+    http_header_t *h = &client->headers[i];
+    if (h->key && strcasecmp(h->key, key) == 0) {
+      free(h->value);
+      h->value = strdup(value);
+      return ESP_OK;
+    }
+    if (h->key == NULL && free_slot == NULL) {
+      free_slot = h;
+    }
+  }
+  if (free_slot == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  free_slot->key   = strdup(key);
+  free_slot->value = strdup(value);
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method)
+{
+  client->method = method;
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len)
+{
+  client->post     = data;
+  client->post_len = data ? len : 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
+{
+  esp_err_t err;
+  client->status         = -1;
+  client->content_length = -1;
+
+  if (client->ssl == NULL && (err = _connect(client)) != ESP_OK) {
+    return err;
+  }
+
+  char head[HTTP_HEAD_MAX];
+  int len = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: ESP32 HTTP Client/1.0\r\n",
+                     _method_name(client->method), client->path, client->host);
+  for (int i = 0; i < HTTP_MAX_HEADERS && len < (int)sizeof(head); i++) {
+    if (client->headers[i].key) {
+      len += snprintf(head + len, sizeof(head) - len, "%s: %s\r\n", client->headers[i].key,
+                      client->headers[i].value);
+    }
+  }
+  if (len < (int)sizeof(head)) {
+    len += snprintf(head + len, sizeof(head) - len, "%sContent-Length: %d\r\n\r\n",
+                    client->cfg.keep_alive_enable ? "" : "Connection: close\r\n", client->post_len);
+  }
+  if (len >= (int)sizeof(head)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  if (!_write_all(client, head, len)) {
+    return _fail(client, ESP_ERR_HTTP_WRITE_DATA);
+  }
+  _event(client, HTTP_EVENT_HEADER_SENT, NULL, 0, NULL, NULL);
+  if (client->post_len > 0 && !_write_all(client, client->post, client->post_len)) {
+    return _fail(client, ESP_ERR_HTTP_WRITE_DATA);
+  }
+
+  return _read_response(client);
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+  return client->status;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client)
+{
+  return client->content_length;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+  if (client->ssl) {
+    _drop(client);
+    _event(client, HTTP_EVENT_DISCONNECTED, NULL, 0, NULL, NULL);
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+  esp_http_client_close(client);
+  for (int i = 0; i < HTTP_MAX_HEADERS; i++) {
+    free(client->headers[i].key);
+    free(client->headers[i].value);
+  }
+  SSL_SESSION_free(client->session);
+  SSL_CTX_free(client->ctx);
+  free(client);
+  return ESP_OK;
+}
+
+/* ---- mbedtls ---- */
+
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
+{
+  size_t need = 4 * ((slen + 2) / 3) + 1;
+  *olen = need;
+  if (dst == NULL || dlen < need) {
+    return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+  }
+  *olen = (size_t)EVP_EncodeBlock(dst, src, (int)slen);
+  return 0;
+}
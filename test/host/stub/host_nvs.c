@@ -0,0 +1,180 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_stub.h"
+#include "nvs.h"
+
+/* key/value pairs per namespace, values are stored as blobs; a handle is
+ * the index of its namespace plus one */
+
+#define NVS_MAX_NAMESPACES  (16)
+#define NVS_MAX_ENTRIES     (64)
+#define NVS_NAME_LEN        (16)
+
+typedef struct {
+  int ns;
+  char key[NVS_NAME_LEN];
+  uint8_t *value;
+  size_t len;
+} nvs_entry_t;
+
+static pthread_mutex_t g_nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_namespaces[NVS_MAX_NAMESPACES][NVS_NAME_LEN];
+static int g_namespace_count = 0;
+static nvs_entry_t g_entries[NVS_MAX_ENTRIES];
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+  if (!name || strlen(name) >= NVS_NAME_LEN || !handle) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&g_nvs_lock);
+  int ns = 0;
+  while (ns < g_namespace_count && strcmp(g_namespaces[ns], name) != 0) {
+    ns++;
+  }
+  if (ns == g_namespace_count) {
+    if (mode == NVS_READONLY || ns == NVS_MAX_NAMESPACES) {
+      pthread_mutex_unlock(&g_nvs_lock);
+      return ESP_ERR_NVS_NOT_FOUND;
+    }
+    strcpy(g_namespaces[g_namespace_count++], name);
+  }
+  pthread_mutex_unlock(&g_nvs_lock);
+
+  *handle = (nvs_handle_t)ns + 1;
+  return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+  return ESP_OK;
+}
+
+static nvs_entry_t *_find(nvs_handle_t handle, const char *key)
+{
+  for (int i = 0; i < NVS_MAX_ENTRIES; i++) {
+    if (g_entries[i].value && g_entries[i].ns == (int)handle && strcmp(g_entries[i].key, key) == 0) {
+      return &g_entries[i];
+    }
+  }
+  return NULL;
+}
+
+static esp_err_t _set(nvs_handle_t handle, const char *key, const void *value, size_t len)
+{
+  if (!key || strlen(key) >= NVS_NAME_LEN) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&g_nvs_lock);
+  nvs_entry_t *entry = _find(handle, key);
+  for (int i = 0; !entry && i < NVS_MAX_ENTRIES; i++) {
+    if (!g_entries[i].value) {
+      entry     = &g_entries[i];
+      entry->ns = (int)handle;
+      strcpy(entry->key, key);
+    }
+  }
+  if (!entry) {
+    pthread_mutex_unlock(&g_nvs_lock);
+    return ESP_ERR_NVS_NO_FREE_PAGES;
+  }
+  free(entry->value);
+  entry->value = malloc(len ? len : 1);
+  memcpy(entry->value, value, len);
+  entry->len = len;
+  pthread_mutex_unlock(&g_nvs_lock);
+  return ESP_OK;
+}
+
+/* value NULL asks for the length only, as nvs_get_blob() does */
+static esp_err_t _get(nvs_handle_t handle, const char *key, void *value, size_t *len)
+{
+  pthread_mutex_lock(&g_nvs_lock);
+  nvs_entry_t *entry = _find(handle, key);
+  esp_err_t err = ESP_OK;
+  if (!entry) {
+    err = ESP_ERR_NVS_NOT_FOUND;
+  } else if (value && *len < entry->len) {
+    err = ESP_ERR_INVALID_SIZE;
+  } else if (value) {
+    memcpy(value, entry->value, entry->len);
+  }
+  if (entry && err != ESP_ERR_INVALID_SIZE) {
+    *len = entry->len;
+  }
+  pthread_mutex_unlock(&g_nvs_lock);
+  return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+  pthread_mutex_lock(&g_nvs_lock);
+  nvs_entry_t *entry = _find(handle, key);
+  if (entry) {
+    free(entry->value);
+    entry->value = NULL;
+  }
+  pthread_mutex_unlock(&g_nvs_lock);
+  return entry ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len)
+{
+  return _set(handle, key, value, len);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *len)
+{
+  return _get(handle, key, value, len);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+  return _set(handle, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *value, size_t *len)
+{
+  return _get(handle, key, value, len);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+  return _set(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *value)
+{
+  size_t len = sizeof(*value);
+  return _get(handle, key, value, &len);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+  return _set(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *value)
+{
+  size_t len = sizeof(*value);
+  return _get(handle, key, value, &len);
+}
+
+void host_nvs_erase_all(void)
+{
+  pthread_mutex_lock(&g_nvs_lock);
+  for (int i = 0; i < NVS_MAX_ENTRIES; i++) {
+    free(g_entries[i].value);
+    g_entries[i].value = NULL;
+  }
+  pthread_mutex_unlock(&g_nvs_lock);
+}
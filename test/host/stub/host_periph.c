@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "driver/i2c.h"
+#include "host_stub.h"
+
+/* ---- I2C ---- */
+
+static host_i2c_dev_t g_i2c_dev = NULL;
+static void *g_i2c_ctx = NULL;
+
+/* a command link only carries what a probe needs: the address byte */
+struct host_i2c_cmd {
+  bool dynamic;
+  int addr;
+};
+
+void host_i2c_attach(host_i2c_dev_t dev, void *ctx)
+{
+  g_i2c_ctx = ctx;
+  g_i2c_dev = dev;
+}
+
+static esp_err_t _transfer(uint8_t addr, const uint8_t *wr, size_t wr_len, uint8_t *rd, size_t rd_len)
+{
+  if (!g_i2c_dev) {
+    return ESP_FAIL;   // nobody acks
+  }
+  return g_i2c_dev(addr, wr, wr_len, rd, rd_len, g_i2c_ctx);
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+  i2c_cmd_handle_t cmd = calloc(1, sizeof(*cmd));
+  cmd->dynamic = true;
+  cmd->addr    = -1;
+  return cmd;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buf, uint32_t size)
+{
+  if (size < sizeof(struct host_i2c_cmd)) {
+    return NULL;
+  }
+  i2c_cmd_handle_t cmd = (i2c_cmd_handle_t)buf;
+  cmd->dynamic = false;
+  cmd->addr    = -1;
+  return cmd;
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd)
+{
+  free(cmd);
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd)
+{
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd)
+{
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd)
+{
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en)
+{
+  if (cmd->addr < 0) {
+    cmd->addr = data >> 1;
+  }
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks)
+{
+  return cmd->addr < 0 ? ESP_ERR_INVALID_ARG : _transfer((uint8_t)cmd->addr, NULL, 0, NULL, 0);
+}
+
+esp_err_t i2c_master_write_to_device(i2c_port_t port, uint8_t addr, const uint8_t *wr, size_t wr_len, TickType_t ticks)
+{
+  return _transfer(addr, wr, wr_len, NULL, 0);
+}
+
+esp_err_t i2c_master_read_from_device(i2c_port_t port, uint8_t addr, uint8_t *rd, size_t rd_len, TickType_t ticks)
+{
+  return _transfer(addr, NULL, 0, rd, rd_len);
+}
+
+esp_err_t i2c_master_write_read_device(i2c_port_t port, uint8_t addr, const uint8_t *wr, size_t wr_len, uint8_t *rd,
+                                       size_t rd_len, TickType_t ticks)
+{
+  return _transfer(addr, wr, wr_len, rd, rd_len);
+}
+
+esp_err_t i2c_set_pin(i2c_port_t port, int sda, int scl, bool sda_pullup, bool scl_pullup, i2c_mode_t mode)
+{
+  return ESP_OK;
+}
+
+esp_err_t i2c_reset_tx_fifo(i2c_port_t port)
+{
+  return ESP_OK;
+}
+
+esp_err_t i2c_reset_rx_fifo(i2c_port_t port)
+{
+  return ESP_OK;
+}
+
+/* ---- GPIO ---- */
+
+static host_gpio_get_t g_gpio_get = NULL;
+static host_gpio_set_t g_gpio_set = NULL;
+static void *g_gpio_ctx = NULL;
+
+void host_gpio_attach(host_gpio_get_t get, host_gpio_set_t set, void *ctx)
+{
+  g_gpio_ctx = ctx;
+  g_gpio_get = get;
+  g_gpio_set = set;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode)
+{
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+  if (g_gpio_set) {
+    g_gpio_set(pin, level != 0, g_gpio_ctx);
+  }
+  return ESP_OK;
+}
+
+/* lines float high without a device */
+int gpio_get_level(gpio_num_t pin)
+{
+  return g_gpio_get ? g_gpio_get(pin, g_gpio_ctx) : 1;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+  return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t isr, void *arg)
+{
+  return ESP_OK;
+}
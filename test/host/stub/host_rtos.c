@@ -0,0 +1,474 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/* FreeRTOS on pthreads, enough for the application modules to run their
+ * tasks on the host. Priorities and core affinity are ignored. */
+
+struct host_task {
+  TaskFunction_t fn;
+  void *arg;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint32_t notify;
+};
+
+struct host_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint8_t *items;
+  UBaseType_t item_size;
+  UBaseType_t length;
+  UBaseType_t head;
+  UBaseType_t count;
+};
+
+struct host_events {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  EventBits_t bits;
+};
+
+static pthread_mutex_t g_critical;
+static pthread_once_t g_critical_once = PTHREAD_ONCE_INIT;
+static __thread struct host_task *t_self = NULL;
+
+static void _critical_init(void)
+{
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&g_critical, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+void host_critical_enter(void)
+{
+  pthread_once(&g_critical_once, _critical_init);
+  pthread_mutex_lock(&g_critical);
+}
+
+void host_critical_exit(void)
+{
+  pthread_mutex_unlock(&g_critical);
+}
+
+static void _cond_init(pthread_cond_t *cond)
+{
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+static struct timespec _deadline(TickType_t ticks)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec  += ticks / 1000;
+  ts.tv_nsec += (long)(ticks % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  return ts;
+}
+
+/* wait on cond until woken or the deadline passed, false on timeout */
+static bool _wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline)
+{
+  if (ticks == 0) {
+    return false;
+  }
+  if (ticks == portMAX_DELAY) {
+    pthread_cond_wait(cond, lock);
+    return true;
+  }
+  return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+/* ---- tasks ---- */
+
+static struct host_task *_task_new(TaskFunction_t fn, void *arg)
+{
+  struct host_task *task = calloc(1, sizeof(*task));
+  task->fn  = fn;
+  task->arg = arg;
+  pthread_mutex_init(&task->lock, NULL);
+  _cond_init(&task->cond);
+  return task;
+}
+
+static struct host_task *_self(void)
+{
+  if (!t_self) {
+    t_self = _task_new(NULL, NULL);   // a thread the shim did not start, e.g. main
+    t_self->thread = pthread_self();
+  }
+  return t_self;
+}
+
+static void *_task_entry(void *arg)
+{
+  struct host_task *task = arg;
+  t_self = task;
+  task->fn(task->arg);
+  return NULL;
+}
+
+static TaskHandle_t _task_start(TaskFunction_t fn, void *arg)
+{
+  struct host_task *task = _task_new(fn, arg);
+  if (pthread_create(&task->thread, NULL, _task_entry, task) != 0) {
+    free(task);
+    return NULL;
+  }
+  pthread_detach(task->thread);
+  return task;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *handle)
+{
+  TaskHandle_t task = _task_start(fn, arg);
+  if (handle) {
+    *handle = task;
+  }
+  return task ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                                   TaskHandle_t *handle, BaseType_t core)
+{
+  return xTaskCreate(fn, name, stack, arg, prio, handle);
+}
+
+BaseType_t xTaskCreatePinnedToCoreWithCaps(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                           UBaseType_t prio, TaskHandle_t *handle, BaseType_t core, uint32_t caps)
+{
+  return xTaskCreate(fn, name, stack, arg, prio, handle);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                               StackType_t *stack_buf, StaticTask_t *task_buf)
+{
+  return _task_start(fn, arg);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                           UBaseType_t prio, StackType_t *stack_buf, StaticTask_t *task_buf,
+                                           BaseType_t core)
+{
+  return _task_start(fn, arg);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  if (task == NULL || task == t_self) {
+    pthread_exit(NULL);
+  }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  usleep((useconds_t)ticks * 1000);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+void vTaskDelayUntil(TickType_t *prev_wake, TickType_t increment)
+{
+  *prev_wake += increment;
+  int32_t left = (int32_t)(*prev_wake - xTaskGetTickCount());
+  if (left > 0) {
+    vTaskDelay((TickType_t)left);
+  }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  return _self();
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core)
+{
+  static struct host_task idle[portNUM_PROCESSORS];
+  return (core >= 0 && core < portNUM_PROCESSORS) ? &idle[core] : NULL;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+  return 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+  struct host_task *self = _self();
+  struct timespec deadline = _deadline(ticks);
+
+  pthread_mutex_lock(&self->lock);
+  while (self->notify == 0 && _wait(&self->cond, &self->lock, ticks, &deadline)) {
+  }
+  uint32_t value = self->notify;
+  if (value) {
+    self->notify = clear ? 0 : value - 1;
+  }
+  pthread_mutex_unlock(&self->lock);
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  pthread_mutex_lock(&task->lock);
+  task->notify++;
+  pthread_cond_broadcast(&task->cond);
+  pthread_mutex_unlock(&task->lock);
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+  xTaskNotifyGive(task);
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+  return 0;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *tasks, UBaseType_t count, uint32_t *total_run_time)
+{
+  if (total_run_time) {
+    *total_run_time = 0;
+  }
+  return 0;
+}
+
+/* ---- queues and semaphores ---- */
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+  struct host_queue *queue = calloc(1, sizeof(*queue));
+  pthread_mutex_init(&queue->lock, NULL);
+  _cond_init(&queue->cond);
+  queue->length    = length;
+  queue->item_size = item_size;
+  queue->items     = item_size ? calloc(length, item_size) : NULL;
+  return queue;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buf)
+{
+  return xQueueCreate(length, item_size);
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+  if (queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->cond);
+    free(queue->items);
+    free(queue);
+  }
+}
+
+static BaseType_t _queue_put(QueueHandle_t queue, const void *item, TickType_t ticks, bool overwrite)
+{
+  struct timespec deadline = _deadline(ticks);
+
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == queue->length && !overwrite) {
+    if (!_wait(&queue->cond, &queue->lock, ticks, &deadline)) {
+      pthread_mutex_unlock(&queue->lock);
+      return errQUEUE_FULL;
+    }
+  }
+  if (queue->count == queue->length) {
+    queue->count--;   // overwrite, only used on queues of one
+  }
+  if (queue->item_size) {
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+  }
+  queue->count++;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+  return pdPASS;
+}
+
+static BaseType_t _queue_get(QueueHandle_t queue, void *item, TickType_t ticks, bool peek)
+{
+  struct timespec deadline = _deadline(ticks);
+
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == 0) {
+    if (!_wait(&queue->cond, &queue->lock, ticks, &deadline)) {
+      pthread_mutex_unlock(&queue->lock);
+      return pdFALSE;
+    }
+  }
+  if (queue->item_size && item) {
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+  }
+  if (!peek) {
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->cond);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+  return _queue_put(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken)
+{
+  return _queue_put(queue, item, 0, false);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+  return _queue_put(queue, item, 0, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+  return _queue_get(queue, item, ticks, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+  return _queue_get(queue, item, ticks, true);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  pthread_mutex_lock(&queue->lock);
+  UBaseType_t count = queue->count;
+  pthread_mutex_unlock(&queue->lock);
+  return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+  SemaphoreHandle_t sem = xQueueCreate(max, 0);
+  sem->count = initial;
+  return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+  return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buf)
+{
+  return xSemaphoreCreateBinary();
+}
+
+/* no priority inheritance and no recursion, which the application does not use */
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+  return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf)
+{
+  return xSemaphoreCreateMutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+  return _queue_get(sem, NULL, ticks, false);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  return _queue_put(sem, NULL, 0, false);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+  return xSemaphoreGive(sem);
+}
+
+/* ---- event groups ---- */
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+  struct host_events *group = calloc(1, sizeof(*group));
+  pthread_mutex_init(&group->lock, NULL);
+  _cond_init(&group->cond);
+  return group;
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buf)
+{
+  return xEventGroupCreate();
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+  pthread_mutex_lock(&group->lock);
+  group->bits |= bits;
+  EventBits_t now = group->bits;
+  pthread_cond_broadcast(&group->cond);
+  pthread_mutex_unlock(&group->lock);
+  return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+  pthread_mutex_lock(&group->lock);
+  EventBits_t before = group->bits;
+  group->bits &= ~bits;
+  pthread_mutex_unlock(&group->lock);
+  return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+  pthread_mutex_lock(&group->lock);
+  EventBits_t bits = group->bits;
+  pthread_mutex_unlock(&group->lock);
+  return bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_all, TickType_t ticks)
+{
+  struct timespec deadline = _deadline(ticks);
+
+  pthread_mutex_lock(&group->lock);
+  while (wait_all ? (group->bits & bits) != bits : (group->bits & bits) == 0) {
+    if (!_wait(&group->cond, &group->lock, ticks, &deadline)) {
+      break;
+    }
+  }
+  EventBits_t now = group->bits;
+  bool met = wait_all ? (now & bits) == bits : (now & bits) != 0;
+  if (met && clear_on_exit) {
+    group->bits &= ~bits;
+  }
+  pthread_mutex_unlock(&group->lock);
+  return now;
+}
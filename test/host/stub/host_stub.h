@@ -0,0 +1,57 @@
+#ifndef HOST_STUB_H
+#define HOST_STUB_H
+
+/* Hooks the host tests use to drive the stubbed ESP-IDF: a simulated
+ * clock, a simulated I2C bus and GPIOs, and what the stubs recorded. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_wifi.h"
+
+/* esp_timer_get_time() returns us from now on; timers keep real time */
+void host_time_set(int64_t us);
+void host_time_advance(int64_t us);
+/* back to the monotonic clock */
+void host_time_real(void);
+
+/* one device answers every address; wr is what was written, rd what the
+ * master reads. Returning an error fails the transfer */
+typedef esp_err_t (*host_i2c_dev_t)(uint8_t addr, const uint8_t *wr, size_t wr_len, uint8_t *rd, size_t rd_len,
+                                    void *ctx);
+void host_i2c_attach(host_i2c_dev_t dev, void *ctx);
+
+typedef int (*host_gpio_get_t)(int pin, void *ctx);
+typedef void (*host_gpio_set_t)(int pin, int level, void *ctx);
+void host_gpio_attach(host_gpio_get_t get, host_gpio_set_t set, void *ctx);
+
+/* PM locks currently acquired, over all lock types */
+int host_pm_locks_held(void);
+
+void host_nvs_erase_all(void);
+
+/* sizes of the simulated heaps, resets them; every block is lost */
+void host_heap_init(size_t internal_size, size_t psram_size);
+
+/* true on the default event loop's thread; wait until it has dispatched
+ * everything posted so far */
+bool host_event_loop_current(void);
+void host_event_loop_idle(void);
+
+/* the simulated access point answers each esp_wifi_connect() with the
+ * reason to fail it with, 0 to accept it and hand out the lease */
+typedef uint8_t (*host_wifi_connect_t)(const wifi_sta_config_t *sta, void *ctx);
+void host_wifi_attach(host_wifi_connect_t connect, void *ctx);
+void host_wifi_set_ap(const uint8_t bssid[6], uint8_t channel, uint32_t ip);
+void host_wifi_drop_link(uint8_t reason);
+/* esp_wifi_connect() calls made while an attempt was still in flight */
+int host_wifi_overlapping_connects(void);
+
+/* esp_http_client connects to 127.0.0.1 on this port whatever the URL's
+ * host; esp_http_client_init() calls so far. Only in the host_https tests */
+void host_http_set_port(int port);
+int host_http_clients(void);
+
+#endif
@@ -0,0 +1,222 @@
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "host_stub.h"
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+/* a connect attempt is answered this long after esp_wifi_connect() */
+#define HOST_WIFI_CONNECT_MS  (20)
+
+static wifi_ps_type_t g_ps = WIFI_PS_MIN_MODEM;   // the driver default
+
+static pthread_mutex_t g_wifi_lock = PTHREAD_MUTEX_INITIALIZER;
+static wifi_config_t g_config;
+static host_wifi_connect_t g_connect_cb = NULL;
+static void *g_connect_ctx = NULL;
+static uint8_t g_ap_bssid[6];
+static uint8_t g_ap_channel = 0;
+static uint32_t g_ap_ip = 0;
+static bool g_connecting = false;
+static bool g_connected = false;
+static int g_overlaps = 0;
+
+/* ---- esp_netif ---- */
+
+struct host_netif {
+  bool dhcp;
+  esp_netif_ip_info_t ip_info;
+  esp_netif_dns_info_t dns;
+};
+
+static struct host_netif g_sta_netif = { .dhcp = true };
+
+esp_err_t esp_netif_init(void)
+{
+  return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+  return &g_sta_netif;
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *netif)
+{
+  netif->dhcp = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *netif)
+{
+  netif->dhcp = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *netif, const esp_netif_ip_info_t *info)
+{
+  if (netif->dhcp) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  netif->ip_info = *info;
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns)
+{
+  netif->dns = *dns;
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns)
+{
+  *dns = netif->dns;
+  return ESP_OK;
+}
+
+/* ---- the station driver ---- */
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+  pthread_mutex_lock(&g_wifi_lock);
+  g_config = *conf;
+  pthread_mutex_unlock(&g_wifi_lock);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+  pthread_mutex_lock(&g_wifi_lock);
+  *conf = g_config;
+  pthread_mutex_unlock(&g_wifi_lock);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+  return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+}
+
+static void _post_disconnected(uint8_t reason)
+{
+  wifi_event_sta_disconnected_t event = { .reason = reason };
+  esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event), portMAX_DELAY);
+}
+
+/* the access point's answer, from the driver's own thread */
+static void *_answer_thread(void *arg)
+{
+  uint8_t reason = (uint8_t)(uintptr_t)arg;
+
+  usleep(HOST_WIFI_CONNECT_MS * 1000);
+  pthread_mutex_lock(&g_wifi_lock);
+  g_connecting = false;
+  g_connected  = reason == 0;
+  pthread_mutex_unlock(&g_wifi_lock);
+
+  if (reason != 0) {
+    _post_disconnected(reason);
+    return NULL;
+  }
+
+  ip_event_got_ip_t got_ip = {
+    .ip_info = {
+      .ip      = { .addr = g_ap_ip },
+      .netmask = { .addr = 0x00ffffff },
+      .gw      = { .addr = (g_ap_ip & 0x00ffffff) | 0x01000000 },
+    },
+  };
+  esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, NULL, 0, portMAX_DELAY);
+  esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), portMAX_DELAY);
+  return NULL;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+  pthread_mutex_lock(&g_wifi_lock);
+  if (g_connecting) {
+    g_overlaps++;
+  }
+  g_connecting = true;
+  wifi_sta_config_t sta = g_config.sta;
+  host_wifi_connect_t cb = g_connect_cb;
+  void *ctx = g_connect_ctx;
+  pthread_mutex_unlock(&g_wifi_lock);
+
+  uint8_t reason = cb ? cb(&sta, ctx) : 0;
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, _answer_thread, (void *)(uintptr_t)reason);
+  pthread_detach(thread);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+  pthread_mutex_lock(&g_wifi_lock);
+  bool connected = g_connected;
+  memset(ap_info, 0, sizeof(*ap_info));
+  memcpy(ap_info->bssid, g_ap_bssid, sizeof(ap_info->bssid));
+  ap_info->primary = g_ap_channel;
+  pthread_mutex_unlock(&g_wifi_lock);
+  return connected ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+  g_ps = type;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *type)
+{
+  *type = g_ps;
+  return ESP_OK;
+}
+
+void host_wifi_attach(host_wifi_connect_t connect, void *ctx)
+{
+  pthread_mutex_lock(&g_wifi_lock);
+  g_connect_cb  = connect;
+  g_connect_ctx = ctx;
+  pthread_mutex_unlock(&g_wifi_lock);
+}
+
+void host_wifi_set_ap(const uint8_t bssid[6], uint8_t channel, uint32_t ip)
+{
+  pthread_mutex_lock(&g_wifi_lock);
+  memcpy(g_ap_bssid, bssid, sizeof(g_ap_bssid));
+  g_ap_channel = channel;
+  g_ap_ip      = ip;
+  pthread_mutex_unlock(&g_wifi_lock);
+}
+
+void host_wifi_drop_link(uint8_t reason)
+{
+  pthread_mutex_lock(&g_wifi_lock);
+  g_connected = false;
+  pthread_mutex_unlock(&g_wifi_lock);
+  _post_disconnected(reason);
+}
+
+int host_wifi_overlapping_connects(void)
+{
+  pthread_mutex_lock(&g_wifi_lock);
+  int overlaps = g_overlaps;
+  pthread_mutex_unlock(&g_wifi_lock);
+  return overlaps;
+}
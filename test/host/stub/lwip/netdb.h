@@ -0,0 +1,7 @@
+#ifndef HOST_LWIP_NETDB_H
+#define HOST_LWIP_NETDB_H
+
+#include <netdb.h>
+#include <sys/socket.h>
+
+#endif
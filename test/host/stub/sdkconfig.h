@@ -0,0 +1,6 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+/* menuconfig defaults; tests set the options they need on the command line */
+
+#endif
@@ -0,0 +1,266 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ai_agent.h"
+#include "common.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "host_stub.h"
+#include "host_test.h"
+#include "nvs.h"
+#include "rest_standin.h"
+
+/* 409 recovery against a stand-in for the agent API that keeps a list of
+ * running agents, this device's and another's. A join conflicts while an
+ * agent named like ours runs. Every request is logged, so a test can
+ * check exactly which agents were stopped and whether the list was read. */
+
+#define OUR_NAME     "esp32_agent_123456"   // CONVO_AGENT_NAME and the stub MAC
+#define OTHER_NAME   "esp32_agent_abcdef"
+#define PROJECT      "/api/conversational-ai-agent/v2/projects/your_agora_app_id"
+#define MAX_AGENTS   (8)
+#define LOG_MAX      (1024)
+#define EVENT_WAIT_MS (10000)
+
+app_t g_app;
+
+typedef struct {
+  char id[32];
+  char name[32];
+} running_agent_t;
+
+static SemaphoreHandle_t g_lock = NULL;
+static running_agent_t g_running[MAX_AGENTS];
+static int g_running_count = 0;
+static int g_joins = 0;
+static int g_stale_conflicts = 0;   // 409s to give with nothing of ours running
+static bool g_drop_leaves = false;
+static char g_log[LOG_MAX];
+
+static QueueHandle_t g_events = NULL;
+
+static void _log(const char *method, const char *path)
+{
+  size_t len = strlen(g_log);
+  const char *short_path = strncmp(path, PROJECT, strlen(PROJECT)) == 0 ? path + strlen(PROJECT) : path;
+  snprintf(g_log + len, sizeof(g_log) - len, "%s %s|", method, short_path);
+}
+
+static int _find(const char *field, const char *value)
+{
+  for (int i = 0; i < g_running_count; i++) {
+    const char *have = strcmp(field, "id") == 0 ? g_running[i].id : g_running[i].name;
+    if (strcmp(have, value) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void _add(const char *id, const char *name)
+{
+  running_agent_t *agent = &g_running[g_running_count++];
+  snprintf(agent->id, sizeof(agent->id), "%s", id);
+  snprintf(agent->name, sizeof(agent->name), "%s", name);
+}
+
+static void _route(const char *method, const char *path, const char *body, standin_reply_t *reply, void *ctx)
+{
+  char id[32];
+
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  _log(method, path);
+
+  if (strcmp(method, "POST") == 0 && strcmp(path, PROJECT "/join") == 0) {
+    if (_find("name", OUR_NAME) >= 0 || g_stale_conflicts > 0) {
+      if (g_stale_conflicts > 0) {
+        g_stale_conflicts--;
+      }
+      reply->status = 409;
+      snprintf(reply->body, sizeof(reply->body), "{\"detail\":\"task conflict\",\"reason\":\"TaskConflict\"}");
+    } else {
+      snprintf(id, sizeof(id), "A%d", ++g_joins);
+      _add(id, OUR_NAME);
+      reply->status = 200;
+      snprintf(reply->body, sizeof(reply->body), "{\"agent_id\":\"%s\",\"create_ts\":1712345678,\"status\":\"RUNNING\"}",
+               id);
+    }
+  } else if (strcmp(method, "GET") == 0 && strncmp(path, PROJECT "/agents?", strlen(PROJECT "/agents?")) == 0) {
+    int len = snprintf(reply->body, sizeof(reply->body), "{\"data\":{\"count\":%d,\"list\":[", g_running_count);
+    for (int i = 0; i < g_running_count; i++) {
+      len += snprintf(reply->body + len, sizeof(reply->body) - len, "%s{\"agent_id\":\"%s\",\"name\":\"%s\"}",
+                      i ? "," : "", g_running[i].id, g_running[i].name);
+    }
+    snprintf(reply->body + len, sizeof(reply->body) - len, "]},\"meta\":{}}");
+    reply->status = 200;
+  } else if (strcmp(method, "POST") == 0 && sscanf(path, PROJECT "/agents/%31[^/]/leave", id) == 1) {
+    int i = _find("id", id);
+    if (g_drop_leaves) {
+      reply->drop = true;
+    } else if (i < 0) {
+      reply->status = 404;
+      snprintf(reply->body, sizeof(reply->body), "{\"detail\":\"agent not found\",\"reason\":\"InvalidRequest\"}");
+    } else {
+      g_running[i] = g_running[--g_running_count];
+      reply->status = 200;
+      snprintf(reply->body, sizeof(reply->body), "{\"code\":0,\"message\":\"ok\"}");
+    }
+  }
+  xSemaphoreGive(g_lock);
+}
+
+static void _on_event(ai_agent_event_t event, ai_agent_cmd_t cmd, void *ctx)
+{
+  xQueueSend(g_events, &event, 0);
+}
+
+/* submit cmd, wait for the control task to report it done and return the
+ * requests it made */
+static const char *_run(ai_agent_cmd_t cmd, ai_agent_event_t expected)
+{
+  static char log[LOG_MAX];
+  ai_agent_event_t event = AI_AGENT_EVT_CANCELLED;
+
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  g_log[0] = '\0';
+  xSemaphoreGive(g_lock);
+
+  TEST_CHECK_INT(ai_agent_submit(cmd), 0);
+  TEST_CHECK(xQueueReceive(g_events, &event, pdMS_TO_TICKS(EVENT_WAIT_MS)) == pdTRUE);
+  TEST_CHECK_INT(event, expected);
+
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  snprintf(log, sizeof(log), "%s", g_log);
+  xSemaphoreGive(g_lock);
+  return log;
+}
+
+/* the agent_id in NVS, "" when there is none */
+static const char *_record(void)
+{
+  static char id[AGENT_ID_LEN];
+  nvs_handle_t nvs;
+  size_t len = sizeof(id);
+
+  id[0] = '\0';
+  if (nvs_open("ai_agent", NVS_READONLY, &nvs) == ESP_OK) {
+    if (nvs_get_str(nvs, "agent_id", id, &len) != ESP_OK) {
+      id[0] = '\0';
+    }
+    nvs_close(nvs);
+  }
+  return id;
+}
+
+static bool _running(const char *id)
+{
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  bool running = _find("id", id) >= 0;
+  xSemaphoreGive(g_lock);
+  return running;
+}
+
+static void test_recorded_agent_on_conflict(void)
+{
+  // the agent of the last boot, recorded in NVS before ai_agent_init(), is stopped by id
+  TEST_CHECK_STR(_run(AI_AGENT_CMD_START, AI_AGENT_EVT_STARTED),
+                 "POST /join|POST /agents/OLD/leave|POST /join|");
+  TEST_CHECK(!_running("OLD"));
+  TEST_CHECK(_running("B1"));
+  TEST_CHECK_STR(_record(), "A1");
+}
+
+static void test_leave_clears_record(void)
+{
+  TEST_CHECK_STR(_run(AI_AGENT_CMD_STOP, AI_AGENT_EVT_STOPPED), "POST /agents/A1/leave|");
+  TEST_CHECK_STR(_record(), "");
+  TEST_CHECK(!_running("A1"));
+}
+
+static void test_lookup_stops_only_ours(void)
+{
+  // no record: ours is found by name in a list that starts with the other device's
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  _add("C1", OUR_NAME);
+  xSemaphoreGive(g_lock);
+  TEST_CHECK_STR(_run(AI_AGENT_CMD_START, AI_AGENT_EVT_STARTED),
+                 "POST /join|GET /agents?state=2&limit=20|POST /agents/C1/leave|POST /join|");
+  TEST_CHECK(_running("B1"));
+  TEST_CHECK(!_running("C1"));
+  TEST_CHECK_STR(_record(), "A2");
+  TEST_CHECK_STR(_run(AI_AGENT_CMD_STOP, AI_AGENT_EVT_STOPPED), "POST /agents/A2/leave|");
+
+  // a conflict with none of ours listed is stale: nothing is stopped
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  g_stale_conflicts = 1;
+  xSemaphoreGive(g_lock);
+  TEST_CHECK_STR(_run(AI_AGENT_CMD_START, AI_AGENT_EVT_STARTED),
+                 "POST /join|GET /agents?state=2&limit=20|POST /join|");
+  TEST_CHECK(_running("B1"));
+  TEST_CHECK_STR(_record(), "A3");
+}
+
+static void test_record_kept_on_transport_error(void)
+{
+  // the leave never gets an answer: the record outlives the session
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  g_drop_leaves = true;
+  xSemaphoreGive(g_lock);
+  TEST_CHECK_STR(_run(AI_AGENT_CMD_STOP, AI_AGENT_EVT_STOPPED),
+                 "POST /agents/A3/leave|POST /agents/A3/leave|POST /agents/A3/leave|");
+  TEST_CHECK_STR(_record(), "A3");
+  TEST_CHECK(_running("A3"));
+
+  // and is what recovery stops once the API answers again
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  g_drop_leaves = false;
+  g_log[0] = '\0';
+  xSemaphoreGive(g_lock);
+
+  ai_agent_event_t event = AI_AGENT_EVT_CANCELLED;
+  ai_agent_recover();
+  TEST_CHECK(xQueueReceive(g_events, &event, pdMS_TO_TICKS(EVENT_WAIT_MS)) == pdTRUE);
+  TEST_CHECK_INT(event, AI_AGENT_EVT_STOPPED);
+  TEST_CHECK_STR(g_log, "POST /agents/A3/leave|");
+  TEST_CHECK_STR(_record(), "");
+  TEST_CHECK(!_running("A3"));
+
+  // with no record, recovery has nothing to do
+  ai_agent_recover();
+  TEST_CHECK(xQueueReceive(g_events, &event, pdMS_TO_TICKS(200)) == pdFALSE);
+}
+
+int main(void)
+{
+  nvs_handle_t nvs;
+
+  g_lock = xSemaphoreCreateMutex();
+  g_events = xQueueCreate(8, sizeof(ai_agent_event_t));
+  _add("B1", OTHER_NAME);
+  _add("OLD", OUR_NAME);
+
+  int port = standin_start(_route, NULL, 0);
+  if (port == 0) {
+    printf("stand-in server did not start\n");
+    return 1;
+  }
+  host_http_set_port(port);
+
+  // the last boot left its agent running
+  TEST_CHECK_INT(nvs_open("ai_agent", NVS_READWRITE, &nvs), ESP_OK);
+  TEST_CHECK_INT(nvs_set_str(nvs, "agent_id", "OLD"), ESP_OK);
+  nvs_commit(nvs);
+  nvs_close(nvs);
+
+  ai_agent_set_event_cb(_on_event, NULL);
+  ai_agent_init();
+
+  TEST_RUN(test_recorded_agent_on_conflict);
+  TEST_RUN(test_leave_clears_record);
+  TEST_RUN(test_lookup_stops_only_ours);
+  TEST_RUN(test_record_kept_on_transport_error);
+  TEST_EXIT();
+}
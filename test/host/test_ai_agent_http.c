@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ai_agent.h"
+#include "common.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "host_stub.h"
+#include "host_test.h"
+#include "rest_standin.h"
+
+/* The agent's REST client against a local HTTPS stand-in for the agent
+ * API. Starts and stops go through the control task as on the board; the
+ * stand-in counts TCP connections and resumed TLS sessions, so keep-alive
+ * and the session ticket show up as numbers. */
+
+#define SERVER_IDLE_CLOSE_MS  (400)   // CONFIG_AGENT_HTTP_IDLE_CLOSE_MS is 200 here
+#define EVENT_WAIT_MS         (5000)
+
+/* "Basic " and the base64 of app_config.h.example's key:secret */
+#define EXPECTED_AUTH  "Basic eW91cl9hZ29yYV9hcGlfa2V5OnlvdXJfYWdvcmFfYXBpX3NlY3JldA=="
+
+app_t g_app;
+
+static QueueHandle_t g_events = NULL;
+static int g_joins = 0;
+static volatile int g_drop_leaves = 0;
+
+static void _route(const char *method, const char *path, const char *body, standin_reply_t *reply, void *ctx)
+{
+  if (strcmp(method, "POST") == 0 && strstr(path, "/join") != NULL) {
+    reply->status = 200;
+    snprintf(reply->body, sizeof(reply->body), "{\"agent_id\":\"A%d\",\"create_ts\":1712345678,\"status\":\"RUNNING\"}",
+             ++g_joins);
+  } else if (strcmp(method, "POST") == 0 && strstr(path, "/leave") != NULL) {
+    if (g_drop_leaves > 0) {
+      g_drop_leaves--;
+      reply->drop = true;
+      return;
+    }
+    reply->status = 200;
+    snprintf(reply->body, sizeof(reply->body), "{\"code\":0,\"message\":\"ok\"}");
+  }
+}
+
+static void _on_event(ai_agent_event_t event, ai_agent_cmd_t cmd, void *ctx)
+{
+  xQueueSend(g_events, &event, 0);
+}
+
+/* submit cmd and wait for the control task to report it done */
+static ai_agent_event_t _run(ai_agent_cmd_t cmd)
+{
+  ai_agent_event_t event = AI_AGENT_EVT_CANCELLED;
+  TEST_CHECK_INT(ai_agent_submit(cmd), 0);
+  TEST_CHECK(xQueueReceive(g_events, &event, pdMS_TO_TICKS(EVENT_WAIT_MS)) == pdTRUE);
+  return event;
+}
+
+static standin_stats_t _stats(void)
+{
+  standin_stats_t stats;
+  standin_get_stats(&stats);
+  return stats;
+}
+
+static void test_keep_alive(void)
+{
+  // two start/stop rounds, four requests on one connection
+  for (int round = 0; round < 2; round++) {
+    TEST_CHECK_INT(_run(AI_AGENT_CMD_START), AI_AGENT_EVT_STARTED);
+    TEST_CHECK_INT(_run(AI_AGENT_CMD_STOP), AI_AGENT_EVT_STOPPED);
+  }
+
+  standin_stats_t stats = _stats();
+  TEST_CHECK_INT(stats.requests, 4);
+  TEST_CHECK_INT(stats.connections, 1);
+  TEST_CHECK_INT(stats.resumed, 0);
+  TEST_CHECK_INT(host_http_clients(), 1);
+
+  // the header was encoded once and sent as is every time
+  TEST_CHECK_STR(stats.auth, EXPECTED_AUTH);
+  TEST_CHECK_INT(stats.auth_changes, 0);
+}
+
+static void test_idle_reconnect(void)
+{
+  standin_stats_t before = _stats();
+
+  // idle past both limits: the client reconnects before the server's close bites
+  usleep((SERVER_IDLE_CLOSE_MS + 200) * 1000);
+  TEST_CHECK_INT(_run(AI_AGENT_CMD_START), AI_AGENT_EVT_STARTED);
+
+  standin_stats_t stats = _stats();
+  TEST_CHECK_INT(stats.idle_closed, before.idle_closed + 1);
+  TEST_CHECK_INT(stats.connections, before.connections + 1);
+  TEST_CHECK_INT(stats.resumed, before.resumed + 1);
+  TEST_CHECK_INT(stats.requests, before.requests + 1);
+
+  TEST_CHECK_INT(_run(AI_AGENT_CMD_STOP), AI_AGENT_EVT_STOPPED);
+  TEST_CHECK_INT(_stats().connections, before.connections + 1);
+}
+
+static void test_resume_after_drop(void)
+{
+  standin_stats_t before = _stats();
+
+  // the server hangs up on a leave: it is repeated on a resumed connection
+  TEST_CHECK_INT(_run(AI_AGENT_CMD_START), AI_AGENT_EVT_STARTED);
+  g_drop_leaves = 1;
+  TEST_CHECK_INT(_run(AI_AGENT_CMD_STOP), AI_AGENT_EVT_STOPPED);
+
+  standin_stats_t stats = _stats();
+  TEST_CHECK_INT(stats.requests, before.requests + 3);
+  TEST_CHECK_INT(stats.connections, before.connections + 1);
+  TEST_CHECK_INT(stats.resumed, before.resumed + 1);
+  TEST_CHECK_INT(stats.auth_changes, 0);
+  TEST_CHECK_INT(host_http_clients(), 1);
+}
+
+int main(void)
+{
+  int port = standin_start(_route, NULL, SERVER_IDLE_CLOSE_MS);
+  if (port == 0) {
+    printf("stand-in server did not start\n");
+    return 1;
+  }
+  host_http_set_port(port);
+
+  g_events = xQueueCreate(8, sizeof(ai_agent_event_t));
+  ai_agent_set_event_cb(_on_event, NULL);
+  ai_agent_init();
+
+  TEST_RUN(test_keep_alive);
+  TEST_RUN(test_idle_reconnect);
+  TEST_RUN(test_resume_after_drop);
+  TEST_EXIT();
+}
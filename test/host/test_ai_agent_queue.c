@@ -0,0 +1,215 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ai_agent.h"
+#include "app_state.h"
+#include "common.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "host_stub.h"
+#include "host_test.h"
+#include "rest_standin.h"
+
+/* The command queue of the agent control task against a stand-in for the
+ * agent API. A join can be held in the server, which keeps the control
+ * task busy while the test submits behind it, or answered with a stale
+ * 409, which puts the running start into its backoff wait. Every event is
+ * recorded with the command it belongs to. */
+
+#define PROJECT       "/api/conversational-ai-agent/v2/projects/your_agora_app_id"
+#define LOG_MAX       (1024)
+#define EVENT_WAIT_MS (10000)
+
+app_t g_app;
+
+typedef struct {
+  ai_agent_event_t event;
+  ai_agent_cmd_t cmd;
+} agent_event_t;
+
+static SemaphoreHandle_t g_lock = NULL;
+static SemaphoreHandle_t g_join_entered = NULL;   // given when a held join reaches the server
+static SemaphoreHandle_t g_join_gate = NULL;      // taken by a held join before it is answered
+static bool g_hold_join = false;
+static int g_stale_conflicts = 0;
+static int g_joins = 0;
+static char g_log[LOG_MAX];
+
+static QueueHandle_t g_events = NULL;
+
+static void _route(const char *method, const char *path, const char *body, standin_reply_t *reply, void *ctx)
+{
+  char id[32];
+
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  size_t len = strlen(g_log);
+  const char *short_path = strncmp(path, PROJECT, strlen(PROJECT)) == 0 ? path + strlen(PROJECT) : path;
+  snprintf(g_log + len, sizeof(g_log) - len, "%s %s|", method, short_path);
+  bool hold = g_hold_join && strcmp(path, PROJECT "/join") == 0;
+  xSemaphoreGive(g_lock);
+
+  if (hold) {
+    xSemaphoreGive(g_join_entered);
+    xSemaphoreTake(g_join_gate, portMAX_DELAY);
+  }
+
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  if (strcmp(method, "POST") == 0 && strcmp(path, PROJECT "/join") == 0) {
+    if (g_stale_conflicts > 0) {
+      g_stale_conflicts--;
+      reply->status = 409;
+      snprintf(reply->body, sizeof(reply->body), "{\"detail\":\"task conflict\",\"reason\":\"TaskConflict\"}");
+    } else {
+      reply->status = 200;
+      snprintf(reply->body, sizeof(reply->body), "{\"agent_id\":\"A%d\",\"create_ts\":1712345678,\"status\":\"RUNNING\"}",
+               ++g_joins);
+    }
+  } else if (strcmp(method, "GET") == 0) {
+    reply->status = 200;
+    snprintf(reply->body, sizeof(reply->body), "{\"data\":{\"count\":0,\"list\":[]},\"meta\":{}}");
+  } else if (strcmp(method, "POST") == 0 && sscanf(path, PROJECT "/agents/%31[^/]/leave", id) == 1) {
+    reply->status = 200;
+    snprintf(reply->body, sizeof(reply->body), "{\"code\":0,\"message\":\"ok\"}");
+  }
+  xSemaphoreGive(g_lock);
+}
+
+static void _on_event(ai_agent_event_t event, ai_agent_cmd_t cmd, void *ctx)
+{
+  agent_event_t e = { .event = event, .cmd = cmd };
+  xQueueSend(g_events, &e, 0);
+}
+
+static void _expect(ai_agent_event_t event, ai_agent_cmd_t cmd)
+{
+  agent_event_t e = { .event = AI_AGENT_EVT_START_FAILED, .cmd = AI_AGENT_CMD_NONE };
+  TEST_CHECK(xQueueReceive(g_events, &e, pdMS_TO_TICKS(EVENT_WAIT_MS)) == pdTRUE);
+  TEST_CHECK_INT(e.event, event);
+  TEST_CHECK_INT(e.cmd, cmd);
+}
+
+static void _expect_none(void)
+{
+  agent_event_t e;
+  TEST_CHECK(xQueueReceive(g_events, &e, pdMS_TO_TICKS(300)) == pdFALSE);
+}
+
+static const char *_take_log(void)
+{
+  static char log[LOG_MAX];
+
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  snprintf(log, sizeof(log), "%s", g_log);
+  g_log[0] = '\0';
+  xSemaphoreGive(g_lock);
+  return log;
+}
+
+/* submit a start and return once its join is held in the server */
+static void _start_held(void)
+{
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  g_hold_join = true;
+  xSemaphoreGive(g_lock);
+
+  TEST_CHECK_INT(ai_agent_submit(AI_AGENT_CMD_START), 0);
+  TEST_CHECK(xSemaphoreTake(g_join_entered, pdMS_TO_TICKS(EVENT_WAIT_MS)) == pdTRUE);
+
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  g_hold_join = false;
+  xSemaphoreGive(g_lock);
+}
+
+static void test_duplicate_is_coalesced(void)
+{
+  _start_held();
+
+  // the second stop finds the first still pending and merges into it
+  TEST_CHECK_INT(ai_agent_submit(AI_AGENT_CMD_STOP), 0);
+  TEST_CHECK_INT(ai_agent_submit(AI_AGENT_CMD_STOP), 0);
+  xSemaphoreGive(g_join_gate);
+
+  _expect(AI_AGENT_EVT_STARTED, AI_AGENT_CMD_START);
+  _expect(AI_AGENT_EVT_STOPPED, AI_AGENT_CMD_STOP);
+  _expect_none();
+  TEST_CHECK_STR(_take_log(), "POST /join|POST /agents/A1/leave|");
+}
+
+static void test_pending_is_replaced(void)
+{
+  _start_held();
+
+  // a restart replaces the stop that never ran, which is reported cancelled
+  TEST_CHECK_INT(ai_agent_submit(AI_AGENT_CMD_STOP), 0);
+  TEST_CHECK_INT(ai_agent_submit(AI_AGENT_CMD_RESTART), 0);
+  xSemaphoreGive(g_join_gate);
+
+  _expect(AI_AGENT_EVT_STARTED, AI_AGENT_CMD_START);
+  _expect(AI_AGENT_EVT_CANCELLED, AI_AGENT_CMD_STOP);
+  _expect(AI_AGENT_EVT_STOPPED, AI_AGENT_CMD_RESTART);
+  _expect(AI_AGENT_EVT_STARTED, AI_AGENT_CMD_RESTART);
+  _expect_none();
+  TEST_CHECK_STR(_take_log(), "POST /join|POST /agents/A2/leave|POST /join|");
+
+  TEST_CHECK_INT(ai_agent_submit(AI_AGENT_CMD_STOP), 0);
+  _expect(AI_AGENT_EVT_STOPPED, AI_AGENT_CMD_STOP);
+  TEST_CHECK_STR(_take_log(), "POST /agents/A3/leave|");
+}
+
+static void test_start_superseded_in_backoff(void)
+{
+  // a stale conflict: the start waits at least a second before it retries
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  g_stale_conflicts = 1;
+  xSemaphoreGive(g_lock);
+  TEST_CHECK_INT(ai_agent_submit(AI_AGENT_CMD_START), 0);
+
+  bool waiting = false;
+  for (int i = 0; i < EVENT_WAIT_MS / 10 && !waiting; i++) {
+    vTaskDelay(pdMS_TO_TICKS(10));
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+    waiting = strstr(g_log, "GET ") != NULL;
+    xSemaphoreGive(g_lock);
+  }
+  TEST_CHECK(waiting);
+  vTaskDelay(pdMS_TO_TICKS(100));
+
+  // a stop wakes it: it gives up without another join and the stop runs
+  int64_t submit_us = esp_timer_get_time();
+  TEST_CHECK_INT(ai_agent_submit(AI_AGENT_CMD_STOP), 0);
+  _expect(AI_AGENT_EVT_CANCELLED, AI_AGENT_CMD_START);
+  TEST_CHECK(esp_timer_get_time() - submit_us < 500 * 1000);
+  _expect(AI_AGENT_EVT_STOPPED, AI_AGENT_CMD_STOP);
+  _expect_none();
+  TEST_CHECK_STR(_take_log(), "POST /join|GET /agents?state=2&limit=20|");
+  TEST_CHECK_INT(g_joins, 3);
+  TEST_CHECK(!app_state_has(APP_STATE_AGENT_JOINED));
+}
+
+int main(void)
+{
+  g_lock = xSemaphoreCreateMutex();
+  g_join_entered = xSemaphoreCreateBinary();
+  g_join_gate = xSemaphoreCreateBinary();
+  g_events = xQueueCreate(16, sizeof(agent_event_t));
+
+  int port = standin_start(_route, NULL, 0);
+  if (port == 0) {
+    printf("stand-in server did not start\n");
+    return 1;
+  }
+  host_http_set_port(port);
+
+  ai_agent_set_event_cb(_on_event, NULL);
+  ai_agent_init();
+
+  TEST_RUN(test_duplicate_is_coalesced);
+  TEST_RUN(test_pending_is_replaced);
+  TEST_RUN(test_start_superseded_in_backoff);
+  TEST_EXIT();
+}
@@ -0,0 +1,239 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "app_state.h"
+#include "host_test.h"
+
+/* The state machine is three independent bits, so every transition between
+ * any two of the eight states is driven and the notifications checked. */
+
+#define ALL_BITS     (APP_STATE_WIFI_CONNECTED | APP_STATE_SESSION_STARTED | APP_STATE_AGENT_JOINED)
+#define MAX_RECORDED (256)
+#define SETTLE_MS    (1000)
+
+typedef struct {
+  app_state_t changed;
+  app_state_t state;
+} note_t;
+
+static note_t g_notes[MAX_RECORDED];
+static volatile int g_note_count = 0;
+static volatile bool g_block = false;
+static SemaphoreHandle_t g_unblock = NULL;
+
+static void _record(app_state_t changed, app_state_t state, void *ctx)
+{
+  if (g_block) {
+    xSemaphoreTake(g_unblock, portMAX_DELAY);
+  }
+  host_critical_enter();
+  if (g_note_count < MAX_RECORDED) {
+    g_notes[g_note_count] = (note_t){ changed, state };
+  }
+  g_note_count++;
+  host_critical_exit();
+}
+
+static void _noop(app_state_t changed, app_state_t state, void *ctx)
+{
+}
+
+/* wait for the app_state task to deliver count notifications */
+static bool _settle(int count)
+{
+  for (int waited = 0; waited < SETTLE_MS; waited++) {
+    if (g_note_count >= count) {
+      vTaskDelay(pdMS_TO_TICKS(2));   // and nothing more
+      return g_note_count == count;
+    }
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+  return false;
+}
+
+static void _go_to(app_state_t target)
+{
+  app_state_t now = app_state_get();
+  app_state_set(target & ~now);
+  app_state_clear(now & ~target);
+}
+
+static void test_starts_empty(void)
+{
+  TEST_CHECK_INT(app_state_get(), 0);
+  TEST_CHECK(!app_state_has(APP_STATE_WIFI_CONNECTED));
+  TEST_CHECK(app_state_has(0));
+}
+
+static void test_set_clear_before_init(void)
+{
+  // writers may run before app_state_init, nothing is lost
+  app_state_set(APP_STATE_WIFI_CONNECTED);
+  TEST_CHECK(app_state_has(APP_STATE_WIFI_CONNECTED));
+  app_state_clear(APP_STATE_WIFI_CONNECTED);
+  TEST_CHECK_INT(app_state_get(), 0);
+}
+
+static void test_subscribe(void)
+{
+  TEST_CHECK_INT(app_state_subscribe(NULL, NULL), -1);
+  TEST_CHECK_INT(app_state_subscribe(_record, NULL), 0);
+  for (int i = 1; i < APP_STATE_MAX_SUBSCRIBERS; i++) {
+    TEST_CHECK_INT(app_state_subscribe(_noop, NULL), 0);
+  }
+  TEST_CHECK_INT(app_state_subscribe(_noop, NULL), -1);
+}
+
+static void test_queued_before_init_delivered(void)
+{
+  // the two changes of test_set_clear_before_init were queued for the task
+  app_state_init();
+  app_state_init();   // a second call starts nothing
+  TEST_CHECK(_settle(2));
+  TEST_CHECK_INT(g_notes[0].changed, APP_STATE_WIFI_CONNECTED);
+  TEST_CHECK_INT(g_notes[0].state, APP_STATE_WIFI_CONNECTED);
+  TEST_CHECK_INT(g_notes[1].changed, APP_STATE_WIFI_CONNECTED);
+  TEST_CHECK_INT(g_notes[1].state, 0);
+  g_note_count = 0;
+}
+
+static void test_no_change_no_notification(void)
+{
+  app_state_stats_t before, after;
+  app_state_get_stats(&before);
+
+  app_state_clear(ALL_BITS);   // already clear
+  app_state_set(0);
+  TEST_CHECK(_settle(0));
+
+  app_state_set(APP_STATE_SESSION_STARTED);
+  app_state_set(APP_STATE_SESSION_STARTED);
+  TEST_CHECK(_settle(1));
+
+  app_state_get_stats(&after);
+  TEST_CHECK_INT(after.transitions - before.transitions, 1);
+
+  app_state_clear(APP_STATE_SESSION_STARTED);
+  TEST_CHECK(_settle(2));
+  g_note_count = 0;
+}
+
+static void test_all_transitions(void)
+{
+  for (app_state_t from = 0; from <= ALL_BITS; from++) {
+    for (app_state_t to = 0; to <= ALL_BITS; to++) {
+      app_state_t prev = app_state_get();
+      g_note_count     = 0;
+      _go_to(from);
+      TEST_CHECK(_settle(((from & ~prev) != 0) + ((prev & ~from) != 0)));
+      g_note_count = 0;
+
+      _go_to(to);
+      TEST_CHECK_INT(app_state_get(), to);
+      TEST_CHECK(app_state_has(to));
+      TEST_CHECK(to == ALL_BITS || !app_state_has(ALL_BITS));
+
+      // one notification for the bits set, one for the bits cleared
+      int expected = ((to & ~from) != 0) + ((from & ~to) != 0);
+      if (!_settle(expected)) {
+        printf("%u -> %u: %d notifications, expected %d\n", (unsigned)from, (unsigned)to, g_note_count, expected);
+        g_test_failures++;
+        continue;
+      }
+
+      // replayed in order, the notifications lead from one state to the other
+      app_state_t state = from;
+      for (int i = 0; i < expected; i++) {
+        TEST_CHECK(g_notes[i].changed != 0);
+        TEST_CHECK_INT(g_notes[i].changed, state ^ g_notes[i].state);
+        state = g_notes[i].state;
+      }
+      TEST_CHECK_INT(state, to);
+    }
+  }
+  _go_to(0);
+  vTaskDelay(pdMS_TO_TICKS(10));
+  g_note_count = 0;
+}
+
+static void _set_later(void *arg)
+{
+  vTaskDelay(pdMS_TO_TICKS(50));
+  app_state_set((app_state_t)(uintptr_t)arg);
+  vTaskDelete(NULL);
+}
+
+static void test_wait(void)
+{
+  TickType_t start = xTaskGetTickCount();
+  TEST_CHECK(!app_state_wait(APP_STATE_AGENT_JOINED, 30));
+  TEST_CHECK(xTaskGetTickCount() - start >= 30);
+
+  app_state_set(APP_STATE_WIFI_CONNECTED);
+  TEST_CHECK(app_state_wait(APP_STATE_WIFI_CONNECTED, 0));
+
+  // all bits are needed, one of them is not enough
+  TEST_CHECK(!app_state_wait(APP_STATE_WIFI_CONNECTED | APP_STATE_SESSION_STARTED, 10));
+
+  xTaskCreate(_set_later, "set_later", 2048, (void *)(uintptr_t)APP_STATE_SESSION_STARTED, 5, NULL);
+  start = xTaskGetTickCount();
+  TEST_CHECK(app_state_wait(APP_STATE_WIFI_CONNECTED | APP_STATE_SESSION_STARTED, 1000));
+  TEST_CHECK(xTaskGetTickCount() - start < 1000);
+
+  // waiting does not consume the bits
+  TEST_CHECK(app_state_has(APP_STATE_WIFI_CONNECTED | APP_STATE_SESSION_STARTED));
+
+  _go_to(0);
+  vTaskDelay(pdMS_TO_TICKS(10));
+  g_note_count = 0;
+}
+
+static void test_full_queue_drops(void)
+{
+  app_state_stats_t before, after;
+  const int toggles = 40;
+
+  app_state_get_stats(&before);
+
+  // a stuck subscriber holds the task, changes pile up in the queue
+  g_block = true;
+  for (int i = 0; i < toggles; i++) {
+    if (i & 1) {
+      app_state_clear(APP_STATE_AGENT_JOINED);
+    } else {
+      app_state_set(APP_STATE_AGENT_JOINED);
+    }
+  }
+  TEST_CHECK_INT(app_state_get(), 0);
+
+  app_state_get_stats(&after);
+  uint32_t dropped = after.dropped - before.dropped;
+  TEST_CHECK_INT(after.transitions - before.transitions, toggles);
+  TEST_CHECK(dropped > 0);
+
+  g_block = false;
+  for (int i = 0; i < toggles; i++) {
+    xSemaphoreGive(g_unblock);
+  }
+  TEST_CHECK(_settle(toggles - (int)dropped));
+  g_note_count = 0;
+}
+
+int main(void)
+{
+  g_unblock = xSemaphoreCreateCounting(64, 0);
+
+  TEST_RUN(test_starts_empty);
+  TEST_RUN(test_set_clear_before_init);
+  TEST_RUN(test_subscribe);
+  TEST_RUN(test_queued_before_init_delivered);
+  TEST_RUN(test_no_change_no_notification);
+  TEST_RUN(test_all_transitions);
+  TEST_RUN(test_wait);
+  TEST_RUN(test_full_queue_drops);
+  TEST_EXIT();
+}
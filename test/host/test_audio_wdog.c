@@ -0,0 +1,191 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "audio_wdog.h"
+#include "host_test.h"
+#include "load_gov.h"
+
+/* audio_wdog_tick on a simulated clock: a 20 ms frame, 10 ms of slack and
+ * a one second window, as the capture loop configures it for G.711 */
+
+#define PERIOD_US  (20000)
+
+static const audio_wdog_cfg_t g_cfg = {
+  .period_us       = PERIOD_US,
+  .slack_us        = PERIOD_US / 2,
+  .window_us       = AUDIO_WDOG_WINDOW_MS * 1000,
+  .degrade_misses  = 3,
+  .restart_windows = 5,
+};
+
+typedef struct {
+  audio_wdog_t wdog;
+  int64_t now_us;
+  int counts[AUDIO_WDOG_RESTART + 1];
+} sim_t;
+
+static void _sim_start(sim_t *sim)
+{
+  *sim = (sim_t){ .now_us = 1000000 };
+  audio_wdog_reset(&sim->wdog, sim->now_us);
+}
+
+static audio_wdog_action_t _frame(sim_t *sim, int64_t gap_us, uint32_t *late_us)
+{
+  uint32_t late = 0;
+  sim->now_us += gap_us;
+  audio_wdog_action_t action = audio_wdog_tick(&sim->wdog, &g_cfg, sim->now_us, &late);
+  sim->counts[action]++;
+  if (late_us) {
+    *late_us = late;
+  }
+  return action;
+}
+
+/* one window of frames with that many late ones; each late frame is
+ * followed by a short one, so the window keeps its length */
+static void _window(sim_t *sim, int misses)
+{
+  int frames = (int)(g_cfg.window_us / PERIOD_US);
+  for (int i = 0; i < frames; i++) {
+    if (i < 2 * misses) {
+      _frame(sim, (i & 1) ? PERIOD_US - 15000 : PERIOD_US + 15000, NULL);
+    } else {
+      _frame(sim, PERIOD_US, NULL);
+    }
+  }
+}
+
+static void test_on_time(void)
+{
+  sim_t sim;
+  _sim_start(&sim);
+
+  // ten seconds of frames, jitter within the slack
+  for (int i = 0; i < 500; i++) {
+    _frame(&sim, PERIOD_US + ((i % 3) - 1) * 9000, NULL);
+  }
+  TEST_CHECK_INT(sim.counts[AUDIO_WDOG_OK], 500);
+  TEST_CHECK_INT(sim.wdog.total_misses, 0);
+  TEST_CHECK_INT(sim.wdog.max_late_us, 0);
+}
+
+static void test_slack_boundary(void)
+{
+  sim_t sim;
+  uint32_t late = 0;
+  _sim_start(&sim);
+
+  TEST_CHECK_INT(_frame(&sim, PERIOD_US + PERIOD_US / 2, &late), AUDIO_WDOG_OK);
+  TEST_CHECK_INT(late, 0);
+  TEST_CHECK_INT(_frame(&sim, PERIOD_US + PERIOD_US / 2 + 1, &late), AUDIO_WDOG_LOG);
+  TEST_CHECK_INT(late, PERIOD_US / 2 + 1);
+}
+
+static void test_escalates_within_a_window(void)
+{
+  sim_t sim;
+  uint32_t late = 0;
+  _sim_start(&sim);
+
+  TEST_CHECK_INT(_frame(&sim, 3 * PERIOD_US, &late), AUDIO_WDOG_LOG);
+  TEST_CHECK_INT(late, 2 * PERIOD_US);
+  TEST_CHECK_INT(_frame(&sim, PERIOD_US, NULL), AUDIO_WDOG_OK);
+  TEST_CHECK_INT(_frame(&sim, 2 * PERIOD_US, NULL), AUDIO_WDOG_LOG);
+  TEST_CHECK_INT(_frame(&sim, 5 * PERIOD_US, &late), AUDIO_WDOG_DEGRADE);
+  TEST_CHECK_INT(_frame(&sim, 2 * PERIOD_US, NULL), AUDIO_WDOG_DEGRADE);
+
+  TEST_CHECK_INT(sim.wdog.total_misses, 4);
+  TEST_CHECK_INT(sim.wdog.max_late_us, 4 * PERIOD_US);
+
+  // a new window starts with a log again
+  int64_t window_start = sim.wdog.window_start_us;
+  while (sim.wdog.window_start_us == window_start) {
+    _frame(&sim, PERIOD_US, NULL);
+  }
+  TEST_CHECK_INT(sim.wdog.window_misses, 0);
+  TEST_CHECK_INT(_frame(&sim, 2 * PERIOD_US, NULL), AUDIO_WDOG_LOG);
+}
+
+static void test_restart_after_persistent_windows(void)
+{
+  sim_t sim;
+  _sim_start(&sim);
+
+  for (int w = 0; w < g_cfg.restart_windows - 1; w++) {
+    _window(&sim, g_cfg.degrade_misses);
+  }
+  TEST_CHECK_INT(sim.counts[AUDIO_WDOG_RESTART], 0);
+  TEST_CHECK_INT(sim.wdog.bad_windows, g_cfg.restart_windows - 1);
+
+  // the window that makes restart_windows in a row ends in a restart
+  _window(&sim, g_cfg.degrade_misses);
+  TEST_CHECK_INT(sim.counts[AUDIO_WDOG_RESTART], 1);
+  TEST_CHECK_INT(sim.wdog.bad_windows, 0);
+
+  // after a restart the count starts over
+  for (int w = 0; w < g_cfg.restart_windows - 1; w++) {
+    _window(&sim, g_cfg.degrade_misses);
+  }
+  TEST_CHECK_INT(sim.counts[AUDIO_WDOG_RESTART], 1);
+}
+
+static void test_good_window_clears_the_streak(void)
+{
+  sim_t sim;
+  _sim_start(&sim);
+
+  for (int round = 0; round < 10; round++) {
+    for (int w = 0; w < g_cfg.restart_windows - 1; w++) {
+      _window(&sim, g_cfg.degrade_misses);
+    }
+    _window(&sim, g_cfg.degrade_misses - 1);   // a window below the degrade rate
+  }
+  TEST_CHECK_INT(sim.counts[AUDIO_WDOG_RESTART], 0);
+  TEST_CHECK(sim.counts[AUDIO_WDOG_DEGRADE] > 0);
+}
+
+static void test_reset_after_stall(void)
+{
+  sim_t sim;
+  _sim_start(&sim);
+
+  // a restarted pipeline resets the watchdog, the start-up gap is no miss
+  sim.now_us += 400000;
+  audio_wdog_reset(&sim.wdog, sim.now_us);
+  TEST_CHECK_INT(_frame(&sim, PERIOD_US, NULL), AUDIO_WDOG_OK);
+  TEST_CHECK_INT(sim.wdog.total_misses, 0);
+}
+
+static void test_degrade_reaches_load_gov(void)
+{
+  load_gov_init();
+  for (int i = 0; i < 3; i++) {
+    audio_wdog_handle(AUDIO_WDOG_DEGRADE, 2 * PERIOD_US, 0);
+  }
+  vTaskDelay(pdMS_TO_TICKS(3 * CONFIG_LOAD_GOV_PERIOD_MS));
+  TEST_CHECK(load_gov_level() > LOAD_LEVEL_FULL);
+
+  // a logged miss is named by the next load_gov sample, never on the caller
+  audio_wdog_handle(AUDIO_WDOG_LOG, 2 * PERIOD_US, 0);
+  TaskStatus_t tasks[2] = {
+    { .xHandle = xTaskGetIdleTaskHandleForCore(0), .pcTaskName = "IDLE0", .ulRunTimeCounter = 100, .xCoreID = 0 },
+    { .xHandle = (TaskHandle_t)&tasks[1], .pcTaskName = "hog", .ulRunTimeCounter = 900, .xCoreID = 0 },
+  };
+  audio_wdog_sample(tasks, 2, 1000);
+}
+
+int main(void)
+{
+  TEST_RUN(test_on_time);
+  TEST_RUN(test_slack_boundary);
+  TEST_RUN(test_escalates_within_a_window);
+  TEST_RUN(test_restart_after_persistent_windows);
+  TEST_RUN(test_good_window_clears_the_streak);
+  TEST_RUN(test_reset_after_stall);
+  TEST_RUN(test_degrade_reaches_load_gov);
+  TEST_EXIT();
+}
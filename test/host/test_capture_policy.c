@@ -0,0 +1,119 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "capture_policy.h"
+#include "host_stub.h"
+#include "host_test.h"
+
+/* The deinterleave against a one-sample-at-a-time reference, for every
+ * policy and every frame count around the unrolled step, with the input
+ * starting at an odd offset in its buffer. Then the per-session policy and
+ * its A/B rotation through NVS. */
+
+#define MAX_FRAMES  (37)
+#define CANARY      (0x5A5A)
+
+static int32_t _slot(int frame, int channel)
+{
+  // distinct audio in the top half, and noise in the low half that must go
+  int16_t audio = (int16_t)(frame * 997 * (channel ? -1 : 1) + channel * 300 - 16000);
+  return (int32_t)((uint32_t)(uint16_t)audio << 16) | (frame * 31 + channel + 0x1234);
+}
+
+static int16_t _expected(const int32_t *stereo, int frame, capture_policy_t policy)
+{
+  int32_t left = stereo[2 * frame] >> 16;
+  int32_t right = stereo[2 * frame + 1] >> 16;
+  switch (policy) {
+    case CAPTURE_CH_LEFT:  return (int16_t)left;
+    case CAPTURE_CH_RIGHT: return (int16_t)right;
+    default:               return (int16_t)((left + right) >> 1);
+  }
+}
+
+static void test_deinterleave(void)
+{
+  int32_t buf[2 * MAX_FRAMES + 1];
+  int16_t mono[MAX_FRAMES + 1];
+  int32_t *stereo = &buf[1];   // not where the buffer starts
+
+  for (int i = 0; i < MAX_FRAMES; i++) {
+    stereo[2 * i] = _slot(i, 0);
+    stereo[2 * i + 1] = _slot(i, 1);
+  }
+
+  for (int policy = CAPTURE_CH_LEFT; policy < CAPTURE_CH_COUNT; policy++) {
+    for (int frames = 0; frames <= MAX_FRAMES; frames++) {
+      for (int i = 0; i <= MAX_FRAMES; i++) {
+        mono[i] = CANARY;
+      }
+      capture_deinterleave_s32(stereo, mono, frames, (capture_policy_t)policy);
+
+      bool same = true;
+      for (int i = 0; i < frames; i++) {
+        same &= mono[i] == _expected(stereo, i, (capture_policy_t)policy);
+      }
+      TEST_CHECK(same);
+      TEST_CHECK_INT(mono[frames], CANARY);   // nothing written past the end
+    }
+  }
+}
+
+static void test_extremes(void)
+{
+  int32_t stereo[8] = {
+    INT32_MIN, INT32_MAX,         // full scale both ways
+    INT32_MAX, INT32_MAX,
+    INT32_MIN, INT32_MIN,
+    (int32_t)0xFFFF0000, 0x00010000,   // -1 and 1
+  };
+  int16_t mono[4];
+
+  capture_deinterleave_s32(stereo, mono, 4, CAPTURE_CH_LEFT);
+  TEST_CHECK_INT(mono[0], INT16_MIN);
+  TEST_CHECK_INT(mono[1], INT16_MAX);
+  TEST_CHECK_INT(mono[3], -1);
+
+  capture_deinterleave_s32(stereo, mono, 4, CAPTURE_CH_RIGHT);
+  TEST_CHECK_INT(mono[0], INT16_MAX);
+  TEST_CHECK_INT(mono[2], INT16_MIN);
+  TEST_CHECK_INT(mono[3], 1);
+
+  // the mix cannot overflow, and rounds toward minus infinity
+  capture_deinterleave_s32(stereo, mono, 4, CAPTURE_CH_MIX);
+  TEST_CHECK_INT(mono[0], -1);
+  TEST_CHECK_INT(mono[1], INT16_MAX);
+  TEST_CHECK_INT(mono[2], INT16_MIN);
+  TEST_CHECK_INT(mono[3], 0);
+}
+
+static void test_session_policy(void)
+{
+  // the A/B rotation carries on from NVS, one channel per session
+  host_nvs_erase_all();
+  TEST_CHECK_INT(capture_policy_session_begin(), CAPTURE_CH_LEFT);
+  TEST_CHECK_INT(capture_policy_session_begin(), CAPTURE_CH_RIGHT);
+  TEST_CHECK_INT(capture_policy_session_begin(), CAPTURE_CH_MIX);
+  TEST_CHECK_INT(capture_policy_session_begin(), CAPTURE_CH_LEFT);
+  TEST_CHECK_INT(capture_policy_get(), CAPTURE_CH_LEFT);
+
+  // a set policy waits for the next session, then overrides the rotation
+  capture_policy_set(CAPTURE_CH_MIX);
+  TEST_CHECK_INT(capture_policy_get(), CAPTURE_CH_LEFT);
+  TEST_CHECK_INT(capture_policy_session_begin(), CAPTURE_CH_MIX);
+  TEST_CHECK_INT(capture_policy_session_begin(), CAPTURE_CH_MIX);
+  capture_policy_set(CAPTURE_CH_COUNT);   // ignored
+  TEST_CHECK_INT(capture_policy_session_begin(), CAPTURE_CH_MIX);
+
+  TEST_CHECK_STR(capture_policy_name(CAPTURE_CH_RIGHT), "right");
+  TEST_CHECK_STR(capture_policy_name(CAPTURE_CH_COUNT), "?");
+}
+
+int main(void)
+{
+  TEST_RUN(test_deinterleave);
+  TEST_RUN(test_extremes);
+  TEST_RUN(test_session_policy);
+  TEST_EXIT();
+}
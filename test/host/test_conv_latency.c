@@ -0,0 +1,283 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "conv_latency.h"
+#include "host_test.h"
+
+/* Synthetic conversations on a simulated clock: 20 ms frames of a square
+ * wave whose amplitude is the frame level, the uplink and the agent's
+ * downlink side by side. Latencies come out to the frame. */
+
+#define FRAME_MS    (20)
+#define SAMPLES     (16 * FRAME_MS)
+
+#define QUIET       (40)     // room noise
+#define LOUD_NOISE  (500)    // a fan, above CONV_VAD_MIN_LEVEL
+#define SPEECH      (3000)
+#define NONE        (0)
+
+static int64_t g_now_us = 0;
+
+static void _fill(int16_t *pcm, int level)
+{
+  for (int i = 0; i < SAMPLES; i++) {
+    pcm[i] = (int16_t)((i & 1) ? -level : level);
+  }
+}
+
+/* ms of uplink at level up while the agent plays at level down, NONE for no
+ * downlink frames at all */
+static void _run(int ms, int up, int down)
+{
+  int16_t up_pcm[SAMPLES], down_pcm[SAMPLES];
+  _fill(up_pcm, up);
+  _fill(down_pcm, down);
+
+  for (int t = 0; t < ms; t += FRAME_MS) {
+    conv_latency_capture_frame(up_pcm, SAMPLES, g_now_us, FRAME_MS);
+    if (down != NONE) {
+      conv_latency_agent_audio(down_pcm, SAMPLES, g_now_us);
+    }
+    g_now_us += FRAME_MS * 1000;
+  }
+}
+
+/* a fresh session well away from any earlier agent audio */
+static void _begin(bool joined)
+{
+  g_now_us += 60 * 1000 * 1000;
+  conv_latency_session_begin(g_now_us, joined);
+}
+
+static conv_hist_t _hist(conv_lat_metric_t metric, bool session)
+{
+  conv_hist_t h;
+  conv_latency_get_hist(metric, session, &h);
+  return h;
+}
+
+static void test_press_join_greeting(void)
+{
+  _begin(false);
+  _run(1500, QUIET, NONE);
+  conv_latency_agent_joined(g_now_us);
+  _run(800, QUIET, NONE);
+  _run(1000, QUIET, SPEECH);
+
+  conv_hist_t join = _hist(CONV_LAT_PRESS_JOIN, true);
+  conv_hist_t greeting = _hist(CONV_LAT_JOIN_GREETING, true);
+  TEST_CHECK_INT(join.count, 1);
+  TEST_CHECK_INT(join.min_ms, 1500);
+  TEST_CHECK_INT(greeting.count, 1);
+  TEST_CHECK_INT(greeting.min_ms, 800);
+
+  // the greeting is measured once
+  _run(500, QUIET, NONE);
+  _run(500, QUIET, SPEECH);
+  TEST_CHECK_INT(_hist(CONV_LAT_JOIN_GREETING, true).count, 1);
+  conv_latency_session_end();
+}
+
+static void test_warm_standby(void)
+{
+  conv_hist_t greeting_total = _hist(CONV_LAT_JOIN_GREETING, false);
+
+  // the agent joins in standby between conversations, its greeting goes to
+  // the muted downlink and never reaches conv_latency_agent_audio()
+  g_now_us += 60 * 1000 * 1000;
+  conv_latency_agent_joined(g_now_us);
+  _run(30 * 1000, QUIET, NONE);
+
+  // the press finds it there: no press-to-join, and no greeting that would
+  // count the time spent in standby
+  _begin(true);
+  _run(600, QUIET, NONE);
+  _run(200, QUIET, SPEECH);
+  TEST_CHECK_INT(_hist(CONV_LAT_PRESS_JOIN, true).count, 0);
+  TEST_CHECK_INT(_hist(CONV_LAT_JOIN_GREETING, true).count, 0);
+  TEST_CHECK_INT(_hist(CONV_LAT_JOIN_GREETING, false).count, greeting_total.count);
+  conv_latency_session_end();
+
+  // a standby join right at the press still leaves nothing pending
+  conv_latency_agent_joined(g_now_us);
+  _begin(true);
+  _run(200, QUIET, SPEECH);
+  TEST_CHECK_INT(_hist(CONV_LAT_JOIN_GREETING, true).count, 0);
+  conv_latency_session_end();
+
+  // and the next cold session measures its own greeting only
+  _begin(false);
+  _run(1000, QUIET, NONE);
+  conv_latency_agent_joined(g_now_us);
+  _run(400, QUIET, NONE);
+  _run(200, QUIET, SPEECH);
+  TEST_CHECK_INT(_hist(CONV_LAT_PRESS_JOIN, true).min_ms, 1000);
+  TEST_CHECK_INT(_hist(CONV_LAT_JOIN_GREETING, true).count, 1);
+  TEST_CHECK_INT(_hist(CONV_LAT_JOIN_GREETING, true).max_ms, 400);
+  conv_latency_session_end();
+}
+
+static void test_turn(void)
+{
+  _begin(true);
+  _run(1000, QUIET, NONE);
+  _run(1000, SPEECH, NONE);
+  _run(700, QUIET, NONE);        // the end of the turn is the last loud frame
+  _run(1000, QUIET, SPEECH);
+
+  conv_hist_t turn = _hist(CONV_LAT_TURN, true);
+  TEST_CHECK_INT(turn.count, 1);
+  TEST_CHECK_INT(turn.min_ms, 700);
+  TEST_CHECK_INT(turn.max_ms, 700);
+
+  // a second turn in the same session
+  _run(1000, QUIET, NONE);
+  _run(2000, SPEECH, NONE);
+  _run(1240, QUIET, NONE);
+  _run(200, QUIET, SPEECH);
+  turn = _hist(CONV_LAT_TURN, true);
+  TEST_CHECK_INT(turn.count, 2);
+  TEST_CHECK_INT(turn.max_ms, 1240);
+  TEST_CHECK_INT(turn.total_ms, 1940);
+  conv_latency_session_end();
+}
+
+static void test_pauses_inside_a_turn(void)
+{
+  // a breath shorter than the hangover does not end the turn
+  _begin(true);
+  _run(1000, QUIET, NONE);
+  _run(600, SPEECH, NONE);
+  _run(CONV_EOS_HANGOVER_MS - FRAME_MS, QUIET, NONE);
+  _run(600, SPEECH, NONE);
+  _run(500, QUIET, NONE);
+  _run(200, QUIET, SPEECH);
+
+  conv_hist_t turn = _hist(CONV_LAT_TURN, true);
+  TEST_CHECK_INT(turn.count, 1);
+  TEST_CHECK_INT(turn.min_ms, 500);
+  conv_latency_session_end();
+}
+
+static void test_clicks_are_not_speech(void)
+{
+  _begin(true);
+  _run(1000, QUIET, NONE);
+  for (int i = 0; i < 5; i++) {
+    _run(CONV_SPEECH_MIN_MS - FRAME_MS, SPEECH, NONE);
+    _run(1000, QUIET, NONE);
+  }
+  _run(200, QUIET, SPEECH);
+  TEST_CHECK_INT(_hist(CONV_LAT_TURN, true).count, 0);
+  conv_latency_session_end();
+}
+
+static void test_echo_is_not_a_turn(void)
+{
+  _begin(true);
+  _run(1000, QUIET, NONE);
+
+  // the agent talks and the speaker leaks into the microphone
+  _run(2000, SPEECH, SPEECH);
+  _run(CONV_ECHO_GUARD_MS - FRAME_MS, SPEECH, NONE);   // the tail of the echo
+  _run(1000, QUIET, NONE);
+  _run(200, QUIET, SPEECH);
+  TEST_CHECK_INT(_hist(CONV_LAT_TURN, true).count, 0);
+
+  // quiet agent frames are not agent speech and open no guard
+  _run(1000, QUIET, NONE);
+  _run(600, SPEECH, CONV_AGENT_MIN_LEVEL - 1);
+  _run(800, QUIET, NONE);
+  _run(200, QUIET, SPEECH);
+  conv_hist_t turn = _hist(CONV_LAT_TURN, true);
+  TEST_CHECK_INT(turn.count, 1);
+  TEST_CHECK_INT(turn.min_ms, 800);
+  conv_latency_session_end();
+}
+
+static void test_noise_floor(void)
+{
+  // steady noise above the minimum level is the floor, not speech
+  _begin(true);
+  _run(5000, LOUD_NOISE, NONE);
+  _run(500, LOUD_NOISE, SPEECH);
+  TEST_CHECK_INT(_hist(CONV_LAT_TURN, true).count, 0);
+
+  // speech well above it is still found
+  _run(1000, LOUD_NOISE, NONE);
+  _run(1000, 4 * LOUD_NOISE, NONE);
+  _run(600, LOUD_NOISE, NONE);
+  _run(200, LOUD_NOISE, SPEECH);
+  conv_hist_t turn = _hist(CONV_LAT_TURN, true);
+  TEST_CHECK_INT(turn.count, 1);
+  TEST_CHECK_INT(turn.min_ms, 600);
+  conv_latency_session_end();
+}
+
+static void test_unanswered(void)
+{
+  conv_hist_t before = _hist(CONV_LAT_TURN, false);
+
+  // a reply after the timeout is not a turn latency
+  _begin(true);
+  _run(1000, QUIET, NONE);
+  _run(1000, SPEECH, NONE);
+  _run(CONV_REPLY_TIMEOUT_MS + 500, QUIET, NONE);
+  _run(200, QUIET, SPEECH);
+
+  // nor is a turn still open at the end
+  _run(1000, QUIET, NONE);
+  _run(1000, SPEECH, NONE);
+  _run(1000, QUIET, NONE);
+  conv_latency_session_end();
+
+  TEST_CHECK_INT(_hist(CONV_LAT_TURN, true).count, 0);
+  TEST_CHECK_INT(_hist(CONV_LAT_TURN, false).count, before.count);
+}
+
+static void test_histograms(void)
+{
+  // the first is quicker than the hangover
+  static const int replies_ms[] = { 160, 460, 6000 };
+  conv_hist_t before = _hist(CONV_LAT_TURN, false);
+
+  _begin(true);
+  for (int i = 0; i < 3; i++) {
+    _run(1000, QUIET, NONE);
+    _run(1000, SPEECH, NONE);
+    _run(replies_ms[i], QUIET, NONE);
+    _run(1000, QUIET, SPEECH);
+  }
+
+  // (100, 200], (400, 500] and the open last bin
+  conv_hist_t turn = _hist(CONV_LAT_TURN, true);
+  TEST_CHECK_INT(turn.count, 3);
+  TEST_CHECK_INT(turn.bins[1], 1);
+  TEST_CHECK_INT(turn.bins[4], 1);
+  TEST_CHECK_INT(turn.bins[CONV_HIST_BINS - 1], 1);
+  TEST_CHECK_INT(turn.min_ms, 160);
+  TEST_CHECK_INT(turn.max_ms, 6000);
+  TEST_CHECK_INT(conv_latency_bin_edge(CONV_HIST_BINS - 1), UINT32_MAX);
+  TEST_CHECK_INT(conv_latency_bin_edge(CONV_HIST_BINS), 0);
+  conv_latency_session_end();
+
+  // the session histogram starts over, the total keeps counting
+  _begin(true);
+  TEST_CHECK_INT(_hist(CONV_LAT_TURN, true).count, 0);
+  TEST_CHECK_INT(_hist(CONV_LAT_TURN, false).count, before.count + 3);
+  conv_latency_session_end();
+}
+
+int main(void)
+{
+  TEST_RUN(test_press_join_greeting);
+  TEST_RUN(test_warm_standby);
+  TEST_RUN(test_turn);
+  TEST_RUN(test_pauses_inside_a_turn);
+  TEST_RUN(test_clicks_are_not_speech);
+  TEST_RUN(test_echo_is_not_a_turn);
+  TEST_RUN(test_noise_floor);
+  TEST_RUN(test_unanswered);
+  TEST_RUN(test_histograms);
+  TEST_EXIT();
+}
@@ -0,0 +1,385 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "host_stub.h"
+#include "host_test.h"
+#include "i2c_mgr.h"
+
+/* The scheduler as a pure function, recovery and the stuck check against a
+ * simulated bus with a slave that holds SDA, then the dispatcher serving
+ * clients on a simulated device with CONFIG_I2C_MGR_AGE_LIMIT_MS at 50 ms. */
+
+#define SDA_GPIO    (21)
+#define SCL_GPIO    (22)
+#define ADDR_BLOCK  (0x10)   // the device answers it only when released
+#define ADDR_FAIL   (0x50)   // the device times out on it
+
+/* ---- the bus ---- */
+
+typedef struct {
+  int scl;          // what the master drives, 1 is released
+  int sda;
+  int held_bits;    // SDA stays low for that many more clocks, < 0 forever
+  bool stretch;     // the slave holds SCL low
+  bool busy;        // another master is clocking
+  int busy_phase;
+  int clocks;       // SCL falling edges while the slave held SDA
+  int stops;
+} bus_t;
+
+static int _line_scl(bus_t *bus)
+{
+  if (bus->busy) {
+    bus->busy_phase ^= 1;
+    return bus->busy_phase;
+  }
+  return bus->scl && !bus->stretch;
+}
+
+static int _line_sda(bus_t *bus)
+{
+  return bus->sda && bus->held_bits == 0;
+}
+
+static void _set_scl(void *ctx, int level)
+{
+  bus_t *bus = ctx;
+  // the slave shifts out its next bit after a falling edge
+  if (bus->scl && !level && bus->held_bits != 0) {
+    bus->clocks++;
+    if (bus->held_bits > 0) {
+      bus->held_bits--;
+    }
+  }
+  bus->scl = level;
+}
+
+static void _set_sda(void *ctx, int level)
+{
+  bus_t *bus = ctx;
+  if (!bus->sda && level && bus->held_bits == 0 && bus->scl && !bus->stretch) {
+    bus->stops++;
+  }
+  bus->sda = level;
+}
+
+static int _get_sda(void *ctx)
+{
+  return _line_sda(ctx);
+}
+
+static int _get_scl(void *ctx)
+{
+  return _line_scl(ctx);
+}
+
+static void _delay(void *ctx)
+{
+}
+
+static i2c_recover_io_t _io(bus_t *bus)
+{
+  return (i2c_recover_io_t){
+    .set_scl          = _set_scl,
+    .set_sda          = _set_sda,
+    .get_sda          = _get_sda,
+    .get_scl          = _get_scl,
+    .delay_half_clock = _delay,
+    .ctx              = bus,
+  };
+}
+
+/* ---- the scheduler ---- */
+
+static void test_pick_empty(void)
+{
+  const int64_t heads[I2C_PRIO_COUNT] = { 0 };
+  TEST_CHECK_INT(i2c_sched_pick(heads, 1000000, 200000), -1);
+}
+
+static void test_pick_most_urgent(void)
+{
+  int64_t heads[I2C_PRIO_COUNT] = { 0 };
+
+  heads[I2C_PRIO_POLL] = 1000;
+  TEST_CHECK_INT(i2c_sched_pick(heads, 2000, 200000), I2C_PRIO_POLL);
+
+  // a newer request of a more urgent class goes first
+  heads[I2C_PRIO_CONTROL] = 1500;
+  TEST_CHECK_INT(i2c_sched_pick(heads, 2000, 200000), I2C_PRIO_CONTROL);
+  heads[I2C_PRIO_CODEC] = 1900;
+  TEST_CHECK_INT(i2c_sched_pick(heads, 2000, 200000), I2C_PRIO_CODEC);
+}
+
+static void test_pick_starved(void)
+{
+  int64_t heads[I2C_PRIO_COUNT] = { 0 };
+  const int64_t limit = 200000;
+
+  heads[I2C_PRIO_CODEC] = 1000000;
+  heads[I2C_PRIO_POLL]  = 1000;
+
+  // the age limit is exclusive
+  TEST_CHECK_INT(i2c_sched_pick(heads, 1000 + limit, limit), I2C_PRIO_CODEC);
+  TEST_CHECK_INT(i2c_sched_pick(heads, 1000 + limit + 1, limit), I2C_PRIO_POLL);
+
+  // of several starved classes the one waiting longest, whatever its class
+  heads[I2C_PRIO_CONTROL] = 2000;
+  TEST_CHECK_INT(i2c_sched_pick(heads, 1000000, limit), I2C_PRIO_POLL);
+  heads[I2C_PRIO_CONTROL] = 500;
+  TEST_CHECK_INT(i2c_sched_pick(heads, 1000000, limit), I2C_PRIO_CONTROL);
+
+  // equally old: the more urgent class
+  heads[I2C_PRIO_CODEC] = 500;
+  TEST_CHECK_INT(i2c_sched_pick(heads, 1000000, limit), I2C_PRIO_CODEC);
+}
+
+/* ---- recovery ---- */
+
+static void test_recover_idle_bus(void)
+{
+  bus_t bus = { .scl = 1, .sda = 1 };
+  i2c_recover_io_t io = _io(&bus);
+
+  TEST_CHECK(i2c_bus_recover(&io));
+  TEST_CHECK_INT(bus.clocks, 0);
+  TEST_CHECK_INT(bus.stops, 1);
+}
+
+static void test_recover_releases_sda(void)
+{
+  for (int held = 1; held <= 9; held++) {
+    bus_t bus = { .scl = 1, .sda = 1, .held_bits = held };
+    i2c_recover_io_t io = _io(&bus);
+
+    TEST_CHECK(i2c_bus_recover(&io));
+    TEST_CHECK_INT(bus.clocks, held);   // no more clocks than it took
+    TEST_CHECK_INT(bus.stops, 1);
+    TEST_CHECK(bus.scl && bus.sda);     // both lines are left released
+  }
+}
+
+static void test_recover_gives_up(void)
+{
+  bus_t bus = { .scl = 1, .sda = 1, .held_bits = 11 };
+  i2c_recover_io_t io = _io(&bus);
+
+  // nine clocks and the low phase before the STOP, which frees a tenth bit
+  TEST_CHECK(!i2c_bus_recover(&io));
+  TEST_CHECK_INT(bus.clocks, 10);
+  TEST_CHECK_INT(bus.held_bits, 1);
+
+  bus = (bus_t){ .scl = 1, .sda = 1, .held_bits = -1 };
+  TEST_CHECK(!i2c_bus_recover(&io));
+  TEST_CHECK_INT(bus.clocks, 10);
+  TEST_CHECK_INT(bus.stops, 0);
+}
+
+static void test_stuck(void)
+{
+  bus_t bus = { .scl = 1, .sda = 1 };
+  i2c_recover_io_t io = _io(&bus);
+
+  TEST_CHECK(!i2c_bus_stuck(&io, 20));
+
+  bus.held_bits = -1;
+  TEST_CHECK(i2c_bus_stuck(&io, 20));
+
+  // a transfer in progress toggles SCL, SDA low is a data bit
+  bus.busy = true;
+  TEST_CHECK(!i2c_bus_stuck(&io, 20));
+  bus.busy = false;
+
+  // a slave stretching the clock is busy, not stuck
+  bus.stretch = true;
+  TEST_CHECK(!i2c_bus_stuck(&io, 20));
+}
+
+/* ---- the dispatcher ---- */
+
+static bus_t g_bus = { .scl = 1, .sda = 1 };
+static SemaphoreHandle_t g_release = NULL;
+static SemaphoreHandle_t g_done = NULL;
+static volatile bool g_blocked = false;
+static uint8_t g_served[16];
+static volatile int g_served_count = 0;
+
+static int _gpio_get(int pin, void *ctx)
+{
+  return pin == SDA_GPIO ? _line_sda(&g_bus) : _line_scl(&g_bus);
+}
+
+static void _gpio_set(int pin, int level, void *ctx)
+{
+  if (pin == SDA_GPIO) {
+    _set_sda(&g_bus, level);
+  } else {
+    _set_scl(&g_bus, level);
+  }
+}
+
+static esp_err_t _device(uint8_t addr, const uint8_t *wr, size_t wr_len, uint8_t *rd, size_t rd_len, void *ctx)
+{
+  if (addr == ADDR_BLOCK) {
+    g_blocked = true;
+    xSemaphoreTake(g_release, portMAX_DELAY);
+    g_blocked = false;
+  }
+  if (g_served_count < (int)sizeof(g_served)) {
+    g_served[g_served_count] = addr;
+  }
+  g_served_count++;
+  return addr == ADDR_FAIL ? ESP_ERR_TIMEOUT : ESP_OK;
+}
+
+typedef struct {
+  uint8_t addr;
+  i2c_prio_t prio;
+} client_t;
+
+static void _client(void *arg)
+{
+  const client_t *client = arg;
+  uint8_t byte = 0;
+  i2c_mgr_write(client->addr, client->prio, &byte, 1, 100);
+  xSemaphoreGive(g_done);
+  vTaskDelete(NULL);
+}
+
+static void _submit(const client_t *client)
+{
+  xTaskCreate(_client, "client", 2048, (void *)client, 5, NULL);
+  vTaskDelay(pdMS_TO_TICKS(5));   // enqueued in this order
+}
+
+static void _wait_clients(int count)
+{
+  for (int i = 0; i < count; i++) {
+    TEST_CHECK(xSemaphoreTake(g_done, pdMS_TO_TICKS(1000)) == pdTRUE);
+  }
+}
+
+static void _block_bus(const client_t *blocker)
+{
+  g_served_count = 0;
+  _submit(blocker);
+  for (int waited = 0; !g_blocked && waited < 1000; waited++) {
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+  TEST_CHECK(g_blocked);
+}
+
+static void test_before_init_runs_directly(void)
+{
+  const uint8_t byte = 0;
+
+  g_served_count = 0;
+  TEST_CHECK_INT(i2c_mgr_write(0x20, I2C_PRIO_POLL, &byte, 1, 100), ESP_OK);
+  TEST_CHECK_INT(g_served_count, 1);
+  TEST_CHECK_INT(i2c_mgr_transfer(0x20, I2C_PRIO_COUNT, NULL, 0, 100), ESP_ERR_INVALID_ARG);
+}
+
+static void test_dispatch_order(void)
+{
+  static const client_t blocker = { ADDR_BLOCK, I2C_PRIO_POLL };
+  static const client_t clients[] = {
+    { 0x21, I2C_PRIO_POLL },
+    { 0x22, I2C_PRIO_POLL },
+    { 0x31, I2C_PRIO_CONTROL },
+    { 0x41, I2C_PRIO_CODEC },
+  };
+  static const uint8_t expected[] = { ADDR_BLOCK, 0x41, 0x31, 0x21, 0x22 };
+
+  _block_bus(&blocker);
+  for (int i = 0; i < 4; i++) {
+    _submit(&clients[i]);
+  }
+  xSemaphoreGive(g_release);
+  _wait_clients(5);
+
+  TEST_CHECK_INT(g_served_count, 5);
+  for (int i = 0; i < 5; i++) {
+    TEST_CHECK_INT(g_served[i], expected[i]);
+  }
+}
+
+static void test_dispatch_starved_poll(void)
+{
+  static const client_t blocker = { ADDR_BLOCK, I2C_PRIO_POLL };
+  static const client_t poll    = { 0x21, I2C_PRIO_POLL };
+  static const client_t codec   = { 0x41, I2C_PRIO_CODEC };
+
+  _block_bus(&blocker);
+  _submit(&poll);
+  vTaskDelay(pdMS_TO_TICKS(80));   // past the age limit
+  _submit(&codec);
+  xSemaphoreGive(g_release);
+  _wait_clients(3);
+
+  TEST_CHECK_INT(g_served_count, 3);
+  TEST_CHECK_INT(g_served[1], 0x21);
+  TEST_CHECK_INT(g_served[2], 0x41);
+}
+
+static void test_failure_recovers_stuck_bus_only(void)
+{
+  const uint8_t byte = 0;
+  i2c_mgr_dev_stats_t stats[I2C_MGR_MAX_DEVICES];
+
+  // a timeout on an idle bus leaves the pins alone
+  g_bus = (bus_t){ .scl = 1, .sda = 1 };
+  TEST_CHECK_INT(i2c_mgr_write(ADDR_FAIL, I2C_PRIO_CONTROL, &byte, 1, 100), ESP_ERR_TIMEOUT);
+  TEST_CHECK_INT(g_bus.stops, 0);
+
+  // a slave holding SDA is clocked free
+  g_bus.held_bits = 4;
+  TEST_CHECK_INT(i2c_mgr_write(ADDR_FAIL, I2C_PRIO_CONTROL, &byte, 1, 100), ESP_ERR_TIMEOUT);
+  TEST_CHECK_INT(g_bus.clocks, 4);
+  TEST_CHECK_INT(g_bus.stops, 1);
+  TEST_CHECK_INT(_line_sda(&g_bus), 1);
+
+  // but not again within a second
+  g_bus = (bus_t){ .scl = 1, .sda = 1, .held_bits = 4 };
+  TEST_CHECK_INT(i2c_mgr_write(ADDR_FAIL, I2C_PRIO_CONTROL, &byte, 1, 100), ESP_ERR_TIMEOUT);
+  TEST_CHECK_INT(g_bus.clocks, 0);
+  g_bus = (bus_t){ .scl = 1, .sda = 1 };
+
+  int n = i2c_mgr_get_stats(stats, I2C_MGR_MAX_DEVICES);
+  TEST_CHECK_INT(n, 2);
+  TEST_CHECK_INT(stats[1].addr, ADDR_FAIL);
+  TEST_CHECK_INT(stats[1].timeouts, 3);
+  TEST_CHECK_INT(stats[1].ok, 0);
+  TEST_CHECK_INT(stats[0].addr, 0x41);
+  TEST_CHECK_INT(stats[0].ok, 2);
+  TEST_CHECK_INT(stats[0].errors + stats[0].timeouts, 0);
+}
+
+int main(void)
+{
+  g_release = xSemaphoreCreateBinary();
+  g_done    = xSemaphoreCreateCounting(16, 0);
+  host_i2c_attach(_device, NULL);
+  host_gpio_attach(_gpio_get, _gpio_set, NULL);
+
+  TEST_RUN(test_pick_empty);
+  TEST_RUN(test_pick_most_urgent);
+  TEST_RUN(test_pick_starved);
+  TEST_RUN(test_recover_idle_bus);
+  TEST_RUN(test_recover_releases_sda);
+  TEST_RUN(test_recover_gives_up);
+  TEST_RUN(test_stuck);
+  TEST_RUN(test_before_init_runs_directly);
+
+  i2c_mgr_add_device(0x41, "codec");
+  i2c_mgr_add_device(ADDR_FAIL, "xvf");
+  TEST_CHECK_INT(i2c_mgr_init(I2C_NUM_0, SDA_GPIO, SCL_GPIO), ESP_OK);
+
+  TEST_RUN(test_dispatch_order);
+  TEST_RUN(test_dispatch_starved_poll);
+  TEST_RUN(test_failure_recovers_stuck_bus_only);
+  TEST_EXIT();
+}
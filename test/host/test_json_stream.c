@@ -0,0 +1,254 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_test.h"
+#include "json_stream.h"
+
+/* The events are logged as text so whole documents can be compared. Every
+ * document is also fed split at every byte and one byte at a time, as
+ * HTTP_EVENT_ON_DATA may cut it anywhere, and must give the same log. */
+
+#define LOG_MAX  (4096)
+
+#define BENCH_AGENTS  (1000)
+#define BENCH_CHUNK   (512)    // a typical HTTP_EVENT_ON_DATA piece
+#define BENCH_PASSES  (20)
+
+typedef struct {
+  char text[LOG_MAX];
+  size_t len;
+} event_log_t;
+
+static const char g_event_names[] = "SNTFZ{}";
+
+static void _record(void *ctx, const char *path, json_stream_event_t event, const char *value)
+{
+  event_log_t *log = ctx;
+  int n = snprintf(log->text + log->len, LOG_MAX - log->len, "%s %c %s|", path, g_event_names[event], value);
+  if (n > 0 && log->len + (size_t)n < LOG_MAX) {
+    log->len += (size_t)n;
+  }
+}
+
+/* feed doc in pieces of at most chunk bytes, after a first piece of split bytes */
+static int _parse(const char *doc, size_t split, size_t chunk, event_log_t *log)
+{
+  json_stream_t js;
+  size_t len = strlen(doc);
+
+  memset(log, 0, sizeof(*log));
+  json_stream_init(&js, _record, log);
+  if (json_stream_feed(&js, doc, split) != 0) {
+    return -1;
+  }
+  for (size_t off = split; off < len; off += chunk) {
+    size_t n = len - off < chunk ? len - off : chunk;
+    if (json_stream_feed(&js, doc + off, n) != 0) {
+      return -1;
+    }
+  }
+  return json_stream_finish(&js);
+}
+
+/* the log of doc, checked to be the same however the input is cut */
+static void _check_doc(const char *doc, const char *expected)
+{
+  event_log_t whole, piece;
+  size_t len = strlen(doc);
+
+  TEST_CHECK_INT(_parse(doc, len, 1, &whole), 0);
+  TEST_CHECK_STR(whole.text, expected);
+
+  for (size_t split = 0; split <= len; split++) {
+    TEST_CHECK_INT(_parse(doc, split, len, &piece), 0);
+    TEST_CHECK_STR(piece.text, whole.text);
+  }
+  TEST_CHECK_INT(_parse(doc, 0, 1, &piece), 0);
+  TEST_CHECK_STR(piece.text, whole.text);
+}
+
+static int _parse_whole(const char *doc)
+{
+  event_log_t log;
+  return _parse(doc, strlen(doc), 1, &log);
+}
+
+static void test_agent_list(void)
+{
+  // a reply to the agents query, the fields in either order
+  _check_doc("{\"code\": 0, \"data\": {\"count\": 2, \"list\": ["
+             "{\"agent_id\": \"A1\", \"name\": \"other\", \"status\": \"RUNNING\"},\n"
+             "{\"name\": \"mine\", \"agent_id\": \"A2\", \"start_ts\": 1712345678}"
+             "]}, \"message\": \"ok\"}",
+             " { |code N 0|data { |data.count N 2|"
+             "data.list[] { |data.list[].agent_id S A1|data.list[].name S other|"
+             "data.list[].status S RUNNING|data.list[] } |"
+             "data.list[] { |data.list[].name S mine|data.list[].agent_id S A2|"
+             "data.list[].start_ts N 1712345678|data.list[] } |"
+             "data } |message S ok| } |");
+}
+
+static void test_conflict_reply(void)
+{
+  _check_doc("{\"detail\":\"task conflict\",\"reason\":\"TaskConflict\"}",
+             " { |detail S task conflict|reason S TaskConflict| } |");
+}
+
+static void test_scalars(void)
+{
+  _check_doc("[true,false,null,-1.5e+3,0,\"\"]",
+             "[] T true|[] F false|[] Z null|[] N -1.5e+3|[] N 0|[] S |");
+  _check_doc("[[],{},[[1]]]", "[] { |[] } |[][][] N 1|");
+  _check_doc("42", " N 42|");
+  _check_doc("  \"root\"  ", " S root|");
+}
+
+static void test_escapes(void)
+{
+  // \u escapes become UTF-8, surrogates a placeholder
+  _check_doc("[\"a\\\"b\\\\c\\/d\\n\\t\", \"\\u0041\\u00e9\\u20AC\", \"\\ud83d\"]",
+             "[] S a\"b\\c/d\n\t|[] S A\xc3\xa9\xe2\x82\xac|[] S ?|");
+}
+
+static void test_truncation(void)
+{
+  char doc[JSON_STREAM_MAX_TOKEN * 2];
+  event_log_t log;
+  json_stream_t js;
+
+  memset(doc, 'x', sizeof(doc));
+  doc[0] = '"';
+  doc[sizeof(doc) - 2] = '"';
+  doc[sizeof(doc) - 1] = '\0';
+
+  // a long value is cut to the token size and flagged, parsing goes on
+  memset(&log, 0, sizeof(log));
+  json_stream_init(&js, _record, &log);
+  TEST_CHECK_INT(json_stream_feed(&js, doc, strlen(doc)), 0);
+  TEST_CHECK_INT(json_stream_finish(&js), 0);
+  TEST_CHECK(js.truncated);
+  TEST_CHECK_INT((int)log.len, 3 + (JSON_STREAM_MAX_TOKEN - 1) + 1);
+}
+
+static void test_invalid(void)
+{
+  static const char *const bad[] = {
+    "",
+    "{",
+    "{\"a\"}",
+    "{\"a\":1,}",
+    "{\"a\" 1}",
+    "[1 2]",
+    "[1}",
+    "{\"a\":1]",
+    "}",
+    "nope",
+    "[\"\\u00g0\"]",
+    "{} {}",
+    "{}x",
+    "{\"a\":tru}",
+    "[[[[[[[[[1]]]]]]]]]",   // one level too deep
+  };
+
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    if (_parse_whole(bad[i]) != -1) {
+      printf("accepted: %s\n", bad[i]);
+      g_test_failures++;
+    }
+  }
+
+  // the deepest nesting allowed
+  TEST_CHECK_INT(_parse_whole("[[[[[[[[1]]]]]]]]"), 0);
+}
+
+static void test_error_is_sticky(void)
+{
+  json_stream_t js;
+  event_log_t log = { 0 };
+
+  json_stream_init(&js, _record, &log);
+  TEST_CHECK_INT(json_stream_feed(&js, "{\"a\":}", 6), -1);
+  TEST_CHECK_INT(json_stream_feed(&js, "{\"b\":1}", 7), -1);
+  TEST_CHECK_INT(json_stream_finish(&js), -1);
+  TEST_CHECK_STR(log.text, " { |");
+}
+
+typedef struct {
+  int events;
+  int entries;
+  bool name_matches;
+  char found[32];
+} list_scan_t;
+
+/* roughly what ai_agent does with an agents list: find the entry with our
+ * name, here always listed before its agent_id */
+static void _scan(void *ctx, const char *path, json_stream_event_t event, const char *value)
+{
+  list_scan_t *scan = ctx;
+  scan->events++;
+  if (strcmp(path, "data.list[]") == 0 && event == JSON_STREAM_OBJECT_END) {
+    scan->entries++;
+  } else if (strcmp(path, "data.list[].name") == 0) {
+    scan->name_matches = strcmp(value, "esp32_agent_123456") == 0;
+  } else if (strcmp(path, "data.list[].agent_id") == 0 && scan->name_matches) {
+    snprintf(scan->found, sizeof(scan->found), "%s", value);
+  }
+}
+
+static void test_bench_large_list(void)
+{
+  size_t cap = BENCH_AGENTS * 256 + 256;
+  char *doc = malloc(cap);
+  TEST_CHECK(doc != NULL);
+  if (!doc) {
+    return;
+  }
+
+  // a full page of running agents, ours the last
+  size_t len = (size_t)snprintf(doc, cap, "{\"data\":{\"count\":%d,\"list\":[", BENCH_AGENTS);
+  for (int i = 0; i < BENCH_AGENTS; i++) {
+    len += (size_t)snprintf(doc + len, cap - len,
+                            "%s{\"name\":\"%s\",\"agent_id\":\"1NT%08dxyzabcdefghij\",\"start_ts\":17123456%02d,"
+                            "\"status\":\"RUNNING\",\"channel\":\"convo_ai_channel_%d\"}",
+                            i ? "," : "", i == BENCH_AGENTS - 1 ? "esp32_agent_123456" : "esp32_agent_other", i,
+                            i % 100, i);
+  }
+  len += (size_t)snprintf(doc + len, cap - len, "]},\"meta\":{\"cursor\":\"\",\"total\":%d}}", BENCH_AGENTS);
+
+  list_scan_t scan;
+  int64_t start = esp_timer_get_time();
+  for (int pass = 0; pass < BENCH_PASSES; pass++) {
+    json_stream_t js;
+    memset(&scan, 0, sizeof(scan));
+    json_stream_init(&js, _scan, &scan);
+    for (size_t off = 0; off < len; off += BENCH_CHUNK) {
+      TEST_CHECK_INT(json_stream_feed(&js, doc + off, len - off < BENCH_CHUNK ? len - off : BENCH_CHUNK), 0);
+    }
+    TEST_CHECK_INT(json_stream_finish(&js), 0);
+  }
+  int64_t elapsed_us = esp_timer_get_time() - start;
+  double mb_per_s = (double)len * BENCH_PASSES / (elapsed_us > 0 ? elapsed_us : 1);
+
+  printf("json_stream: %zu byte list of %d agents in %d byte pieces, %d events, %.1f MB/s, %zu bytes of parser state\n",
+         len, BENCH_AGENTS, BENCH_CHUNK, scan.events, mb_per_s, sizeof(json_stream_t));
+  TEST_CHECK_INT(scan.entries, BENCH_AGENTS);
+  TEST_CHECK_STR(scan.found, "1NT00000999xyzabcdefghij");
+  TEST_CHECK(mb_per_s > 1.0);
+  free(doc);
+}
+
+int main(void)
+{
+  TEST_RUN(test_agent_list);
+  TEST_RUN(test_conflict_reply);
+  TEST_RUN(test_scalars);
+  TEST_RUN(test_escapes);
+  TEST_RUN(test_truncation);
+  TEST_RUN(test_invalid);
+  TEST_RUN(test_error_is_sticky);
+  TEST_RUN(test_bench_large_list);
+  TEST_EXIT();
+}
@@ -0,0 +1,201 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_test.h"
+#include "json_writer.h"
+
+/* Every document is rendered twice, measuring with a NULL buffer and for
+ * real, and the two lengths must agree: ai_agent sizes the join body that
+ * way. Buffers one byte short have to fail without writing past the end. */
+
+#define CANARY  ('#')
+#define BENCH_RENDERS  (200000)
+
+/* a body shaped like the agent join request */
+static void _join_body(json_writer_t *w, const char *channel, long uid)
+{
+  json_writer_begin_object(w, NULL);
+  json_writer_string(w, "name", channel);
+  json_writer_begin_object(w, "properties");
+  json_writer_string(w, "channel", channel);
+  json_writer_int(w, "agent_rtc_uid", 0);
+  json_writer_begin_array(w, "remote_rtc_uids");
+  json_writer_int(w, NULL, uid);
+  json_writer_end_array(w);
+  json_writer_int(w, "idle_timeout", 120);
+  json_writer_begin_object(w, "llm");
+  json_writer_string(w, "system_messages", "You are \"Luna\".\nBe brief.\t\x01");
+  json_writer_bool(w, "greeting", true);
+  json_writer_bool(w, "vision", false);
+  json_writer_end_object(w);
+  json_writer_end_object(w);
+  json_writer_end_object(w);
+}
+
+static const char g_expected[] =
+  "{\"name\":\"room 42\",\"properties\":{\"channel\":\"room 42\",\"agent_rtc_uid\":0,"
+  "\"remote_rtc_uids\":[-12345],\"idle_timeout\":120,\"llm\":{\"system_messages\":"
+  "\"You are \\\"Luna\\\".\\nBe brief.\\t\\u0001\",\"greeting\":true,\"vision\":false}}}";
+
+static int _measure(void)
+{
+  json_writer_t w;
+  json_writer_init(&w, NULL, 0);
+  _join_body(&w, "room 42", -12345);
+  return json_writer_finish(&w);
+}
+
+static void test_render(void)
+{
+  char buf[512];
+  json_writer_t w;
+
+  json_writer_init(&w, buf, sizeof(buf));
+  _join_body(&w, "room 42", -12345);
+  TEST_CHECK_INT(json_writer_finish(&w), (int)strlen(g_expected));
+  TEST_CHECK_STR(buf, g_expected);
+}
+
+static void test_measure_matches_render(void)
+{
+  TEST_CHECK_INT(_measure(), (int)strlen(g_expected));
+}
+
+static void test_exact_fit(void)
+{
+  int len = _measure();
+  char buf[512];
+  json_writer_t w;
+
+  // the measured length plus the NUL is enough
+  memset(buf, CANARY, sizeof(buf));
+  json_writer_init(&w, buf, (size_t)len + 1);
+  _join_body(&w, "room 42", -12345);
+  TEST_CHECK_INT(json_writer_finish(&w), len);
+  TEST_CHECK_STR(buf, g_expected);
+  TEST_CHECK_INT(buf[len + 1], CANARY);
+
+  // one byte less is an error, with an empty string and nothing written past it
+  memset(buf, CANARY, sizeof(buf));
+  json_writer_init(&w, buf, (size_t)len);
+  _join_body(&w, "room 42", -12345);
+  TEST_CHECK_INT(json_writer_finish(&w), -1);
+  TEST_CHECK_STR(buf, "");
+  TEST_CHECK_INT(buf[len], CANARY);
+}
+
+static void test_every_short_buffer(void)
+{
+  int len = _measure();
+  char buf[512];
+
+  for (int cap = 1; cap <= len; cap++) {
+    json_writer_t w;
+    memset(buf, CANARY, sizeof(buf));
+    json_writer_init(&w, buf, (size_t)cap);
+    _join_body(&w, "room 42", -12345);
+    TEST_CHECK_INT(json_writer_finish(&w), -1);
+    TEST_CHECK_INT(buf[cap], CANARY);
+  }
+}
+
+static void test_values(void)
+{
+  char buf[128];
+  json_writer_t w;
+
+  json_writer_init(&w, buf, sizeof(buf));
+  json_writer_begin_array(&w, NULL);
+  json_writer_int(&w, NULL, 2147483647L);
+  json_writer_int(&w, NULL, -2147483647L - 1);
+  json_writer_string(&w, NULL, NULL);
+  json_writer_string(&w, NULL, "\\/\b\f\r\x1f");
+  json_writer_begin_object(&w, NULL);
+  json_writer_end_object(&w);
+  json_writer_begin_object(&w, NULL);
+  json_writer_begin_array(&w, "a\"b");
+  json_writer_end_array(&w);
+  json_writer_end_object(&w);
+  json_writer_end_array(&w);
+  TEST_CHECK(json_writer_finish(&w) > 0);
+  TEST_CHECK_STR(buf, "[2147483647,-2147483648,\"\",\"\\\\/\\b\\f\\r\\u001f\",{},{\"a\\\"b\":[]}]");
+}
+
+static void test_structure_errors(void)
+{
+  char buf[128];
+  json_writer_t w;
+
+  // unbalanced
+  json_writer_init(&w, buf, sizeof(buf));
+  json_writer_begin_object(&w, NULL);
+  TEST_CHECK_INT(json_writer_finish(&w), -1);
+
+  json_writer_init(&w, buf, sizeof(buf));
+  json_writer_end_object(&w);
+  TEST_CHECK_INT(json_writer_finish(&w), -1);
+
+  // too deep, in both modes
+  for (int measuring = 0; measuring < 2; measuring++) {
+    json_writer_init(&w, measuring ? NULL : buf, sizeof(buf));
+    for (int i = 0; i <= JSON_WRITER_MAX_DEPTH; i++) {
+      json_writer_begin_array(&w, NULL);
+    }
+    for (int i = 0; i <= JSON_WRITER_MAX_DEPTH; i++) {
+      json_writer_end_array(&w);
+    }
+    TEST_CHECK_INT(json_writer_finish(&w), -1);
+  }
+
+  // exactly the maximum depth is fine
+  json_writer_init(&w, buf, sizeof(buf));
+  for (int i = 0; i < JSON_WRITER_MAX_DEPTH; i++) {
+    json_writer_begin_array(&w, NULL);
+  }
+  for (int i = 0; i < JSON_WRITER_MAX_DEPTH; i++) {
+    json_writer_end_array(&w);
+  }
+  TEST_CHECK_INT(json_writer_finish(&w), 2 * JSON_WRITER_MAX_DEPTH);
+
+  // a zero sized buffer cannot even hold the NUL
+  json_writer_init(&w, buf, 0);
+  TEST_CHECK_INT(json_writer_finish(&w), -1);
+}
+
+/* the join body the way ai_agent renders it, a measuring pass and the
+ * real one into a buffer of the measured size, timed */
+static void test_bench(void)
+{
+  char buf[512];
+  json_writer_t w;
+  int len = 0;
+
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < BENCH_RENDERS; i++) {
+    len = _measure();
+    json_writer_init(&w, buf, len + 1);
+    _join_body(&w, "room 42", -12345);
+    TEST_CHECK_INT(json_writer_finish(&w), len);
+  }
+  int64_t elapsed_us = esp_timer_get_time() - start;
+
+  // the writer keeps no state outside json_writer_t: the buffer is the only memory
+  printf("json_writer join body: %d bytes, %zu bytes of writer state, 0 allocations, %.0f ns/render\n", len,
+         sizeof(json_writer_t), elapsed_us * 1000.0 / BENCH_RENDERS);
+  TEST_CHECK_INT(len, (int)strlen(g_expected));
+  TEST_CHECK(elapsed_us * 1000 / BENCH_RENDERS < 100 * 1000);
+}
+
+int main(void)
+{
+  TEST_RUN(test_render);
+  TEST_RUN(test_measure_matches_render);
+  TEST_RUN(test_exact_fit);
+  TEST_RUN(test_every_short_buffer);
+  TEST_RUN(test_values);
+  TEST_RUN(test_structure_errors);
+  TEST_RUN(test_bench);
+  TEST_EXIT();
+}
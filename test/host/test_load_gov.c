@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "host_test.h"
+#include "load_gov.h"
+
+/* The ladder as a pure function of the samples, then the governor on its
+ * timer with CONFIG_LOAD_GOV_PERIOD_MS at 20 ms. On the host the run-time
+ * stats are empty, so only deadline misses drive it there. */
+
+static const load_policy_cfg_t g_cfg = {
+  .cpu_high_pct    = 85,
+  .cpu_low_pct     = 60,
+  .degrade_samples = 2,
+  .restore_samples = 10,
+  .miss_burst      = 3,
+};
+
+static load_level_t _feed(load_policy_t *policy, uint8_t cpu, uint32_t misses, int times)
+{
+  load_sample_t in = { .cpu_pct = cpu, .deadline_misses = misses };
+  load_level_t level = policy->level;
+  for (int i = 0; i < times; i++) {
+    level = load_policy_step(&g_cfg, policy, &in);
+  }
+  return level;
+}
+
+static void test_degrade_needs_consecutive_samples(void)
+{
+  load_policy_t policy = { 0 };
+
+  TEST_CHECK_INT(_feed(&policy, 90, 0, 1), LOAD_LEVEL_FULL);
+  TEST_CHECK_INT(_feed(&policy, 70, 0, 1), LOAD_LEVEL_FULL);   // the streak is broken
+  TEST_CHECK_INT(_feed(&policy, 90, 0, 1), LOAD_LEVEL_FULL);
+  TEST_CHECK_INT(_feed(&policy, 90, 0, 1), LOAD_LEVEL_VIDEO_LOW_RES);
+
+  // a step restarts the count, one level per degrade_samples
+  TEST_CHECK_INT(_feed(&policy, 90, 0, 1), LOAD_LEVEL_VIDEO_LOW_RES);
+  TEST_CHECK_INT(_feed(&policy, 90, 0, 1), LOAD_LEVEL_VIDEO_PAUSED);
+}
+
+static void test_hysteresis_holds(void)
+{
+  load_policy_t policy = { .level = LOAD_LEVEL_VIDEO_PAUSED };
+
+  // between the marks nothing moves, however long
+  TEST_CHECK_INT(_feed(&policy, 60, 0, 100), LOAD_LEVEL_VIDEO_PAUSED);
+  TEST_CHECK_INT(_feed(&policy, 85, 0, 100), LOAD_LEVEL_VIDEO_PAUSED);
+  TEST_CHECK_INT(_feed(&policy, 72, 0, 100), LOAD_LEVEL_VIDEO_PAUSED);
+}
+
+static void test_restore_one_level_at_a_time(void)
+{
+  load_policy_t policy = { .level = LOAD_LEVEL_HTTP_DEFERRED };
+
+  TEST_CHECK_INT(_feed(&policy, 20, 0, 9), LOAD_LEVEL_HTTP_DEFERRED);
+  TEST_CHECK_INT(_feed(&policy, 20, 0, 1), LOAD_LEVEL_DSP_OFF);
+  TEST_CHECK_INT(_feed(&policy, 20, 0, 9), LOAD_LEVEL_DSP_OFF);
+
+  // one busy sample restarts the calm count
+  TEST_CHECK_INT(_feed(&policy, 70, 0, 1), LOAD_LEVEL_DSP_OFF);
+  TEST_CHECK_INT(_feed(&policy, 20, 0, 9), LOAD_LEVEL_DSP_OFF);
+  TEST_CHECK_INT(_feed(&policy, 20, 0, 1), LOAD_LEVEL_VIDEO_PAUSED);
+
+  TEST_CHECK_INT(_feed(&policy, 20, 0, 20), LOAD_LEVEL_FULL);
+  TEST_CHECK_INT(_feed(&policy, 20, 0, 100), LOAD_LEVEL_FULL);
+}
+
+static void test_deadline_misses(void)
+{
+  load_policy_t policy = { 0 };
+
+  // any miss is overload whatever the CPU says, a burst steps at once
+  TEST_CHECK_INT(_feed(&policy, 10, 1, 1), LOAD_LEVEL_FULL);
+  TEST_CHECK_INT(_feed(&policy, 10, 1, 1), LOAD_LEVEL_VIDEO_LOW_RES);
+  TEST_CHECK_INT(_feed(&policy, 10, 3, 1), LOAD_LEVEL_VIDEO_PAUSED);
+
+  // a sample with a miss is never calm, isolated misses keep the level where it is
+  for (int i = 0; i < 20; i++) {
+    _feed(&policy, 10, 0, 5);
+    _feed(&policy, 10, 1, 1);
+  }
+  TEST_CHECK_INT(policy.level, LOAD_LEVEL_VIDEO_PAUSED);
+}
+
+static void test_saturates(void)
+{
+  load_policy_t policy = { 0 };
+
+  TEST_CHECK_INT(_feed(&policy, 100, 5, 50), LOAD_LEVEL_HTTP_DEFERRED);
+  TEST_CHECK_INT(_feed(&policy, 0, 0, 500), LOAD_LEVEL_FULL);
+}
+
+static void test_skipped_levels(void)
+{
+  // an audio-only build: the first step sheds the DSP, and back
+  load_policy_cfg_t cfg = g_cfg;
+  cfg.skip_levels = (1u << LOAD_LEVEL_VIDEO_LOW_RES) | (1u << LOAD_LEVEL_VIDEO_PAUSED);
+  load_policy_t policy = { 0 };
+  load_sample_t busy = { .cpu_pct = 90 };
+  load_sample_t idle = { .cpu_pct = 20 };
+
+  load_policy_step(&cfg, &policy, &busy);
+  TEST_CHECK_INT(load_policy_step(&cfg, &policy, &busy), LOAD_LEVEL_DSP_OFF);
+  load_policy_step(&cfg, &policy, &busy);
+  TEST_CHECK_INT(load_policy_step(&cfg, &policy, &busy), LOAD_LEVEL_HTTP_DEFERRED);
+  for (int i = 0; i < 10; i++) {
+    load_policy_step(&cfg, &policy, &busy);
+  }
+  TEST_CHECK_INT(policy.level, LOAD_LEVEL_HTTP_DEFERRED);
+
+  for (int i = 0; i < 10; i++) {
+    load_policy_step(&cfg, &policy, &idle);
+  }
+  TEST_CHECK_INT(policy.level, LOAD_LEVEL_DSP_OFF);
+  for (int i = 0; i < 10; i++) {
+    load_policy_step(&cfg, &policy, &idle);
+  }
+  TEST_CHECK_INT(policy.level, LOAD_LEVEL_FULL);
+
+  // H.264 has no lower resolution, pausing is the first video step
+  cfg.skip_levels = 1u << LOAD_LEVEL_VIDEO_LOW_RES;
+  policy.level = LOAD_LEVEL_FULL;
+  load_policy_step(&cfg, &policy, &busy);
+  TEST_CHECK_INT(load_policy_step(&cfg, &policy, &busy), LOAD_LEVEL_VIDEO_PAUSED);
+}
+
+static void test_converges_without_flapping(void)
+{
+  /* a board where the uplink video costs 30% and the rest 10% per level:
+   * 110% asked, the ladder settles where the load fits and stays there */
+  static const uint8_t cost[LOAD_LEVEL_COUNT] = { 110, 95, 80, 75, 70 };
+  load_policy_t policy = { 0 };
+  int changes = 0;
+
+  for (int i = 0; i < 1000; i++) {
+    load_level_t before = policy.level;
+    load_level_t after  = _feed(&policy, cost[policy.level] > 100 ? 100 : cost[policy.level], 0, 1);
+    changes += after != before;
+  }
+  TEST_CHECK_INT(policy.level, LOAD_LEVEL_VIDEO_PAUSED);
+  TEST_CHECK_INT(changes, 2);
+}
+
+static void test_level_names(void)
+{
+  for (int level = 0; level < LOAD_LEVEL_COUNT; level++) {
+    TEST_CHECK(load_level_name((load_level_t)level)[0] != '?');
+  }
+  TEST_CHECK_STR(load_level_name(LOAD_LEVEL_COUNT), "?");
+}
+
+static void test_governor_reacts_to_misses(void)
+{
+  load_gov_init();
+  load_gov_init();   // a second call starts nothing
+  TEST_CHECK_INT(load_gov_level(), LOAD_LEVEL_FULL);
+
+  for (int i = 0; i < 3; i++) {
+    load_gov_note_deadline_miss();
+  }
+  vTaskDelay(pdMS_TO_TICKS(3 * CONFIG_LOAD_GOV_PERIOD_MS));
+  TEST_CHECK_INT(load_gov_level(), LOAD_LEVEL_VIDEO_LOW_RES);
+
+  // calm samples bring it back
+  TEST_CHECK(load_gov_wait_below(LOAD_LEVEL_VIDEO_LOW_RES, 40 * CONFIG_LOAD_GOV_PERIOD_MS));
+  TEST_CHECK_INT(load_gov_level(), LOAD_LEVEL_FULL);
+  TEST_CHECK(load_gov_wait_below(LOAD_LEVEL_VIDEO_LOW_RES, 0));
+}
+
+int main(void)
+{
+  TEST_RUN(test_degrade_needs_consecutive_samples);
+  TEST_RUN(test_hysteresis_holds);
+  TEST_RUN(test_restore_one_level_at_a_time);
+  TEST_RUN(test_deadline_misses);
+  TEST_RUN(test_saturates);
+  TEST_RUN(test_skipped_levels);
+  TEST_RUN(test_converges_without_flapping);
+  TEST_RUN(test_level_names);
+  TEST_RUN(test_governor_reacts_to_misses);
+  TEST_EXIT();
+}
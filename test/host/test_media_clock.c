@@ -0,0 +1,213 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "host_test.h"
+#include "media_clock.h"
+
+/* The a/v policy on made-up timelines: audio frames every 20 ms with a fixed
+ * capture-to-send latency, video frames every 100 ms that reach the check
+ * some time after capture and the send point an encode later. */
+
+#define VIDEO_PERIOD_US   (100 * 1000)
+#define ENCODE_US         (60 * 1000)
+#define BOUND_US          (MEDIA_SYNC_MAX_SKEW_MS * 1000)
+
+static int64_t g_now_us = 0;
+static int32_t g_audio_latency_us = 30 * 1000;
+static uint32_t g_sent = 0;
+static uint32_t g_held = 0;
+static uint32_t g_dropped = 0;
+
+/* one video period: five audio frames and a video frame that is age_us old
+ * when it is checked and takes encode_us to reach the send point */
+static void _period_enc(int32_t age_us, int32_t encode_us)
+{
+  for (int i = 0; i < 5; i++) {
+    g_now_us += VIDEO_PERIOD_US / 5;
+    media_sync_audio_sent(g_now_us - g_audio_latency_us, g_now_us);
+  }
+
+  int64_t capture_us = g_now_us - age_us;
+  if (media_sync_video_check(capture_us, g_now_us) == MEDIA_SYNC_DROP) {
+    media_sync_video_dropped();
+    g_dropped++;
+    return;
+  }
+
+  int64_t send_us = g_now_us + encode_us;
+  int32_t hold_us = -1;
+  media_sync_action_t action = media_sync_video_send_check(capture_us, send_us, &hold_us);
+  if (action == MEDIA_SYNC_DROP) {
+    media_sync_video_dropped();
+    g_dropped++;
+    return;
+  }
+  if (action == MEDIA_SYNC_HOLD) {
+    TEST_CHECK(hold_us > 0);
+    send_us += hold_us;
+    g_held++;
+  } else {
+    TEST_CHECK_INT(hold_us, 0);
+  }
+  media_sync_video_sent(capture_us, send_us);
+  g_sent++;
+}
+
+static void _period(int32_t age_us)
+{
+  _period_enc(age_us, ENCODE_US);
+}
+
+static void _begin(int32_t audio_latency_us)
+{
+  media_sync_reset();
+  g_audio_latency_us = audio_latency_us;
+  g_sent = 0;
+  g_held = 0;
+  g_dropped = 0;
+}
+
+static void test_within_bound_is_sent(void)
+{
+  media_sync_stats_t stats;
+
+  // video is steadily 70 ms behind audio, inside the bound: all of it is sent
+  _begin(30 * 1000);
+  for (int i = 0; i < 100; i++) {
+    _period(40 * 1000);
+  }
+  TEST_CHECK_INT(g_dropped, 0);
+  TEST_CHECK_INT(g_held, 0);
+  TEST_CHECK_INT(g_sent, 100);
+
+  media_sync_get_stats(&stats);
+  TEST_CHECK_INT(stats.audio_latency_us, 30 * 1000);
+  TEST_CHECK_INT(stats.video_latency_us, 100 * 1000);
+  TEST_CHECK_INT(stats.encode_us, ENCODE_US);
+  TEST_CHECK_INT(stats.skew_us, 70 * 1000);
+  TEST_CHECK(stats.max_abs_skew_us <= BOUND_US);
+  TEST_CHECK_INT(stats.video_skewed, 0);
+  TEST_CHECK_INT(stats.video_frames, 100);
+  TEST_CHECK_INT(stats.audio_frames, 500);
+
+  // one slow encode would push its frame past the bound: dropped at the send point
+  _period_enc(40 * 1000, ENCODE_US + 30 * 1000);
+  TEST_CHECK_INT(g_dropped, 1);
+  _period(40 * 1000);
+  TEST_CHECK_INT(g_sent, 101);
+
+  media_sync_get_stats(&stats);
+  TEST_CHECK(stats.max_abs_skew_us <= BOUND_US);
+  TEST_CHECK_INT(stats.video_dropped, 1);
+}
+
+static void test_late_video_is_dropped(void)
+{
+  media_sync_stats_t stats;
+
+  // video would be steadily 90 ms behind audio: the encode time predicts it,
+  // so frames are dropped before the encoder, bar one a MEDIA_SYNC_MIN_VIDEO_GAP_MS
+  _begin(30 * 1000);
+  int periods = 5 * MEDIA_SYNC_MIN_VIDEO_GAP_MS * 1000 / VIDEO_PERIOD_US;
+  for (int i = 0; i < periods; i++) {
+    _period(60 * 1000);
+  }
+  TEST_CHECK_INT(g_sent, 5);
+  TEST_CHECK_INT(g_dropped, periods - 5);
+
+  media_sync_get_stats(&stats);
+  TEST_CHECK_INT(stats.video_frames, 5);
+  TEST_CHECK_INT(stats.video_skewed, 5);  // only the frames the gap let through
+  TEST_CHECK_INT(stats.video_dropped, periods - 5);
+}
+
+static void test_early_video_is_held(void)
+{
+  media_sync_stats_t stats;
+
+  // audio goes out 200 ms after capture, video 70 ms: video waits for it
+  _begin(200 * 1000);
+  for (int i = 0; i < 50; i++) {
+    _period(10 * 1000);
+  }
+  TEST_CHECK_INT(g_dropped, 0);
+  TEST_CHECK_INT(g_sent, 50);
+  TEST_CHECK_INT(g_held, 50);
+
+  media_sync_get_stats(&stats);
+  TEST_CHECK_INT(stats.video_held, 50);
+  TEST_CHECK_INT(stats.skew_us, 0);
+  TEST_CHECK_INT(stats.max_abs_skew_us, 0);
+  TEST_CHECK_INT(stats.video_skewed, 0);
+
+  // inside the bound nothing is held
+  _begin(100 * 1000);
+  for (int i = 0; i < 50; i++) {
+    _period(10 * 1000);
+  }
+  TEST_CHECK_INT(g_held, 0);
+  TEST_CHECK_INT(g_sent, 50);
+}
+
+static void test_backlog_is_dropped(void)
+{
+  _begin(30 * 1000);
+  for (int i = 0; i < 20; i++) {
+    _period(10 * 1000);
+  }
+
+  // a frame that waited in the camera queue behind a stall
+  _period(10 * 1000 + MEDIA_SYNC_MAX_BACKLOG_MS * 1000 + 1000);
+  TEST_CHECK_INT(g_dropped, 1);
+
+  // not stale, but the encode would leave it past the skew bound
+  _period(10 * 1000 + MEDIA_SYNC_MAX_BACKLOG_MS * 1000 - 20000);
+  TEST_CHECK_INT(g_dropped, 2);
+
+  // the fresh frames after it go out
+  for (int i = 0; i < 10; i++) {
+    _period(10 * 1000);
+  }
+  TEST_CHECK_INT(g_dropped, 2);
+  TEST_CHECK_INT(g_sent, 30);
+
+  media_sync_stats_t stats;
+  media_sync_get_stats(&stats);
+  TEST_CHECK_INT(stats.video_dropped, 2);
+  TEST_CHECK_INT(stats.video_skewed, 0);
+  TEST_CHECK(stats.max_abs_skew_us <= BOUND_US);
+}
+
+static void test_first_frames(void)
+{
+  media_sync_stats_t stats;
+  int32_t hold_us;
+
+  // no history: the first frame is sent whatever its age, with no skew yet
+  _begin(30 * 1000);
+  int64_t capture_us = g_now_us - 500 * 1000;
+  TEST_CHECK_INT(media_sync_video_check(capture_us, g_now_us), MEDIA_SYNC_SEND);
+  TEST_CHECK_INT(media_sync_video_send_check(capture_us, g_now_us, &hold_us), MEDIA_SYNC_SEND);
+  media_sync_video_sent(capture_us, g_now_us);
+  media_sync_get_stats(&stats);
+  TEST_CHECK_INT(stats.skew_us, 0);
+  TEST_CHECK_INT(stats.video_skewed, 0);
+  TEST_CHECK_INT(stats.video_frames, 1);
+
+  // a new session forgets it all
+  media_sync_reset();
+  media_sync_get_stats(&stats);
+  TEST_CHECK_INT(stats.video_frames, 0);
+  TEST_CHECK_INT(stats.video_age_us, 0);
+  TEST_CHECK_INT(stats.encode_us, 0);
+}
+
+int main(void)
+{
+  TEST_RUN(test_within_bound_is_sent);
+  TEST_RUN(test_late_video_is_dropped);
+  TEST_RUN(test_early_video_is_held);
+  TEST_RUN(test_backlog_is_dropped);
+  TEST_RUN(test_first_frames);
+  TEST_EXIT();
+}
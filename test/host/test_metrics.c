@@ -0,0 +1,173 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "host_test.h"
+#include "metrics.h"
+
+/* The registry and the snapshot text, updates racing from several tasks,
+ * then a timed run of the update paths and the snapshot with the registry
+ * full. The timings are printed; their bounds only catch a per-update cost
+ * that has grown by an order of magnitude, not host jitter. */
+
+#define RACE_TASKS      (4)
+#define RACE_UPDATES    (100000)
+#define BENCH_UPDATES   (1000000)
+#define BENCH_SNAPSHOTS (10000)
+
+static METRIC_COUNTER(g_frames, "test.frames");
+static METRIC_COUNTER(g_errors, "test.errors");
+static METRIC_GAUGE(g_level, "test.level");
+static METRIC_HIST(g_latency, "test.latency_ms", 10, 20, 50, 100, 200, 500, 1000);
+
+static SemaphoreHandle_t g_done = NULL;
+
+static bool _has_line(const char *text, const char *line)
+{
+  size_t len = strlen(line);
+  for (const char *p = text; (p = strstr(p, line)) != NULL; p++) {
+    if ((p == text || p[-1] == '\n') && (p[len] == '\n' || p[len] == '\0')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void test_snapshot_text(void)
+{
+  char buf[1024];
+
+  metrics_register_counter(&g_frames);
+  metrics_register_counter(&g_errors);
+  metrics_register_counter(&g_frames);   // a second registration is ignored
+  metrics_register_gauge(&g_level);
+  metrics_register_hist(&g_latency);
+
+  metric_inc(&g_frames);
+  metric_add(&g_frames, 41);
+  metric_set(&g_level, -7);
+  metric_observe(&g_latency, 5);
+  metric_observe(&g_latency, 10);     // an edge belongs to its own bin
+  metric_observe(&g_latency, 11);
+  metric_observe(&g_latency, 5000);   // past the last edge
+
+  int len = metrics_snapshot(buf, sizeof(buf));
+  TEST_CHECK_INT(len, (int)strlen(buf));
+  TEST_CHECK(_has_line(buf, "c test.frames=42 test.errors=0"));
+  TEST_CHECK(_has_line(buf, "g test.level=-7"));
+  TEST_CHECK(_has_line(buf, "h test.latency_ms n=4 avg=1256 10:2 20:1 50:0 100:0 200:0 500:0 1000:0 +:1"));
+  TEST_CHECK(_has_line(buf, "cpu"));
+}
+
+static void test_snapshot_truncates(void)
+{
+  char full[1024], small[24];
+
+  metrics_snapshot(full, sizeof(full));
+  memset(small, 'x', sizeof(small));
+
+  // the text is cut and terminated, and the length says it was cut
+  TEST_CHECK(metrics_snapshot(small, sizeof(small)) >= (int)sizeof(small));
+  TEST_CHECK_INT((int)strlen(small), (int)sizeof(small) - 1);
+  TEST_CHECK(strncmp(small, full, sizeof(small) - 1) == 0);
+  TEST_CHECK_INT(metrics_snapshot(small, 0), 0);
+  TEST_CHECK_INT(metrics_snapshot(NULL, sizeof(small)), 0);
+}
+
+static void _racer(void *arg)
+{
+  for (int i = 0; i < RACE_UPDATES; i++) {
+    metric_inc(&g_errors);
+    metric_observe(&g_latency, (uint32_t)(i % 300));
+  }
+  xSemaphoreGive(g_done);
+  vTaskDelete(NULL);
+}
+
+static void test_updates_race(void)
+{
+  uint32_t errors = g_errors.value;
+  uint32_t observed = g_latency.count;
+
+  for (int i = 0; i < RACE_TASKS; i++) {
+    xTaskCreate(_racer, "racer", 2048, NULL, 5, NULL);
+  }
+  for (int i = 0; i < RACE_TASKS; i++) {
+    TEST_CHECK(xSemaphoreTake(g_done, pdMS_TO_TICKS(10000)) == pdTRUE);
+  }
+
+  // no update is lost, and every observation lands in exactly one bin
+  TEST_CHECK_INT(g_errors.value - errors, RACE_TASKS * RACE_UPDATES);
+  TEST_CHECK_INT(g_latency.count - observed, RACE_TASKS * RACE_UPDATES);
+  uint32_t binned = 0;
+  for (int b = 0; b < METRICS_HIST_BINS; b++) {
+    binned += g_latency.bins[b];
+  }
+  TEST_CHECK_INT(binned, g_latency.count);
+}
+
+static void test_bench(void)
+{
+  static metric_counter_t counters[METRICS_MAX];
+  static metric_gauge_t gauges[METRICS_MAX];
+  static metric_hist_t hists[METRICS_MAX];
+  static char names[3][METRICS_MAX][24];
+  char buf[8192];
+
+  // a full registry, as many names as the device could ever have
+  for (int i = 0; i < METRICS_MAX; i++) {
+    snprintf(names[0][i], sizeof(names[0][i]), "bench.counter%d", i);
+    snprintf(names[1][i], sizeof(names[1][i]), "bench.gauge%d", i);
+    snprintf(names[2][i], sizeof(names[2][i]), "bench.hist%d", i);
+    counters[i] = (metric_counter_t){ .name = names[0][i] };
+    gauges[i] = (metric_gauge_t){ .name = names[1][i] };
+    hists[i] = (metric_hist_t){ .name = names[2][i], .edges = { 1, 2, 5, 10, 20, 50, 100 } };
+    metrics_register_counter(&counters[i]);
+    metrics_register_gauge(&gauges[i]);
+    metrics_register_hist(&hists[i]);
+  }
+
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < BENCH_UPDATES; i++) {
+    metric_inc(&counters[i % METRICS_MAX]);
+  }
+  int64_t inc_us = esp_timer_get_time() - start;
+
+  start = esp_timer_get_time();
+  for (int i = 0; i < BENCH_UPDATES; i++) {
+    metric_observe(&hists[i % METRICS_MAX], (uint32_t)(i & 127));
+  }
+  int64_t observe_us = esp_timer_get_time() - start;
+
+  int len = 0;
+  start = esp_timer_get_time();
+  for (int i = 0; i < BENCH_SNAPSHOTS; i++) {
+    len = metrics_snapshot(buf, sizeof(buf));
+  }
+  int64_t snapshot_us = esp_timer_get_time() - start;
+
+  printf("metric_inc      %6.1f ns/op\n", inc_us * 1000.0 / BENCH_UPDATES);
+  printf("metric_observe  %6.1f ns/op\n", observe_us * 1000.0 / BENCH_UPDATES);
+  printf("metrics_snapshot %5.1f us/op, %d bytes\n", (double)snapshot_us / BENCH_SNAPSHOTS, len);
+
+  TEST_CHECK(len < (int)sizeof(buf));
+  TEST_CHECK(inc_us * 1000 / BENCH_UPDATES < 200);
+  TEST_CHECK(observe_us * 1000 / BENCH_UPDATES < 1000);
+  TEST_CHECK(snapshot_us / BENCH_SNAPSHOTS < 2000);
+}
+
+int main(void)
+{
+  g_done = xSemaphoreCreateCounting(RACE_TASKS, 0);
+
+  TEST_RUN(test_snapshot_text);
+  TEST_RUN(test_snapshot_truncates);
+  TEST_RUN(test_updates_race);
+  TEST_RUN(test_bench);
+  TEST_EXIT();
+}
@@ -0,0 +1,176 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "app_state.h"
+#include "host_stub.h"
+#include "host_test.h"
+#include "power_gov.h"
+
+/* The policy is checked as a pure function on a simulated clock, then the
+ * governor end to end with CONFIG_POWER_IDLE_DELAY_MS at 100 ms. */
+
+#define DISPATCH_MS  (20)   // app_state delivers to the governor on its task
+
+static void test_policy_inputs(void)
+{
+  power_inputs_t in = { 0 };
+
+  TEST_CHECK_INT(power_policy_mode(&in, 0), POWER_MODE_IDLE);
+
+  in.agent_joined = true;
+  TEST_CHECK_INT(power_policy_mode(&in, 0), POWER_MODE_ACTIVE);
+  TEST_CHECK_INT(power_policy_mode(&in, INT64_MAX / 2), POWER_MODE_ACTIVE);
+
+  // the hold window is half open
+  in.agent_joined  = false;
+  in.hold_until_ms = 1000;
+  TEST_CHECK_INT(power_policy_mode(&in, 999), POWER_MODE_ACTIVE);
+  TEST_CHECK_INT(power_policy_mode(&in, 1000), POWER_MODE_IDLE);
+
+  // running pipelines do not make the mode active
+  in.media_running = true;
+  TEST_CHECK_INT(power_policy_mode(&in, 2000), POWER_MODE_IDLE);
+}
+
+static void test_policy_timeline(void)
+{
+  /* press, agent joins, agent leaves, next press inside the delay */
+  static const struct {
+    int64_t at_ms;
+    int event;   // 0 none, 1 press, 2 join, 3 leave
+    power_mode_t mode;
+  } steps[] = {
+    { 0,     0, POWER_MODE_IDLE },
+    { 1000,  1, POWER_MODE_ACTIVE },
+    { 1800,  2, POWER_MODE_ACTIVE },
+    { 30000, 0, POWER_MODE_ACTIVE },
+    { 60000, 3, POWER_MODE_ACTIVE },
+    { 60000 + CONFIG_POWER_IDLE_DELAY_MS - 1, 0, POWER_MODE_ACTIVE },
+    { 60000 + CONFIG_POWER_IDLE_DELAY_MS, 0, POWER_MODE_IDLE },
+    { 90000, 1, POWER_MODE_ACTIVE },
+    { 90000 + CONFIG_POWER_IDLE_DELAY_MS, 0, POWER_MODE_IDLE },
+  };
+  power_inputs_t in = { .media_running = true };
+
+  for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    int64_t now = steps[i].at_ms;
+    switch (steps[i].event) {
+      case 1:
+        in.hold_until_ms = now + CONFIG_POWER_IDLE_DELAY_MS;
+        break;
+      case 2:
+        in.agent_joined = true;
+        break;
+      case 3:
+        in.agent_joined  = false;
+        in.hold_until_ms = now + CONFIG_POWER_IDLE_DELAY_MS;
+        break;
+    }
+    TEST_CHECK_INT(power_policy_mode(&in, now), steps[i].mode);
+  }
+}
+
+static wifi_ps_type_t _ps(void)
+{
+  wifi_ps_type_t ps;
+  esp_wifi_get_ps(&ps);
+  return ps;
+}
+
+static void _dispatch(void)
+{
+  vTaskDelay(pdMS_TO_TICKS(DISPATCH_MS));
+}
+
+static void test_locks_follow_agent(void)
+{
+  power_gov_stats_t stats;
+
+  app_state_init();
+  power_gov_init();
+  power_gov_get_stats(&stats);
+  TEST_CHECK_INT(stats.mode, POWER_MODE_IDLE);
+  TEST_CHECK_INT(host_pm_locks_held(), 0);
+
+  // the Wi-Fi power save is applied once there is a connection
+  esp_wifi_set_ps(WIFI_PS_NONE);
+  app_state_set(APP_STATE_WIFI_CONNECTED);
+  _dispatch();
+  TEST_CHECK_INT(_ps(), WIFI_PS_MIN_MODEM);
+
+  // pipelines running without an agent: DFS and modem sleep stay on
+  power_gov_set_media_running(true);
+  TEST_CHECK_INT(host_pm_locks_held(), 0);
+  TEST_CHECK_INT(_ps(), WIFI_PS_MIN_MODEM);
+
+  app_state_set(APP_STATE_AGENT_JOINED);
+  _dispatch();
+  power_gov_get_stats(&stats);
+  TEST_CHECK_INT(stats.mode, POWER_MODE_ACTIVE);
+  TEST_CHECK_INT(_ps(), WIFI_PS_NONE);
+  TEST_CHECK_INT(host_pm_locks_held(), 2);
+
+  // the agent leaves: active for the delay, then idle and the locks go
+  app_state_clear(APP_STATE_AGENT_JOINED);
+  _dispatch();
+  power_gov_get_stats(&stats);
+  TEST_CHECK_INT(stats.mode, POWER_MODE_ACTIVE);
+  TEST_CHECK_INT(host_pm_locks_held(), 2);
+  vTaskDelay(pdMS_TO_TICKS(CONFIG_POWER_IDLE_DELAY_MS + 50));
+  power_gov_get_stats(&stats);
+  TEST_CHECK_INT(stats.mode, POWER_MODE_IDLE);
+  TEST_CHECK_INT(_ps(), WIFI_PS_MIN_MODEM);
+  TEST_CHECK_INT(host_pm_locks_held(), 0);
+
+  // active again, then the pipelines stop: released once only
+  app_state_set(APP_STATE_AGENT_JOINED);
+  _dispatch();
+  TEST_CHECK_INT(host_pm_locks_held(), 2);
+  power_gov_set_media_running(false);
+  TEST_CHECK_INT(host_pm_locks_held(), 0);
+  power_gov_set_media_running(false);
+  TEST_CHECK_INT(host_pm_locks_held(), 0);
+  app_state_clear(APP_STATE_AGENT_JOINED);
+  _dispatch();
+  TEST_CHECK_INT(host_pm_locks_held(), 0);
+  vTaskDelay(pdMS_TO_TICKS(CONFIG_POWER_IDLE_DELAY_MS + 50));
+}
+
+static void test_wake_to_audio(void)
+{
+  power_gov_stats_t before, after;
+  power_gov_get_stats(&before);
+
+  power_gov_wake();
+  TEST_CHECK_INT(_ps(), WIFI_PS_NONE);
+  vTaskDelay(pdMS_TO_TICKS(30));
+  power_gov_note_audio();
+
+  power_gov_get_stats(&after);
+  TEST_CHECK_INT(after.mode, POWER_MODE_ACTIVE);
+  TEST_CHECK_INT(after.transitions - before.transitions, 1);
+  TEST_CHECK(after.last_wake_to_audio_ms >= 30 && after.last_wake_to_audio_ms < 1000);
+
+  // only the first audio after a wake is measured
+  power_gov_note_audio();
+  power_gov_get_stats(&before);
+  TEST_CHECK_INT(before.last_wake_to_audio_ms, after.last_wake_to_audio_ms);
+
+  vTaskDelay(pdMS_TO_TICKS(CONFIG_POWER_IDLE_DELAY_MS + 50));
+  power_gov_get_stats(&after);
+  TEST_CHECK_INT(after.mode, POWER_MODE_IDLE);
+  TEST_CHECK(after.active_ms >= CONFIG_POWER_IDLE_DELAY_MS);
+}
+
+int main(void)
+{
+  TEST_RUN(test_policy_inputs);
+  TEST_RUN(test_policy_timeline);
+  TEST_RUN(test_locks_follow_agent);
+  TEST_RUN(test_wake_to_audio);
+  TEST_EXIT();
+}
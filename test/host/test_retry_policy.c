@@ -0,0 +1,279 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "host_test.h"
+#include "retry_policy.h"
+
+/* The policy takes its clock and randomness as arguments, so the backoff
+ * bounds, the breaker and the retry decisions are checked directly, then a
+ * call loop shaped like ai_agent's runs against scripted server answers. */
+
+static const retry_policy_cfg_t g_cfg = {
+  .base_ms           = 100,
+  .cap_ms            = 1000,
+  .max_attempts      = 4,
+  .breaker_threshold = 3,
+  .breaker_open_ms   = 5000,
+  .idempotent        = true,
+};
+
+static void test_backoff_window(void)
+{
+  // the largest random value shows the window: base doubling up to the cap
+  static const uint32_t windows[] = { 100, 200, 400, 800, 1000, 1000 };
+
+  for (int retry = 0; retry < 6; retry++) {
+    TEST_CHECK_INT(retry_backoff_ms(&g_cfg, retry, windows[retry]), windows[retry]);
+    TEST_CHECK_INT(retry_backoff_ms(&g_cfg, retry, windows[retry] + 1), 0);
+    TEST_CHECK_INT(retry_backoff_ms(&g_cfg, retry, 0), 0);
+  }
+
+  // no overflow for a retry count far past the cap
+  TEST_CHECK(retry_backoff_ms(&g_cfg, 100, UINT32_MAX) <= g_cfg.cap_ms);
+
+  retry_policy_cfg_t zero = g_cfg;
+  zero.base_ms = 0;
+  TEST_CHECK_INT(retry_backoff_ms(&zero, 3, 12345), 0);
+}
+
+static void test_backoff_full_jitter(void)
+{
+  // every value of the window is reachable, none outside it
+  uint32_t seen_max = 0;
+  bool seen[401] = { false };
+
+  for (uint32_t r = 0; r < 4010; r++) {
+    uint32_t ms = retry_backoff_ms(&g_cfg, 2, r * 2654435761u);
+    TEST_CHECK(ms <= 400);
+    if (ms <= 400) {
+      seen[ms] = true;
+    }
+    if (ms > seen_max) {
+      seen_max = ms;
+    }
+  }
+  int covered = 0;
+  for (int i = 0; i <= 400; i++) {
+    covered += seen[i];
+  }
+  TEST_CHECK(covered > 380);
+  TEST_CHECK_INT(seen_max, 400);
+}
+
+static void test_transient(void)
+{
+  TEST_CHECK(retry_status_is_transient(-1));
+  TEST_CHECK(retry_status_is_transient(429));
+  TEST_CHECK(retry_status_is_transient(500));
+  TEST_CHECK(retry_status_is_transient(503));
+  TEST_CHECK(retry_status_is_transient(599));
+  TEST_CHECK(!retry_status_is_transient(200));
+  TEST_CHECK(!retry_status_is_transient(400));
+  TEST_CHECK(!retry_status_is_transient(409));
+  TEST_CHECK(!retry_status_is_transient(600));
+}
+
+static void test_should_retry(void)
+{
+  retry_policy_cfg_t once = g_cfg;
+  once.idempotent = false;
+
+  // an idempotent call repeats on every transient failure
+  TEST_CHECK(retry_should_retry(&g_cfg, -1, false));
+  TEST_CHECK(retry_should_retry(&g_cfg, -1, true));
+  TEST_CHECK(retry_should_retry(&g_cfg, 503, true));
+  TEST_CHECK(retry_should_retry(&g_cfg, 429, true));
+  TEST_CHECK(!retry_should_retry(&g_cfg, 404, true));
+  TEST_CHECK(!retry_should_retry(&g_cfg, 200, true));
+
+  // one that is not only when the server cannot have acted on it
+  TEST_CHECK(retry_should_retry(&once, -1, false));
+  TEST_CHECK(!retry_should_retry(&once, -1, true));
+  TEST_CHECK(!retry_should_retry(&once, 500, true));
+  TEST_CHECK(!retry_should_retry(&once, 503, true));
+  TEST_CHECK(retry_should_retry(&once, 429, true));
+  TEST_CHECK(!retry_should_retry(&once, 409, true));
+}
+
+static void test_breaker(void)
+{
+  retry_endpoint_t ep;
+  retry_endpoint_init(&ep, "test", &g_cfg);
+  TEST_CHECK_INT(ep.state, RETRY_BREAKER_CLOSED);
+
+  // a success in between resets the streak
+  retry_endpoint_record(&ep, false, 10, 0);
+  retry_endpoint_record(&ep, false, 10, 0);
+  retry_endpoint_record(&ep, true, 10, 0);
+  retry_endpoint_record(&ep, false, 10, 0);
+  retry_endpoint_record(&ep, false, 10, 0);
+  TEST_CHECK_INT(ep.state, RETRY_BREAKER_CLOSED);
+
+  retry_endpoint_record(&ep, false, 30, 1000);
+  TEST_CHECK_INT(ep.state, RETRY_BREAKER_OPEN);
+  TEST_CHECK_INT(ep.breaker_trips, 1);
+  TEST_CHECK(!retry_endpoint_allow(&ep, 1000 + g_cfg.breaker_open_ms - 1));
+  TEST_CHECK_INT(ep.rejected, 1);
+
+  // one trial when the open time is over, the rest wait for its outcome
+  TEST_CHECK(retry_endpoint_allow(&ep, 1000 + g_cfg.breaker_open_ms));
+  TEST_CHECK_INT(ep.state, RETRY_BREAKER_HALF_OPEN);
+  TEST_CHECK(!retry_endpoint_allow(&ep, 1000 + g_cfg.breaker_open_ms));
+  TEST_CHECK_INT(ep.rejected, 2);
+
+  // a failed trial opens it again at once
+  retry_endpoint_record(&ep, false, 10, 7000);
+  TEST_CHECK_INT(ep.state, RETRY_BREAKER_OPEN);
+  TEST_CHECK_INT(ep.breaker_trips, 2);
+  TEST_CHECK(!retry_endpoint_allow(&ep, 7000 + g_cfg.breaker_open_ms - 1));
+
+  // a good trial closes it
+  TEST_CHECK(retry_endpoint_allow(&ep, 7000 + g_cfg.breaker_open_ms));
+  retry_endpoint_record(&ep, true, 20, 12000);
+  TEST_CHECK_INT(ep.state, RETRY_BREAKER_CLOSED);
+  TEST_CHECK(retry_endpoint_allow(&ep, 12000));
+  TEST_CHECK(retry_endpoint_allow(&ep, 12000));
+
+  TEST_CHECK_INT(ep.attempts, 8);
+  TEST_CHECK_INT(ep.successes, 2);
+  TEST_CHECK_INT(ep.failures, 6);
+  TEST_CHECK_INT(ep.max_latency_ms, 30);
+  TEST_CHECK_INT(ep.total_latency_ms, 110);
+}
+
+static void test_retry_after(void)
+{
+  TEST_CHECK_INT(retry_parse_retry_after("0"), 0);
+  TEST_CHECK_INT(retry_parse_retry_after("3"), 3000);
+  TEST_CHECK_INT(retry_parse_retry_after("  120 "), 120000);
+  TEST_CHECK_INT(retry_parse_retry_after("99999999999"), 3600 * 1000);
+  TEST_CHECK_INT(retry_parse_retry_after(NULL), -1);
+  TEST_CHECK_INT(retry_parse_retry_after(""), -1);
+  TEST_CHECK_INT(retry_parse_retry_after("-5"), -1);
+  TEST_CHECK_INT(retry_parse_retry_after("1.5"), -1);
+  TEST_CHECK_INT(retry_parse_retry_after("Wed, 21 Oct 2015 07:28:00 GMT"), -1);
+}
+
+static void test_retry_after_delay(void)
+{
+  // no Retry-After, or a shorter one: the backoff as drawn
+  TEST_CHECK_INT(retry_delay_ms(&g_cfg, 2, -1, 300), 300);
+  TEST_CHECK_INT(retry_delay_ms(&g_cfg, 2, 200, 300), 300);
+
+  // a longer one within the cap is honoured
+  TEST_CHECK_INT(retry_delay_ms(&g_cfg, 0, 700, 50), 700);
+  TEST_CHECK_INT(retry_delay_ms(&g_cfg, 0, (int32_t)g_cfg.cap_ms, 50), (int)g_cfg.cap_ms);
+
+  // past the cap the call gives up rather than wait, whatever the backoff
+  TEST_CHECK_INT(retry_delay_ms(&g_cfg, 0, (int32_t)g_cfg.cap_ms + 1, 50), -1);
+  TEST_CHECK_INT(retry_delay_ms(&g_cfg, 5, retry_parse_retry_after("3600"), UINT32_MAX), -1);
+}
+
+/* ---- a call loop against scripted answers ---- */
+
+typedef struct {
+  int status;
+  bool sent;
+} answer_t;
+
+typedef struct {
+  const answer_t *answers;
+  int count;
+  int next;
+  int served;       // requests that reached the server
+  int64_t now_ms;
+} server_t;
+
+static int _call(retry_endpoint_t *ep, server_t *server)
+{
+  int status = -1;
+
+  for (int attempt = 0; attempt < ep->cfg.max_attempts; attempt++) {
+    if (!retry_endpoint_allow(ep, server->now_ms)) {
+      return -1;
+    }
+    answer_t answer = server->answers[server->next < server->count ? server->next++ : server->count - 1];
+    server->served += answer.sent;
+    status = answer.status;
+
+    retry_endpoint_record(ep, !retry_status_is_transient(status), 50, server->now_ms);
+    server->now_ms += 50;
+    if (!retry_should_retry(&ep->cfg, status, answer.sent)) {
+      break;
+    }
+    server->now_ms += retry_backoff_ms(&ep->cfg, attempt, (uint32_t)attempt * 7919u);
+  }
+  return status;
+}
+
+static void test_call_idempotent(void)
+{
+  static const answer_t answers[] = { { -1, false }, { 503, true }, { 200, true } };
+  server_t server = { answers, 3 };
+  retry_endpoint_t ep;
+  retry_endpoint_init(&ep, "agents", &g_cfg);
+
+  TEST_CHECK_INT(_call(&ep, &server), 200);
+  TEST_CHECK_INT(ep.attempts, 3);
+  TEST_CHECK_INT(ep.state, RETRY_BREAKER_CLOSED);
+}
+
+static void test_call_not_idempotent(void)
+{
+  // the server may have started the agent: a join is not sent twice
+  static const answer_t lost[] = { { -1, true }, { 200, true } };
+  static const answer_t busy[] = { { 429, true }, { 200, true } };
+  static const answer_t refused[] = { { -1, false }, { 200, true } };
+  retry_policy_cfg_t cfg = g_cfg;
+  cfg.idempotent = false;
+  retry_endpoint_t ep;
+
+  server_t server = { lost, 2 };
+  retry_endpoint_init(&ep, "join", &cfg);
+  TEST_CHECK_INT(_call(&ep, &server), -1);
+  TEST_CHECK_INT(server.served, 1);
+
+  server = (server_t){ busy, 2 };
+  retry_endpoint_init(&ep, "join", &cfg);
+  TEST_CHECK_INT(_call(&ep, &server), 200);
+  TEST_CHECK_INT(server.served, 2);
+
+  server = (server_t){ refused, 2 };
+  retry_endpoint_init(&ep, "join", &cfg);
+  TEST_CHECK_INT(_call(&ep, &server), 200);
+  TEST_CHECK_INT(server.served, 1);
+}
+
+static void test_call_outage(void)
+{
+  // a dead server: the breaker opens inside the first call, cuts its last
+  // attempt short and spares the server the next call
+  static const answer_t down[] = { { 503, true } };
+  server_t server = { down, 1 };
+  retry_endpoint_t ep;
+  retry_endpoint_init(&ep, "agents", &g_cfg);
+
+  TEST_CHECK_INT(_call(&ep, &server), -1);
+  TEST_CHECK_INT(server.served, g_cfg.breaker_threshold);
+  TEST_CHECK_INT(ep.state, RETRY_BREAKER_OPEN);
+  TEST_CHECK_INT(ep.rejected, 1);
+
+  TEST_CHECK_INT(_call(&ep, &server), -1);
+  TEST_CHECK_INT(server.served, g_cfg.breaker_threshold);
+  TEST_CHECK_INT(ep.rejected, 2);
+}
+
+int main(void)
+{
+  TEST_RUN(test_backoff_window);
+  TEST_RUN(test_backoff_full_jitter);
+  TEST_RUN(test_transient);
+  TEST_RUN(test_should_retry);
+  TEST_RUN(test_breaker);
+  TEST_RUN(test_retry_after);
+  TEST_RUN(test_retry_after_delay);
+  TEST_RUN(test_call_idempotent);
+  TEST_RUN(test_call_not_idempotent);
+  TEST_RUN(test_call_outage);
+  TEST_EXIT();
+}
@@ -0,0 +1,218 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "host_stub.h"
+#include "host_test.h"
+#include "session_arena.h"
+
+/* A soak of agent start/stop cycles on the simulated first-fit heap. Two
+ * media threads take their buffers, video at a different size every cycle
+ * as the degradation ladder would, while the session leaves a small object
+ * behind every few cycles, the way a log line or a cached id outlives it.
+ * With plain malloc/free those objects land between the media buffers and
+ * split the heap; with the arenas the heap only loses what is really held. */
+
+#define CYCLES          (1000)
+#define KEEP_EVERY      (10)       // cycles between two objects that stay
+#define KEEP_SIZE       (48)
+#define INTERNAL_HEAP   (64 * 1024)
+#define PSRAM_HEAP      (1024 * 1024)
+#define INTERNAL_CAPS   (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+
+#define AUDIO_PCM       (640)
+#define AUDIO_CAPTURE   (1280)
+
+static void *g_kept[CYCLES / KEEP_EVERY];
+static int g_kept_count = 0;
+
+static size_t _video_internal(int cycle)
+{
+  return 256 * (1 + cycle % 7);
+}
+
+static size_t _video_frame(int cycle)
+{
+  return (cycle % 3 == 0) ? 160 * 120 * 3 / 2 : 96 * 96 * 3 / 2;   // I420, full and low res
+}
+
+static size_t _largest(void)
+{
+  return heap_caps_get_largest_free_block(INTERNAL_CAPS);
+}
+
+static void _keep(int cycle)
+{
+  if (cycle % KEEP_EVERY == 0) {
+    g_kept[g_kept_count++] = heap_caps_malloc(KEEP_SIZE, INTERNAL_CAPS);
+  }
+}
+
+static void _free_kept(void)
+{
+  for (int i = 0; i < g_kept_count; i++) {
+    heap_caps_free(g_kept[i]);
+  }
+  g_kept_count = 0;
+}
+
+/* ---- plain heap ---- */
+
+static size_t g_heap_loss = 0;
+
+static void test_soak_heap(void)
+{
+  host_heap_init(INTERNAL_HEAP, PSRAM_HEAP);
+  size_t start = _largest();
+  size_t worst = start;
+
+  for (int cycle = 0; cycle < CYCLES; cycle++) {
+    void *pcm     = heap_caps_malloc(AUDIO_PCM, INTERNAL_CAPS);
+    void *capture = heap_caps_malloc(AUDIO_CAPTURE, INTERNAL_CAPS);
+    void *yuv     = heap_caps_malloc(_video_internal(cycle), INTERNAL_CAPS);
+    void *frame   = heap_caps_malloc(_video_frame(cycle), MALLOC_CAP_SPIRAM);
+    TEST_CHECK(pcm && capture && yuv && frame);
+    _keep(cycle);
+
+    heap_caps_free(frame);
+    heap_caps_free(yuv);
+    heap_caps_free(capture);
+    heap_caps_free(pcm);
+    if (_largest() < worst) {
+      worst = _largest();
+    }
+  }
+
+  g_heap_loss = start - worst;
+  printf("heap: largest internal block %u -> %u, %u bytes kept\n", (unsigned)start, (unsigned)worst,
+         (unsigned)(g_kept_count * KEEP_SIZE));
+  _free_kept();
+}
+
+/* ---- arenas ---- */
+
+static SemaphoreHandle_t g_video_go = NULL;
+static SemaphoreHandle_t g_video_done = NULL;
+static volatile int g_cycle = 0;
+static volatile bool g_video_ok = true;
+
+/* the video thread of one cycle: buffers from the arena, then recycle */
+static void _video_task(void *arg)
+{
+  while (xSemaphoreTake(g_video_go, portMAX_DELAY) == pdTRUE) {
+    int cycle = g_cycle;
+    if (cycle < 0) {
+      break;
+    }
+    void *yuv   = session_alloc(SESSION_MEM_INTERNAL, _video_internal(cycle));
+    void *frame = session_alloc(SESSION_MEM_PSRAM, _video_frame(cycle));
+    g_video_ok = yuv && frame && session_arena_recycle(SESSION_ARENA_RECYCLE_WAIT_MS);
+    xSemaphoreGive(g_video_done);
+  }
+  session_arena_release();
+  xSemaphoreGive(g_video_done);
+  vTaskDelete(NULL);
+}
+
+static void test_soak_arena(void)
+{
+  session_arena_stats_t stats;
+
+  host_heap_init(INTERNAL_HEAP, PSRAM_HEAP);
+  session_arena_init();
+  size_t start = _largest();
+  size_t worst = start;
+
+  g_video_go   = xSemaphoreCreateBinary();
+  g_video_done = xSemaphoreCreateBinary();
+  session_arena_retain();   // audio, on this thread
+  session_arena_retain();   // video
+  xTaskCreate(_video_task, "video", 4096, NULL, 5, NULL);
+
+  for (int cycle = 0; cycle < CYCLES; cycle++) {
+    g_cycle = cycle;
+    xSemaphoreGive(g_video_go);
+
+    void *pcm     = session_alloc(SESSION_MEM_INTERNAL, AUDIO_PCM);
+    void *capture = session_alloc(SESSION_MEM_INTERNAL, AUDIO_CAPTURE);
+    TEST_CHECK(pcm && capture);
+    _keep(cycle);
+
+    // the agent leaves, both threads recycle
+    TEST_CHECK(session_arena_recycle(SESSION_ARENA_RECYCLE_WAIT_MS));
+    TEST_CHECK(xSemaphoreTake(g_video_done, pdMS_TO_TICKS(2000)) == pdTRUE);
+    TEST_CHECK(g_video_ok);
+    if (_largest() < worst) {
+      worst = _largest();
+    }
+  }
+
+  session_arena_get_stats(&stats);
+  TEST_CHECK_INT(stats.resets, CYCLES);
+  TEST_CHECK_INT(stats.arena[SESSION_MEM_INTERNAL].fallbacks, 0);
+  TEST_CHECK_INT(stats.arena[SESSION_MEM_PSRAM].fallbacks, 0);
+  TEST_CHECK_INT(stats.arena[SESSION_MEM_INTERNAL].used, 0);
+
+  // nothing lost but the objects still held
+  size_t kept = (size_t)g_kept_count * KEEP_SIZE;
+  printf("arena: largest internal block %u -> %u, %u bytes kept\n", (unsigned)start, (unsigned)worst,
+         (unsigned)kept);
+  TEST_CHECK_INT(start - worst, kept);
+  TEST_CHECK(g_heap_loss > kept);
+
+  // the RTC session ends: the video thread releases, then audio
+  g_cycle = -1;
+  xSemaphoreGive(g_video_go);
+  TEST_CHECK(xSemaphoreTake(g_video_done, pdMS_TO_TICKS(2000)) == pdTRUE);
+  session_arena_release();
+  session_arena_get_stats(&stats);
+  TEST_CHECK_INT(stats.resets, CYCLES + 1);
+  _free_kept();
+  TEST_CHECK_INT(_largest(), start);
+}
+
+static void _release_later(void *arg)
+{
+  vTaskDelay(pdMS_TO_TICKS(30));
+  session_arena_release();
+  vTaskDelete(NULL);
+}
+
+static void test_recycle_barrier(void)
+{
+  session_arena_stats_t before, after;
+
+  // the other user never recycles: give up, the buffers stay valid
+  session_arena_get_stats(&before);
+  session_arena_retain();
+  session_arena_retain();
+  void *buf = session_alloc(SESSION_MEM_INTERNAL, 64);
+  TEST_CHECK(!session_arena_recycle(30));
+  session_arena_get_stats(&after);
+  TEST_CHECK_INT(after.resets, before.resets);
+  TEST_CHECK(session_alloc(SESSION_MEM_INTERNAL, 64) != buf);
+
+  // it releases instead, which completes the barrier
+  xTaskCreate(_release_later, "release", 4096, NULL, 5, NULL);
+  TEST_CHECK(session_arena_recycle(SESSION_ARENA_RECYCLE_WAIT_MS));
+  session_arena_get_stats(&after);
+  TEST_CHECK_INT(after.resets, before.resets + 1);
+  TEST_CHECK_INT(after.arena[SESSION_MEM_INTERNAL].used, 0);
+
+  session_arena_release();
+  session_arena_get_stats(&after);
+  TEST_CHECK_INT(after.resets, before.resets + 2);
+}
+
+int main(void)
+{
+  TEST_RUN(test_soak_heap);
+  TEST_RUN(test_soak_arena);
+  TEST_RUN(test_recycle_barrier);
+  TEST_EXIT();
+}
@@ -0,0 +1,222 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "app_state.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "host_stub.h"
+#include "host_test.h"
+#include "voice_sensor.h"
+#include "xvf3800.h"
+
+/* The uplink gate as a pure function, then the sensor task against a
+ * simulated XVF3800 on the I2C bus that answers DOA_VALUE and
+ * AEC_SPENERGY_VALUES from what the test sets. Built with a 10 ms period
+ * and a 100 ms hangover, on real time. */
+
+#define PERIOD_MS    (CONFIG_VOICE_SENSOR_PERIOD_MS)
+#define HANGOVER_MS  (CONFIG_VOICE_SENSOR_HANGOVER_MS)
+#define WAIT_MS      (2000)
+
+typedef struct {
+  volatile uint16_t doa;
+  volatile uint16_t speech;
+  float energy[4];
+  volatile bool fail;          // answer ERROR to every command
+  volatile int doa_reads;
+} sensor_dev_t;
+
+typedef struct {
+  bool open;
+  int16_t doa;
+} gate_event_t;
+
+static sensor_dev_t g_dev;
+static QueueHandle_t g_events = NULL;
+
+static xvf3800_handle_t g_handle = {
+  .i2c_port         = I2C_NUM_0,
+  .i2c_addr         = XVF3800_I2C_ADDR,
+  .resource_id_gpio = XVF3800_RESOURCE_ID_GPIO,
+};
+
+static esp_err_t _dev_i2c(uint8_t addr, const uint8_t *wr, size_t wr_len, uint8_t *rd, size_t rd_len, void *ctx)
+{
+  if (addr != XVF3800_I2C_ADDR || wr_len != 3 || rd_len < 1 || !(wr[1] & 0x80)) {
+    return ESP_FAIL;
+  }
+  memset(rd, 0, rd_len);
+  if (g_dev.fail) {
+    rd[0] = XVF3800_STATUS_ERROR;
+    return ESP_OK;
+  }
+
+  uint8_t resid = wr[0], cmd = wr[1] & 0x7F;
+  if (resid == 20 && cmd == 18 && rd_len == 5) {
+    // DOA_VALUE: 2 x u16, the direction and the speech flag
+    rd[1] = g_dev.doa & 0xFF;
+    rd[2] = g_dev.doa >> 8;
+    rd[3] = g_dev.speech & 0xFF;
+    rd[4] = g_dev.speech >> 8;
+    g_dev.doa_reads++;
+  } else if (resid == 33 && cmd == 80 && rd_len == 17) {
+    // AEC_SPENERGY_VALUES: 4 x float
+    memcpy(&rd[1], g_dev.energy, 16);
+  } else {
+    rd[0] = XVF3800_STATUS_ERROR;
+    return ESP_OK;
+  }
+  rd[0] = XVF3800_STATUS_SUCCESS;
+  return ESP_OK;
+}
+
+static void _on_gate(bool open, int16_t doa_deg, void *ctx)
+{
+  gate_event_t e = { .open = open, .doa = doa_deg };
+  xQueueSend(g_events, &e, 0);
+}
+
+static gate_event_t _wait_gate(void)
+{
+  gate_event_t e = { .open = false, .doa = -2 };
+  TEST_CHECK(xQueueReceive(g_events, &e, pdMS_TO_TICKS(WAIT_MS)) == pdTRUE);
+  return e;
+}
+
+static void _talk(uint16_t doa, bool speech)
+{
+  g_dev.doa    = doa;
+  g_dev.speech = speech ? 1 : 0;
+}
+
+static void test_gate_step(void)
+{
+  const voice_gate_cfg_t cfg = { .hangover_us = 300 * 1000 };
+  voice_gate_t gate = { 0 };
+
+  TEST_CHECK(!voice_gate_step(&gate, &cfg, false, 0));
+  TEST_CHECK(voice_gate_step(&gate, &cfg, true, 1000 * 1000));
+
+  // held through the hangover, closed once it has run out
+  TEST_CHECK(voice_gate_step(&gate, &cfg, false, 1100 * 1000));
+  TEST_CHECK(voice_gate_step(&gate, &cfg, false, 1299 * 1000));
+  TEST_CHECK(!voice_gate_step(&gate, &cfg, false, 1300 * 1000));
+
+  // speech within the hangover restarts it
+  TEST_CHECK(voice_gate_step(&gate, &cfg, true, 2000 * 1000));
+  TEST_CHECK(voice_gate_step(&gate, &cfg, false, 2200 * 1000));
+  TEST_CHECK(voice_gate_step(&gate, &cfg, true, 2250 * 1000));
+  TEST_CHECK(voice_gate_step(&gate, &cfg, false, 2500 * 1000));
+  TEST_CHECK(!voice_gate_step(&gate, &cfg, false, 2550 * 1000));
+}
+
+static void test_idle_until_agent_joined(void)
+{
+  voice_sensor_state_t state;
+
+  // in the channel, but no agent yet: the bus is left alone and the uplink is open
+  app_state_set(APP_STATE_SESSION_STARTED);
+  voice_sensor_start(&g_handle);
+  vTaskDelay(pdMS_TO_TICKS(10 * PERIOD_MS));
+  TEST_CHECK_INT(g_dev.doa_reads, 0);
+  voice_sensor_get(&state);
+  TEST_CHECK(!state.valid);
+  TEST_CHECK_INT(state.doa_deg, -1);
+  TEST_CHECK(voice_sensor_uplink_open());
+  TEST_CHECK(!voice_sensor_speech());
+
+  // the agent joins: readings start, and silence closes the uplink
+  app_state_set(APP_STATE_AGENT_JOINED);
+  vTaskDelay(pdMS_TO_TICKS(5 * PERIOD_MS));
+  TEST_CHECK(g_dev.doa_reads > 0);
+  voice_sensor_get(&state);
+  TEST_CHECK(state.valid);
+  TEST_CHECK(!voice_sensor_uplink_open());
+}
+
+static void test_open_hangover_close(void)
+{
+  voice_sensor_state_t state;
+
+  g_dev.energy[0] = 0.5f;
+  g_dev.energy[2] = 2.5f;
+  _talk(90, true);
+  gate_event_t e = _wait_gate();
+  TEST_CHECK(e.open);
+  TEST_CHECK_INT(e.doa, 90);
+  TEST_CHECK(voice_sensor_speech());
+  TEST_CHECK(voice_sensor_uplink_open());
+  voice_sensor_get(&state);
+  TEST_CHECK(state.energy == 2.5f);
+
+  // the talker moves: the direction follows while there is speech
+  _talk(400, true);
+  vTaskDelay(pdMS_TO_TICKS(5 * PERIOD_MS));
+  TEST_CHECK_INT(voice_sensor_direction(), 40);
+
+  // silence: open through the hangover from the last speech reading, then
+  // closed. The direction read without speech is noise and is not taken
+  int64_t silence_us = esp_timer_get_time();
+  _talk(200, false);
+  vTaskDelay(pdMS_TO_TICKS(HANGOVER_MS / 2));
+  TEST_CHECK(!voice_sensor_speech());
+  TEST_CHECK(voice_sensor_uplink_open());
+  e = _wait_gate();
+  TEST_CHECK(!e.open);
+  TEST_CHECK(esp_timer_get_time() - silence_us >= (HANGOVER_MS - PERIOD_MS) * 1000);
+  TEST_CHECK_INT(e.doa, 40);
+  TEST_CHECK(!voice_sensor_uplink_open());
+  TEST_CHECK_INT(voice_sensor_direction(), 40);
+}
+
+static void test_stale_fails_open(void)
+{
+  voice_sensor_state_t state;
+
+  TEST_CHECK(!voice_sensor_uplink_open());
+
+  // the device stops answering: the readings go stale and the uplink opens
+  g_dev.fail = true;
+  vTaskDelay(pdMS_TO_TICKS(2 * VOICE_SENSOR_STALE_PERIODS * PERIOD_MS));
+  voice_sensor_get(&state);
+  TEST_CHECK(!state.valid);
+  TEST_CHECK(voice_sensor_uplink_open());
+  TEST_CHECK(!voice_sensor_speech());
+
+  // and closes again once silence is read
+  g_dev.fail = false;
+  vTaskDelay(pdMS_TO_TICKS(5 * PERIOD_MS));
+  TEST_CHECK(!voice_sensor_uplink_open());
+
+  // no callback for either: the gate itself never opened
+  gate_event_t e;
+  TEST_CHECK(xQueueReceive(g_events, &e, 0) == pdFALSE);
+}
+
+static void test_idle_after_leave(void)
+{
+  app_state_clear(APP_STATE_AGENT_JOINED);
+  vTaskDelay(pdMS_TO_TICKS(5 * PERIOD_MS));
+  int reads = g_dev.doa_reads;
+  vTaskDelay(pdMS_TO_TICKS(10 * PERIOD_MS));
+  TEST_CHECK_INT(g_dev.doa_reads, reads);
+  TEST_CHECK(voice_sensor_uplink_open());
+}
+
+int main(void)
+{
+  g_events = xQueueCreate(8, sizeof(gate_event_t));
+  host_i2c_attach(_dev_i2c, NULL);
+  app_state_init();
+  voice_sensor_set_cb(_on_gate, NULL);
+
+  TEST_RUN(test_gate_step);
+  TEST_RUN(test_idle_until_agent_joined);
+  TEST_RUN(test_open_hangover_close);
+  TEST_RUN(test_stale_fails_open);
+  TEST_RUN(test_idle_after_leave);
+  TEST_EXIT();
+}
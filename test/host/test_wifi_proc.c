@@ -0,0 +1,166 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_wifi.h"
+#include "nvs.h"
+
+#include "app_state.h"
+#include "host_stub.h"
+#include "host_test.h"
+#include "wifi_proc.h"
+
+/* wifi_proc against the simulated station driver: the access point fails
+ * or accepts each attempt from a script, answering from a driver thread
+ * like the real one. Every esp_wifi_connect() has to come from the default
+ * event loop, never from the backoff timer, and never while another attempt
+ * is still in flight. */
+
+#define REASON_NO_AP_FOUND   (201)
+#define REASON_BEACON_LOST   (200)
+#define MAX_ATTEMPTS         (16)
+#define WAIT_MS              (5000)
+
+static const uint8_t g_bssid[6] = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 };
+
+typedef struct {
+  bool on_loop;
+  bool bssid_set;
+  uint8_t bssid[6];
+  uint8_t channel;
+} attempt_t;
+
+static uint8_t g_script[MAX_ATTEMPTS];
+static int g_script_len = 0;
+static attempt_t g_attempts[MAX_ATTEMPTS];
+static volatile int g_attempt_count = 0;
+
+static uint8_t _access_point(const wifi_sta_config_t *sta, void *ctx)
+{
+  int n = g_attempt_count;
+  if (n >= MAX_ATTEMPTS) {
+    return REASON_NO_AP_FOUND;
+  }
+  g_attempts[n].on_loop   = host_event_loop_current();
+  g_attempts[n].bssid_set = sta->bssid_set;
+  g_attempts[n].channel   = sta->channel;
+  memcpy(g_attempts[n].bssid, sta->bssid, sizeof(g_attempts[n].bssid));
+  g_attempt_count = n + 1;
+  return n < g_script_len ? g_script[n] : 0;
+}
+
+/* the access point answers the next attempts with these reasons */
+static void _script(const uint8_t *reasons, int count)
+{
+  g_attempt_count = 0;
+  memcpy(g_script, reasons, (size_t)count);
+  g_script_len = count;
+}
+
+static wifi_proc_stats_t _wait_connects(uint32_t connects)
+{
+  wifi_proc_stats_t stats;
+  for (int waited = 0; waited < WAIT_MS; waited += 10) {
+    wifi_proc_get_stats(&stats);
+    if (stats.connects >= connects) {
+      break;
+    }
+    usleep(10 * 1000);
+  }
+  host_event_loop_idle();
+  wifi_proc_get_stats(&stats);
+  return stats;
+}
+
+static void _check_attempts(const bool *targeted, int count)
+{
+  TEST_CHECK_INT(g_attempt_count, count);
+  for (int i = 0; i < count && i < g_attempt_count; i++) {
+    TEST_CHECK(g_attempts[i].on_loop);
+    TEST_CHECK_INT(g_attempts[i].bssid_set, targeted[i]);
+    if (targeted[i]) {
+      TEST_CHECK(memcmp(g_attempts[i].bssid, g_bssid, sizeof(g_bssid)) == 0);
+      TEST_CHECK_INT(g_attempts[i].channel, 6);
+    } else {
+      TEST_CHECK_INT(g_attempts[i].channel, 0);
+    }
+  }
+}
+
+static void test_first_connect(void)
+{
+  static const uint8_t reasons[] = { REASON_NO_AP_FOUND, REASON_NO_AP_FOUND, 0 };
+  static const bool targeted[] = { false, false, false };
+
+  // nothing cached: full scans, the retries after a backoff
+  _script(reasons, 3);
+  wifi_proc_start();
+  wifi_proc_stats_t stats = _wait_connects(1);
+
+  TEST_CHECK_INT(stats.connects, 1);
+  TEST_CHECK_INT(stats.attempts, 3);
+  TEST_CHECK_INT(stats.full_scan_ok, 1);
+  TEST_CHECK_INT(stats.targeted_ok, 0);
+  _check_attempts(targeted, 3);
+  TEST_CHECK(app_state_has(APP_STATE_WIFI_CONNECTED));
+
+  // the AP is cached for the next time
+  nvs_handle_t nvs;
+  uint8_t blob[128];
+  size_t len = sizeof(blob);
+  TEST_CHECK_INT(nvs_open("wifi_cache", NVS_READONLY, &nvs), ESP_OK);
+  TEST_CHECK_INT(nvs_get_blob(nvs, "ap", blob, &len), ESP_OK);
+  nvs_close(nvs);
+}
+
+static void test_link_lost(void)
+{
+  static const bool targeted[] = { true };
+
+  // straight back to the cached AP, no backoff
+  _script(NULL, 0);
+  host_wifi_drop_link(REASON_BEACON_LOST);
+  wifi_proc_stats_t stats = _wait_connects(2);
+
+  TEST_CHECK_INT(stats.connects, 2);
+  TEST_CHECK_INT(stats.attempts, 4);
+  TEST_CHECK_INT(stats.targeted_ok, 1);
+  _check_attempts(targeted, 1);
+  TEST_CHECK(app_state_has(APP_STATE_WIFI_CONNECTED));
+}
+
+static void test_targeted_falls_back(void)
+{
+  static const uint8_t reasons[] = { REASON_NO_AP_FOUND, REASON_NO_AP_FOUND, 0 };
+  static const bool targeted[] = { true, true, false };
+
+  // the AP moved: two targeted tries, then a full scan finds it
+  _script(reasons, 3);
+  host_wifi_drop_link(REASON_BEACON_LOST);
+  wifi_proc_stats_t stats = _wait_connects(3);
+
+  TEST_CHECK_INT(stats.connects, 3);
+  TEST_CHECK_INT(stats.attempts, 7);
+  TEST_CHECK_INT(stats.targeted_ok, 1);
+  TEST_CHECK_INT(stats.full_scan_ok, 2);
+  _check_attempts(targeted, 3);
+}
+
+static void test_no_overlapping_connects(void)
+{
+  TEST_CHECK_INT(host_wifi_overlapping_connects(), 0);
+}
+
+int main(void)
+{
+  host_nvs_erase_all();
+  host_wifi_set_ap(g_bssid, 6, 0x3201a8c0);   // 192.168.1.50
+  host_wifi_attach(_access_point, NULL);
+
+  TEST_RUN(test_first_connect);
+  TEST_RUN(test_link_lost);
+  TEST_RUN(test_targeted_falls_back);
+  TEST_RUN(test_no_overlapping_connects);
+  TEST_EXIT();
+}
@@ -0,0 +1,462 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_stub.h"
+#include "host_test.h"
+#include "xvf3800.h"
+#include "xvf3800_param.h"
+
+/* The encoding as pure functions, then reads and writes against a simulated
+ * XVF3800 on the I2C bus. The device keeps its own list of parameter sizes
+ * and answers ERROR to any command whose length byte does not match: on a
+ * read it counts the status byte and the payload, on a write the payload
+ * only. Requests run in the caller as i2c_mgr is not started. */
+
+#define DEV_MAX_PARAMS  (16)
+
+typedef struct {
+  uint8_t resid;
+  uint8_t cmd;
+  uint8_t size;
+  uint8_t data[16];
+} dev_param_t;
+
+typedef struct {
+  dev_param_t params[DEV_MAX_PARAMS];
+  int count;
+  uint8_t status;        // answer to the status read after a write
+  int busy;              // commands answered RETRY before the next one is served
+  int gpi_all_fails;     // GPI_VALUE_ALL answers ERROR
+  int transfers;
+  int commands;
+  int framing_errors;
+} xvf_dev_t;
+
+static xvf_dev_t g_dev;
+
+static dev_param_t *_dev_param(uint8_t resid, uint8_t cmd)
+{
+  for (int i = 0; i < g_dev.count; i++) {
+    if (g_dev.params[i].resid == resid && g_dev.params[i].cmd == cmd) {
+      return &g_dev.params[i];
+    }
+  }
+  return NULL;
+}
+
+static void _dev_add(uint8_t resid, uint8_t cmd, uint8_t size, const void *data)
+{
+  dev_param_t *p = &g_dev.params[g_dev.count++];
+  *p = (dev_param_t){ .resid = resid, .cmd = cmd, .size = size };
+  if (data) {
+    memcpy(p->data, data, size);
+  }
+}
+
+static void _dev_reset(void)
+{
+  static const uint8_t version[] = { 2, 1, 7 };
+  static const uint8_t gpi_all[] = { 0x03, 0, 0, 0 };   // both buttons released
+
+  memset(&g_dev, 0, sizeof(g_dev));
+  _dev_add(48, 0, 3, version);           // VERSION, 3 x u8
+  _dev_add(33, 1, 4, NULL);              // AEC_HPFONOFF, i32
+  _dev_add(33, 39, 8, NULL);             // AEC_FIXEDBEAMSTHETA, 2 x radians
+  _dev_add(33, 75, 16, NULL);            // AEC_AZIMUTH_VALUES, 4 x radians
+  _dev_add(17, 10, 4, NULL);             // PP_AGCONOFF, i32
+  _dev_add(17, 11, 4, NULL);             // PP_AGCMAXGAIN, float
+  _dev_add(17, 12, 4, NULL);             // PP_AGCDESIREDLEVEL, float
+  _dev_add(17, 21, 4, NULL);             // PP_MIN_NS, float
+  _dev_add(20, 18, 4, NULL);             // DOA_VALUE, 2 x u16
+  _dev_add(XVF3800_RESOURCE_ID_GPIO, XVF3800_CMD_GPI_VALUE_ALL, 4, gpi_all);
+  _dev_add(XVF3800_RESOURCE_ID_GPIO, XVF3800_CMD_GPI_INDEX, 1, NULL);
+  _dev_add(XVF3800_RESOURCE_ID_GPIO, XVF3800_CMD_GPI_VALUE, 1, NULL);
+  g_dev.status = 0xFF;
+}
+
+static uint8_t _dev_command(const uint8_t *wr, size_t wr_len, uint8_t *rd, size_t rd_len)
+{
+  g_dev.commands++;
+  if (g_dev.busy > 0) {
+    g_dev.busy--;
+    return XVF3800_STATUS_RETRY;
+  }
+
+  bool read = (wr[1] & 0x80) != 0;
+  dev_param_t *p = _dev_param(wr[0], wr[1] & 0x7F);
+  if (!p) {
+    return XVF3800_STATUS_ERROR;
+  }
+  if (read && p->cmd == XVF3800_CMD_GPI_VALUE_ALL && g_dev.gpi_all_fails) {
+    return XVF3800_STATUS_ERROR;
+  }
+
+  if (read) {
+    if (wr_len != 3 || wr[2] != 1 + p->size || rd_len != 1 + (size_t)p->size) {
+      g_dev.framing_errors++;
+      return XVF3800_STATUS_ERROR;
+    }
+    memcpy(&rd[1], p->data, p->size);
+    return XVF3800_STATUS_SUCCESS;
+  }
+
+  if (wr[2] != p->size || wr_len != 3 + (size_t)p->size) {
+    g_dev.framing_errors++;
+    return XVF3800_STATUS_ERROR;
+  }
+  memcpy(p->data, &wr[3], p->size);
+  if (p->cmd == XVF3800_CMD_GPI_INDEX && p->resid == XVF3800_RESOURCE_ID_GPIO) {
+    // the selected pin's level: released, high
+    _dev_param(XVF3800_RESOURCE_ID_GPIO, XVF3800_CMD_GPI_VALUE)->data[0] = 1;
+  }
+  return XVF3800_STATUS_SUCCESS;
+}
+
+static esp_err_t _dev_i2c(uint8_t addr, const uint8_t *wr, size_t wr_len, uint8_t *rd, size_t rd_len, void *ctx)
+{
+  if (addr != XVF3800_I2C_ADDR) {
+    return ESP_FAIL;
+  }
+  g_dev.transfers++;
+
+  if (wr_len == 0 && rd_len == 0) {
+    return ESP_OK;   // probe
+  }
+  if (wr_len == 0) {
+    // the status read that follows a write
+    rd[0] = g_dev.status;
+    memset(&rd[1], 0, rd_len - 1);
+    g_dev.status = 0xFF;
+    return ESP_OK;
+  }
+  if (wr_len < 3) {
+    g_dev.framing_errors++;
+    return ESP_FAIL;
+  }
+
+  uint8_t status = _dev_command(wr, wr_len, rd, rd_len);
+  if (rd_len > 0) {
+    rd[0] = status;
+  } else {
+    g_dev.status = status;
+  }
+  return ESP_OK;
+}
+
+/* ai_agent as seen by the button code in xvf3800.c, not pressed here */
+bool ai_agent_is_active(void)
+{
+  return false;
+}
+
+void ai_agent_start(void)
+{
+}
+
+void ai_agent_stop(void)
+{
+}
+
+static xvf3800_handle_t g_handle = {
+  .i2c_port         = I2C_NUM_0,
+  .i2c_addr         = XVF3800_I2C_ADDR,
+  .resource_id_gpio = XVF3800_RESOURCE_ID_GPIO,
+};
+
+static uint32_t _float_bits(float f)
+{
+  uint32_t raw;
+  memcpy(&raw, &f, 4);
+  return raw;
+}
+
+static uint32_t _le32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* ---- encoding ---- */
+
+static void test_table(void)
+{
+  for (int id = 0; id < XVF3800_PARAM_COUNT; id++) {
+    const xvf3800_param_desc_t *desc = xvf3800_param_desc((xvf3800_param_t)id);
+    TEST_CHECK(desc != NULL && desc->name != NULL);
+    TEST_CHECK(desc->count >= 1 && desc->count <= XVF3800_PARAM_MAX_VALUES);
+    TEST_CHECK(desc->cmd < 0x80);
+    TEST_CHECK(xvf3800_param_size(desc) <= 16);
+    // (resid, cmd) is unique
+    for (int other = 0; other < id; other++) {
+      const xvf3800_param_desc_t *o = xvf3800_param_desc((xvf3800_param_t)other);
+      TEST_CHECK(o->resid != desc->resid || o->cmd != desc->cmd);
+    }
+  }
+  TEST_CHECK(xvf3800_param_desc(XVF3800_PARAM_COUNT) == NULL);
+  TEST_CHECK_INT(xvf3800_param_size(xvf3800_param_desc(XVF3800_PARAM_VERSION)), 3);
+  TEST_CHECK_INT(xvf3800_param_size(xvf3800_param_desc(XVF3800_PARAM_DOA_VALUE)), 4);
+  TEST_CHECK_INT(xvf3800_param_size(xvf3800_param_desc(XVF3800_PARAM_AEC_AZIMUTH_VALUES)), 16);
+}
+
+static void test_encode_integers(void)
+{
+  uint8_t buf[16];
+  xvf3800_value_t in[4] = { { .i = -2 } }, out[4];
+
+  const xvf3800_param_desc_t *i32 = xvf3800_param_desc(XVF3800_PARAM_AEC_HPFONOFF);
+  TEST_CHECK_INT(xvf3800_param_encode(i32, in, buf, sizeof(buf)), 4);
+  TEST_CHECK_INT(_le32(buf), 0xFFFFFFFEu);
+  TEST_CHECK_INT(xvf3800_param_decode(i32, buf, 4, out), 4);
+  TEST_CHECK_INT(out[0].i, -2);
+
+  // u8 and u16 are truncated on the way out and zero-extended on the way in
+  const xvf3800_param_desc_t *u8 = xvf3800_param_desc(XVF3800_PARAM_VERSION);
+  in[0].i = 2; in[1].i = 0x1FF; in[2].i = 200;
+  TEST_CHECK_INT(xvf3800_param_encode(u8, in, buf, sizeof(buf)), 3);
+  TEST_CHECK(buf[0] == 2 && buf[1] == 0xFF && buf[2] == 200);
+  TEST_CHECK_INT(xvf3800_param_decode(u8, buf, 3, out), 3);
+  TEST_CHECK_INT(out[2].i, 200);
+
+  const xvf3800_param_desc_t *u16 = xvf3800_param_desc(XVF3800_PARAM_DOA_VALUE);
+  static const uint8_t doa[] = { 0x0E, 0x01, 0x01, 0x00 };   // 270 degrees, speech
+  TEST_CHECK_INT(xvf3800_param_decode(u16, doa, sizeof(doa), out), 4);
+  TEST_CHECK_INT(out[0].i, 270);
+  TEST_CHECK_INT(out[1].i, 1);
+  static const uint8_t high[] = { 0xFF, 0xFF, 0, 0 };
+  xvf3800_param_decode(u16, high, sizeof(high), out);
+  TEST_CHECK_INT(out[0].i, 65535);
+}
+
+static void test_encode_floats(void)
+{
+  uint8_t buf[16];
+  xvf3800_value_t in[4], out[4];
+
+  const xvf3800_param_desc_t *f = xvf3800_param_desc(XVF3800_PARAM_PP_AGCMAXGAIN);
+  in[0].f = 31.5f;
+  TEST_CHECK_INT(xvf3800_param_encode(f, in, buf, sizeof(buf)), 4);
+  TEST_CHECK_INT(_le32(buf), _float_bits(31.5f));
+  xvf3800_param_decode(f, buf, 4, out);
+  TEST_CHECK(out[0].f == 31.5f);
+
+  // degrees here, radians on the wire
+  const xvf3800_param_desc_t *rad = xvf3800_param_desc(XVF3800_PARAM_AEC_FIXEDBEAMSTHETA);
+  in[0].f = 90.0f;
+  in[1].f = -180.0f;
+  TEST_CHECK_INT(xvf3800_param_encode(rad, in, buf, sizeof(buf)), 8);
+  float wire[2];
+  memcpy(&wire[0], &buf[0], 4);
+  memcpy(&wire[1], &buf[4], 4);
+  TEST_CHECK(fabsf(wire[0] - (float)M_PI / 2) < 1e-6f);
+  TEST_CHECK(fabsf(wire[1] + (float)M_PI) < 1e-6f);
+  xvf3800_param_decode(rad, buf, 8, out);
+  TEST_CHECK(fabsf(out[0].f - 90.0f) < 1e-4f);
+  TEST_CHECK(fabsf(out[1].f + 180.0f) < 1e-4f);
+}
+
+static void test_encode_bounds(void)
+{
+  uint8_t buf[16];
+  xvf3800_value_t values[4] = { { 0 } };
+  const xvf3800_param_desc_t *az = xvf3800_param_desc(XVF3800_PARAM_AEC_AZIMUTH_VALUES);
+
+  TEST_CHECK_INT(xvf3800_param_encode(az, values, buf, 15), 0);
+  TEST_CHECK_INT(xvf3800_param_encode(az, values, buf, 16), 16);
+  TEST_CHECK_INT(xvf3800_param_decode(az, buf, 15, values), 0);
+  TEST_CHECK_INT(xvf3800_param_decode(az, buf, 16, values), 16);
+}
+
+/* ---- against the device ---- */
+
+static void test_read(void)
+{
+  _dev_reset();
+  xvf3800_param_cache_clear();
+  _dev_param(20, 18)->data[0] = 90;
+  _dev_param(20, 18)->data[2] = 1;
+
+  int32_t doa[2];
+  TEST_CHECK_INT(xvf3800_param_get_int(&g_handle, XVF3800_PARAM_DOA_VALUE, doa, 2), ESP_OK);
+  TEST_CHECK_INT(doa[0], 90);
+  TEST_CHECK_INT(doa[1], 1);
+
+  // the RO value is read again
+  _dev_param(20, 18)->data[0] = 180;
+  TEST_CHECK_INT(xvf3800_param_get_int(&g_handle, XVF3800_PARAM_DOA_VALUE, doa, 1), ESP_OK);
+  TEST_CHECK_INT(doa[0], 180);
+  TEST_CHECK_INT(g_dev.framing_errors, 0);
+
+  // more values than the parameter has
+  TEST_CHECK_INT(xvf3800_param_get_int(&g_handle, XVF3800_PARAM_DOA_VALUE, doa, 3), ESP_ERR_INVALID_ARG);
+}
+
+static void test_const_is_cached(void)
+{
+  int32_t version[3];
+
+  _dev_reset();
+  xvf3800_param_cache_clear();
+  TEST_CHECK_INT(xvf3800_param_get_int(&g_handle, XVF3800_PARAM_VERSION, version, 3), ESP_OK);
+  TEST_CHECK(version[0] == 2 && version[1] == 1 && version[2] == 7);
+  TEST_CHECK_INT(g_dev.transfers, 1);
+
+  TEST_CHECK_INT(xvf3800_param_get_int(&g_handle, XVF3800_PARAM_VERSION, version, 3), ESP_OK);
+  TEST_CHECK_INT(g_dev.transfers, 1);
+
+  xvf3800_param_cache_clear();
+  TEST_CHECK_INT(xvf3800_param_get_int(&g_handle, XVF3800_PARAM_VERSION, version, 3), ESP_OK);
+  TEST_CHECK_INT(g_dev.transfers, 2);
+}
+
+static void test_write(void)
+{
+  _dev_reset();
+
+  const float gain = 24.0f;
+  TEST_CHECK_INT(xvf3800_param_set_float(&g_handle, XVF3800_PARAM_PP_AGCMAXGAIN, &gain, 1), ESP_OK);
+  TEST_CHECK_INT(_le32(_dev_param(17, 11)->data), _float_bits(gain));
+
+  const float theta[2] = { 45.0f, 135.0f };
+  TEST_CHECK_INT(xvf3800_param_set_float(&g_handle, XVF3800_PARAM_AEC_FIXEDBEAMSTHETA, theta, 2), ESP_OK);
+  float wire;
+  memcpy(&wire, &_dev_param(33, 39)->data[4], 4);
+  TEST_CHECK(fabsf(wire - 3.0f * (float)M_PI / 4) < 1e-6f);
+
+  const int32_t on = 1;
+  TEST_CHECK_INT(xvf3800_param_set_int(&g_handle, XVF3800_PARAM_PP_AGCONOFF, &on, 1), ESP_OK);
+  TEST_CHECK_INT(_le32(_dev_param(17, 10)->data), 1);
+
+  // every write carried the payload length the device expects
+  TEST_CHECK_INT(g_dev.framing_errors, 0);
+
+  // read back through the API
+  float back;
+  TEST_CHECK_INT(xvf3800_param_get_float(&g_handle, XVF3800_PARAM_PP_AGCMAXGAIN, &back, 1), ESP_OK);
+  TEST_CHECK(back == gain);
+}
+
+static void test_write_rejected(void)
+{
+  _dev_reset();
+
+  // read-only or a partial write: nothing goes on the bus
+  const int32_t doa[2] = { 0, 0 };
+  TEST_CHECK_INT(xvf3800_param_set_int(&g_handle, XVF3800_PARAM_DOA_VALUE, doa, 2), ESP_ERR_INVALID_ARG);
+  const float theta = 10.0f;
+  TEST_CHECK_INT(xvf3800_param_set_float(&g_handle, XVF3800_PARAM_AEC_FIXEDBEAMSTHETA, &theta, 1),
+                 ESP_ERR_INVALID_ARG);
+  TEST_CHECK_INT(g_dev.transfers, 0);
+
+  // a parameter the firmware does not have answers ERROR
+  const float ref_gain = 1.0f;
+  TEST_CHECK_INT(xvf3800_param_set_float(&g_handle, XVF3800_PARAM_AUDIO_MGR_REF_GAIN, &ref_gain, 1), ESP_FAIL);
+}
+
+static void test_batches(void)
+{
+  static const xvf3800_param_t reads[] = {
+    XVF3800_PARAM_AEC_HPFONOFF, XVF3800_PARAM_AEC_FIXEDBEAMSTHETA, XVF3800_PARAM_AEC_AZIMUTH_VALUES,
+    XVF3800_PARAM_PP_AGCONOFF, XVF3800_PARAM_PP_AGCMAXGAIN, XVF3800_PARAM_PP_AGCDESIREDLEVEL,
+    XVF3800_PARAM_PP_MIN_NS, XVF3800_PARAM_DOA_VALUE, XVF3800_PARAM_AEC_HPFONOFF,
+    XVF3800_PARAM_PP_AGCONOFF,
+  };
+  xvf3800_param_io_t io[10];
+
+  _dev_reset();
+  for (int i = 0; i < 10; i++) {
+    io[i] = (xvf3800_param_io_t){ .id = reads[i] };
+  }
+  // one command per parameter, at most I2C_MGR_MAX_OPS in a batch
+  TEST_CHECK_INT(xvf3800_param_read(&g_handle, io, 10), ESP_OK);
+  TEST_CHECK_INT(g_dev.commands, 10);
+  TEST_CHECK_INT(g_dev.framing_errors, 0);
+
+  // writes take two ops each, a command and its status
+  static const xvf3800_param_t writes[] = {
+    XVF3800_PARAM_AEC_HPFONOFF, XVF3800_PARAM_PP_AGCONOFF, XVF3800_PARAM_PP_AGCMAXGAIN,
+    XVF3800_PARAM_PP_AGCDESIREDLEVEL, XVF3800_PARAM_PP_MIN_NS,
+  };
+  _dev_reset();
+  for (int i = 0; i < 5; i++) {
+    io[i] = (xvf3800_param_io_t){ .id = writes[i] };
+    io[i].v[0].i = 0x01020304;
+  }
+  TEST_CHECK_INT(xvf3800_param_write(&g_handle, io, 5), ESP_OK);
+  TEST_CHECK_INT(g_dev.commands, 5);
+  TEST_CHECK_INT(g_dev.transfers, 10);
+  TEST_CHECK_INT(g_dev.framing_errors, 0);
+
+  // one bad parameter does not spoil the rest of the batch
+  _dev_reset();
+  io[0] = (xvf3800_param_io_t){ .id = XVF3800_PARAM_PP_AGCONOFF };
+  io[1] = (xvf3800_param_io_t){ .id = XVF3800_PARAM_AUDIO_MGR_MIC_GAIN };
+  io[2] = (xvf3800_param_io_t){ .id = XVF3800_PARAM_DOA_VALUE };
+  TEST_CHECK_INT(xvf3800_param_read(&g_handle, io, 3), ESP_FAIL);
+  TEST_CHECK_INT(io[0].err, ESP_OK);
+  TEST_CHECK_INT(io[1].err, ESP_FAIL);
+  TEST_CHECK_INT(io[2].err, ESP_OK);
+}
+
+static void test_retry(void)
+{
+  float gain;
+
+  // the servicer is busy for a while: sent again after a pause
+  _dev_reset();
+  g_dev.busy = 2;
+  TEST_CHECK_INT(xvf3800_param_get_float(&g_handle, XVF3800_PARAM_PP_AGCMAXGAIN, &gain, 1), ESP_OK);
+  TEST_CHECK_INT(g_dev.commands, 3);
+
+  const float value = 6.0f;
+  g_dev.busy = 1;
+  TEST_CHECK_INT(xvf3800_param_set_float(&g_handle, XVF3800_PARAM_PP_AGCMAXGAIN, &value, 1), ESP_OK);
+  TEST_CHECK_INT(_le32(_dev_param(17, 11)->data), _float_bits(value));
+
+  // and gives up after a few rounds
+  _dev_reset();
+  g_dev.busy = 100;
+  TEST_CHECK_INT(xvf3800_param_get_float(&g_handle, XVF3800_PARAM_PP_AGCMAXGAIN, &gain, 1), ESP_ERR_TIMEOUT);
+  TEST_CHECK(g_dev.commands < 10);
+}
+
+static void test_write_cmd_length(void)
+{
+  uint8_t state = 0xFF;
+
+  // GPI_VALUE_ALL refused: the fallback writes GPI_INDEX with xvf3800_write_cmd
+  _dev_reset();
+  g_dev.gpi_all_fails = 1;
+  TEST_CHECK_INT(xvf3800_read_gpi(&g_handle, XVF3800_GPI_ACTION_BUTTON, &state), ESP_OK);
+  TEST_CHECK_INT(state, 1);
+  TEST_CHECK_INT(_dev_param(XVF3800_RESOURCE_ID_GPIO, XVF3800_CMD_GPI_INDEX)->data[0], XVF3800_GPI_ACTION_BUTTON);
+  TEST_CHECK_INT(g_dev.framing_errors, 0);
+
+  // the bitmap path
+  bool pressed = true;
+  g_dev.gpi_all_fails = 0;
+  TEST_CHECK_INT(xvf3800_read_mute_button(&g_handle, &pressed), ESP_OK);
+  TEST_CHECK(!pressed);
+  _dev_param(XVF3800_RESOURCE_ID_GPIO, XVF3800_CMD_GPI_VALUE_ALL)->data[0] = 0x02;
+  TEST_CHECK_INT(xvf3800_read_mute_button(&g_handle, &pressed), ESP_OK);
+  TEST_CHECK(pressed);
+  TEST_CHECK_INT(g_dev.framing_errors, 0);
+}
+
+int main(void)
+{
+  host_i2c_attach(_dev_i2c, NULL);
+
+  TEST_RUN(test_table);
+  TEST_RUN(test_encode_integers);
+  TEST_RUN(test_encode_floats);
+  TEST_RUN(test_encode_bounds);
+  TEST_RUN(test_read);
+  TEST_RUN(test_const_is_cached);
+  TEST_RUN(test_write);
+  TEST_RUN(test_write_rejected);
+  TEST_RUN(test_batches);
+  TEST_RUN(test_retry);
+  TEST_RUN(test_write_cmd_length);
+  TEST_EXIT();
+}
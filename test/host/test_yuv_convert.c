@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_test.h"
+#include "yuv_convert.h"
+
+/* The YUYV to I420 conversion in front of the H.264 encoder, checked pixel
+ * by pixel on a frame where every byte says where it came from, then timed
+ * at the camera sizes. The encoders themselves only exist for the S3, their
+ * frame size and encode time are printed on the device every 50 frames. */
+
+#define CANARY  (0xa5)
+
+/* luma of pixel (x, y) and chroma of the pair starting at even x */
+static uint8_t _y(int x, int y)  { return (uint8_t)(x * 7 + y * 13); }
+static uint8_t _u(int x, int y)  { return (uint8_t)(x * 3 + y * 5 + 1); }
+static uint8_t _v(int x, int y)  { return (uint8_t)(x * 11 + y * 2 + 2); }
+
+static void _fill_yuyv(uint8_t *src, int width, int height)
+{
+  for (int y = 0; y < height; y++) {
+    uint8_t *line = src + y * width * 2;
+    for (int x = 0; x < width; x += 2) {
+      *line++ = _y(x, y);
+      *line++ = _u(x, y);
+      *line++ = _y(x + 1, y);
+      *line++ = _v(x, y);
+    }
+  }
+}
+
+static double _now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void _check_size(int width, int height)
+{
+  size_t size = YUV_I420_SIZE(width, height);
+  uint8_t *src = malloc((size_t)width * height * 2);
+  uint8_t *dst = malloc(size + 16);
+
+  _fill_yuyv(src, width, height);
+  memset(dst, CANARY, size + 16);
+  yuyv_to_i420(src, dst, width, height);
+
+  const uint8_t *plane_u = dst + width * height;
+  const uint8_t *plane_v = plane_u + width * height / 4;
+  int wrong = 0;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      wrong += dst[y * width + x] != _y(x, y);
+    }
+  }
+  // the chroma of even rows, one sample per pixel pair
+  for (int y = 0; y < height / 2; y++) {
+    for (int x = 0; x < width / 2; x++) {
+      wrong += plane_u[y * width / 2 + x] != _u(2 * x, 2 * y);
+      wrong += plane_v[y * width / 2 + x] != _v(2 * x, 2 * y);
+    }
+  }
+  TEST_CHECK_INT(wrong, 0);
+  for (int i = 0; i < 16; i++) {
+    TEST_CHECK_INT(dst[size + i], CANARY);
+  }
+
+  free(dst);
+  free(src);
+}
+
+static void test_layout(void)
+{
+  _check_size(2, 2);
+  _check_size(320, 240);
+  _check_size(640, 480);
+  _check_size(96, 2);
+}
+
+static void test_speed(void)
+{
+  static const int sizes[][2] = { { 320, 240 }, { 640, 480 } };
+  const int rounds = 200;
+
+  for (int s = 0; s < 2; s++) {
+    int width = sizes[s][0], height = sizes[s][1];
+    uint8_t *src = malloc((size_t)width * height * 2);
+    uint8_t *dst = malloc(YUV_I420_SIZE(width, height));
+    _fill_yuyv(src, width, height);
+
+    double start = _now_ms();
+    for (int i = 0; i < rounds; i++) {
+      yuyv_to_i420(src, dst, width, height);
+    }
+    double per_frame = (_now_ms() - start) / rounds;
+    printf("yuyv_to_i420 %dx%d: %.3f ms per frame on the host\n", width, height, per_frame);
+
+    // far below a frame period even here, whatever the host
+    TEST_CHECK(per_frame < 50.0);
+    free(dst);
+    free(src);
+  }
+}
+
+int main(void)
+{
+  TEST_RUN(test_layout);
+  TEST_RUN(test_speed);
+  TEST_EXIT();
+}